@@ -0,0 +1,569 @@
+// backwalk_bench: measures the cost per frame of walking and symbolizing stacks, across stack
+// depths and thread counts, against glibc's backtrace() and the unwinder's _Unwind_Backtrace().
+//
+// Every method handles exactly `depth` frames of a recursion, so times divide evenly into frames.
+// Each measurement is warmed up, then timed as a number of samples of calibrated batches of walks,
+// and reported as percentiles. Results are printed as a table, and with --json as a JSON document.
+
+// NOLINTBEGIN(cppcoreguidelines-pro-type-vararg, misc-no-recursion)
+#include <dlfcn.h>              // for dladdr, Dl_info
+#include <execinfo.h>           // for backtrace, backtrace_symbols
+#include <getopt.h>             // for getopt_long, option, optarg, no_argument, required_argument
+#include <pthread.h>            // for pthread_create, pthread_join, pthread_cond_t, ...
+#include <sys/utsname.h>        // for uname, utsname
+#include <unistd.h>             // for sysconf, _SC_NPROCESSORS_ONLN
+#include <unwind.h>             // for _Unwind_Backtrace, _Unwind_GetIP, _Unwind_Context, ...
+
+#include <cstddef>              // for size_t
+#include <cstdint>              // for uintptr_t, uint64_t
+#include <cstdio>               // for fprintf, printf, fopen, fclose, FILE, stderr, stdout
+#include <cstdlib>              // for calloc, free, qsort, strtoul
+#include <cstring>              // for strcmp, strerror
+#include <ctime>                // for clock_gettime, timespec, CLOCK_MONOTONIC
+
+#include "backwalk/backwalk.h"  // for bw_backtrace, bw_capture, bw_set_demangle, bw_set_unwin...
+#include "common.h"             // for BW_UNUSED, BW_ARRAY_LEN
+
+#ifndef BW_BENCH_BUILD_TYPE
+#define BW_BENCH_BUILD_TYPE ""
+#endif
+
+namespace bench {
+
+constexpr size_t k_max_depth = 512;
+// Frames between the recursion and the thread's entry point, which no walk reaches
+constexpr int k_depth_margin = 8;
+constexpr size_t k_default_samples = 100;
+constexpr size_t k_quick_samples = 10;
+constexpr size_t k_quick_max_depth = 16;
+constexpr size_t k_default_scale_depth = 32;
+constexpr size_t k_warmup_walks = 10;
+// Each sample times a batch of walks that takes about this long
+constexpr double k_sample_ns = 200e3;
+constexpr double k_quick_sample_ns = 20e3;
+constexpr size_t k_max_batch = 100000;
+constexpr double k_ns_per_sec = 1e9;
+
+enum method_t {
+    METHOD_CAPTURE,
+    METHOD_CAPTURE_DLADDR,
+    METHOD_BACKTRACE,
+    METHOD_BACKTRACE_DEMANGLE,
+    METHOD_GLIBC_BACKTRACE,
+    METHOD_GLIBC_BACKTRACE_SYMBOLS,
+    METHOD_UNWIND_BACKTRACE,
+    METHOD_COUNT,
+};
+
+const char* const k_method_names[METHOD_COUNT] = {
+    "bw_capture",
+    "bw_capture+dladdr",
+    "bw_backtrace",
+    "bw_backtrace+demangle",
+    "backtrace",
+    "backtrace+backtrace_symbols",
+    "_Unwind_Backtrace",
+};
+
+struct config_t {
+    size_t max_depth;
+    size_t samples;
+    size_t max_threads;
+    size_t scale_depth;
+    double sample_ns;
+    const char* json_path;
+};
+
+struct stats_t {
+    double min;
+    double p50;
+    double p90;
+    double p99;
+};
+
+struct result_t {
+    int method;
+    size_t depth;
+    size_t threads;
+    size_t frames;    // Frames each walk actually handled
+    stats_t ns;       // Per frame
+    double walks_per_sec;
+};
+
+// Holds started threads until all of them are ready, or releases them untimed on failure
+struct start_gate_t {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t ready;
+    bool open;
+    bool cancelled;
+};
+
+struct job_t {
+    int method;
+    size_t depth;
+    size_t samples;
+    size_t batch;     // Walks per sample, 0 to calibrate
+    double sample_ns;
+    double* out;      // `samples` times per walk
+    size_t frames;
+    start_gate_t* gate;
+    double start_ns;  // Span of the timed samples
+    double end_ns;
+};
+
+struct count_ctx_t {
+    size_t frames;
+    size_t max;
+};
+
+bool count_cb(uintptr_t addr, const char* fname, const char* sname, void* arg) {
+    BW_UNUSED(addr);
+    BW_UNUSED(fname);
+    BW_UNUSED(sname);
+    auto* ctx = static_cast<count_ctx_t*>(arg);
+    return ++ctx->frames < ctx->max;
+}
+
+struct unwind_ctx_t {
+    uintptr_t* ips;
+    size_t len;
+    size_t max;
+};
+
+_Unwind_Reason_Code unwind_cb(_Unwind_Context* uc, void* arg) {
+    auto* ctx = static_cast<unwind_ctx_t*>(arg);
+    if (ctx->len == ctx->max) {
+        return _URC_END_OF_STACK;
+    }
+    ctx->ips[ctx->len++] = _Unwind_GetIP(uc);
+    return _URC_NO_REASON;
+}
+
+// Walks `depth` frames of the calling thread's stack and returns how many were handled
+__attribute__((noinline)) size_t walk(int method, size_t depth) {
+    uintptr_t ips[k_max_depth];
+    void* addrs[k_max_depth];
+    size_t len = 0;
+
+    switch (method) {
+    case METHOD_CAPTURE:
+        return bw_capture(ips, depth, 0);
+    case METHOD_CAPTURE_DLADDR:
+        len = bw_capture(ips, depth, 0);
+        for (size_t i = 0; i < len; ++i) {
+            Dl_info info;
+            // NOLINTNEXTLINE(performance-no-int-to-ptr)
+            BW_UNUSED(dladdr(reinterpret_cast<const void*>(ips[i] - 1), &info));
+        }
+        return len;
+    case METHOD_BACKTRACE:
+    case METHOD_BACKTRACE_DEMANGLE: {
+        count_ctx_t ctx = {0, depth};
+        BW_UNUSED(bw_backtrace(count_cb, &ctx));
+        return ctx.frames;
+    }
+    case METHOD_GLIBC_BACKTRACE:
+        return static_cast<size_t>(backtrace(addrs, static_cast<int>(depth)));
+    case METHOD_GLIBC_BACKTRACE_SYMBOLS: {
+        int n = backtrace(addrs, static_cast<int>(depth));
+        char** symbols = backtrace_symbols(addrs, n);
+        // NOLINTNEXTLINE(cppcoreguidelines-no-malloc)
+        free(static_cast<void*>(symbols));
+        return static_cast<size_t>(n);
+    }
+    case METHOD_UNWIND_BACKTRACE: {
+        unwind_ctx_t ctx = {ips, 0, depth};
+        BW_UNUSED(_Unwind_Backtrace(unwind_cb, &ctx));
+        return ctx.len;
+    }
+    default:
+        return 0;
+    }
+}
+
+double now_ns() {
+    timespec ts = {};
+    BW_UNUSED(clock_gettime(CLOCK_MONOTONIC, &ts));
+    return (static_cast<double>(ts.tv_sec) * k_ns_per_sec) + static_cast<double>(ts.tv_nsec);
+}
+
+// Waits for the gate to open and returns false when it was cancelled instead
+bool gate_wait(start_gate_t* gate) {
+    BW_UNUSED(pthread_mutex_lock(&gate->lock));
+    gate->ready++;
+    BW_UNUSED(pthread_cond_broadcast(&gate->cond));
+    while (!gate->open && !gate->cancelled) {
+        BW_UNUSED(pthread_cond_wait(&gate->cond, &gate->lock));
+    }
+    bool open = gate->open;
+    BW_UNUSED(pthread_mutex_unlock(&gate->lock));
+    return open;
+}
+
+// Opens the gate once `threads` threads wait at it, or cancels it right away
+void gate_release(start_gate_t* gate, size_t threads, bool open) {
+    BW_UNUSED(pthread_mutex_lock(&gate->lock));
+    while (open && gate->ready < threads) {
+        BW_UNUSED(pthread_cond_wait(&gate->cond, &gate->lock));
+    }
+    gate->open = open;
+    gate->cancelled = !open;
+    BW_UNUSED(pthread_cond_broadcast(&gate->cond));
+    BW_UNUSED(pthread_mutex_unlock(&gate->lock));
+}
+
+void run_job(job_t* job) {
+    for (size_t i = 0; i < k_warmup_walks; ++i) {
+        job->frames = walk(job->method, job->depth);
+    }
+
+    if (job->batch == 0) {
+        double start = now_ns();
+        for (size_t i = 0; i < k_warmup_walks; ++i) {
+            BW_UNUSED(walk(job->method, job->depth));
+        }
+        double per_walk = (now_ns() - start) / k_warmup_walks;
+        double batch = per_walk > 0 ? job->sample_ns / per_walk : k_max_batch;
+        job->batch = batch < 1 ? 1 : batch > k_max_batch ? k_max_batch : static_cast<size_t>(batch);
+    }
+
+    // Threads start timing together, so that they contend for the whole measurement
+    if (job->gate && !gate_wait(job->gate)) {
+        return;
+    }
+    job->start_ns = now_ns();
+    for (size_t s = 0; s < job->samples; ++s) {
+        double start = now_ns();
+        for (size_t i = 0; i < job->batch; ++i) {
+            BW_UNUSED(walk(job->method, job->depth));
+        }
+        job->out[s] = (now_ns() - start) / static_cast<double>(job->batch);
+    }
+    job->end_ns = now_ns();
+}
+
+// Runs the job at the bottom of a recursion deep enough for every walk to see `depth` frames
+__attribute__((noinline)) size_t recurse(int remaining, job_t* job) {
+    if (remaining > 0) {
+        return recurse(remaining - 1, job) + 1;
+    }
+
+    run_job(job);
+    return 0;
+}
+
+void* thread_main(void* arg) {
+    auto* job = static_cast<job_t*>(arg);
+    BW_UNUSED(recurse(static_cast<int>(job->depth) + k_depth_margin, job));
+    return nullptr;
+}
+
+int compare_doubles(const void* a, const void* b) {
+    double lhs = *static_cast<const double*>(a);
+    double rhs = *static_cast<const double*>(b);
+    return lhs < rhs ? -1 : lhs > rhs;
+}
+
+// Sorts the times per walk and returns their percentiles per frame
+stats_t percentiles(double* times, size_t len, size_t frames) {
+    qsort(times, len, sizeof(*times), compare_doubles);
+    double per_frame = frames > 0 ? 1.0 / static_cast<double>(frames) : 0;
+    stats_t stats = {};
+    stats.min = times[0] * per_frame;
+    stats.p50 = times[(len - 1) * 50 / 100] * per_frame;
+    stats.p90 = times[(len - 1) * 90 / 100] * per_frame;
+    stats.p99 = times[(len - 1) * 99 / 100] * per_frame;
+    return stats;
+}
+
+// Doubles the thread count of the scaling sweep, which always ends at exactly `max`
+size_t next_threads(size_t threads, size_t max) {
+    if (threads >= max) {
+        return max + 1;
+    }
+    return threads * 2 < max ? threads * 2 : max;
+}
+
+// Runs `method` on `threads` threads at once, each walking `depth` frames
+bool measure(const config_t* config, int method, size_t depth, size_t threads, result_t* result) {
+    bw_set_demangle(method == METHOD_BACKTRACE_DEMANGLE);
+
+    // The batch size is calibrated once, so that every thread runs for about as long
+    job_t calibration = {};
+    calibration.method = method;
+    calibration.depth = depth;
+    calibration.sample_ns = config->sample_ns;
+    BW_UNUSED(thread_main(&calibration));
+
+    auto* times = static_cast<double*>(calloc(threads * config->samples, sizeof(double)));
+    auto* jobs = static_cast<job_t*>(calloc(threads, sizeof(job_t)));
+    auto* tids = static_cast<pthread_t*>(calloc(threads, sizeof(pthread_t)));
+    start_gate_t gate = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, false, false};
+    bool success = times && jobs && tids;
+
+    size_t started = 0;
+    while (success && started < threads) {
+        job_t* job = &jobs[started];
+        *job = calibration;
+        job->samples = config->samples;
+        job->out = times + (started * config->samples);
+        job->gate = &gate;
+        int err = pthread_create(&tids[started], nullptr, thread_main, job);
+        if (err != 0) {
+            // NOLINTNEXTLINE(concurrency-mt-unsafe)
+            fprintf(stderr, "backwalk_bench: cannot create thread: %s\n", strerror(err));
+            success = false;
+        } else {
+            started++;
+        }
+    }
+    // Threads that did start are released without timing anything when the others failed
+    gate_release(&gate, started, success);
+    for (size_t i = 0; i < started; ++i) {
+        BW_UNUSED(pthread_join(tids[i], nullptr));
+    }
+
+    if (success) {
+        // Throughput is over the wall time of all threads, which is what contention slows down
+        double start = jobs[0].start_ns;
+        double end = jobs[0].end_ns;
+        for (size_t i = 1; i < threads; ++i) {
+            start = jobs[i].start_ns < start ? jobs[i].start_ns : start;
+            end = jobs[i].end_ns > end ? jobs[i].end_ns : end;
+        }
+        size_t walks = threads * config->samples * calibration.batch;
+        result->method = method;
+        result->depth = depth;
+        result->threads = threads;
+        result->frames = calibration.frames;
+        result->walks_per_sec =
+            end > start ? static_cast<double>(walks) * k_ns_per_sec / (end - start) : 0;
+        result->ns = percentiles(times, threads * config->samples, calibration.frames);
+    }
+    BW_UNUSED(pthread_cond_destroy(&gate.cond));
+    BW_UNUSED(pthread_mutex_destroy(&gate.lock));
+    // NOLINTBEGIN(cppcoreguidelines-no-malloc)
+    free(tids);
+    free(jobs);
+    free(times);
+    // NOLINTEND(cppcoreguidelines-no-malloc)
+    bw_set_demangle(false);
+
+    return success;
+}
+
+void print_result(const result_t* result) {
+    printf("%-28s %6zu %7zu %10.1f %10.1f %10.1f %10.1f %14.0f\n",
+           k_method_names[result->method],
+           result->depth,
+           result->threads,
+           result->ns.min,
+           result->ns.p50,
+           result->ns.p90,
+           result->ns.p99,
+           result->walks_per_sec);
+}
+
+void json_results(FILE* out, const char* key, const result_t* results, size_t len) {
+    fprintf(out, "  \"%s\": [", key);
+    for (size_t i = 0; i < len; ++i) {
+        const result_t* r = &results[i];
+        fprintf(out,
+                "%s\n    {\"method\": \"%s\", \"depth\": %zu, \"threads\": %zu, \"frames\": %zu, "
+                "\"ns_per_frame\": {\"min\": %.2f, \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f}, "
+                "\"walks_per_sec\": %.0f}",
+                i > 0 ? "," : "",
+                k_method_names[r->method],
+                r->depth,
+                r->threads,
+                r->frames,
+                r->ns.min,
+                r->ns.p50,
+                r->ns.p90,
+                r->ns.p99,
+                r->walks_per_sec);
+    }
+    fprintf(out, "\n  ]");
+}
+
+// Writes `str` as a JSON string, dropping the characters that would need escaping
+void json_string(FILE* out, const char* str) {
+    fputc('"', out);
+    for (; *str; ++str) {
+        if (*str != '"' && *str != '\\' && static_cast<unsigned char>(*str) >= ' ') {
+            fputc(*str, out);
+        }
+    }
+    fputc('"', out);
+}
+
+bool write_json(const config_t* config,
+                bool cfi,
+                const result_t* depths,
+                size_t depths_len,
+                const result_t* scaling,
+                size_t scaling_len) {
+    bool to_stdout = strcmp(config->json_path, "-") == 0;
+    FILE* out = to_stdout ? stdout : fopen(config->json_path, "w");
+    if (!out) {
+        return false;
+    }
+
+    utsname uts = {};
+    BW_UNUSED(uname(&uts));
+    fprintf(out, "{\n  \"machine\": {\"cpus\": %ld, \"kernel\": ", sysconf(_SC_NPROCESSORS_ONLN));
+    json_string(out, uts.release);
+    fprintf(out, ", \"arch\": ");
+    json_string(out, uts.machine);
+    fprintf(out, "},\n  \"build\": ");
+    json_string(out, BW_BENCH_BUILD_TYPE);
+    fprintf(out,
+            ",\n  \"unwind_mode\": \"%s\",\n  \"samples\": %zu,\n",
+            cfi ? "cfi" : "fp",
+            config->samples);
+    json_results(out, "depths", depths, depths_len);
+    fprintf(out, ",\n");
+    json_results(out, "threads", scaling, scaling_len);
+    fprintf(out, "\n}\n");
+
+    return to_stdout ? fflush(out) == 0 : fclose(out) == 0;
+}
+
+void usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [--quick] [--cfi] [--samples N] [--max-depth N] [--threads N]\n"
+            "          [--scale-depth N] [--json FILE]\n"
+            "  --quick        few samples and shallow stacks, to check that it runs\n"
+            "  --cfi          walk with BW_UNWIND_CFI instead of frame pointers\n"
+            "  --samples      timed samples per measurement, %zu by default\n"
+            "  --max-depth    deepest stack of the depth sweep, at most %zu\n"
+            "  --threads      largest thread count of the scaling sweep, the CPU count by default\n"
+            "  --scale-depth  stack depth of the scaling sweep, %zu by default\n"
+            "  --json         also write the results as JSON to FILE, - for standard output\n",
+            prog,
+            k_default_samples,
+            k_max_depth,
+            k_default_scale_depth);
+}
+
+} // namespace bench
+
+int main(int argc, char** argv) {
+    using namespace bench;
+
+    config_t config = {};
+    config.max_depth = k_max_depth;
+    config.samples = k_default_samples;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    config.max_threads = cpus > 0 ? static_cast<size_t>(cpus) : 1;
+    config.scale_depth = k_default_scale_depth;
+    config.sample_ns = k_sample_ns;
+    bool cfi = false;
+
+    const option options[] = {
+        {"quick", no_argument, nullptr, 'q'},
+        {"cfi", no_argument, nullptr, 'c'},
+        {"samples", required_argument, nullptr, 's'},
+        {"max-depth", required_argument, nullptr, 'd'},
+        {"threads", required_argument, nullptr, 't'},
+        {"scale-depth", required_argument, nullptr, 'D'},
+        {"json", required_argument, nullptr, 'j'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    int opt = 0;
+    while ((opt = getopt_long(argc, argv, "", options, nullptr)) != -1) {
+        size_t value = optarg ? strtoul(optarg, nullptr, 10) : 0;
+        if (opt == 'q') {
+            config.samples = k_quick_samples;
+            config.max_depth = k_quick_max_depth;
+            config.sample_ns = k_quick_sample_ns;
+        } else if (opt == 'c') {
+            cfi = true;
+        } else if (opt == 's' && value > 0) {
+            config.samples = value;
+        } else if (opt == 'd' && value > 0 && value <= k_max_depth) {
+            config.max_depth = value;
+        } else if (opt == 't' && value > 0) {
+            config.max_threads = value;
+        } else if (opt == 'D' && value > 0 && value <= k_max_depth) {
+            config.scale_depth = value;
+        } else if (opt == 'j') {
+            config.json_path = optarg;
+        } else {
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    bw_set_unwind_mode(cfi ? BW_UNWIND_CFI : BW_UNWIND_FP);
+
+    size_t depths_len = 0;
+    size_t scaling_len = 0;
+    for (size_t depth = 1; depth <= config.max_depth; depth *= 2) {
+        depths_len += METHOD_COUNT;
+    }
+    for (size_t threads = 1; threads <= config.max_threads;
+         threads = next_threads(threads, config.max_threads)) {
+        scaling_len += METHOD_COUNT;
+    }
+    auto* depths = static_cast<result_t*>(calloc(depths_len + 1, sizeof(result_t)));
+    auto* scaling = static_cast<result_t*>(calloc(scaling_len + 1, sizeof(result_t)));
+    bool success = depths && scaling;
+
+    // The JSON document alone goes to standard output when asked for
+    bool table = !config.json_path || strcmp(config.json_path, "-") != 0;
+    if (table && !success) {
+        fprintf(stderr, "backwalk_bench: out of memory\n");
+    }
+    if (table && success) {
+        printf("%-28s %6s %7s %10s %10s %10s %10s %14s\n",
+               "ns/frame",
+               "depth",
+               "threads",
+               "min",
+               "p50",
+               "p90",
+               "p99",
+               "walks/s");
+    }
+
+    size_t len = 0;
+    for (size_t depth = 1; success && depth <= config.max_depth; depth *= 2) {
+        for (int method = 0; success && method < METHOD_COUNT; ++method) {
+            success = measure(&config, method, depth, 1, &depths[len]);
+            if (success && table) {
+                print_result(&depths[len]);
+            }
+            len++;
+        }
+    }
+
+    len = 0;
+    for (size_t threads = 1; success && threads <= config.max_threads;
+         threads = next_threads(threads, config.max_threads)) {
+        for (int method = 0; success && method < METHOD_COUNT; ++method) {
+            success = measure(&config, method, config.scale_depth, threads, &scaling[len]);
+            if (success && table) {
+                print_result(&scaling[len]);
+            }
+            len++;
+        }
+    }
+
+    if (success && config.json_path) {
+        success = write_json(&config, cfi, depths, depths_len, scaling, scaling_len);
+    }
+    if (!success) {
+        fprintf(stderr, "backwalk_bench: benchmark failed\n");
+    }
+
+    // NOLINTBEGIN(cppcoreguidelines-no-malloc)
+    free(scaling);
+    free(depths);
+    // NOLINTEND(cppcoreguidelines-no-malloc)
+
+    return success ? 0 : 1;
+}
+
+// NOLINTEND(cppcoreguidelines-pro-type-vararg, misc-no-recursion)
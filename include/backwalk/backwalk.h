@@ -2,20 +2,167 @@
 #define BW_BACKWALK_H
 
 #ifdef __cplusplus
+#include <cstddef>
 #include <cstdint>
 #else
 #include <stdbool.h>  // for bool
-#include <stdint.h>   // for uintptr_t
+#include <stddef.h>   // for size_t
+#include <stdint.h>   // for uintptr_t, uint64_t
 #endif
+#include <ucontext.h> // for ucontext_t
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef struct {
+    uintptr_t ip;      // Absolute return address, or the interrupted instruction
+    uintptr_t addr;    // Module-relative address, or 0 if unknown
+    const char* fname; // Module path, or "?" if unknown
+} bw_frame_t;
+
+// A frame as passed to bw_backtrace() callbacks
+typedef struct {
+    uintptr_t addr;    // Module-relative address, or 0 if unknown
+    const char* fname; // Module path, or "?" if unknown
+    const char* sname; // Symbol name, or "?" if unknown
+} bw_symbol_t;
+
+// Counters of the calling thread's cache of resolved return addresses
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions; // Misses that replaced another cached address
+    uint64_t flushes;   // Times the cache was emptied because the module map was rebuilt
+    size_t capacity;    // Addresses the cache holds
+} bw_symbol_cache_stats_t;
+
+// Allocator of trace objects. `free` receives the size passed to `alloc`, and `ctx` is passed to
+// both, for example an arena.
+typedef struct {
+    void* (*alloc)(size_t size, void* ctx);
+    void (*free)(void* ptr, size_t size, void* ctx);
+    void* ctx;
+} bw_allocator_t;
+
+// A captured stack that is symbolized on first use
+typedef struct bw_trace bw_trace_t;
+
+typedef enum {
+    BW_UNWIND_FP = 0,  // Follow the frame pointer chain
+    BW_UNWIND_CFI = 1, // Use .eh_frame call frame information, falling back to frame pointers
+} bw_unwind_mode_t;
+
+enum { BW_BUILD_ID_MAX = 32 };
+
+// A loaded module, with what is needed to symbolize its addresses on another machine
+typedef struct {
+    const char* path;     // As passed to bw_backtrace() callbacks as `fname`
+    uintptr_t base;       // Lowest mapped address, module-relative addresses start here
+    uintptr_t end;        // End of the highest loadable segment
+    uintptr_t bias;       // Run-time minus link-time addresses
+    uintptr_t text_start; // Range covering the executable segments, 0 if there are none
+    uintptr_t text_end;
+    size_t build_id_len;  // 0 if the module has no NT_GNU_BUILD_ID note
+    unsigned char build_id[BW_BUILD_ID_MAX];
+} bw_module_t;
+
+typedef bool (*bw_module_cb)(const bw_module_t* mod, void* arg);
+
 typedef bool (*bw_backtrace_cb)(uintptr_t addr, const char* fname, const char* sname, void* arg);
 
 bool bw_backtrace(bw_backtrace_cb cb, void* arg);
 
+// Selects how the stack is walked, the default is BW_UNWIND_FP. With BW_UNWIND_CFI, frames of code
+// built without frame pointers are also found. The .eh_frame of each module is compiled into a
+// lookup table the first time one of its frames is walked; bw_backtrace_signal_safe() only uses
+// tables built before it runs, by bw_signal_safe_init() or by an earlier walk.
+void bw_set_unwind_mode(bw_unwind_mode_t mode);
+
+// Enables demangling of the C++ symbol names passed to bw_backtrace() callbacks, off by default.
+// Requires the program to link the C++ runtime, otherwise names are passed unchanged.
+void bw_set_demangle(bool enabled);
+
+// Returns the demangled form of the symbol name `sname`, or `sname` itself if it is not a mangled
+// C++ name. Each name is demangled once per process: results are cached by the address of
+// `sname`, so it must remain valid and unchanged, as symbol names passed to bw_backtrace()
+// callbacks do. The returned string is never freed. Not async-signal-safe.
+const char* bw_demangle(const char* sname);
+
+// Stores up to `max` absolute return addresses in `out`, skipping the first `skip` frames, and
+// returns the number stored. No symbol lookup is performed.
+size_t bw_capture(uintptr_t* out, size_t max, size_t skip);
+
+// Resolves `len` return addresses stored by bw_capture() into `out`, with the same results and
+// demangling as bw_backtrace() callbacks receive. Together they walk and resolve a stack without a
+// callback per frame. Not async-signal-safe.
+void bw_symbolize(const uintptr_t* ips, size_t len, bw_symbol_t* out);
+
+// Reports the counters of the calling thread's symbol cache. bw_backtrace() and bw_symbolize() look
+// return addresses up in a small per-thread cache before searching symbol tables, so that the
+// frames common to most stacks are resolved once per thread. The cache is allocated by the thread's
+// first lookup, emptied whenever the module map is rebuilt after modules were loaded or unloaded,
+// and freed when the thread exits.
+void bw_symbol_cache_stats(bw_symbol_cache_stats_t* stats);
+
+// Captures up to `max` return addresses of the calling function's stack, skipping the first `skip`,
+// into a trace allocated from `allocator`, or with malloc() if it is NULL. The allocator is copied
+// and must outlive the trace. Only addresses are stored, as with bw_capture(), and nothing is
+// resolved until the trace is iterated. Returns NULL if `max` is 0 or the allocation fails.
+bw_trace_t* bw_trace_capture(size_t max, size_t skip, const bw_allocator_t* allocator);
+
+// Returns the number of frames of `trace`
+size_t bw_trace_len(const bw_trace_t* trace);
+
+// Returns the absolute return addresses of `trace`, innermost first
+const uintptr_t* bw_trace_ips(const bw_trace_t* trace);
+
+// Calls `cb` for every frame of `trace` with the arguments bw_backtrace() would pass, and returns
+// false if `cb` stopped the iteration. The first call resolves every frame and keeps the results
+// in the trace, so later calls do no symbol lookups. Traces may be iterated from several threads.
+// Not async-signal-safe.
+bool bw_trace_foreach(bw_trace_t* trace, bw_backtrace_cb cb, void* arg);
+
+// Frees `trace` and its resolved frames through the allocator it was captured with
+void bw_trace_free(bw_trace_t* trace);
+
+// Prepares the state used by bw_backtrace_signal_safe(). Not async-signal-safe: call it before the
+// handler can run, and again from every thread whose stack should be bounds-checked, after setting
+// up its alternate signal stack.
+bool bw_signal_safe_init(void);
+
+// Async-signal-safe: stores up to `max` frames of the calling thread in `frames` and returns the
+// number stored. It never allocates, takes locks or calls into the dynamic linker, and reads at
+// most two words per frame. Modules loaded after the last call to bw_signal_safe_init() or
+// bw_backtrace() are reported as unknown.
+size_t bw_backtrace_signal_safe(bw_frame_t* frames, size_t max);
+
+// Like bw_backtrace_signal_safe(), but walks the stack that was interrupted by a signal, starting
+// from the registers saved in `uc`, the third argument of an SA_SIGINFO handler. The first frame is
+// the interrupted instruction itself rather than a return address, and neither the handler nor the
+// kernel's signal trampoline are reported. Async-signal-safe.
+size_t bw_backtrace_from_ucontext(const ucontext_t* uc, bw_frame_t* frames, size_t max);
+
+// Looks up the source file and line of the call that returned to `ip`, an absolute return address
+// as stored by bw_capture() or bw_backtrace_signal_safe(). Line tables are read from the module's
+// .debug_line section, so it must be built with -g. Returns false if no line information covers
+// `ip`. Not async-signal-safe.
+bool bw_resolve_line(uintptr_t ip, const char** file, unsigned int* line);
+
+// Calls `cb` for every loaded module in address order, after picking up modules loaded or unloaded
+// since the last walk. Returning false stops the iteration. Not async-signal-safe.
+bool bw_modules(bw_module_cb cb, void* arg);
+
+// Finds the module containing the absolute address `ip`. The link-time address that symbolizers
+// such as addr2line expect for a frame's `addr` is `addr + base - bias`, which is the same as
+// `addr` for executables and shared libraries linked at address 0. Not async-signal-safe.
+bool bw_module_find(uintptr_t ip, bw_module_t* mod);
+
+// Writes the module's build ID as a NUL-terminated lowercase hex string, the form used in
+// /usr/lib/debug/.build-id paths and by debuginfod. Returns the length written, or 0 if the
+// module has no build ID or `size` is too small.
+size_t bw_build_id_hex(const bw_module_t* mod, char* out, size_t size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,99 @@
+#ifndef BW_BACKWALK_HPP
+#define BW_BACKWALK_HPP
+
+#include <array>                // for array
+#include <cstddef>              // for size_t
+#include <cstdint>              // for uintptr_t
+#include <vector>               // for vector
+
+#include "backwalk/backwalk.h"  // for bw_capture, bw_symbolize, bw_symbol_t
+
+// Header-only C++ interface. The walk and the symbol lookups are single calls into the library,
+// while the loop over frames and the callback are inlined into the caller, so a lambda costs no
+// indirect call per frame.
+namespace bw {
+
+// Frames walked when no depth is given
+constexpr std::size_t k_default_depth = 128;
+
+// Frames resolved per call into the library, which bounds the stack used by backtrace()
+constexpr std::size_t k_symbolize_batch = 16;
+
+// Return addresses of a stack, innermost first, in fixed storage
+template <std::size_t N>
+class trace {
+public:
+    using const_iterator = const std::uintptr_t*;
+
+    static constexpr std::size_t capacity() { return N; }
+
+    std::size_t size() const { return len_; }
+    bool empty() const { return len_ == 0; }
+    const std::uintptr_t* data() const { return ips_.data(); }
+    const_iterator begin() const { return ips_.data(); }
+    const_iterator end() const { return ips_.data() + len_; }
+    std::uintptr_t operator[](std::size_t i) const { return ips_[i]; }
+
+    // Resolves frame `i`, as bw_backtrace() would pass it to a callback
+    bw_symbol_t symbol(std::size_t i) const {
+        bw_symbol_t sym;
+        bw_symbolize(&ips_[i], 1, &sym);
+        return sym;
+    }
+
+private:
+    template <std::size_t M>
+    friend trace<M> capture(std::size_t skip);
+
+    std::array<std::uintptr_t, N> ips_;
+    std::size_t len_ = 0;
+};
+
+// Captures up to N return addresses of the calling function's stack, skipping the first `skip`.
+// Always inlined, so the first frame is the caller's, as with bw_capture().
+template <std::size_t N = k_default_depth>
+[[gnu::always_inline]] inline trace<N> capture(std::size_t skip = 0) {
+    static_assert(N > 0, "a trace must hold at least one frame");
+    trace<N> result;
+    result.len_ = bw_capture(result.ips_.data(), N, skip);
+    return result;
+}
+
+// Calls `f(addr, fname, sname)` for every frame of the calling function's stack, innermost first,
+// with the arguments bw_backtrace() passes to its callback. Returning false from `f` stops the walk,
+// and backtrace() then returns false. Stacks of up to WalkDepth frames are captured once into a
+// buffer on the stack. A deeper stack is captured again into a heap buffer that doubles until the
+// stack fits, which walks at most about four times its depth in all. Frames are symbolized in
+// batches, so frames after the one that stopped the walk may already have been looked up.
+template <std::size_t WalkDepth = k_default_depth, typename F>
+[[gnu::always_inline]] inline bool backtrace(F&& f) {
+    static_assert(WalkDepth > 0, "the walk must reach at least one frame");
+    std::array<std::uintptr_t, WalkDepth> ips;
+    const std::uintptr_t* frames = ips.data();
+    std::size_t len = bw_capture(ips.data(), WalkDepth, 0);
+
+    // Every capture is made from this frame, so each one starts with the same frames
+    std::vector<std::uintptr_t> deep;
+    while (len == (deep.empty() ? WalkDepth : deep.size())) {
+        deep.resize(len * 2);
+        len = bw_capture(deep.data(), deep.size(), 0);
+        frames = deep.data();
+    }
+
+    std::array<bw_symbol_t, (WalkDepth < k_symbolize_batch ? WalkDepth : k_symbolize_batch)> syms;
+    for (std::size_t start = 0; start < len; start += syms.size()) {
+        std::size_t batch = len - start < syms.size() ? len - start : syms.size();
+        bw_symbolize(frames + start, batch, syms.data());
+        for (std::size_t i = 0; i < batch; ++i) {
+            if (!f(syms[i].addr, syms[i].fname, syms[i].sname)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+} // namespace bw
+
+#endif // BW_BACKWALK_HPP
@@ -0,0 +1,56 @@
+#ifndef BW_CONTENTION_PROFILER_H
+#define BW_CONTENTION_PROFILER_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdbool.h>  // for bool
+#include <stddef.h>   // for size_t
+#include <stdint.h>   // for uintptr_t, uint64_t, uint32_t
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { BW_CONTENTION_PROFILER_FRAMES_MAX = 64 };
+
+// Called by bw_contention_profiler_dump() for every stack that waited for a lock. `wait_ns` and
+// `waits` are estimates when shorter waits are sampled. The frames start at the caller of the
+// locking function and stay valid for the lifetime of the process.
+typedef void (*bw_contention_profiler_cb)(const uintptr_t* ips,
+                                          size_t len,
+                                          uint64_t wait_ns,
+                                          uint64_t waits,
+                                          void* arg);
+
+typedef struct {
+    uint64_t threshold_ns;  // Waits at least this long are always recorded, 0 for 100 us
+    uint32_t sample_period; // Shorter waits are recorded one in this many per thread, 0 for 100
+    size_t max_stacks;      // Distinct waiting stacks, 0 for 16384
+} bw_contention_profiler_config_t;
+
+typedef struct {
+    uint64_t contended; // Acquisitions that blocked while profiling
+    uint64_t wait_ns;   // Total time spent blocked in them
+    uint64_t recorded;  // Waits whose stack was captured
+    uint64_t dropped;   // Recorded waits lost because the stack table was full
+} bw_contention_profiler_stats_t;
+
+// Starts timing acquisitions of pthread mutexes and read-write locks that block. The stack table
+// is sized by the first call and kept for the lifetime of the process.
+bool bw_contention_profiler_start(const bw_contention_profiler_config_t* config);
+
+void bw_contention_profiler_stop(void);
+
+// Reports the wait time of each stack since the first bw_contention_profiler_start()
+void bw_contention_profiler_dump(bw_contention_profiler_cb cb, void* arg);
+
+void bw_contention_profiler_get_stats(bw_contention_profiler_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BW_CONTENTION_PROFILER_H
@@ -0,0 +1,45 @@
+#ifndef BW_CRASH_H
+#define BW_CRASH_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stdbool.h>  // for bool
+#include <stddef.h>   // for size_t
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { BW_CRASH_FRAMES_MAX = 128 };
+
+typedef struct {
+    const char* path;      // File that reports are mapped into, or NULL to write them to `fd`
+    int fd;                // Open descriptor reports are written to when `path` is NULL
+    size_t buffer_size;    // Longest report, 0 for 64 KiB. Longer reports are truncated.
+    size_t alt_stack_size; // Signal stack of each registered thread, 0 for 64 KiB
+} bw_crash_config_t;
+
+// Installs handlers for SIGSEGV, SIGBUS, SIGABRT and SIGFPE that write the crashing thread's stack
+// and the loaded modules with their build IDs, then pass the signal on to the previous handler.
+// Everything the handlers use is allocated here, and the calling thread is registered. Modules
+// loaded afterwards are only listed once bw_backtrace() or bw_signal_safe_init() has run again.
+// On failure, nothing stays installed.
+bool bw_crash_install(const bw_crash_config_t* config);
+
+// Restores the previous handlers and releases the report buffer. A report file without a report is
+// truncated to empty, which also happens when the process exits normally: crashes in exit handlers
+// that run after that are not reported, and a process ended by _exit() leaves the file zero-filled
+// at its full size. Alternate signal stacks stay installed until their threads exit.
+void bw_crash_uninstall(void);
+
+// Gives the calling thread an alternate signal stack, so that stack overflows are reported too,
+// and caches its stack bounds for the walk. Threads that are not registered are still reported.
+bool bw_crash_register_thread(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BW_CRASH_H
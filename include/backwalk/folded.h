@@ -0,0 +1,48 @@
+#ifndef BW_FOLDED_H
+#define BW_FOLDED_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdbool.h>  // for bool
+#include <stddef.h>   // for size_t
+#include <stdint.h>   // for uintptr_t, uint64_t
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct bw_folded bw_folded_t;
+
+typedef struct {
+    int fd;             // Where folded lines are written
+    char* buffer;       // Optional output buffer, written out with one write() whenever it fills
+    size_t buffer_size; // Size of `buffer`, or of an internal one if it is NULL: 0 for 64 KiB
+    bool cache_symbols; // Resolve each distinct address once for the lifetime of the writer
+    bool demangle;      // Demangle C++ names, see bw_demangle()
+} bw_folded_config_t;
+
+// Creates a writer of the folded stack format read by flamegraph.pl and most flame graph tools:
+// one "outer;...;inner count" line per distinct stack. Returns NULL if out of memory or if the
+// config is invalid. A writer must only be used by one thread at a time.
+bw_folded_t* bw_folded_create(const bw_folded_config_t* config);
+
+// Adds `value` to the stack `ips`: return addresses as stored by bw_capture(), innermost first.
+// Stacks are aggregated in a trie, nothing is resolved or written until bw_folded_flush().
+bool bw_folded_add(bw_folded_t* folded, const uintptr_t* ips, size_t len, uint64_t value);
+
+// Writes one line for every stack added since the last flush, resolving frames like bw_backtrace(),
+// and empties the trie, so each flush costs as much as the stacks added since the last one. Returns
+// false if a write failed.
+bool bw_folded_flush(bw_folded_t* folded);
+
+// Frees the writer without flushing it. Does not close the descriptor.
+void bw_folded_destroy(bw_folded_t* folded);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BW_FOLDED_H
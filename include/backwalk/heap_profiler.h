@@ -0,0 +1,57 @@
+#ifndef BW_HEAP_PROFILER_H
+#define BW_HEAP_PROFILER_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdbool.h>  // for bool
+#include <stddef.h>   // for size_t
+#include <stdint.h>   // for uintptr_t, uint64_t
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { BW_HEAP_PROFILER_FRAMES_MAX = 64 };
+
+// Called by bw_heap_profiler_dump() for every stack with live sampled allocations. `live_bytes` is
+// the estimated number of bytes allocated from that stack and not freed yet. The frames start at
+// the caller of malloc() and stay valid for the lifetime of the process.
+typedef void (*bw_heap_profiler_cb)(const uintptr_t* ips,
+                                    size_t len,
+                                    uint64_t live_bytes,
+                                    uint64_t live_allocs,
+                                    void* arg);
+
+typedef struct {
+    size_t sample_interval; // Mean number of bytes allocated between samples, 0 for 512 KiB
+    size_t max_samples;     // Live sampled allocations tracked at once, 0 for 65536
+    size_t max_stacks;      // Distinct allocation stacks, 0 for 16384
+} bw_heap_profiler_config_t;
+
+typedef struct {
+    uint64_t samples;      // Allocations sampled since the first bw_heap_profiler_start()
+    uint64_t dropped;      // Samples lost because a table was full
+    uint64_t live_samples; // Sampled allocations that were not freed yet
+} bw_heap_profiler_stats_t;
+
+// Starts sampling the allocations made with malloc(), calloc(), realloc(), memalign(),
+// aligned_alloc() and posix_memalign(). The tables are sized by the first call and kept for the
+// lifetime of the process, since sampled allocations can be freed at any time.
+bool bw_heap_profiler_start(const bw_heap_profiler_config_t* config);
+
+// Stops sampling new allocations. Sampled allocations are still accounted for when freed.
+void bw_heap_profiler_stop(void);
+
+// Reports the live sampled allocations of each stack. `cb` may allocate and free.
+void bw_heap_profiler_dump(bw_heap_profiler_cb cb, void* arg);
+
+void bw_heap_profiler_get_stats(bw_heap_profiler_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BW_HEAP_PROFILER_H
@@ -0,0 +1,55 @@
+#ifndef BW_PPROF_H
+#define BW_PPROF_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdbool.h>  // for bool
+#include <stddef.h>   // for size_t
+#include <stdint.h>   // for uintptr_t, int64_t
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { BW_PPROF_VALUES_MAX = 8 };
+
+typedef struct bw_pprof bw_pprof_t;
+
+typedef struct {
+    const char* type; // For example "alloc_space" or "cpu"
+    const char* unit; // For example "bytes" or "nanoseconds"
+} bw_pprof_value_type_t;
+
+typedef struct {
+    const bw_pprof_value_type_t* sample_types; // What each value of a sample measures
+    size_t sample_types_len;                   // 1 to BW_PPROF_VALUES_MAX
+    bw_pprof_value_type_t period_type;         // Optional, both fields NULL if unused
+    int64_t period;
+    int64_t time_nanos;     // Collection start, in nanoseconds since the epoch
+    int64_t duration_nanos;
+    bool symbolize;         // Adds function names and source lines, otherwise pprof can symbolize
+                            // the mappings from their build IDs
+} bw_pprof_config_t;
+
+// Starts a profile in the pprof profile.proto format, written uncompressed to `fd`, which pprof
+// reads as is. Samples are streamed out as they are added; the location, mapping, function and
+// string tables follow when the profile is closed. Returns NULL if out of memory or if the config
+// is invalid. A profile must only be used by one thread at a time.
+bw_pprof_t* bw_pprof_create(int fd, const bw_pprof_config_t* config);
+
+// Adds a sample of `values`, one per sample type, for the stack `ips`: return addresses as stored
+// by bw_capture(), innermost first. Locations are deduplicated by address.
+bool bw_pprof_add_sample(bw_pprof_t* pprof, const uintptr_t* ips, size_t len, const int64_t* values);
+
+// Writes the tables, resolving each location to the loaded module that contains it, and frees the
+// profile. Returns false if any write failed. Does not close `fd`.
+bool bw_pprof_close(bw_pprof_t* pprof);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BW_PPROF_H
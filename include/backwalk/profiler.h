@@ -0,0 +1,59 @@
+#ifndef BW_PROFILER_H
+#define BW_PROFILER_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdbool.h>  // for bool
+#include <stddef.h>   // for size_t
+#include <stdint.h>   // for uintptr_t, uint64_t
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { BW_PROFILER_FRAMES_MAX = 64 };
+
+// Called on the collector thread for every sample, with absolute return addresses starting at the
+// interrupted frame, including the samples of threads that exited or unregistered. The profiler's
+// lock is not held, so it may call any profiler function except bw_profiler_stop().
+typedef void (*bw_profiler_sample_cb)(int tid, const uintptr_t* ips, size_t len, void* arg);
+
+typedef struct {
+    unsigned frequency_hz;       // Samples per second of CPU time per thread, 0 for 100
+    size_t ring_capacity;        // Samples buffered per thread, rounded up to a power of two
+    unsigned drain_interval_ms;  // How often the collector drains the buffers, 0 for 10
+    int signo;                   // Signal used by the timers, 0 for SIGPROF
+    bw_profiler_sample_cb cb;
+    void* arg;
+} bw_profiler_config_t;
+
+typedef struct {
+    unsigned frequency_hz;          // Configured by the last bw_profiler_start()
+    size_t threads;                 // Currently registered threads
+    uint64_t samples;               // Samples captured by the signal handler
+    uint64_t dropped;               // Samples lost because a thread's buffer was full
+    uint64_t handler_ns;            // Total time spent in the signal handler
+    uint64_t overhead_ns_per_sample;
+} bw_profiler_stats_t;
+
+bool bw_profiler_start(const bw_profiler_config_t* config);
+
+// Drains the remaining samples and stops the collector. Registered threads stay registered and
+// are sampled again by the next bw_profiler_start().
+void bw_profiler_stop(void);
+
+// Arms a CPU-time timer for the calling thread. Threads are unregistered when they exit.
+bool bw_profiler_register_thread(void);
+
+void bw_profiler_unregister_thread(void);
+
+void bw_profiler_get_stats(bw_profiler_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BW_PROFILER_H
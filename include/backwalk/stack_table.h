@@ -0,0 +1,45 @@
+#ifndef BW_STACK_TABLE_H
+#define BW_STACK_TABLE_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stddef.h>  // for size_t
+#include <stdint.h>  // for uintptr_t, uint32_t
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Stack IDs start at 1 and are handed out in order. 0 is never a valid ID. Threads that insert the
+// same new stack at once each take an ID, but only one is kept: the others are left unused, and use
+// up capacity, so IDs below bw_stack_table_id_limit() can have gaps.
+enum { BW_STACK_ID_INVALID = 0 };
+
+typedef struct bw_stack_table bw_stack_table_t;
+
+// Creates a table that holds up to `capacity` distinct stacks
+bw_stack_table_t* bw_stack_table_create(size_t capacity);
+
+void bw_stack_table_destroy(bw_stack_table_t* table);
+
+// Returns the ID of the stack, inserting it if it is new, or BW_STACK_ID_INVALID if the table is
+// full. Safe to call concurrently; stacks that were already interned are found without locks or
+// writes to shared memory.
+uint32_t bw_stack_table_intern(bw_stack_table_t* table, const uintptr_t* ips, size_t len);
+
+// Points `ips` at the frames of stack `id` and returns their count, or 0 if `id` is unknown or
+// unused. Each stack is reported under a single ID. The frames stay valid until the table is
+// destroyed.
+size_t bw_stack_table_get(const bw_stack_table_t* table, uint32_t id, const uintptr_t** ips);
+
+// Returns one more than the largest ID handed out so far
+uint32_t bw_stack_table_id_limit(const bw_stack_table_t* table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BW_STACK_TABLE_H
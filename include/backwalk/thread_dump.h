@@ -0,0 +1,56 @@
+#ifndef BW_THREAD_DUMP_H
+#define BW_THREAD_DUMP_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stdbool.h>            // for bool
+#include <stddef.h>             // for size_t
+#endif
+
+#include "backwalk/backwalk.h"  // for bw_frame_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { BW_DUMP_FRAMES_MAX = 64 };
+enum { BW_DUMP_NAME_MAX = 16 };
+
+typedef struct {
+    int signo;          // Real-time signal reserved for dumps, 0 for SIGRTMIN + 3
+    size_t max_threads; // Threads listed per dump, 0 for 1024. Any others are left out.
+} bw_dump_config_t;
+
+typedef struct {
+    int tid;
+    char name[BW_DUMP_NAME_MAX]; // As in /proc/self/task/<tid>/comm
+    bool captured;               // False if the thread did not answer in time or had exited
+    size_t len;
+    const bw_frame_t* frames;    // Starting at the interrupted instruction, valid during the call
+} bw_thread_stack_t;
+
+// Called on the dumping thread for every thread of the process, captured or not. Returning false
+// stops the iteration. It must not start another dump.
+typedef bool (*bw_dump_cb)(const bw_thread_stack_t* stack, void* arg);
+
+// Installs the handler of the reserved signal and preallocates a slot per thread. It stays
+// installed for the lifetime of the process: a thread that answers after its dump timed out must
+// still find a handler. Called with the defaults by the first dump if it was not called before.
+bool bw_dump_install(const bw_dump_config_t* config);
+
+// Signals every thread listed in /proc/self/task, including the caller, and waits up to
+// `timeout_ms` for each one to store its own stack with bw_backtrace_from_ucontext(). Threads
+// that block the signal or are stuck in the kernel without being interruptible are reported as
+// not captured. Dumps are serialized. Returns the number of threads captured. Not
+// async-signal-safe: call it from a watchdog thread, or from one waiting for SIGQUIT in sigwait().
+size_t bw_dump_all_threads(unsigned timeout_ms, bw_dump_cb cb, void* arg);
+
+// Like bw_dump_all_threads(), but writes every thread's name and symbolized stack to `fd`.
+bool bw_dump_all_threads_fd(int fd, unsigned timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BW_THREAD_DUMP_H
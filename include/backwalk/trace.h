@@ -0,0 +1,107 @@
+#ifndef BW_TRACE_H
+#define BW_TRACE_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdbool.h>  // for bool
+#include <stddef.h>   // for size_t
+#include <stdint.h>   // for uintptr_t, uint32_t, uint64_t, int32_t
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { BW_TRACE_VERSION = 1 };
+// Longer stacks are truncated to their innermost frames
+enum { BW_TRACE_FRAMES_MAX = 256 };
+// Module index of frames outside of any loaded module, whose `addr` is absolute
+enum { BW_TRACE_MODULE_UNKNOWN = -1 };
+
+typedef struct bw_trace_writer bw_trace_writer_t;
+typedef struct bw_trace_reader bw_trace_reader_t;
+
+typedef struct {
+    uint64_t time_ns;  // On any clock, stored as the difference from the previous sample
+    uint64_t value;    // For example 1 for a CPU sample, or the bytes of an allocation
+    uint32_t stack_id; // Set by the reader, ignored by the writer
+    int32_t tid;
+} bw_trace_sample_t;
+
+typedef struct {
+    const char* path;              // Not NUL-terminated, `path_len` bytes long
+    size_t path_len;
+    const unsigned char* build_id; // Empty if the module has no NT_GNU_BUILD_ID note
+    size_t build_id_len;
+} bw_trace_module_t;
+
+typedef struct {
+    int module;     // Index in the module table, or BW_TRACE_MODULE_UNKNOWN
+    uintptr_t addr; // Module-relative return address, as passed to bw_backtrace() callbacks
+} bw_trace_frame_t;
+
+typedef struct {
+    int fd;                // Where the trace is appended
+    size_t buffer_size;    // Written out with one write() whenever it fills, 0 for 1 MiB, at
+                           // least 64 KiB
+    size_t stack_capacity; // Distinct stacks kept, 0 for 1M. Samples of new stacks are dropped
+                           // once it is reached.
+} bw_trace_config_t;
+
+// Starts a trace file: a header followed by records of modules, stacks and runs of samples, which
+// refer to stacks and modules by index. Each distinct stack is written once, the first time it is
+// sampled, with varint and delta encoded module-relative addresses. Returns NULL if out of memory
+// or if the config is invalid. A writer must only be used by one thread at a time.
+bw_trace_writer_t* bw_trace_writer_create(const bw_trace_config_t* config);
+
+// Appends a sample of the stack `ips`: return addresses as stored by bw_capture(), innermost
+// first. Only new stacks are mapped to their modules. Returns false if the sample was dropped.
+bool bw_trace_write(bw_trace_writer_t* writer,
+                    const bw_trace_sample_t* sample,
+                    const uintptr_t* ips,
+                    size_t len);
+
+// Writes out the buffered records. Returns false if a write failed.
+bool bw_trace_writer_flush(bw_trace_writer_t* writer);
+
+// Returns the number of samples dropped because the stack table was full
+uint64_t bw_trace_writer_dropped(const bw_trace_writer_t* writer);
+
+// Flushes and frees the writer. Returns false if a write failed. Does not close the descriptor.
+bool bw_trace_writer_close(bw_trace_writer_t* writer);
+
+// Maps the trace at `path` and indexes its modules and stacks. Records after a truncated one, as
+// left by a writer that did not flush, are ignored. Returns NULL if the file cannot be mapped or
+// is not a trace of a supported version.
+bw_trace_reader_t* bw_trace_reader_open(const char* path);
+
+void bw_trace_reader_close(bw_trace_reader_t* reader);
+
+size_t bw_trace_reader_modules_len(const bw_trace_reader_t* reader);
+
+// Points `mod` at module `index`, whose strings point into the mapped file
+bool bw_trace_reader_module(const bw_trace_reader_t* reader, size_t index, bw_trace_module_t* mod);
+
+// Returns one more than the largest stack ID in the trace
+uint32_t bw_trace_reader_stack_id_limit(const bw_trace_reader_t* reader);
+
+// Decodes up to `max` frames of stack `id`, innermost first, and returns their count, or 0 if
+// `id` is unknown
+size_t bw_trace_reader_stack(const bw_trace_reader_t* reader,
+                             uint32_t id,
+                             bw_trace_frame_t* frames,
+                             size_t max);
+
+// Decodes the next sample straight from the mapping. Returns false at the end of the trace.
+bool bw_trace_reader_next(bw_trace_reader_t* reader, bw_trace_sample_t* sample);
+
+// Restarts iteration at the first sample
+void bw_trace_reader_rewind(bw_trace_reader_t* reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BW_TRACE_H
@@ -0,0 +1,63 @@
+#include "arena.h"
+
+#include <stdalign.h>   // for alignof
+#include <stdatomic.h>  // for atomic_compare_exchange_strong_explicit, atomic_fetch_add_...
+#include <stddef.h>     // for size_t, NULL, max_align_t
+#include <stdlib.h>     // for free, malloc
+
+struct arena_chunk {
+    arena_chunk_t* next;
+    size_t size;
+    atomic_size_t used;
+    alignas(max_align_t) unsigned char data[];
+};
+
+#define ARENA_ALIGN (alignof(max_align_t))
+
+void arena_init(arena_t* arena, size_t chunk_size) {
+    atomic_init(&arena->current, NULL);
+    arena->chunk_size = chunk_size;
+}
+
+void arena_destroy(arena_t* arena) {
+    arena_chunk_t* chunk = atomic_load(&arena->current);
+    while (chunk) {
+        arena_chunk_t* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    atomic_store(&arena->current, NULL);
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    for (;;) {
+        arena_chunk_t* chunk = atomic_load_explicit(&arena->current, memory_order_acquire);
+        if (chunk) {
+            // Concurrent allocations may push `used` past the end, which only wastes the tail
+            size_t offset = atomic_fetch_add_explicit(&chunk->used, size, memory_order_relaxed);
+            if (offset + size <= chunk->size) {
+                return &chunk->data[offset];
+            }
+        }
+
+        size_t chunk_size = size > arena->chunk_size ? size : arena->chunk_size;
+        arena_chunk_t* fresh = malloc(sizeof(*fresh) + chunk_size);
+        if (!fresh) {
+            return NULL;
+        }
+        fresh->next = chunk;
+        fresh->size = chunk_size;
+        // The new chunk starts with our allocation, so installing it is enough to succeed
+        atomic_init(&fresh->used, size);
+
+        if (atomic_compare_exchange_strong_explicit(
+                &arena->current, &chunk, fresh, memory_order_acq_rel, memory_order_acquire)) {
+            return fresh->data;
+        }
+
+        // Another thread installed a chunk first: retry with that one
+        free(fresh);
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef BW_ARENA_H
+#define BW_ARENA_H
+
+#include <stdatomic.h>  // for _Atomic
+#include <stddef.h>     // for size_t
+
+typedef struct arena_chunk arena_chunk_t;
+
+// A lock-free bump allocator. Memory is only released when the whole arena is destroyed.
+typedef struct {
+    _Atomic(arena_chunk_t*) current;
+    size_t chunk_size;
+} arena_t;
+
+void arena_init(arena_t* arena, size_t chunk_size);
+
+void arena_destroy(arena_t* arena);
+
+// Returns `size` bytes aligned for any fundamental type, or NULL if out of memory. Safe to call
+// concurrently from multiple threads.
+void* arena_alloc(arena_t* arena, size_t size);
+
+#endif // BW_ARENA_H
@@ -2,31 +2,124 @@
 #define _GNU_SOURCE
 #include "backwalk/backwalk.h"
 
-#include <dlfcn.h>    // for dladdr, Dl_info
-#include <stdbool.h>  // for bool, false, true
-#include <stddef.h>   // for NULL
-#include <stdint.h>   // for uintptr_t
+#include <stdatomic.h>  // for atomic_int, atomic_load_explicit, atomic_store_explicit, mem...
+#include <stdbool.h>    // for bool, false, true
+#include <stddef.h>     // for NULL, size_t
+#include <stdint.h>     // for uintptr_t, SIZE_MAX
+#include <stdlib.h>     // for free, malloc
+#include <string.h>     // for memcpy
 
-#include "context.h"  // for context_get_ip, context_init, context_step, con...
-#include "debug.h"    // for BW_PRINT_FRAME
+#include "cfi.h"        // for cfi_table_lookup, cfi_table_t
+#include "common.h"     // for BW_UNUSED
+#include "context.h"    // for context_get_ip, context_init, context_init_fp, context_set...
+#include "debug.h"      // for BW_PRINT_FRAME
+#include "demangle.h"   // for demangle_name
+#include "dwarf_line.h" // for dwarf_lines_lookup, dwarf_lines_t
+#include "module.h"     // for module_lookup, module_map_acquire, module_map_synced, module_t, ...
+#include "resolve.h"    // for resolve_cache_stats, resolve_frame_cached
+#include "stack.h"      // for stack_bounds_get, stack_bounds_init
+
+#define HEX_BASE 16
+
+static atomic_int unwind_mode = BW_UNWIND_FP;
+static atomic_bool demangle_enabled = false;
+
+struct bw_trace {
+    bw_allocator_t allocator;
+    _Atomic(bw_symbol_t*) syms; // Resolved frames without demangling, NULL until first iterated
+    size_t size;                // Bytes allocated for the trace, as passed back to the allocator
+    size_t len;
+    uintptr_t ips[];
+};
+
+typedef struct {
+    const module_map_t* cfi_map; // NULL when walking the frame pointer chain
+    const module_t* mod;         // Module of the previous frame, most steps stay in it
+    const cfi_table_t* cfi;
+    bool build;                  // Build missing tables, which is not async-signal-safe
+    bool synced;                 // The map was synchronized after a lookup missed, once per walk
+    bool interrupted;            // The current IP is an interrupted instruction, not a return address
+} walk_t;
+
+static void walk_init(walk_t* walk, bool sync, bool build) {
+    walk->cfi_map = NULL;
+    walk->mod = NULL;
+    walk->cfi = NULL;
+    walk->build = build;
+    walk->synced = false;
+    walk->interrupted = false;
+
+    if (atomic_load_explicit(&unwind_mode, memory_order_relaxed) == BW_UNWIND_CFI) {
+        walk->cfi_map = sync ? module_map_acquire() : module_map_get();
+    }
+}
+
+// Steps to the caller's frame, with the CFI table of the current frame's module in CFI mode
+static bool walk_step(walk_t* walk, context_t* ctx) {
+    bool interrupted = walk->interrupted;
+    walk->interrupted = false;
+    if (!walk->cfi_map) {
+        return context_step(ctx);
+    }
+
+    // Return addresses point past the call instruction, look up the call itself
+    uintptr_t pc = context_get_ip(ctx) - (interrupted ? 0 : 1);
+    if (!walk->mod || pc < walk->mod->base || pc >= walk->mod->end) {
+        walk->mod = module_lookup(walk->cfi_map, pc);
+        // Modules loaded since the map was built are only found after synchronizing it
+        if (!walk->mod && walk->build && !walk->synced) {
+            walk->synced = true;
+            if (module_map_sync()) {
+                walk->cfi_map = module_map_get();
+                walk->mod = module_lookup(walk->cfi_map, pc);
+            }
+        }
+        walk->cfi = NULL;
+        if (walk->mod) {
+            walk->cfi = walk->build ? module_cfi(walk->mod) : module_cfi_get(walk->mod);
+        }
+    }
+
+    return context_step_cfi(ctx, cfi_table_lookup(walk->cfi, pc));
+}
+
+void bw_set_unwind_mode(bw_unwind_mode_t mode) {
+    atomic_store_explicit(&unwind_mode, mode, memory_order_relaxed);
+}
+
+void bw_set_demangle(bool enabled) {
+    atomic_store_explicit(&demangle_enabled, enabled, memory_order_relaxed);
+}
+
+const char* bw_demangle(const char* sname) {
+    return demangle_name(sname);
+}
 
 bool bw_backtrace(bw_backtrace_cb cb, void* arg) {
+    const module_map_t* map = module_map_synced();
+    BW_UNUSED(stack_bounds_init(false));
+
+    walk_t walk;
+    walk_init(&walk, false, true);
+
     context_t ctx;
-    context_init(&ctx);
+    if (walk.cfi_map) {
+        context_init(&ctx);
+    } else {
+        context_init_fp(&ctx);
+    }
+    context_set_bounds(&ctx, stack_bounds_get());
 
-    while (context_step(&ctx)) {
+    while (walk_step(&walk, &ctx)) {
         uintptr_t ip = context_get_ip(&ctx);
-        Dl_info info;
         uintptr_t mod_addr = 0;
         const char* fname = NULL;
         const char* sname = NULL;
 
-        // NOLINTNEXTLINE(performance-no-int-to-ptr)
-        if (dladdr((const void*)(ip - 1), &info)) {
-            mod_addr = ip - (uintptr_t)info.dli_fbase;
+        resolve_frame_cached(map, ip, &mod_addr, &fname, &sname);
+        if (atomic_load_explicit(&demangle_enabled, memory_order_relaxed)) {
+            sname = demangle_name(sname);
         }
-        fname = info.dli_fname ? info.dli_fname : "?";
-        sname = info.dli_sname ? info.dli_sname : "?";
 
         BW_PRINT_FRAME(mod_addr, fname, sname);
 
@@ -37,3 +130,340 @@ bool bw_backtrace(bw_backtrace_cb cb, void* arg) {
 
     return true;
 }
+
+// Inlined into its callers, so the walk starts at their frame
+__attribute__((always_inline)) static inline size_t capture_ips(uintptr_t* out,
+                                                                size_t max,
+                                                                size_t skip) {
+    BW_UNUSED(stack_bounds_init(false));
+
+    walk_t walk;
+    walk_init(&walk, true, true);
+
+    context_t ctx;
+    if (walk.cfi_map) {
+        context_init(&ctx);
+    } else {
+        context_init_fp(&ctx);
+    }
+    context_set_bounds(&ctx, stack_bounds_get());
+
+    size_t len = 0;
+    while (len < max && walk_step(&walk, &ctx)) {
+        if (skip > 0) {
+            --skip;
+            continue;
+        }
+        out[len++] = context_get_ip(&ctx);
+    }
+
+    return len;
+}
+
+size_t bw_capture(uintptr_t* out, size_t max, size_t skip) {
+    if (!out || max == 0) {
+        return 0;
+    }
+
+    return capture_ips(out, max, skip);
+}
+
+void bw_symbolize(const uintptr_t* ips, size_t len, bw_symbol_t* out) {
+    if (!ips || !out || len == 0) {
+        return;
+    }
+
+    const module_map_t* map = module_map_synced();
+    bool demangle = atomic_load_explicit(&demangle_enabled, memory_order_relaxed);
+
+    for (size_t i = 0; i < len; ++i) {
+        resolve_frame_cached(map, ips[i], &out[i].addr, &out[i].fname, &out[i].sname);
+        if (demangle) {
+            out[i].sname = demangle_name(out[i].sname);
+        }
+    }
+}
+
+void bw_symbol_cache_stats(bw_symbol_cache_stats_t* stats) {
+    if (stats) {
+        resolve_cache_stats(stats);
+    }
+}
+
+static void* default_alloc(size_t size, void* ctx) {
+    BW_UNUSED(ctx);
+    return malloc(size);
+}
+
+static void default_free(void* ptr, size_t size, void* ctx) {
+    BW_UNUSED(size);
+    BW_UNUSED(ctx);
+    free(ptr);
+}
+
+static const bw_allocator_t default_allocator = {
+    .alloc = default_alloc,
+    .free = default_free,
+    .ctx = NULL,
+};
+
+static size_t trace_size(size_t len) {
+    return sizeof(bw_trace_t) + len * sizeof(uintptr_t);
+}
+
+bw_trace_t* bw_trace_capture(size_t max, size_t skip, const bw_allocator_t* allocator) {
+    if (max == 0 || max > (SIZE_MAX - sizeof(bw_trace_t)) / sizeof(uintptr_t)) {
+        return NULL;
+    }
+    if (!allocator) {
+        allocator = &default_allocator;
+    }
+
+    // Sized for `max` frames, so the stack is walked once, straight into the trace
+    bw_trace_t* trace = allocator->alloc(trace_size(max), allocator->ctx);
+    if (!trace) {
+        return NULL;
+    }
+    trace->allocator = *allocator;
+    atomic_init(&trace->syms, NULL);
+    trace->size = trace_size(max);
+    trace->len = capture_ips(trace->ips, max, skip);
+
+    return trace;
+}
+
+size_t bw_trace_len(const bw_trace_t* trace) {
+    return trace ? trace->len : 0;
+}
+
+const uintptr_t* bw_trace_ips(const bw_trace_t* trace) {
+    return trace ? trace->ips : NULL;
+}
+
+// Resolves the frames of `trace` once. Threads that iterate it concurrently may both resolve it,
+// the first to publish its results wins and the others free theirs.
+static const bw_symbol_t* trace_syms(bw_trace_t* trace) {
+    bw_symbol_t* syms = atomic_load_explicit(&trace->syms, memory_order_acquire);
+    if (syms || trace->len == 0) {
+        return syms;
+    }
+
+    const bw_allocator_t* allocator = &trace->allocator;
+    syms = allocator->alloc(trace->len * sizeof(*syms), allocator->ctx);
+    if (!syms) {
+        return NULL;
+    }
+
+    const module_map_t* map = module_map_synced();
+    for (size_t i = 0; i < trace->len; ++i) {
+        resolve_frame_cached(map, trace->ips[i], &syms[i].addr, &syms[i].fname, &syms[i].sname);
+    }
+
+    bw_symbol_t* expected = NULL;
+    if (!atomic_compare_exchange_strong_explicit(
+            &trace->syms, &expected, syms, memory_order_acq_rel, memory_order_acquire)) {
+        allocator->free(syms, trace->len * sizeof(*syms), allocator->ctx);
+        syms = expected;
+    }
+
+    return syms;
+}
+
+bool bw_trace_foreach(bw_trace_t* trace, bw_backtrace_cb cb, void* arg) {
+    if (!trace || !cb) {
+        return trace != NULL;
+    }
+
+    // Without memory for the results, every iteration resolves the frames again
+    const bw_symbol_t* syms = trace_syms(trace);
+    const module_map_t* map = NULL;
+    if (!syms) {
+        map = module_map_synced();
+    }
+    bool demangle = atomic_load_explicit(&demangle_enabled, memory_order_relaxed);
+
+    for (size_t i = 0; i < trace->len; ++i) {
+        bw_symbol_t sym;
+        if (syms) {
+            sym = syms[i];
+        } else {
+            resolve_frame_cached(map, trace->ips[i], &sym.addr, &sym.fname, &sym.sname);
+        }
+        if (demangle) {
+            sym.sname = demangle_name(sym.sname);
+        }
+
+        if (!cb(sym.addr, sym.fname, sym.sname, arg)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void bw_trace_free(bw_trace_t* trace) {
+    if (!trace) {
+        return;
+    }
+
+    bw_allocator_t allocator = trace->allocator;
+    bw_symbol_t* syms = atomic_load_explicit(&trace->syms, memory_order_acquire);
+    if (syms) {
+        allocator.free(syms, trace->len * sizeof(*syms), allocator.ctx);
+    }
+    allocator.free(trace, trace->size, allocator.ctx);
+}
+
+bool bw_signal_safe_init(void) {
+    bool success = stack_bounds_init(true) && module_map_sync();
+
+    // Tables cannot be built from a signal handler
+    walk_t walk;
+    walk_init(&walk, false, true);
+    for (size_t i = 0; walk.cfi_map && i < walk.cfi_map->len; ++i) {
+        BW_UNUSED(module_cfi(walk.cfi_map->mods[i]));
+    }
+
+    return success;
+}
+
+static void frame_init(bw_frame_t* frame, const module_map_t* map, uintptr_t ip, uintptr_t pc) {
+    const module_t* mod = module_lookup(map, pc);
+    frame->ip = ip;
+    frame->addr = mod ? ip - mod->base : 0;
+    frame->fname = mod ? mod->path : "?";
+}
+
+// Records the caller of each frame until the walk ends or `frames` is full
+static size_t walk_frames(walk_t* walk, context_t* ctx, bw_frame_t* frames, size_t len, size_t max) {
+    // The snapshot is immutable and never freed, reading it only needs an atomic load
+    const module_map_t* map = module_map_get();
+
+    while (len < max && walk_step(walk, ctx)) {
+        uintptr_t ip = context_get_ip(ctx);
+        frame_init(&frames[len++], map, ip, ip - 1);
+    }
+
+    return len;
+}
+
+size_t bw_backtrace_signal_safe(bw_frame_t* frames, size_t max) {
+    if (!frames || max == 0) {
+        return 0;
+    }
+
+    walk_t walk;
+    walk_init(&walk, false, false);
+
+    context_t ctx;
+    if (walk.cfi_map) {
+        context_init(&ctx);
+    } else {
+        context_init_fp(&ctx);
+    }
+    context_set_bounds(&ctx, stack_bounds_get());
+
+    return walk_frames(&walk, &ctx, frames, 0, max);
+}
+
+size_t bw_backtrace_from_ucontext(const ucontext_t* uc, bw_frame_t* frames, size_t max) {
+    if (!uc || !frames || max == 0) {
+        return 0;
+    }
+
+    walk_t walk;
+    walk_init(&walk, false, false);
+    walk.interrupted = true;
+
+    context_t ctx;
+    context_init_ucontext(&ctx, uc);
+    context_set_bounds(&ctx, stack_bounds_get());
+
+    // The interrupted instruction is not a return address, the module is looked up at the IP itself
+    uintptr_t ip = context_get_ip(&ctx);
+    frame_init(&frames[0], module_map_get(), ip, ip);
+
+    return walk_frames(&walk, &ctx, frames, 1, max);
+}
+
+bool bw_resolve_line(uintptr_t ip, const char** file, unsigned int* line) {
+    if (!file || !line) {
+        return false;
+    }
+
+    // Only rebuild the module map when the address is not in the current one
+    const module_t* mod = module_lookup(module_map_get(), ip - 1);
+    if (!mod && module_map_sync()) {
+        mod = module_lookup(module_map_get(), ip - 1);
+    }
+
+    dwarf_lines_t* lines = mod ? module_lines(mod) : NULL;
+    uint32_t row_line = 0;
+    if (!lines || !dwarf_lines_lookup(lines, ip - 1 - mod->bias, file, &row_line)) {
+        return false;
+    }
+    *line = row_line;
+
+    return true;
+}
+
+static void module_export(const module_t* mod, bw_module_t* out) {
+    out->path = mod->path;
+    out->base = mod->base;
+    out->end = mod->end;
+    out->bias = mod->bias;
+    out->text_start = mod->text_start;
+    out->text_end = mod->text_end;
+    out->build_id_len = mod->build_id_len;
+    memcpy(out->build_id, mod->build_id, mod->build_id_len);
+}
+
+bool bw_modules(bw_module_cb cb, void* arg) {
+    if (!cb || !module_map_sync()) {
+        return false;
+    }
+
+    const module_map_t* map = module_map_get();
+    for (size_t i = 0; map && i < map->len; ++i) {
+        bw_module_t mod;
+        module_export(map->mods[i], &mod);
+        if (!cb(&mod, arg)) {
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool bw_module_find(uintptr_t ip, bw_module_t* mod) {
+    if (!mod) {
+        return false;
+    }
+
+    const module_t* found = module_lookup(module_map_get(), ip);
+    if (!found && module_map_sync()) {
+        found = module_lookup(module_map_get(), ip);
+    }
+    if (!found) {
+        return false;
+    }
+    module_export(found, mod);
+
+    return true;
+}
+
+size_t bw_build_id_hex(const bw_module_t* mod, char* out, size_t size) {
+    static const char k_digits[] = "0123456789abcdef";
+
+    if (!mod || !out || mod->build_id_len == 0 || size < (mod->build_id_len * 2) + 1) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < mod->build_id_len; ++i) {
+        out[2 * i] = k_digits[mod->build_id[i] / HEX_BASE];
+        out[(2 * i) + 1] = k_digits[mod->build_id[i] % HEX_BASE];
+    }
+    out[mod->build_id_len * 2] = '\0';
+
+    return mod->build_id_len * 2;
+}
@@ -0,0 +1,656 @@
+#if defined(__x86_64__) || defined(__aarch64__)
+#include "cfi.h"
+
+#include <stdbool.h>      // for bool, false, true
+#include <stddef.h>       // for size_t, NULL
+#include <stdint.h>       // for uintptr_t, int64_t, uint64_t, uint8_t, int32_t, INT16_MAX, ...
+#include <stdlib.h>       // for free, calloc, qsort, realloc
+#include <string.h>       // for memcpy
+
+#include "common.h"       // for BW_UNUSED
+#include "dwarf_reader.h" // for dwarf_read_u8, dwarf_read_uleb, dwarf_reader_t, dwarf_read...
+
+// DWARF register numbers of the frame and stack pointers
+#if defined(__x86_64__)
+enum { CFI_DWARF_FP = 6, CFI_DWARF_SP = 7 };
+#else
+enum { CFI_DWARF_FP = 29, CFI_DWARF_SP = 31 };
+#endif
+
+// Pointer encodings used by .eh_frame and .eh_frame_hdr
+enum {
+    DW_EH_PE_ABSPTR = 0x00,
+    DW_EH_PE_ULEB128 = 0x01,
+    DW_EH_PE_UDATA2 = 0x02,
+    DW_EH_PE_UDATA4 = 0x03,
+    DW_EH_PE_UDATA8 = 0x04,
+    DW_EH_PE_SLEB128 = 0x09,
+    DW_EH_PE_SDATA2 = 0x0a,
+    DW_EH_PE_SDATA4 = 0x0b,
+    DW_EH_PE_SDATA8 = 0x0c,
+    DW_EH_PE_PCREL = 0x10,
+    DW_EH_PE_DATAREL = 0x30,
+    DW_EH_PE_OMIT = 0xff,
+};
+
+#define DW_EH_PE_FORMAT_MASK 0x0fU
+#define DW_EH_PE_APPLICATION_MASK 0x70U
+
+// Call frame instructions, the first three encode an operand in their low 6 bits
+enum {
+    DW_CFA_NOP = 0x00,
+    DW_CFA_SET_LOC = 0x01,
+    DW_CFA_ADVANCE_LOC1 = 0x02,
+    DW_CFA_ADVANCE_LOC2 = 0x03,
+    DW_CFA_ADVANCE_LOC4 = 0x04,
+    DW_CFA_OFFSET_EXTENDED = 0x05,
+    DW_CFA_RESTORE_EXTENDED = 0x06,
+    DW_CFA_UNDEFINED = 0x07,
+    DW_CFA_SAME_VALUE = 0x08,
+    DW_CFA_REGISTER = 0x09,
+    DW_CFA_REMEMBER_STATE = 0x0a,
+    DW_CFA_RESTORE_STATE = 0x0b,
+    DW_CFA_DEF_CFA = 0x0c,
+    DW_CFA_DEF_CFA_REGISTER = 0x0d,
+    DW_CFA_DEF_CFA_OFFSET = 0x0e,
+    DW_CFA_DEF_CFA_EXPRESSION = 0x0f,
+    DW_CFA_EXPRESSION = 0x10,
+    DW_CFA_OFFSET_EXTENDED_SF = 0x11,
+    DW_CFA_DEF_CFA_SF = 0x12,
+    DW_CFA_DEF_CFA_OFFSET_SF = 0x13,
+    DW_CFA_VAL_OFFSET = 0x14,
+    DW_CFA_VAL_OFFSET_SF = 0x15,
+    DW_CFA_VAL_EXPRESSION = 0x16,
+    DW_CFA_AARCH64_NEGATE_RA_STATE = 0x2d,
+    DW_CFA_GNU_ARGS_SIZE = 0x2e,
+    DW_CFA_GNU_NEGATIVE_OFFSET_EXTENDED = 0x2f,
+    DW_CFA_ADVANCE_LOC = 0x40,
+    DW_CFA_OFFSET = 0x80,
+    DW_CFA_RESTORE = 0xc0,
+};
+
+#define DW_CFA_PRIMARY_MASK 0xc0U
+#define DW_CFA_OPERAND_MASK 0x3fU
+
+enum { EH_FRAME_HDR_VERSION = 1 };
+// Binary search table entries are pairs of 4-byte offsets from the start of .eh_frame_hdr
+enum { EH_FRAME_HDR_TABLE_ENC = DW_EH_PE_DATAREL | DW_EH_PE_SDATA4 };
+// Version, three encodings and two encoded values of at most 8 bytes
+enum { EH_FRAME_HDR_MAX_SIZE = 4 + (2 * 8) };
+// Length, extended length and CIE pointer of an entry
+enum { EH_FRAME_ENTRY_HEADER_MAX_SIZE = 4 + 8 + 8 };
+enum { CIE_VERSION_MAX = 4 };
+
+enum { CFI_STATE_STACK_DEPTH = 8 };
+enum { CFI_ROWS_INITIAL_CAP = 1024 };
+
+// Local to compilation: rules that cannot be expressed in a row
+enum { CFI_RULE_UNSUPPORTED = 3 };
+
+#define DWARF64_ESCAPE 0xffffffffU
+
+typedef struct {
+    uint8_t kind;
+    int64_t offset;
+} cfi_rule_t;
+
+typedef struct {
+    uint64_t cfa_reg;
+    int64_t cfa_offset;
+    bool cfa_expr;
+    cfi_rule_t ra;
+    cfi_rule_t fp;
+} cfi_state_t;
+
+typedef struct {
+    const unsigned char* entry;
+    const unsigned char* insns;
+    const unsigned char* end;
+    uint64_t code_align;
+    int64_t data_align;
+    uint64_t ra_reg;
+    uint8_t fde_enc;
+    bool has_aug_data;
+    bool signal_frame;
+    cfi_state_t initial;
+} cfi_cie_t;
+
+typedef struct {
+    uintptr_t base;
+    cfi_row_t* rows;
+    size_t len;
+    size_t cap;
+    size_t fde_start;
+    bool failed;
+} cfi_builder_t;
+
+// Reads an encoded pointer. Only the encodings emitted by GNU and LLVM toolchains are supported.
+static uintptr_t read_encoded(dwarf_reader_t* r, uint8_t enc, uintptr_t datarel_base) {
+    if (enc == DW_EH_PE_OMIT) {
+        return 0;
+    }
+
+    uintptr_t field = (uintptr_t)r->pos;
+    uintptr_t val = 0;
+    switch (enc & DW_EH_PE_FORMAT_MASK) {
+    case DW_EH_PE_ABSPTR:
+    case DW_EH_PE_UDATA8:
+    case DW_EH_PE_SDATA8:
+        val = (uintptr_t)dwarf_read_fixed(r, sizeof(uint64_t));
+        break;
+    case DW_EH_PE_UDATA2:
+        val = dwarf_read_u16(r);
+        break;
+    case DW_EH_PE_UDATA4:
+        val = dwarf_read_u32(r);
+        break;
+    case DW_EH_PE_SDATA2:
+        val = (uintptr_t)(int16_t)dwarf_read_u16(r);
+        break;
+    case DW_EH_PE_SDATA4:
+        val = (uintptr_t)(int32_t)dwarf_read_u32(r);
+        break;
+    case DW_EH_PE_ULEB128:
+        val = (uintptr_t)dwarf_read_uleb(r);
+        break;
+    case DW_EH_PE_SLEB128:
+        val = (uintptr_t)dwarf_read_sleb(r);
+        break;
+    default:
+        r->ok = false;
+        return 0;
+    }
+
+    switch (enc & DW_EH_PE_APPLICATION_MASK) {
+    case 0:
+        return val;
+    case DW_EH_PE_PCREL:
+        return val + field;
+    case DW_EH_PE_DATAREL:
+        return val + datarel_base;
+    default:
+        r->ok = false;
+        return 0;
+    }
+}
+
+// Reads the length of a CIE or FDE and narrows the reader to its contents
+static bool read_entry(dwarf_reader_t* r, const unsigned char* entry, bool* is64) {
+    r->pos = entry;
+    r->end = entry + EH_FRAME_ENTRY_HEADER_MAX_SIZE;
+    r->ok = true;
+
+    uint64_t len = dwarf_read_u32(r);
+    *is64 = len == DWARF64_ESCAPE;
+    if (*is64) {
+        len = dwarf_read_fixed(r, sizeof(uint64_t));
+    }
+
+    r->end = r->pos + len;
+
+    return r->ok && len != 0;
+}
+
+static cfi_rule_t* state_rule(cfi_state_t* state, const cfi_cie_t* cie, uint64_t reg) {
+    if (reg == cie->ra_reg) {
+        return &state->ra;
+    }
+    if (reg == CFI_DWARF_FP) {
+        return &state->fp;
+    }
+
+    // Other registers are not needed to find the caller's frame
+    return NULL;
+}
+
+static void set_rule(cfi_state_t* state,
+                     const cfi_cie_t* cie,
+                     uint64_t reg,
+                     uint8_t kind,
+                     int64_t offset) {
+    cfi_rule_t* rule = state_rule(state, cie, reg);
+    if (rule) {
+        rule->kind = kind;
+        rule->offset = offset;
+    }
+}
+
+static void restore_rule(cfi_state_t* state, const cfi_cie_t* cie, uint64_t reg) {
+    cfi_rule_t* rule = state_rule(state, cie, reg);
+    if (rule) {
+        *rule = reg == cie->ra_reg ? cie->initial.ra : cie->initial.fp;
+    }
+}
+
+static bool fits(int64_t val, int64_t min, int64_t max) {
+    return val >= min && val <= max;
+}
+
+static void builder_emit(cfi_builder_t* builder,
+                         const cfi_cie_t* cie,
+                         uintptr_t loc,
+                         const cfi_state_t* state,
+                         bool end) {
+    if (builder->failed || loc < builder->base || loc - builder->base > UINT32_MAX) {
+        return;
+    }
+
+    cfi_row_t row = {0};
+    row.pc = (uint32_t)(loc - builder->base);
+    row.cfa_reg = CFI_REG_NONE;
+
+    bool supported = !end && !cie->signal_frame && !state->cfa_expr &&
+                     (state->cfa_reg == CFI_DWARF_SP || state->cfa_reg == CFI_DWARF_FP) &&
+                     fits(state->cfa_offset, INT32_MIN, INT32_MAX) &&
+                     state->ra.kind != CFI_RULE_UNSUPPORTED &&
+                     state->fp.kind != CFI_RULE_UNSUPPORTED &&
+                     fits(state->ra.offset, INT16_MIN, INT16_MAX) &&
+                     fits(state->fp.offset, INT16_MIN, INT16_MAX);
+    if (supported) {
+        row.cfa_reg = state->cfa_reg == CFI_DWARF_SP ? CFI_REG_SP : CFI_REG_FP;
+        row.cfa_offset = (int32_t)state->cfa_offset;
+        row.ra_rule = state->ra.kind;
+        row.ra_offset = (int16_t)state->ra.offset;
+        row.fp_rule = state->fp.kind;
+        row.fp_offset = (int16_t)state->fp.offset;
+    }
+
+    // Collapse rows of the same function that start at the same address or change nothing
+    if (builder->len > builder->fde_start) {
+        cfi_row_t* last = &builder->rows[builder->len - 1];
+        if (last->pc == row.pc) {
+            *last = row;
+            return;
+        }
+        if (!end && last->cfa_reg == row.cfa_reg && last->cfa_offset == row.cfa_offset &&
+            last->ra_rule == row.ra_rule && last->ra_offset == row.ra_offset &&
+            last->fp_rule == row.fp_rule && last->fp_offset == row.fp_offset) {
+            return;
+        }
+    }
+
+    if (builder->len == builder->cap) {
+        size_t cap = builder->cap ? builder->cap * 2 : CFI_ROWS_INITIAL_CAP;
+        cfi_row_t* rows = realloc(builder->rows, cap * sizeof(*rows));
+        if (!rows) {
+            builder->failed = true;
+            return;
+        }
+        builder->rows = rows;
+        builder->cap = cap;
+    }
+
+    builder->rows[builder->len++] = row;
+}
+
+// Runs a CFA program. With a builder, a row is emitted every time the location advances.
+static bool cfa_program_run(const cfi_cie_t* cie,
+                            dwarf_reader_t* r,
+                            cfi_state_t* state,
+                            cfi_builder_t* builder,
+                            uintptr_t* loc) {
+    cfi_state_t stack[CFI_STATE_STACK_DEPTH];
+    size_t depth = 0;
+
+    while (r->ok && r->pos < r->end) {
+        uint8_t op = dwarf_read_u8(r);
+        uint8_t operand = op & DW_CFA_OPERAND_MASK;
+        uint64_t advance = 0;
+        uint64_t reg = 0;
+
+        switch (op & DW_CFA_PRIMARY_MASK) {
+        case DW_CFA_ADVANCE_LOC:
+            advance = operand;
+            break;
+        case DW_CFA_OFFSET:
+            set_rule(state, cie, operand, CFI_RULE_OFFSET,
+                     (int64_t)dwarf_read_uleb(r) * cie->data_align);
+            continue;
+        case DW_CFA_RESTORE:
+            restore_rule(state, cie, operand);
+            continue;
+        default:
+            break;
+        }
+
+        if (op < DW_CFA_ADVANCE_LOC) {
+            switch (op) {
+            case DW_CFA_NOP:
+            case DW_CFA_AARCH64_NEGATE_RA_STATE:
+                // Signed return addresses are stripped when they are read
+                break;
+            case DW_CFA_SET_LOC:
+                // Unlike the advance instructions this does not scale by the code alignment
+                if (builder) {
+                    uintptr_t next = read_encoded(r, cie->fde_enc, 0);
+                    builder_emit(builder, cie, *loc, state, false);
+                    *loc = next;
+                } else {
+                    return false;
+                }
+                break;
+            case DW_CFA_ADVANCE_LOC1:
+                advance = dwarf_read_u8(r);
+                break;
+            case DW_CFA_ADVANCE_LOC2:
+                advance = dwarf_read_u16(r);
+                break;
+            case DW_CFA_ADVANCE_LOC4:
+                advance = dwarf_read_u32(r);
+                break;
+            case DW_CFA_OFFSET_EXTENDED:
+                reg = dwarf_read_uleb(r);
+                set_rule(state, cie, reg, CFI_RULE_OFFSET,
+                         (int64_t)dwarf_read_uleb(r) * cie->data_align);
+                break;
+            case DW_CFA_OFFSET_EXTENDED_SF:
+                reg = dwarf_read_uleb(r);
+                set_rule(state, cie, reg, CFI_RULE_OFFSET, dwarf_read_sleb(r) * cie->data_align);
+                break;
+            case DW_CFA_GNU_NEGATIVE_OFFSET_EXTENDED:
+                reg = dwarf_read_uleb(r);
+                set_rule(state, cie, reg, CFI_RULE_OFFSET,
+                         -(int64_t)dwarf_read_uleb(r) * cie->data_align);
+                break;
+            case DW_CFA_RESTORE_EXTENDED:
+                restore_rule(state, cie, dwarf_read_uleb(r));
+                break;
+            case DW_CFA_UNDEFINED:
+                set_rule(state, cie, dwarf_read_uleb(r), CFI_RULE_UNDEFINED, 0);
+                break;
+            case DW_CFA_SAME_VALUE:
+                set_rule(state, cie, dwarf_read_uleb(r), CFI_RULE_SAME, 0);
+                break;
+            case DW_CFA_REGISTER:
+                reg = dwarf_read_uleb(r);
+                BW_UNUSED(dwarf_read_uleb(r));
+                set_rule(state, cie, reg, CFI_RULE_UNSUPPORTED, 0);
+                break;
+            case DW_CFA_REMEMBER_STATE:
+                if (depth == CFI_STATE_STACK_DEPTH) {
+                    return false;
+                }
+                stack[depth++] = *state;
+                break;
+            case DW_CFA_RESTORE_STATE:
+                if (depth == 0) {
+                    return false;
+                }
+                *state = stack[--depth];
+                break;
+            case DW_CFA_DEF_CFA:
+                state->cfa_reg = dwarf_read_uleb(r);
+                state->cfa_offset = (int64_t)dwarf_read_uleb(r);
+                state->cfa_expr = false;
+                break;
+            case DW_CFA_DEF_CFA_SF:
+                state->cfa_reg = dwarf_read_uleb(r);
+                state->cfa_offset = dwarf_read_sleb(r) * cie->data_align;
+                state->cfa_expr = false;
+                break;
+            case DW_CFA_DEF_CFA_REGISTER:
+                state->cfa_reg = dwarf_read_uleb(r);
+                state->cfa_expr = false;
+                break;
+            case DW_CFA_DEF_CFA_OFFSET:
+                state->cfa_offset = (int64_t)dwarf_read_uleb(r);
+                break;
+            case DW_CFA_DEF_CFA_OFFSET_SF:
+                state->cfa_offset = dwarf_read_sleb(r) * cie->data_align;
+                break;
+            case DW_CFA_DEF_CFA_EXPRESSION:
+                state->cfa_expr = true;
+                dwarf_skip(r, dwarf_read_uleb(r));
+                break;
+            case DW_CFA_EXPRESSION:
+            case DW_CFA_VAL_EXPRESSION:
+                reg = dwarf_read_uleb(r);
+                set_rule(state, cie, reg, CFI_RULE_UNSUPPORTED, 0);
+                dwarf_skip(r, dwarf_read_uleb(r));
+                break;
+            case DW_CFA_VAL_OFFSET:
+            case DW_CFA_VAL_OFFSET_SF:
+                reg = dwarf_read_uleb(r);
+                BW_UNUSED(dwarf_read_uleb(r));
+                set_rule(state, cie, reg, CFI_RULE_UNSUPPORTED, 0);
+                break;
+            case DW_CFA_GNU_ARGS_SIZE:
+                BW_UNUSED(dwarf_read_uleb(r));
+                break;
+            default:
+                // Operands of unknown instructions cannot be skipped
+                return false;
+            }
+        }
+
+        if (advance != 0) {
+            if (!builder) {
+                return false;
+            }
+            builder_emit(builder, cie, *loc, state, false);
+            *loc += advance * cie->code_align;
+        }
+    }
+
+    return r->ok;
+}
+
+static bool cie_parse(const unsigned char* entry, cfi_cie_t* cie) {
+    dwarf_reader_t r;
+    bool is64 = false;
+    if (!read_entry(&r, entry, &is64) || dwarf_read_offset(&r, is64) != 0) {
+        return false;
+    }
+
+    cie->entry = entry;
+    cie->end = r.end;
+    cie->fde_enc = DW_EH_PE_ABSPTR;
+    cie->has_aug_data = false;
+    cie->signal_frame = false;
+
+    uint8_t version = dwarf_read_u8(&r);
+    const char* aug = dwarf_read_cstr(&r);
+    if (!r.ok || version == 0 || version > CIE_VERSION_MAX || (aug[0] && aug[0] != 'z')) {
+        return false;
+    }
+    if (version == CIE_VERSION_MAX) {
+        // Address and segment selector sizes
+        dwarf_skip(&r, 2);
+    }
+
+    cie->code_align = dwarf_read_uleb(&r);
+    cie->data_align = dwarf_read_sleb(&r);
+    cie->ra_reg = version == 1 ? dwarf_read_u8(&r) : dwarf_read_uleb(&r);
+
+    if (aug[0] == 'z') {
+        cie->has_aug_data = true;
+        uint64_t aug_len = dwarf_read_uleb(&r);
+        dwarf_reader_t aug_r = {r.pos, r.pos, r.ok};
+        dwarf_skip(&r, aug_len);
+        aug_r.end = r.pos;
+
+        for (const char* c = aug + 1; *c && aug_r.ok; ++c) {
+            if (*c == 'R') {
+                cie->fde_enc = dwarf_read_u8(&aug_r);
+            } else if (*c == 'P') {
+                BW_UNUSED(read_encoded(&aug_r, dwarf_read_u8(&aug_r), 0));
+            } else if (*c == 'L') {
+                BW_UNUSED(dwarf_read_u8(&aug_r));
+            } else if (*c == 'S') {
+                cie->signal_frame = true;
+            } else if (*c != 'B' && *c != 'G') {
+                // The rest of the augmentation data cannot be interpreted, but can be skipped
+                break;
+            }
+        }
+    }
+
+    if (!r.ok) {
+        return false;
+    }
+    cie->insns = r.pos;
+
+    cfi_state_t* initial = &cie->initial;
+    initial->cfa_reg = CFI_DWARF_SP;
+    initial->cfa_offset = 0;
+    initial->cfa_expr = false;
+    initial->ra.kind = CFI_RULE_SAME;
+    initial->ra.offset = 0;
+    initial->fp.kind = CFI_RULE_SAME;
+    initial->fp.offset = 0;
+
+    // The initial instructions cannot advance the location
+    dwarf_reader_t insns = {cie->insns, cie->end, true};
+    uintptr_t loc = 0;
+    cfi_state_t state = *initial;
+    if (!cfa_program_run(cie, &insns, &state, NULL, &loc)) {
+        return false;
+    }
+    cie->initial = state;
+
+    return true;
+}
+
+static void fde_compile(cfi_builder_t* builder, const unsigned char* entry, cfi_cie_t* cie) {
+    dwarf_reader_t r;
+    bool is64 = false;
+    if (!read_entry(&r, entry, &is64)) {
+        return;
+    }
+
+    // The CIE pointer is relative to its own field
+    const unsigned char* field = r.pos;
+    uint64_t cie_offset = dwarf_read_offset(&r, is64);
+    if (!r.ok || cie_offset == 0 || cie_offset > (uintptr_t)field) {
+        return;
+    }
+
+    const unsigned char* cie_entry = field - cie_offset;
+    if (cie->entry != cie_entry && !cie_parse(cie_entry, cie)) {
+        cie->entry = NULL;
+        return;
+    }
+
+    uintptr_t pc_begin = read_encoded(&r, cie->fde_enc, 0);
+    uintptr_t pc_range = read_encoded(&r, cie->fde_enc & DW_EH_PE_FORMAT_MASK, 0);
+    if (cie->has_aug_data) {
+        dwarf_skip(&r, dwarf_read_uleb(&r));
+    }
+    if (!r.ok || pc_range == 0) {
+        return;
+    }
+
+    builder->fde_start = builder->len;
+
+    cfi_state_t state = cie->initial;
+    uintptr_t loc = pc_begin;
+    if (cfa_program_run(cie, &r, &state, builder, &loc)) {
+        builder_emit(builder, cie, loc, &state, false);
+    } else {
+        // Keep the rows before the instruction that could not be decoded
+        builder_emit(builder, cie, loc, &state, true);
+    }
+    builder_emit(builder, cie, pc_begin + pc_range, &state, true);
+}
+
+// Rows that end a function sort before rows at the same address, which start the next one
+static int compare_rows(const void* lhs, const void* rhs) {
+    const cfi_row_t* lrow = lhs;
+    const cfi_row_t* rrow = rhs;
+
+    if (lrow->pc != rrow->pc) {
+        return lrow->pc < rrow->pc ? -1 : 1;
+    }
+
+    return (lrow->cfa_reg != CFI_REG_NONE) - (rrow->cfa_reg != CFI_REG_NONE);
+}
+
+cfi_table_t* cfi_table_build(uintptr_t base, uintptr_t eh_frame_hdr) {
+    if (!eh_frame_hdr) {
+        return NULL;
+    }
+
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    const unsigned char* hdr = (const unsigned char*)eh_frame_hdr;
+    dwarf_reader_t r = {hdr, hdr + EH_FRAME_HDR_MAX_SIZE, true};
+
+    uint8_t version = dwarf_read_u8(&r);
+    uint8_t eh_frame_ptr_enc = dwarf_read_u8(&r);
+    uint8_t fde_count_enc = dwarf_read_u8(&r);
+    uint8_t table_enc = dwarf_read_u8(&r);
+    BW_UNUSED(read_encoded(&r, eh_frame_ptr_enc, eh_frame_hdr));
+    uintptr_t fde_count = read_encoded(&r, fde_count_enc, eh_frame_hdr);
+
+    // Without the sorted table .eh_frame would have to be walked up to its terminator
+    if (!r.ok || version != EH_FRAME_HDR_VERSION || fde_count_enc == DW_EH_PE_OMIT ||
+        table_enc != EH_FRAME_HDR_TABLE_ENC || fde_count == 0) {
+        return NULL;
+    }
+
+    cfi_builder_t builder = {0};
+    builder.base = base;
+
+    cfi_cie_t cie = {0};
+    const unsigned char* table = r.pos;
+    for (uintptr_t i = 0; i < fde_count && !builder.failed; ++i) {
+        int32_t entry[2];
+        memcpy(entry, table + (i * sizeof(entry)), sizeof(entry));
+        fde_compile(&builder, hdr + entry[1], &cie);
+    }
+
+    if (builder.failed || builder.len == 0) {
+        free(builder.rows);
+        return NULL;
+    }
+
+    qsort(builder.rows, builder.len, sizeof(*builder.rows), compare_rows);
+
+    cfi_table_t* cfi = calloc(1, sizeof(*cfi));
+    if (!cfi) {
+        free(builder.rows);
+        return NULL;
+    }
+
+    cfi_row_t* rows = realloc(builder.rows, builder.len * sizeof(*rows));
+    cfi->base = base;
+    cfi->rows = rows ? rows : builder.rows;
+    cfi->len = builder.len;
+
+    return cfi;
+}
+
+void cfi_table_destroy(cfi_table_t* table) {
+    if (!table) {
+        return;
+    }
+
+    free(table->rows);
+    free(table);
+}
+
+const cfi_row_t* cfi_table_lookup(const cfi_table_t* table, uintptr_t pc) {
+    if (!table || pc < table->base || pc - table->base > UINT32_MAX) {
+        return NULL;
+    }
+
+    // Find the last row starting at or before pc. The search is branchless: it runs on every step
+    // and its comparisons are unpredictable.
+    uint32_t offset = (uint32_t)(pc - table->base);
+    const cfi_row_t* row = table->rows;
+    size_t len = table->len;
+    while (len > 1) {
+        size_t half = len / 2;
+        row = row[half].pc <= offset ? row + half : row;
+        len -= half;
+    }
+
+    if (row->pc > offset || row->cfa_reg == CFI_REG_NONE) {
+        return NULL;
+    }
+
+    return row;
+}
+
+#else
+#error "unsupported platform: only x86_64 and aarch64 are supported"
+#endif
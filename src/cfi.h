@@ -0,0 +1,48 @@
+#ifndef BW_CFI_H
+#define BW_CFI_H
+
+#include <stddef.h>   // for size_t
+#include <stdint.h>   // for uintptr_t, uint32_t, int32_t, int16_t, uint8_t
+
+// Register that the canonical frame address (CFA) is computed from
+enum {
+    CFI_REG_NONE = 0, // End of a function, or rules that could not be compiled
+    CFI_REG_SP = 1,
+    CFI_REG_FP = 2,
+};
+
+enum {
+    CFI_RULE_SAME = 0,      // The register is unchanged in the caller
+    CFI_RULE_OFFSET = 1,    // The register is saved at an offset from the CFA
+    CFI_RULE_UNDEFINED = 2, // For the return address: the outermost frame
+};
+
+// How to recover the caller's frame anywhere from `pc` up to the next row. These are compiled from
+// the CFA programs in .eh_frame, so stepping through a frame never needs to interpret them.
+typedef struct {
+    uint32_t pc;        // Offset from the module's base address
+    int32_t cfa_offset; // Added to `cfa_reg` to get the CFA, the caller's stack pointer
+    int16_t ra_offset;  // Offset from the CFA of the saved return address
+    int16_t fp_offset;  // Offset from the CFA of the saved frame pointer
+    uint8_t cfa_reg;
+    uint8_t ra_rule;
+    uint8_t fp_rule;
+} cfi_row_t;
+
+typedef struct {
+    uintptr_t base;
+    cfi_row_t* rows;
+    size_t len;
+} cfi_table_t;
+
+// Compiles every FDE indexed by the loaded .eh_frame_hdr at the run-time address `eh_frame_hdr`
+// into a single table sorted by address. Returns NULL if the module has no usable CFI.
+cfi_table_t* cfi_table_build(uintptr_t base, uintptr_t eh_frame_hdr);
+
+void cfi_table_destroy(cfi_table_t* table);
+
+// Returns the row covering the run-time address `pc`, or NULL if it has no usable CFI. Only reads
+// the table, so it is async-signal-safe.
+const cfi_row_t* cfi_table_lookup(const cfi_table_t* table, uintptr_t pc);
+
+#endif // BW_CFI_H
@@ -0,0 +1,289 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include "backwalk/contention_profiler.h"
+
+#include <dlfcn.h>                 // for dlsym, RTLD_NEXT
+#include <errno.h>                 // for EBUSY, EINVAL
+#include <pthread.h>               // for pthread_mutex_t, pthread_rwlock_t, PTHREAD_MUTEX_INITI...
+#include <stdatomic.h>             // for atomic_load_explicit, atomic_fetch_add_explicit, memor...
+#include <stdbool.h>               // for bool, false, true
+#include <stddef.h>                // for size_t, NULL
+#include <stdint.h>                // for uintptr_t, uint64_t, uint32_t
+#include <stdlib.h>                // for calloc, free, malloc
+#include <string.h>                // for memcpy
+#include <time.h>                  // for clock_gettime, timespec, CLOCK_MONOTONIC
+
+#include "backwalk/backwalk.h"     // for bw_capture
+#include "backwalk/stack_table.h"  // for bw_stack_table_create, bw_stack_table_intern, bw_stac...
+#include "common.h"                // for BW_UNUSED
+
+typedef int (*contention_mutex_fn)(pthread_mutex_t* mutex);
+typedef int (*contention_rwlock_fn)(pthread_rwlock_t* rwlock);
+
+enum { CONTENTION_DEFAULT_THRESHOLD_NS = 100000 };
+enum { CONTENTION_DEFAULT_SAMPLE_PERIOD = 100 };
+enum { CONTENTION_DEFAULT_MAX_STACKS = 1 << 14 };
+// The frames of contention_record() and of the interposed function
+enum { CONTENTION_SKIP_FRAMES = 2 };
+
+#define NS_PER_SEC 1000000000ULL
+
+typedef struct {
+    uint32_t skipped; // Short waits since the last recorded one
+    bool busy;        // Locks taken while capturing a stack are not timed
+} contention_thread_t;
+
+static _Thread_local contention_thread_t contention_thread
+    __attribute__((tls_model("initial-exec")));
+
+typedef struct {
+    atomic_uint_fast64_t wait_ns;
+    atomic_uint_fast64_t waits;
+} contention_stack_t;
+
+typedef struct {
+    uint32_t id;
+    uint64_t wait_ns;
+    uint64_t waits;
+} contention_dump_entry_t;
+
+// The stack table and the per-stack counters are created once and never freed, so waits are
+// recorded with atomics only
+typedef struct {
+    pthread_mutex_t lock;
+    atomic_bool running;
+    _Atomic(uint64_t) threshold_ns;
+    _Atomic(uint32_t) sample_period;
+    bw_stack_table_t* stacks;
+    contention_stack_t* stack_stats;
+    atomic_uint_fast64_t contended;
+    atomic_uint_fast64_t wait_ns;
+    atomic_uint_fast64_t recorded;
+    atomic_uint_fast64_t dropped;
+} contention_profiler_t;
+
+static contention_profiler_t contention = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+// The blocking functions that the interposed ones forward to, looked up on first contention. The
+// trylock functions are not interposed and are called directly.
+static _Atomic(contention_mutex_fn) real_mutex_lock = NULL;
+static _Atomic(contention_rwlock_fn) real_rwlock_rdlock = NULL;
+static _Atomic(contention_rwlock_fn) real_rwlock_wrlock = NULL;
+
+// Looks up the next definition of `name` into the function pointer at `fn`. Racing lookups
+// store the same value.
+static void contention_resolve(const char* name, void* fn, size_t size) {
+    void* sym = dlsym(RTLD_NEXT, name);
+    // ISO C has no conversion from object to function pointers, POSIX guarantees the layout
+    memcpy(fn, &sym, size);
+}
+
+static int contention_mutex_lock(pthread_mutex_t* mutex) {
+    contention_mutex_fn fn = atomic_load_explicit(&real_mutex_lock, memory_order_relaxed);
+    if (!fn) {
+        contention_resolve("pthread_mutex_lock", &fn, sizeof(fn));
+        atomic_store_explicit(&real_mutex_lock, fn, memory_order_relaxed);
+    }
+
+    return fn ? fn(mutex) : EINVAL;
+}
+
+static int contention_rwlock_lock(_Atomic(contention_rwlock_fn)* real,
+                                  const char* name,
+                                  pthread_rwlock_t* rwlock) {
+    contention_rwlock_fn fn = atomic_load_explicit(real, memory_order_relaxed);
+    if (!fn) {
+        contention_resolve(name, &fn, sizeof(fn));
+        atomic_store_explicit(real, fn, memory_order_relaxed);
+    }
+
+    return fn ? fn(rwlock) : EINVAL;
+}
+
+static uint64_t contention_now_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        return 0;
+    }
+
+    return ((uint64_t)ts.tv_sec * NS_PER_SEC) + (uint64_t)ts.tv_nsec;
+}
+
+// Returns the start of a wait to time, or 0 if it is not profiled
+static inline uint64_t contention_start(void) {
+    if (!atomic_load_explicit(&contention.running, memory_order_acquire) ||
+        contention_thread.busy) {
+        return 0;
+    }
+
+    return contention_now_ns();
+}
+
+__attribute__((noinline)) static void contention_record(uint64_t start) {
+    uint64_t wait_ns = contention_now_ns() - start;
+    atomic_fetch_add_explicit(&contention.contended, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&contention.wait_ns, wait_ns, memory_order_relaxed);
+
+    // Short waits are sampled, each one recorded standing for the ones skipped before it
+    contention_thread_t* ct = &contention_thread;
+    uint64_t weight = 1;
+    if (wait_ns < atomic_load_explicit(&contention.threshold_ns, memory_order_relaxed)) {
+        uint32_t period = atomic_load_explicit(&contention.sample_period, memory_order_relaxed);
+        if (++ct->skipped < period) {
+            return;
+        }
+        ct->skipped = 0;
+        weight = period;
+    }
+
+    ct->busy = true;
+
+    uintptr_t ips[BW_CONTENTION_PROFILER_FRAMES_MAX];
+    size_t len = bw_capture(ips, BW_CONTENTION_PROFILER_FRAMES_MAX, CONTENTION_SKIP_FRAMES);
+    uint32_t id = bw_stack_table_intern(contention.stacks, ips, len);
+    if (id != BW_STACK_ID_INVALID) {
+        contention_stack_t* stack = &contention.stack_stats[id];
+        atomic_fetch_add_explicit(&stack->wait_ns, wait_ns * weight, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stack->waits, weight, memory_order_relaxed);
+        atomic_fetch_add_explicit(&contention.recorded, 1, memory_order_relaxed);
+    } else {
+        atomic_fetch_add_explicit(&contention.dropped, 1, memory_order_relaxed);
+    }
+
+    ct->busy = false;
+}
+
+// Uncontended acquisitions succeed in the trylock and return without further work. The slow path
+// is not a tail call, so that the interposed function keeps its frame for the captured stack.
+// NOLINTBEGIN(bugprone-reserved-identifier, readability-identifier-naming)
+
+int pthread_mutex_lock(pthread_mutex_t* mutex) {
+    int err = pthread_mutex_trylock(mutex);
+    if (__builtin_expect(err == EBUSY, 0)) {
+        uint64_t start = contention_start();
+        err = contention_mutex_lock(mutex);
+        if (start) {
+            contention_record(start);
+        }
+    }
+
+    return err;
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t* rwlock) {
+    int err = pthread_rwlock_tryrdlock(rwlock);
+    if (__builtin_expect(err == EBUSY, 0)) {
+        uint64_t start = contention_start();
+        err = contention_rwlock_lock(&real_rwlock_rdlock, "pthread_rwlock_rdlock", rwlock);
+        if (start) {
+            contention_record(start);
+        }
+    }
+
+    return err;
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t* rwlock) {
+    int err = pthread_rwlock_trywrlock(rwlock);
+    if (__builtin_expect(err == EBUSY, 0)) {
+        uint64_t start = contention_start();
+        err = contention_rwlock_lock(&real_rwlock_wrlock, "pthread_rwlock_wrlock", rwlock);
+        if (start) {
+            contention_record(start);
+        }
+    }
+
+    return err;
+}
+
+// NOLINTEND(bugprone-reserved-identifier, readability-identifier-naming)
+
+// Must be called with the lock held
+static bool contention_tables_init(const bw_contention_profiler_config_t* config) {
+    if (contention.stacks) {
+        return true;
+    }
+
+    size_t max_stacks = config->max_stacks ? config->max_stacks : CONTENTION_DEFAULT_MAX_STACKS;
+    contention.stack_stats = calloc(max_stacks + 1, sizeof(*contention.stack_stats));
+    contention.stacks = bw_stack_table_create(max_stacks);
+    if (!contention.stack_stats || !contention.stacks) {
+        free(contention.stack_stats);
+        bw_stack_table_destroy(contention.stacks);
+        contention.stack_stats = NULL;
+        contention.stacks = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+bool bw_contention_profiler_start(const bw_contention_profiler_config_t* config) {
+    if (!config || pthread_mutex_lock(&contention.lock) != 0) {
+        return false;
+    }
+
+    bool success = contention_tables_init(config);
+    if (success) {
+        uint64_t threshold_ns =
+            config->threshold_ns ? config->threshold_ns : CONTENTION_DEFAULT_THRESHOLD_NS;
+        uint32_t period =
+            config->sample_period ? config->sample_period : CONTENTION_DEFAULT_SAMPLE_PERIOD;
+        atomic_store_explicit(&contention.threshold_ns, threshold_ns, memory_order_relaxed);
+        atomic_store_explicit(&contention.sample_period, period, memory_order_relaxed);
+        // Publishes the tables to contention_start()
+        atomic_store_explicit(&contention.running, true, memory_order_release);
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&contention.lock));
+
+    return success;
+}
+
+void bw_contention_profiler_stop(void) {
+    atomic_store_explicit(&contention.running, false, memory_order_relaxed);
+}
+
+void bw_contention_profiler_dump(bw_contention_profiler_cb cb, void* arg) {
+    if (!cb || pthread_mutex_lock(&contention.lock) != 0) {
+        return;
+    }
+
+    // Counters are copied first, so that the callback can take locks
+    uint32_t limit = contention.stacks ? bw_stack_table_id_limit(contention.stacks) : 0;
+    contention_dump_entry_t* entries = limit > 0 ? malloc(limit * sizeof(*entries)) : NULL;
+    size_t len = 0;
+    for (uint32_t id = 1; entries && id < limit; ++id) {
+        const contention_stack_t* stack = &contention.stack_stats[id];
+        uint64_t waits = atomic_load_explicit(&stack->waits, memory_order_relaxed);
+        if (waits > 0) {
+            entries[len].id = id;
+            entries[len].wait_ns = atomic_load_explicit(&stack->wait_ns, memory_order_relaxed);
+            entries[len].waits = waits;
+            len++;
+        }
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&contention.lock));
+
+    for (size_t i = 0; i < len; ++i) {
+        const uintptr_t* ips = NULL;
+        size_t ips_len = bw_stack_table_get(contention.stacks, entries[i].id, &ips);
+        cb(ips, ips_len, entries[i].wait_ns, entries[i].waits, arg);
+    }
+
+    free(entries);
+}
+
+void bw_contention_profiler_get_stats(bw_contention_profiler_stats_t* stats) {
+    if (!stats) {
+        return;
+    }
+
+    stats->contended = atomic_load_explicit(&contention.contended, memory_order_relaxed);
+    stats->wait_ns = atomic_load_explicit(&contention.wait_ns, memory_order_relaxed);
+    stats->recorded = atomic_load_explicit(&contention.recorded, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&contention.dropped, memory_order_relaxed);
+}
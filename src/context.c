@@ -1,44 +1,126 @@
 #if defined(__x86_64__) || defined(__aarch64__)
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
 #include "context.h"
 
 #include <stdbool.h>  // for false, bool, true
-#include <stdint.h>   // for uintptr_t
+#include <stdint.h>   // for uintptr_t, intptr_t, int16_t, UINTMAX_C
+#include <ucontext.h> // for ucontext_t, REG_RBP, REG_RIP, REG_RSP
 
-#define MIN_MMAP_ADDR (64 << 10) // Default on Linux 6.14 x86_64 - Ubuntu 24.04
+#include "cfi.h"      // for cfi_row_t, CFI_REG_SP, CFI_RULE_OFFSET, CFI_RULE_SAME, CFI_R...
 
-bool context_step(context_t* ctx) {
-    if (!ctx) {
-        return false;
-    }
+#if defined(__aarch64__)
+enum {
+    AARCH64_REG_FP = 29,
+    AARCH64_REG_LR = 30,
+};
+
+// Mask of the virtual address bits, which drops pointer authentication codes from return addresses
+#define VA_MASK ((UINTMAX_C(1) << 48) - 1)
+#endif
+
+static bool word_in_range(uintptr_t lo, uintptr_t hi, uintptr_t addr) {
+    return addr >= lo && addr < hi && hi - addr >= sizeof(uintptr_t);
+}
+
+void context_init_ucontext(context_t* ctx, const ucontext_t* uc) {
+#if defined(__x86_64__)
+    ctx->data[CONTEXT_FP] = (uintptr_t)uc->uc_mcontext.gregs[REG_RBP];
+    ctx->data[CONTEXT_IP] = (uintptr_t)uc->uc_mcontext.gregs[REG_RIP];
+    ctx->data[CONTEXT_SP] = (uintptr_t)uc->uc_mcontext.gregs[REG_RSP];
+    ctx->data[CONTEXT_LR] = 0;
+#else
+    ctx->data[CONTEXT_FP] = (uintptr_t)uc->uc_mcontext.regs[AARCH64_REG_FP];
+    ctx->data[CONTEXT_IP] = (uintptr_t)uc->uc_mcontext.pc;
+    ctx->data[CONTEXT_SP] = (uintptr_t)uc->uc_mcontext.sp;
+    // Holds the return address until the interrupted function saves it, CFI tells which applies
+    ctx->data[CONTEXT_LR] = (uintptr_t)uc->uc_mcontext.regs[AARCH64_REG_LR];
+#endif
+}
 
-    if (ctx->data[0] < MIN_MMAP_ADDR) {
+// Whether a saved register can be read at `addr`, in a frame at or above `sp`
+static bool context_readable(const context_t* ctx, uintptr_t sp, uintptr_t addr) {
+    if (addr & (sizeof(uintptr_t) - 1)) {
         return false;
     }
 
-    // Check pointer alignment
-    if (ctx->data[0] & (sizeof(uintptr_t) - 1)) {
-        return false;
+    if (ctx->data[CONTEXT_STACK_HI] == 0) {
+        return addr >= sp;
     }
 
-    // NOLINTNEXTLINE(performance-no-int-to-ptr)
-    uintptr_t* base = (uintptr_t*)ctx->data[0];
+    return word_in_range(ctx->data[CONTEXT_STACK_LO], ctx->data[CONTEXT_STACK_HI], addr) ||
+           word_in_range(ctx->data[CONTEXT_ALT_LO], ctx->data[CONTEXT_ALT_HI], addr);
+}
 
-    if (*base == ctx->data[0]) {
+static bool context_read(const context_t* ctx,
+                         uintptr_t sp,
+                         uintptr_t cfa,
+                         int16_t offset,
+                         uintptr_t* val) {
+    uintptr_t addr = cfa + (uintptr_t)(intptr_t)offset;
+    if (!context_readable(ctx, sp, addr)) {
         return false;
     }
 
-    ctx->data[0] = *base;
-    ctx->data[1] = *(base + 1);
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    *val = *(const uintptr_t*)addr;
 
     return true;
 }
 
-uintptr_t context_get_ip(const context_t* ctx) {
+bool context_step_cfi(context_t* ctx, const cfi_row_t* row) {
     if (!ctx) {
-        return 0;
+        return false;
+    }
+
+    uintptr_t sp = ctx->data[CONTEXT_SP];
+    uintptr_t fp = ctx->data[CONTEXT_FP];
+    if (!row || (row->cfa_reg == CFI_REG_SP && sp == 0)) {
+        return context_step(ctx);
     }
 
-    return ctx->data[1];
+    if (row->ra_rule == CFI_RULE_UNDEFINED) {
+        return false;
+    }
+
+    uintptr_t cfa = (row->cfa_reg == CFI_REG_SP ? sp : fp) + (uintptr_t)(intptr_t)row->cfa_offset;
+    if (cfa < CONTEXT_MIN_MMAP_ADDR || (cfa & (sizeof(uintptr_t) - 1))) {
+        return false;
+    }
+
+    // The caller's frame must be above this one, as in context_step(). Only a leaf function that
+    // keeps its return address in a register can share the stack pointer with its caller.
+    bool leaves_alt = word_in_range(ctx->data[CONTEXT_ALT_LO], ctx->data[CONTEXT_ALT_HI], sp) &&
+                      !word_in_range(ctx->data[CONTEXT_ALT_LO], ctx->data[CONTEXT_ALT_HI], cfa);
+    if (!leaves_alt && (cfa < sp || (cfa == sp && row->ra_rule != CFI_RULE_SAME))) {
+        return false;
+    }
+    uintptr_t lo = leaves_alt ? 0 : sp;
+
+    uintptr_t ip = ctx->data[CONTEXT_LR];
+    if (row->ra_rule == CFI_RULE_OFFSET && !context_read(ctx, lo, cfa, row->ra_offset, &ip)) {
+        return false;
+    }
+
+    uintptr_t next_fp = fp;
+    if (row->fp_rule == CFI_RULE_OFFSET &&
+        !context_read(ctx, lo, cfa, row->fp_offset, &next_fp)) {
+        return false;
+    }
+
+#if defined(__aarch64__)
+    ip &= VA_MASK;
+#endif
+    if (ip == 0) {
+        return false;
+    }
+
+    ctx->data[CONTEXT_FP] = next_fp;
+    ctx->data[CONTEXT_IP] = ip;
+    ctx->data[CONTEXT_SP] = cfa;
+    ctx->data[CONTEXT_LR] = 0;
+
+    return true;
 }
 
 #else
@@ -1,19 +1,137 @@
 #ifndef BW_CONTEXT_H
 #define BW_CONTEXT_H
 
-#include <stdbool.h>  // for bool
+#include <stdbool.h>  // for bool, false, true
+#include <stddef.h>   // for NULL
 #include <stdint.h>   // for uintptr_t
+#include <ucontext.h> // for ucontext_t
 
-enum { CONTEXT_DATA_LEN = 8 };
+#include "cfi.h"      // for cfi_row_t
+#include "stack.h"    // for stack_bounds_t
+
+enum {
+    CONTEXT_FP = 0,
+    CONTEXT_IP = 1,
+    CONTEXT_STACK_LO = 2,
+    CONTEXT_STACK_HI = 3,
+    CONTEXT_ALT_LO = 4,
+    CONTEXT_ALT_HI = 5,
+    CONTEXT_SP = 6,
+    CONTEXT_LR = 7,
+    CONTEXT_DATA_LEN = 8,
+};
+
+#define CONTEXT_MIN_MMAP_ADDR (64 << 10) // Default on Linux 6.14 x86_64 - Ubuntu 24.04
+
+// A frame record holds the caller's frame pointer followed by the return address
+#define CONTEXT_FRAME_RECORD_SIZE (2 * sizeof(uintptr_t))
 
 typedef struct {
     uintptr_t data[CONTEXT_DATA_LEN];
 } context_t;
 
+// The frame pointer walk is inlined into the capture loops: shallow captures are dominated by the
+// cost of calls, and inlining lets the compiler keep the context in registers.
+
 void context_init(context_t* ctx);
 
-bool context_step(context_t* ctx);
+// Starts a frame pointer walk at the frame of the function it is inlined into, like context_init()
+// does for its caller, without the call. Only the frame pointer is set, which is all
+// context_step() reads; walks that step with context_step_cfi() must start with context_init().
+__attribute__((always_inline)) static inline void context_init_fp(context_t* ctx) {
+    ctx->data[CONTEXT_FP] = (uintptr_t)__builtin_frame_address(0);
+    ctx->data[CONTEXT_IP] = 0;
+    ctx->data[CONTEXT_SP] = 0;
+    ctx->data[CONTEXT_LR] = 0;
+}
+
+// Starts the walk at the interrupted instruction of a signal handler's context. Unlike with
+// context_init(), the current IP is not a return address.
+void context_init_ucontext(context_t* ctx, const ucontext_t* uc);
+
+static inline bool context_in_range(uintptr_t lo, uintptr_t hi, uintptr_t fp) {
+    return fp >= lo && fp < hi && hi - fp >= CONTEXT_FRAME_RECORD_SIZE;
+}
+
+// Restricts the walk to the given stack ranges, which must be set after the starting registers.
+// With NULL bounds, frames are only checked for alignment and direction. So are walks that start
+// on neither stack, like on a makecontext() stack, a fiber or a coroutine.
+static inline void context_set_bounds(context_t* ctx, const stack_bounds_t* bounds) {
+    uintptr_t start = ctx->data[CONTEXT_SP] ? ctx->data[CONTEXT_SP] : ctx->data[CONTEXT_FP];
+    if (bounds && !context_in_range(bounds->stack.lo, bounds->stack.hi, start) &&
+        !context_in_range(bounds->alt.lo, bounds->alt.hi, start)) {
+        bounds = NULL;
+    }
+
+    ctx->data[CONTEXT_STACK_LO] = bounds ? bounds->stack.lo : 0;
+    ctx->data[CONTEXT_STACK_HI] = bounds ? bounds->stack.hi : 0;
+    ctx->data[CONTEXT_ALT_LO] = bounds ? bounds->alt.lo : 0;
+    ctx->data[CONTEXT_ALT_HI] = bounds ? bounds->alt.hi : 0;
+}
+
+// Steps to the caller's frame by following the frame pointer chain
+static inline bool context_step(context_t* ctx) {
+    if (!ctx) {
+        return false;
+    }
+
+    uintptr_t fp = ctx->data[CONTEXT_FP];
+
+    // Check the address and pointer alignment
+    if (fp < CONTEXT_MIN_MMAP_ADDR || (fp & (sizeof(uintptr_t) - 1))) {
+        return false;
+    }
+
+    // Almost every frame is on the thread's own stack, and a single unsigned comparison checks both
+    // of its bounds; without bounds, it passes. Only frames outside it are looked for on the
+    // alternate signal stack.
+    uintptr_t lo = ctx->data[CONTEXT_STACK_LO];
+    bool on_alt = false;
+    if (fp - lo > ctx->data[CONTEXT_STACK_HI] - lo - CONTEXT_FRAME_RECORD_SIZE) {
+        on_alt = context_in_range(ctx->data[CONTEXT_ALT_LO], ctx->data[CONTEXT_ALT_HI], fp);
+        if (!on_alt) {
+            return false;
+        }
+    }
+
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    uintptr_t* base = (uintptr_t*)fp;
+    uintptr_t next = *base;
+
+    if (next == fp) {
+        return false;
+    }
+
+    // The stack grows down, so the caller's frame must be at a higher address. A chain that moves
+    // the other way is corrupt or has ended: report this frame and stop at the next step. This also
+    // breaks cycles, which bounds the number of reads. The one exception is the jump from the
+    // alternate signal stack back to the interrupted thread's stack.
+    bool leaves_alt =
+        on_alt && !context_in_range(ctx->data[CONTEXT_ALT_LO], ctx->data[CONTEXT_ALT_HI], next);
+    ctx->data[CONTEXT_FP] = next > fp || leaves_alt ? next : 0;
+    ctx->data[CONTEXT_IP] = *(base + 1);
+#if defined(__x86_64__)
+    // The frame record sits right below the caller's stack pointer
+    ctx->data[CONTEXT_SP] = fp + CONTEXT_FRAME_RECORD_SIZE;
+#else
+    // The frame record can be anywhere in the frame, the caller's stack pointer is unknown
+    ctx->data[CONTEXT_SP] = 0;
+#endif
+    ctx->data[CONTEXT_LR] = 0;
+
+    return true;
+}
+
+// Steps to the caller's frame using the CFI row that covers the current frame, or by following the
+// frame pointer chain if there is none. A return address with an undefined rule ends the walk.
+bool context_step_cfi(context_t* ctx, const cfi_row_t* row);
+
+static inline uintptr_t context_get_ip(const context_t* ctx) {
+    if (!ctx) {
+        return 0;
+    }
 
-uintptr_t context_get_ip(const context_t* ctx);
+    return ctx->data[CONTEXT_IP];
+}
 
 #endif // BW_CONTEXT_H
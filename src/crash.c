@@ -0,0 +1,430 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include "backwalk/crash.h"
+
+#include <errno.h>              // for errno, EINTR
+#include <fcntl.h>              // for open, O_CLOEXEC, O_CREAT, O_RDWR, O_TRUNC
+#include <pthread.h>            // for pthread_mutex_lock, pthread_mutex_unlock, pthread_key_...
+#include <signal.h>             // for sigaction, sigaltstack, siginfo_t, stack_t, SA_ONSTACK
+#include <stdatomic.h>          // for atomic_compare_exchange_strong, atomic_load, atomic_store
+#include <stdbool.h>            // for bool, false, true
+#include <stddef.h>             // for size_t, NULL
+#include <stdint.h>             // for uintptr_t
+#include <stdlib.h>             // for free, malloc
+#include <sys/mman.h>           // for mmap, munmap, MAP_ANONYMOUS, MAP_FAILED, MAP_PRIVATE
+#include <sys/stat.h>           // for S_IRGRP, S_IROTH, S_IRUSR, S_IWUSR
+#include <sys/types.h>          // for off_t, ssize_t
+#include <time.h>               // for nanosleep, timespec
+#include <ucontext.h>           // for ucontext_t
+#include <unistd.h>             // for close, ftruncate, gettid, write
+
+#include "backwalk/backwalk.h"  // for bw_backtrace_from_ucontext, bw_frame_t, bw_signal_safe...
+#include "common.h"             // for BW_UNUSED, BW_ARRAY_LEN
+#include "module.h"             // for module_map_get, module_map_t, module_t
+#include "stack.h"              // for stack_bounds_init
+
+enum { CRASH_DEFAULT_BUFFER_SIZE = 64 << 10 };
+enum { CRASH_DEFAULT_ALT_STACK_SIZE = 64 << 10 };
+enum { CRASH_WAIT_INTERVAL_NS = 1000000 };
+enum { CRASH_FILE_MODE = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH };
+
+#define HEX_BASE 16
+#define DEC_BASE 10
+
+static const int k_crash_signals[] = {SIGSEGV, SIGBUS, SIGABRT, SIGFPE};
+static const char* const k_crash_signal_names[] = {"SIGSEGV", "SIGBUS", "SIGABRT", "SIGFPE"};
+
+enum { CRASH_SIGNALS = BW_ARRAY_LEN(k_crash_signals) };
+
+// A report is formatted in place: in the mapped file itself, or in an anonymous mapping that is
+// written to the descriptor section by section, so that a fault while walking still leaves the
+// parts written before it.
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+    size_t flushed;
+} crash_out_t;
+
+typedef struct {
+    void* sp;
+    size_t size;
+} crash_alt_stack_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    bool installed;
+    bw_crash_config_t config;
+    int fd;
+    bool mapped_file;
+    char* buffer;
+    struct sigaction old_actions[CRASH_SIGNALS];
+    pthread_key_t key;
+    bool key_created;
+    // Only written by the thread that claimed `reporter`
+    bw_frame_t frames[BW_CRASH_FRAMES_MAX];
+    atomic_int reporter; // Thread ID of the thread writing the report, 0 if there is none
+    atomic_bool reported;
+} crash_t;
+
+static crash_t crash = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .fd = -1,
+};
+
+static void out_str(crash_out_t* out, const char* str) {
+    while (*str && out->len < out->cap) {
+        out->data[out->len++] = *str++;
+    }
+}
+
+static void out_num(crash_out_t* out, uintptr_t value, unsigned base) {
+    static const char k_digits[] = "0123456789abcdef";
+
+    char digits[sizeof(value) * 2 + 1];
+    size_t len = sizeof(digits) - 1;
+    digits[len] = '\0';
+    do {
+        digits[--len] = k_digits[value % base];
+        value /= base;
+    } while (value > 0);
+
+    out_str(out, &digits[len]);
+}
+
+static void out_dec(crash_out_t* out, long value) {
+    if (value < 0) {
+        out_str(out, "-");
+        out_num(out, -(uintptr_t)value, DEC_BASE);
+        return;
+    }
+
+    out_num(out, (uintptr_t)value, DEC_BASE);
+}
+
+static void out_hex(crash_out_t* out, uintptr_t value) {
+    out_str(out, "0x");
+    out_num(out, value, HEX_BASE);
+}
+
+static void out_flush(crash_out_t* out) {
+    if (crash.mapped_file) {
+        return;
+    }
+
+    while (out->flushed < out->len) {
+        ssize_t written = write(crash.fd, out->data + out->flushed, out->len - out->flushed);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return;
+        }
+        out->flushed += (size_t)written;
+    }
+}
+
+static const char* crash_signal_name(int sig) {
+    for (size_t i = 0; i < CRASH_SIGNALS; ++i) {
+        if (k_crash_signals[i] == sig) {
+            return k_crash_signal_names[i];
+        }
+    }
+
+    return "?";
+}
+
+static void crash_write_modules(crash_out_t* out) {
+    const module_map_t* map = module_map_get();
+    for (size_t i = 0; map && i < map->len; ++i) {
+        const module_t* mod = map->mods[i];
+        out_hex(out, mod->base);
+        out_str(out, "-");
+        out_hex(out, mod->end);
+        out_str(out, " ");
+        for (size_t j = 0; j < mod->build_id_len; ++j) {
+            // Leading zeros matter in build IDs
+            if (mod->build_id[j] < HEX_BASE) {
+                out_str(out, "0");
+            }
+            out_num(out, mod->build_id[j], HEX_BASE);
+        }
+        out_str(out, mod->build_id_len > 0 ? " " : "- ");
+        out_str(out, mod->path);
+        out_str(out, "\n");
+    }
+}
+
+// Async-signal-safe. The cost is bounded by BW_CRASH_FRAMES_MAX, the number of loaded modules and
+// the buffer size, whatever the state of the stack.
+static void crash_report(int sig, const siginfo_t* info, const ucontext_t* uc) {
+    crash_out_t out = {crash.buffer, 0, crash.config.buffer_size, 0};
+
+    out_str(&out, "*** backwalk crash report ***\nsignal ");
+    out_dec(&out, sig);
+    out_str(&out, " (");
+    out_str(&out, crash_signal_name(sig));
+    out_str(&out, "), code ");
+    out_dec(&out, info->si_code);
+    out_str(&out, ", address ");
+    out_hex(&out, (uintptr_t)info->si_addr);
+    out_str(&out, "\nthread ");
+    out_dec(&out, gettid());
+    out_str(&out, "\n\nstack:\n");
+    out_flush(&out);
+
+    size_t len = bw_backtrace_from_ucontext(uc, crash.frames, BW_CRASH_FRAMES_MAX);
+    for (size_t i = 0; i < len; ++i) {
+        const bw_frame_t* frame = &crash.frames[i];
+        out_str(&out, "#");
+        out_dec(&out, (long)i);
+        out_str(&out, " ");
+        out_hex(&out, frame->ip);
+        out_str(&out, " ");
+        out_str(&out, frame->fname);
+        out_str(&out, "+");
+        out_hex(&out, frame->addr);
+        out_str(&out, "\n");
+    }
+    out_flush(&out);
+
+    out_str(&out, "\nmodules:\n");
+    crash_write_modules(&out);
+    out_flush(&out);
+
+    // The file was sized for the longest report up front, so that writing never faults
+    if (crash.mapped_file) {
+        BW_UNUSED(ftruncate(crash.fd, (off_t)out.len));
+    }
+}
+
+static void crash_restore_handlers(void) {
+    for (size_t i = 0; i < CRASH_SIGNALS; ++i) {
+        BW_UNUSED(sigaction(k_crash_signals[i], &crash.old_actions[i], NULL));
+    }
+}
+
+static void crash_handler(int sig, siginfo_t* info, void* ucontext) {
+    int tid = gettid();
+    int reporter = 0;
+    if (atomic_compare_exchange_strong(&crash.reporter, &reporter, tid)) {
+        crash_report(sig, info, ucontext);
+        atomic_store(&crash.reported, true);
+    } else if (reporter != tid) {
+        // Another thread is reporting its crash. A fault in the report itself falls through.
+        struct timespec interval = {0, CRASH_WAIT_INTERVAL_NS};
+        while (!atomic_load(&crash.reported)) {
+            BW_UNUSED(nanosleep(&interval, NULL));
+        }
+    }
+
+    // Faults happen again when the handler returns, now with the previous handler. Signals that
+    // were sent, like the one raised by abort(), have to be sent again.
+    crash_restore_handlers();
+    if (info->si_code <= 0) {
+        BW_UNUSED(raise(sig));
+    }
+}
+
+static void crash_alt_stack_release(void* arg) {
+    crash_alt_stack_t* alt = arg;
+
+    stack_t ss;
+    if (sigaltstack(NULL, &ss) == 0 && ss.ss_sp == alt->sp) {
+        stack_t disable = {.ss_flags = SS_DISABLE};
+        BW_UNUSED(sigaltstack(&disable, NULL));
+    }
+
+    BW_UNUSED(munmap(alt->sp, alt->size));
+    free(alt);
+}
+
+// Must be called with the lock held
+static bool crash_key_init(void) {
+    if (!crash.key_created) {
+        crash.key_created = pthread_key_create(&crash.key, crash_alt_stack_release) == 0;
+    }
+
+    return crash.key_created;
+}
+
+// Must be called with the lock held
+static bool crash_alt_stack_init(void) {
+    // Threads that already have a signal stack keep it
+    stack_t ss;
+    if (pthread_getspecific(crash.key) ||
+        (sigaltstack(NULL, &ss) == 0 && !(ss.ss_flags & SS_DISABLE))) {
+        return true;
+    }
+
+    crash_alt_stack_t* alt = malloc(sizeof(*alt));
+    if (!alt) {
+        return false;
+    }
+
+    alt->size = crash.config.alt_stack_size ? crash.config.alt_stack_size
+                                            : CRASH_DEFAULT_ALT_STACK_SIZE;
+    alt->sp = mmap(NULL, alt->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK,
+                   -1, 0);
+    if (alt->sp == MAP_FAILED) {
+        free(alt);
+        return false;
+    }
+
+    stack_t alt_ss = {.ss_sp = alt->sp, .ss_size = alt->size};
+    if (sigaltstack(&alt_ss, NULL) != 0 || pthread_setspecific(crash.key, alt) != 0) {
+        crash_alt_stack_release(alt);
+        return false;
+    }
+
+    return true;
+}
+
+static void crash_apply_defaults(bw_crash_config_t* config) {
+    if (config->buffer_size == 0) {
+        config->buffer_size = CRASH_DEFAULT_BUFFER_SIZE;
+    }
+    if (config->alt_stack_size == 0) {
+        config->alt_stack_size = CRASH_DEFAULT_ALT_STACK_SIZE;
+    }
+}
+
+// Must be called with the lock held
+static bool crash_open_output(void) {
+    size_t size = crash.config.buffer_size;
+
+    crash.mapped_file = crash.config.path != NULL;
+    if (!crash.mapped_file) {
+        crash.fd = crash.config.fd;
+        void* buffer =
+            mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        crash.buffer = buffer != MAP_FAILED ? buffer : NULL;
+        return crash.buffer != NULL;
+    }
+
+    crash.fd = open(crash.config.path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, CRASH_FILE_MODE);
+    if (crash.fd < 0) {
+        return false;
+    }
+
+    void* buffer = MAP_FAILED;
+    if (ftruncate(crash.fd, (off_t)size) == 0) {
+        buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, crash.fd, 0);
+    }
+    if (buffer == MAP_FAILED) {
+        BW_UNUSED(close(crash.fd));
+        crash.fd = -1;
+        return false;
+    }
+    crash.buffer = buffer;
+
+    return true;
+}
+
+// Must be called with the lock held
+static void crash_close_output(void) {
+    if (crash.buffer) {
+        BW_UNUSED(munmap(crash.buffer, crash.config.buffer_size));
+        crash.buffer = NULL;
+    }
+
+    // Without a crash, the file is left empty
+    if (crash.mapped_file && crash.fd >= 0) {
+        if (!atomic_load(&crash.reported)) {
+            BW_UNUSED(ftruncate(crash.fd, 0));
+        }
+        BW_UNUSED(close(crash.fd));
+    }
+    crash.fd = -1;
+}
+
+bool bw_crash_install(const bw_crash_config_t* config) {
+    if (!config || (!config->path && config->fd < 0)) {
+        return false;
+    }
+
+    if (pthread_mutex_lock(&crash.lock) != 0) {
+        return false;
+    }
+
+    bool success = !crash.installed && crash_key_init();
+    if (success) {
+        crash.config = *config;
+        crash_apply_defaults(&crash.config);
+        atomic_store(&crash.reporter, 0);
+        atomic_store(&crash.reported, false);
+        // Builds the module map and CFI tables that the handler reads, and the stack bounds,
+        // before any handler can run
+        success = crash_open_output() && crash_alt_stack_init() && bw_signal_safe_init();
+    }
+
+    struct sigaction action = {0};
+    action.sa_sigaction = crash_handler;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    BW_UNUSED(sigemptyset(&action.sa_mask));
+
+    size_t installed = 0;
+    while (success && installed < CRASH_SIGNALS) {
+        success = sigaction(k_crash_signals[installed], &action, &crash.old_actions[installed]) == 0;
+        installed += success ? 1 : 0;
+    }
+
+    if (!success) {
+        while (installed > 0) {
+            --installed;
+            BW_UNUSED(sigaction(k_crash_signals[installed], &crash.old_actions[installed], NULL));
+        }
+        if (!crash.installed) {
+            crash_close_output();
+        }
+    } else {
+        crash.installed = true;
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&crash.lock));
+
+    return success;
+}
+
+void bw_crash_uninstall(void) {
+    if (pthread_mutex_lock(&crash.lock) != 0) {
+        return;
+    }
+
+    if (crash.installed) {
+        crash_restore_handlers();
+        crash_close_output();
+        crash.installed = false;
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&crash.lock));
+}
+
+// A report file of a process that exits without crashing is left empty rather than zero-filled.
+// The handlers are removed with it, since they would write past the end of the truncated file.
+__attribute__((destructor)) static void crash_exit(void) {
+    if (pthread_mutex_lock(&crash.lock) != 0) {
+        return;
+    }
+
+    if (crash.installed && crash.mapped_file) {
+        crash_restore_handlers();
+        crash_close_output();
+        crash.installed = false;
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&crash.lock));
+}
+
+bool bw_crash_register_thread(void) {
+    if (pthread_mutex_lock(&crash.lock) != 0) {
+        return false;
+    }
+
+    bool success = crash_key_init() && crash_alt_stack_init();
+
+    BW_UNUSED(pthread_mutex_unlock(&crash.lock));
+
+    // The walk can only cross from the signal stack back to the thread's stack if it knows both
+    return stack_bounds_init(true) && success;
+}
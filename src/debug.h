@@ -7,6 +7,11 @@
 #define BW_DEBUG_ENABLED 0
 #endif // BW_DEBUG_ENABLED
 
+// Demangling hooks a program may define. When it does, they demangle names instead of the C++
+// runtime, both for debug output and for the cache behind bw_set_demangle() and bw_demangle().
+__attribute__((weak)) char* bw_dbg_demangle(const char* sname);
+__attribute__((weak)) void bw_dbg_demangle_free(const char* sname);
+
 void print_frame(uintptr_t addr, const char* fname, const char* sname);
 
 #if BW_DEBUG_ENABLED
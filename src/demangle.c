@@ -0,0 +1,173 @@
+#include "demangle.h"
+
+#include <pthread.h>    // for pthread_mutex_lock, pthread_mutex_unlock, PTHREAD_MUTEX_INITIA...
+#include <stdatomic.h>  // for atomic_load_explicit, atomic_store_explicit, memory_order_...
+#include <stddef.h>     // for size_t, NULL
+#include <stdint.h>     // for uint64_t, uintptr_t
+#include <stdlib.h>     // for calloc
+#include <string.h>     // for memcpy, strlen
+
+#include "arena.h"      // for arena_alloc, arena_t
+#include "common.h"     // for BW_UNUSED
+#include "debug.h"      // for bw_dbg_demangle, bw_dbg_demangle_free
+
+enum { DEMANGLE_ARENA_CHUNK_SIZE = 64 << 10 };
+enum { DEMANGLE_INITIAL_SLOTS = 1024 };
+
+#define HASH_MULTIPLIER 0x9e3779b97f4a7c15ULL
+#define HASH_SHIFT 32
+
+// Provided by the C++ runtime when the program links it, C programs have no mangled names
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+extern char* __cxa_demangle(const char* mangled, char* buf, size_t* len, int* status)
+    __attribute__((weak));
+
+typedef struct {
+    _Atomic(const char*) key;
+    const char* name;
+} demangle_slot_t;
+
+// Open addressing table keyed by the address of the mangled name, kept at most half full. Slots
+// are only written under the lock and published by their key, so lookups take no lock.
+typedef struct {
+    size_t mask;
+    size_t len;
+    demangle_slot_t slots[];
+} demangle_table_t;
+
+// Like module map snapshots, a table is never freed once it has been grown: readers may still be
+// probing it.
+static _Atomic(demangle_table_t*) demangle_current = NULL;
+static pthread_mutex_t demangle_lock = PTHREAD_MUTEX_INITIALIZER;
+static arena_t demangle_arena = {NULL, DEMANGLE_ARENA_CHUNK_SIZE};
+
+// Scratch buffer for __cxa_demangle, which reallocates it as needed. Only used under the lock.
+static char* demangle_buf = NULL;
+static size_t demangle_buf_len = 0;
+
+static size_t demangle_hash(const char* sname) {
+    uint64_t hash = (uintptr_t)sname * HASH_MULTIPLIER;
+
+    return (size_t)(hash ^ (hash >> HASH_SHIFT));
+}
+
+static const char* table_find(const demangle_table_t* table, const char* sname) {
+    if (!table) {
+        return NULL;
+    }
+
+    for (size_t i = demangle_hash(sname);; ++i) {
+        const demangle_slot_t* slot = &table->slots[i & table->mask];
+        const char* key = atomic_load_explicit(&slot->key, memory_order_acquire);
+        if (key == sname) {
+            return slot->name;
+        }
+        if (!key) {
+            return NULL;
+        }
+    }
+}
+
+static void table_insert(demangle_table_t* table, const char* sname, const char* name) {
+    for (size_t i = demangle_hash(sname);; ++i) {
+        demangle_slot_t* slot = &table->slots[i & table->mask];
+        if (!atomic_load_explicit(&slot->key, memory_order_relaxed)) {
+            slot->name = name;
+            atomic_store_explicit(&slot->key, sname, memory_order_release);
+            table->len++;
+            return;
+        }
+    }
+}
+
+// Returns a table with room for one more entry, publishing a larger copy if `table` is full
+static demangle_table_t* table_reserve(demangle_table_t* table) {
+    if (table && (table->len + 1) * 2 <= table->mask + 1) {
+        return table;
+    }
+
+    size_t slots = table ? (table->mask + 1) * 2 : DEMANGLE_INITIAL_SLOTS;
+    demangle_table_t* grown = calloc(1, sizeof(*grown) + (slots * sizeof(grown->slots[0])));
+    if (!grown) {
+        return NULL;
+    }
+
+    grown->mask = slots - 1;
+    for (size_t i = 0; table && i <= table->mask; ++i) {
+        const char* key = atomic_load_explicit(&table->slots[i].key, memory_order_relaxed);
+        if (key) {
+            table_insert(grown, key, table->slots[i].name);
+        }
+    }
+    atomic_store_explicit(&demangle_current, grown, memory_order_release);
+
+    return grown;
+}
+
+// Demangles with the program's bw_dbg_demangle hook if it has one, or else with the C++ runtime
+// into the scratch buffer. Returns NULL if `sname` could not be demangled.
+static char* demangle_run(const char* sname) {
+    if (bw_dbg_demangle) {
+        return bw_dbg_demangle(sname);
+    }
+
+    int status = -1;
+    char* buf = __cxa_demangle(sname, demangle_buf, &demangle_buf_len, &status);
+    if (status != 0 || !buf) {
+        return NULL;
+    }
+    demangle_buf = buf;
+
+    return buf;
+}
+
+// Demangles `sname` and copies the result into the arena
+static const char* demangle_copy(const char* sname) {
+    char* buf = demangle_run(sname);
+    if (!buf) {
+        return sname;
+    }
+
+    size_t len = strlen(buf) + 1;
+    char* name = arena_alloc(&demangle_arena, len);
+    if (name) {
+        memcpy(name, buf, len);
+    }
+    if (bw_dbg_demangle && bw_dbg_demangle_free) {
+        bw_dbg_demangle_free(buf);
+    }
+
+    return name ? name : sname;
+}
+
+const char* demangle_name(const char* sname) {
+    // Every mangled name starts with _Z, anything else is returned without a lookup
+    if (!sname || sname[0] != '_' || sname[1] != 'Z' || (!__cxa_demangle && !bw_dbg_demangle)) {
+        return sname;
+    }
+
+    const char* name =
+        table_find(atomic_load_explicit(&demangle_current, memory_order_acquire), sname);
+    if (name) {
+        return name;
+    }
+
+    if (pthread_mutex_lock(&demangle_lock) != 0) {
+        return sname;
+    }
+
+    // Names that fail to demangle are cached as themselves, so they are not retried either
+    demangle_table_t* table = atomic_load_explicit(&demangle_current, memory_order_relaxed);
+    name = table_find(table, sname);
+    if (!name) {
+        name = demangle_copy(sname);
+        table = table_reserve(table);
+        if (table) {
+            table_insert(table, sname, name);
+        }
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&demangle_lock));
+
+    return name;
+}
@@ -0,0 +1,10 @@
+#ifndef BW_DEMANGLE_H
+#define BW_DEMANGLE_H
+
+// Returns the demangled form of the C++ symbol name `sname`, or `sname` itself if it is not a
+// mangled name or neither the program's bw_dbg_demangle hook nor the C++ runtime is linked in.
+// Results are cached by the address of `sname`, which must stay valid and unchanged for the
+// lifetime of the process, and are never freed.
+const char* demangle_name(const char* sname);
+
+#endif // BW_DEMANGLE_H
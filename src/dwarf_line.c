@@ -0,0 +1,779 @@
+#include "dwarf_line.h"
+
+#include <elf.h>        // for SHF_COMPRESSED
+#include <link.h>       // for ElfW
+#include <pthread.h>    // for pthread_mutex_lock, pthread_mutex_unlock, pthread_mutex_t, ...
+#include <stdatomic.h>  // for atomic_init, atomic_load_explicit, atomic_store_explicit, ...
+#include <stdbool.h>    // for bool, false, true
+#include <stddef.h>     // for size_t, NULL
+#include <stdint.h>     // for uint8_t, uint16_t, uint32_t, uint64_t, uintptr_t, UINT32_MAX
+#include <stdlib.h>     // for free, calloc, qsort, realloc
+#include <string.h>     // for memchr, memcpy, strlen
+
+#include "arena.h"        // for arena_alloc, arena_destroy, arena_init, arena_t
+#include "common.h"       // for BW_UNUSED
+#include "dwarf_reader.h" // for dwarf_read_u8, dwarf_reader_t, dwarf_read_uleb, dwarf_rea...
+
+enum { DWARF_LINES_ARENA_CHUNK_SIZE = 64 << 10 };
+
+// Line number opcodes and file entry encodings, from the DWARF 5 specification
+enum {
+    DW_LNS_COPY = 0x01,
+    DW_LNS_ADVANCE_PC = 0x02,
+    DW_LNS_ADVANCE_LINE = 0x03,
+    DW_LNS_SET_FILE = 0x04,
+    DW_LNS_CONST_ADD_PC = 0x08,
+    DW_LNS_FIXED_ADVANCE_PC = 0x09,
+};
+
+enum {
+    DW_LNE_END_SEQUENCE = 0x01,
+    DW_LNE_SET_ADDRESS = 0x02,
+};
+
+enum {
+    DW_LNCT_PATH = 0x1,
+    DW_LNCT_DIRECTORY_INDEX = 0x2,
+};
+
+enum {
+    DW_FORM_BLOCK2 = 0x03,
+    DW_FORM_BLOCK4 = 0x04,
+    DW_FORM_DATA2 = 0x05,
+    DW_FORM_DATA4 = 0x06,
+    DW_FORM_DATA8 = 0x07,
+    DW_FORM_STRING = 0x08,
+    DW_FORM_BLOCK = 0x09,
+    DW_FORM_BLOCK1 = 0x0a,
+    DW_FORM_DATA1 = 0x0b,
+    DW_FORM_SDATA = 0x0d,
+    DW_FORM_STRP = 0x0e,
+    DW_FORM_UDATA = 0x0f,
+    DW_FORM_DATA16 = 0x1e,
+    DW_FORM_LINE_STRP = 0x1f,
+};
+
+enum { DWARF_VERSION_MIN = 2, DWARF_VERSION_MAX = 5 };
+enum { DWARF_VERSION_MAX_OPS = 4 };
+enum { DWARF_VERSION_ENTRY_FORMATS = 5 };
+enum { DWARF_MAX_OPCODE = 255 };
+enum { DWARF_DATA16_SIZE = 16 };
+enum { LINE_TABLE_INITIAL_CAP = 16 };
+enum { LINE_ROWS_INITIAL_CAP = 256 };
+
+#define DWARF64_ESCAPE 0xffffffffU
+#define DWARF32_RESERVED 0xfffffff0U
+
+typedef struct {
+    const unsigned char* program;
+    const unsigned char* end;
+    const unsigned char* tables;
+    const unsigned char* opcode_lengths;
+    uint16_t version;
+    bool is64;
+    uint8_t min_inst_len;
+    int8_t line_base;
+    uint8_t line_range;
+    uint8_t opcode_base;
+} line_header_t;
+
+// A row with line 0 ends a sequence: addresses from there on are not covered by it
+typedef struct {
+    uintptr_t addr;
+    uint32_t file;
+    uint32_t line;
+} line_row_t;
+
+typedef struct {
+    line_row_t* rows;
+    size_t len;
+    const char** files;
+    size_t files_len;
+} line_unit_rows_t;
+
+typedef struct {
+    size_t offset;
+    _Atomic(line_unit_rows_t*) rows;
+    atomic_bool failed;
+} line_unit_t;
+
+// Address range of a single sequence in a line program
+typedef struct {
+    uintptr_t lo;
+    uintptr_t hi;
+    size_t unit;
+} line_range_t;
+
+struct dwarf_lines {
+    const unsigned char* data;
+    size_t size;
+    const char* line_str;
+    size_t line_str_size;
+    const char* str;
+    size_t str_size;
+    line_unit_t* units;
+    size_t units_len;
+    line_range_t* ranges;
+    size_t ranges_len;
+    pthread_mutex_t lock;
+    arena_t arena;
+};
+
+// Receives the rows of a line program as the state machine emits them
+typedef struct {
+    bool (*emit)(void* arg, const line_row_t* row, bool end_sequence);
+    void* arg;
+} line_sink_t;
+
+static const char* section_str(const char* data, size_t size, uint64_t offset) {
+    if (!data || offset >= size || !memchr(data + offset, '\0', size - offset)) {
+        return NULL;
+    }
+
+    return data + offset;
+}
+
+// Reads the header of the line program at `offset`, leaving `next` at the following one
+static bool line_header_parse(const dwarf_lines_t* lines,
+                              size_t offset,
+                              line_header_t* hdr,
+                              size_t* next) {
+    dwarf_reader_t r = {lines->data + offset, lines->data + lines->size, true};
+
+    uint64_t unit_length = dwarf_read_u32(&r);
+    hdr->is64 = unit_length == DWARF64_ESCAPE;
+    if (hdr->is64) {
+        unit_length = dwarf_read_fixed(&r, sizeof(uint64_t));
+    } else if (unit_length >= DWARF32_RESERVED) {
+        return false;
+    }
+    if (!r.ok || unit_length == 0 || unit_length > (uint64_t)(r.end - r.pos)) {
+        return false;
+    }
+
+    hdr->end = r.pos + unit_length;
+    *next = (size_t)(hdr->end - lines->data);
+    r.end = hdr->end;
+
+    hdr->version = dwarf_read_u16(&r);
+    if (hdr->version < DWARF_VERSION_MIN || hdr->version > DWARF_VERSION_MAX) {
+        return false;
+    }
+
+    if (hdr->version >= DWARF_VERSION_ENTRY_FORMATS) {
+        uint8_t addr_size = dwarf_read_u8(&r);
+        uint8_t seg_sel_size = dwarf_read_u8(&r);
+        if (addr_size != sizeof(uintptr_t) || seg_sel_size != 0) {
+            return false;
+        }
+    }
+
+    uint64_t header_length = dwarf_read_offset(&r, hdr->is64);
+    if (!r.ok || header_length > (uint64_t)(r.end - r.pos)) {
+        return false;
+    }
+    hdr->program = r.pos + header_length;
+
+    hdr->min_inst_len = dwarf_read_u8(&r);
+    if (hdr->version >= DWARF_VERSION_MAX_OPS) {
+        // Only meaningful for VLIW architectures
+        BW_UNUSED(dwarf_read_u8(&r));
+    }
+    BW_UNUSED(dwarf_read_u8(&r)); // default_is_stmt, all rows are used
+    hdr->line_base = (int8_t)dwarf_read_u8(&r);
+    hdr->line_range = dwarf_read_u8(&r);
+    hdr->opcode_base = dwarf_read_u8(&r);
+    hdr->opcode_lengths = r.pos;
+    dwarf_skip(&r, hdr->opcode_base ? hdr->opcode_base - 1U : 0U);
+    hdr->tables = r.pos;
+
+    return r.ok && hdr->line_range != 0 && hdr->opcode_base != 0 && hdr->tables <= hdr->program;
+}
+
+// Runs the line number state machine of a program, passing every row to `sink`
+static bool line_program_run(const line_header_t* hdr, const line_sink_t* sink) {
+    dwarf_reader_t r = {hdr->program, hdr->end, true};
+    uint8_t const_add_adj = (uint8_t)(DWARF_MAX_OPCODE - hdr->opcode_base);
+
+    line_row_t row = {0, 1, 1};
+    while (r.ok && r.pos < r.end) {
+        uint8_t op = dwarf_read_u8(&r);
+
+        if (op >= hdr->opcode_base) {
+            uint8_t adj = (uint8_t)(op - hdr->opcode_base);
+            row.addr += (uintptr_t)(adj / hdr->line_range) * hdr->min_inst_len;
+            row.line += (uint32_t)(hdr->line_base + (adj % hdr->line_range));
+            if (!sink->emit(sink->arg, &row, false)) {
+                return false;
+            }
+            continue;
+        }
+
+        switch (op) {
+        case 0: {
+            uint64_t len = dwarf_read_uleb(&r);
+            if (!r.ok || len == 0 || len > (uint64_t)(r.end - r.pos)) {
+                return false;
+            }
+
+            const unsigned char* next = r.pos + len;
+            uint8_t sub = dwarf_read_u8(&r);
+            if (sub == DW_LNE_END_SEQUENCE) {
+                if (!sink->emit(sink->arg, &row, true)) {
+                    return false;
+                }
+                row.addr = 0;
+                row.file = 1;
+                row.line = 1;
+            } else if (sub == DW_LNE_SET_ADDRESS && len - 1 == sizeof(uintptr_t)) {
+                row.addr = (uintptr_t)dwarf_read_fixed(&r, sizeof(uintptr_t));
+            }
+            r.pos = next;
+            break;
+        }
+        case DW_LNS_COPY:
+            if (!sink->emit(sink->arg, &row, false)) {
+                return false;
+            }
+            break;
+        case DW_LNS_ADVANCE_PC:
+            row.addr += (uintptr_t)dwarf_read_uleb(&r) * hdr->min_inst_len;
+            break;
+        case DW_LNS_ADVANCE_LINE:
+            row.line += (uint32_t)dwarf_read_sleb(&r);
+            break;
+        case DW_LNS_SET_FILE:
+            row.file = (uint32_t)dwarf_read_uleb(&r);
+            break;
+        case DW_LNS_CONST_ADD_PC:
+            row.addr += (uintptr_t)(const_add_adj / hdr->line_range) * hdr->min_inst_len;
+            break;
+        case DW_LNS_FIXED_ADVANCE_PC:
+            row.addr += dwarf_read_u16(&r);
+            break;
+        default:
+            // Standard opcodes, known or not, declare how many ULEB128 operands they take
+            for (uint8_t i = 0; i < hdr->opcode_lengths[op - 1]; ++i) {
+                BW_UNUSED(dwarf_read_uleb(&r));
+            }
+            break;
+        }
+    }
+
+    return r.ok;
+}
+
+typedef struct {
+    dwarf_lines_t* lines;
+    size_t unit;
+    size_t cap;
+    uintptr_t lo;
+    bool in_sequence;
+} index_state_t;
+
+static bool index_emit(void* arg, const line_row_t* row, bool end_sequence) {
+    index_state_t* state = arg;
+
+    if (!state->in_sequence) {
+        state->lo = row->addr;
+        state->in_sequence = true;
+    }
+    if (!end_sequence) {
+        return true;
+    }
+    state->in_sequence = false;
+
+    // The linker points sequences of discarded functions at address 0
+    if (state->lo == 0 || row->addr <= state->lo) {
+        return true;
+    }
+
+    dwarf_lines_t* lines = state->lines;
+    if (lines->ranges_len == state->cap) {
+        size_t cap = state->cap ? state->cap * 2 : LINE_TABLE_INITIAL_CAP;
+        line_range_t* ranges = realloc(lines->ranges, cap * sizeof(*ranges));
+        if (!ranges) {
+            return false;
+        }
+        lines->ranges = ranges;
+        state->cap = cap;
+    }
+
+    line_range_t* range = &lines->ranges[lines->ranges_len++];
+    range->lo = state->lo;
+    range->hi = row->addr;
+    range->unit = state->unit;
+
+    return true;
+}
+
+static int compare_ranges(const void* lhs, const void* rhs) {
+    const line_range_t* lrange = lhs;
+    const line_range_t* rrange = rhs;
+
+    if (lrange->lo != rrange->lo) {
+        return lrange->lo < rrange->lo ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static bool dwarf_lines_index(dwarf_lines_t* lines) {
+    size_t units_cap = 0;
+    index_state_t state = {lines, 0, 0, 0, false};
+
+    size_t offset = 0;
+    while (offset < lines->size) {
+        line_header_t hdr;
+        size_t next = 0;
+        if (!line_header_parse(lines, offset, &hdr, &next)) {
+            // Without a valid length the next program cannot be found
+            if (next <= offset) {
+                break;
+            }
+            offset = next;
+            continue;
+        }
+
+        if (lines->units_len == units_cap) {
+            size_t cap = units_cap ? units_cap * 2 : LINE_TABLE_INITIAL_CAP;
+            line_unit_t* units = realloc(lines->units, cap * sizeof(*units));
+            if (!units) {
+                return false;
+            }
+            lines->units = units;
+            units_cap = cap;
+        }
+
+        line_unit_t* unit = &lines->units[lines->units_len];
+        unit->offset = offset;
+        atomic_init(&unit->rows, NULL);
+        atomic_init(&unit->failed, false);
+
+        state.unit = lines->units_len++;
+        state.in_sequence = false;
+        BW_UNUSED(line_program_run(&hdr, &(line_sink_t){index_emit, &state}));
+
+        offset = next;
+    }
+
+    qsort(lines->ranges, lines->ranges_len, sizeof(*lines->ranges), compare_ranges);
+
+    return lines->ranges_len > 0;
+}
+
+dwarf_lines_t* dwarf_lines_open(const elf_file_t* elf) {
+    const ElfW(Shdr)* shdr = elf_section(elf, ".debug_line");
+    // Compressed sections are not supported
+    if (!shdr || (shdr->sh_flags & SHF_COMPRESSED)) {
+        return NULL;
+    }
+
+    const unsigned char* data = elf_section_data(elf, shdr);
+    if (!data || shdr->sh_size == 0) {
+        return NULL;
+    }
+
+    dwarf_lines_t* lines = calloc(1, sizeof(*lines));
+    if (!lines) {
+        return NULL;
+    }
+
+    lines->data = data;
+    lines->size = shdr->sh_size;
+
+    const ElfW(Shdr)* line_str = elf_section(elf, ".debug_line_str");
+    if (line_str && !(line_str->sh_flags & SHF_COMPRESSED)) {
+        lines->line_str = (const char*)elf_section_data(elf, line_str);
+        lines->line_str_size = line_str->sh_size;
+    }
+
+    const ElfW(Shdr)* str = elf_section(elf, ".debug_str");
+    if (str && !(str->sh_flags & SHF_COMPRESSED)) {
+        lines->str = (const char*)elf_section_data(elf, str);
+        lines->str_size = str->sh_size;
+    }
+
+    BW_UNUSED(pthread_mutex_init(&lines->lock, NULL));
+    arena_init(&lines->arena, DWARF_LINES_ARENA_CHUNK_SIZE);
+
+    if (!dwarf_lines_index(lines)) {
+        dwarf_lines_close(lines);
+        return NULL;
+    }
+
+    return lines;
+}
+
+void dwarf_lines_close(dwarf_lines_t* lines) {
+    if (!lines) {
+        return;
+    }
+
+    for (size_t i = 0; i < lines->units_len; ++i) {
+        line_unit_rows_t* rows = atomic_load_explicit(&lines->units[i].rows, memory_order_relaxed);
+        if (rows) {
+            free(rows->rows);
+        }
+    }
+
+    free(lines->units);
+    free(lines->ranges);
+    arena_destroy(&lines->arena);
+    BW_UNUSED(pthread_mutex_destroy(&lines->lock));
+    free(lines);
+}
+
+typedef struct {
+    const char* path;
+    uint64_t dir;
+} file_entry_t;
+
+static const char* join_path(dwarf_lines_t* lines, const char* dir, const char* name) {
+    if (!dir || dir[0] == '\0' || name[0] == '/') {
+        return name;
+    }
+
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char* path = arena_alloc(&lines->arena, dir_len + name_len + 2);
+    if (!path) {
+        return name;
+    }
+
+    memcpy(path, dir, dir_len);
+    path[dir_len] = '/';
+    memcpy(path + dir_len + 1, name, name_len + 1);
+
+    return path;
+}
+
+// Reads one attribute of a DWARF 5 directory or file entry, returning its string or number
+static bool read_form(const dwarf_lines_t* lines,
+                      dwarf_reader_t* r,
+                      bool is64,
+                      uint64_t form,
+                      const char** str,
+                      uint64_t* num) {
+    switch (form) {
+    case DW_FORM_STRING:
+        *str = dwarf_read_cstr(r);
+        break;
+    case DW_FORM_LINE_STRP:
+        *str = section_str(lines->line_str, lines->line_str_size, dwarf_read_offset(r, is64));
+        break;
+    case DW_FORM_STRP:
+        *str = section_str(lines->str, lines->str_size, dwarf_read_offset(r, is64));
+        break;
+    case DW_FORM_UDATA:
+        *num = dwarf_read_uleb(r);
+        break;
+    case DW_FORM_SDATA:
+        *num = (uint64_t)dwarf_read_sleb(r);
+        break;
+    case DW_FORM_DATA1:
+        *num = dwarf_read_u8(r);
+        break;
+    case DW_FORM_DATA2:
+        *num = dwarf_read_u16(r);
+        break;
+    case DW_FORM_DATA4:
+        *num = dwarf_read_u32(r);
+        break;
+    case DW_FORM_DATA8:
+        *num = dwarf_read_fixed(r, sizeof(uint64_t));
+        break;
+    case DW_FORM_DATA16:
+        dwarf_skip(r, DWARF_DATA16_SIZE);
+        break;
+    case DW_FORM_BLOCK:
+        dwarf_skip(r, dwarf_read_uleb(r));
+        break;
+    case DW_FORM_BLOCK1:
+        dwarf_skip(r, dwarf_read_u8(r));
+        break;
+    case DW_FORM_BLOCK2:
+        dwarf_skip(r, dwarf_read_u16(r));
+        break;
+    case DW_FORM_BLOCK4:
+        dwarf_skip(r, dwarf_read_u32(r));
+        break;
+    default:
+        // Indexed strings need the unit's entry in .debug_info, which is not read
+        return false;
+    }
+
+    return r->ok;
+}
+
+// Reads a DWARF 5 directory or file table into `entries`, which must be freed by the caller
+static bool read_entry_table_v5(const dwarf_lines_t* lines,
+                                dwarf_reader_t* r,
+                                bool is64,
+                                file_entry_t** entries,
+                                size_t* len) {
+    uint8_t format_count = dwarf_read_u8(r);
+    const unsigned char* format = r->pos;
+    for (uint8_t i = 0; i < format_count; ++i) {
+        BW_UNUSED(dwarf_read_uleb(r));
+        BW_UNUSED(dwarf_read_uleb(r));
+    }
+
+    // Every entry takes at least a byte, which bounds the count by the remaining header
+    uint64_t count = dwarf_read_uleb(r);
+    if (!r->ok || (count > 0 && format_count == 0) || count > (uint64_t)(r->end - r->pos)) {
+        return false;
+    }
+
+    *entries = calloc(count ? count : 1, sizeof(**entries));
+    if (!*entries) {
+        return false;
+    }
+    *len = count;
+
+    for (uint64_t i = 0; i < count; ++i) {
+        dwarf_reader_t fmt = {format, r->end, true};
+        for (uint8_t j = 0; j < format_count; ++j) {
+            uint64_t type = dwarf_read_uleb(&fmt);
+            uint64_t form = dwarf_read_uleb(&fmt);
+            const char* str = NULL;
+            uint64_t num = 0;
+            if (!read_form(lines, r, is64, form, &str, &num)) {
+                return false;
+            }
+
+            if (type == DW_LNCT_PATH) {
+                (*entries)[i].path = str;
+            } else if (type == DW_LNCT_DIRECTORY_INDEX) {
+                (*entries)[i].dir = num;
+            }
+        }
+    }
+
+    return r->ok;
+}
+
+// Reads a DWARF 2-4 directory or file table. Both are 1-based, index 0 of the directory table is
+// the compilation directory which is only recorded in .debug_info.
+static bool read_entry_table_v4(dwarf_reader_t* r, bool files, file_entry_t** entries, size_t* len) {
+    size_t cap = 0;
+    *len = 0;
+    *entries = NULL;
+
+    for (;;) {
+        const char* path = dwarf_read_cstr(r);
+        if (!path || path[0] == '\0') {
+            break;
+        }
+
+        if (*len == cap) {
+            cap = cap ? cap * 2 : LINE_TABLE_INITIAL_CAP;
+            file_entry_t* grown = realloc(*entries, (cap + 1) * sizeof(*grown));
+            if (!grown) {
+                return false;
+            }
+            *entries = grown;
+        }
+
+        file_entry_t* entry = &(*entries)[++*len];
+        entry->path = path;
+        entry->dir = 0;
+        if (files) {
+            entry->dir = dwarf_read_uleb(r);
+            BW_UNUSED(dwarf_read_uleb(r)); // mtime
+            BW_UNUSED(dwarf_read_uleb(r)); // length
+        }
+    }
+
+    if (*entries) {
+        (*entries)[0].path = NULL;
+        (*entries)[0].dir = 0;
+        ++*len;
+    }
+
+    return r->ok;
+}
+
+static bool line_files_build(dwarf_lines_t* lines,
+                             const line_header_t* hdr,
+                             line_unit_rows_t* unit_rows) {
+    dwarf_reader_t r = {hdr->tables, hdr->program, true};
+
+    file_entry_t* dirs = NULL;
+    file_entry_t* files = NULL;
+    size_t dirs_len = 0;
+    size_t files_len = 0;
+
+    bool success = false;
+    if (hdr->version >= DWARF_VERSION_ENTRY_FORMATS) {
+        success = read_entry_table_v5(lines, &r, hdr->is64, &dirs, &dirs_len) &&
+                  read_entry_table_v5(lines, &r, hdr->is64, &files, &files_len);
+    } else {
+        success = read_entry_table_v4(&r, false, &dirs, &dirs_len) &&
+                  read_entry_table_v4(&r, true, &files, &files_len);
+    }
+
+    if (success && files_len > 0) {
+        unit_rows->files = arena_alloc(&lines->arena, files_len * sizeof(*unit_rows->files));
+        success = unit_rows->files != NULL;
+    }
+
+    for (size_t i = 0; success && i < files_len; ++i) {
+        const char* dir = files[i].dir < dirs_len ? dirs[files[i].dir].path : NULL;
+        unit_rows->files[i] = files[i].path ? join_path(lines, dir, files[i].path) : NULL;
+    }
+    unit_rows->files_len = success ? files_len : 0;
+
+    free(dirs);
+    free(files);
+
+    return success;
+}
+
+typedef struct {
+    line_row_t* rows;
+    size_t len;
+    size_t cap;
+    size_t seq_start;
+} rows_state_t;
+
+static bool rows_emit(void* arg, const line_row_t* row, bool end_sequence) {
+    rows_state_t* state = arg;
+
+    // Only the last row emitted for an address within a sequence matters
+    if (state->len > state->seq_start && state->rows[state->len - 1].addr == row->addr &&
+        !end_sequence) {
+        state->rows[state->len - 1] = *row;
+        return true;
+    }
+
+    if (state->len == state->cap) {
+        size_t cap = state->cap ? state->cap * 2 : LINE_ROWS_INITIAL_CAP;
+        line_row_t* rows = realloc(state->rows, cap * sizeof(*rows));
+        if (!rows) {
+            return false;
+        }
+        state->rows = rows;
+        state->cap = cap;
+    }
+
+    line_row_t* out = &state->rows[state->len++];
+    *out = *row;
+    if (end_sequence) {
+        out->line = 0;
+        state->seq_start = state->len;
+    } else if (out->line == 0) {
+        // Line 0 marks code without a source line, keep 0 for sequence ends
+        out->line = UINT32_MAX;
+    }
+
+    return true;
+}
+
+// Sequence ends sort before rows at the same address, which start the next sequence
+static int compare_rows(const void* lhs, const void* rhs) {
+    const line_row_t* lrow = lhs;
+    const line_row_t* rrow = rhs;
+
+    if (lrow->addr != rrow->addr) {
+        return lrow->addr < rrow->addr ? -1 : 1;
+    }
+
+    return (lrow->line != 0) - (rrow->line != 0);
+}
+
+static line_unit_rows_t* line_unit_decode(dwarf_lines_t* lines, const line_unit_t* unit) {
+    line_header_t hdr;
+    size_t next = 0;
+    if (!line_header_parse(lines, unit->offset, &hdr, &next)) {
+        return NULL;
+    }
+
+    line_unit_rows_t* unit_rows = arena_alloc(&lines->arena, sizeof(*unit_rows));
+    if (!unit_rows) {
+        return NULL;
+    }
+    unit_rows->files = NULL;
+    unit_rows->files_len = 0;
+
+    // A unit with unreadable file names still has lines
+    BW_UNUSED(line_files_build(lines, &hdr, unit_rows));
+
+    rows_state_t state = {NULL, 0, 0, 0};
+    if (!line_program_run(&hdr, &(line_sink_t){rows_emit, &state}) && state.len == 0) {
+        free(state.rows);
+        return NULL;
+    }
+
+    qsort(state.rows, state.len, sizeof(*state.rows), compare_rows);
+    unit_rows->rows = state.rows;
+    unit_rows->len = state.len;
+
+    return unit_rows;
+}
+
+static const line_unit_rows_t* line_unit_rows(dwarf_lines_t* lines, line_unit_t* unit) {
+    line_unit_rows_t* rows = atomic_load_explicit(&unit->rows, memory_order_acquire);
+    if (rows || atomic_load_explicit(&unit->failed, memory_order_relaxed)) {
+        return rows;
+    }
+
+    if (pthread_mutex_lock(&lines->lock) != 0) {
+        return NULL;
+    }
+
+    rows = atomic_load_explicit(&unit->rows, memory_order_relaxed);
+    if (!rows && !atomic_load_explicit(&unit->failed, memory_order_relaxed)) {
+        rows = line_unit_decode(lines, unit);
+        atomic_store_explicit(&unit->failed, rows == NULL, memory_order_relaxed);
+        atomic_store_explicit(&unit->rows, rows, memory_order_release);
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&lines->lock));
+
+    return rows;
+}
+
+bool dwarf_lines_lookup(dwarf_lines_t* lines, uintptr_t addr, const char** file, uint32_t* line) {
+    // Find the last sequence starting at or before addr
+    size_t lo = 0;
+    size_t hi = lines->ranges_len;
+    while (lo < hi) {
+        size_t mid = lo + ((hi - lo) / 2);
+        if (lines->ranges[mid].lo <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0 || addr >= lines->ranges[lo - 1].hi) {
+        return false;
+    }
+
+    const line_unit_rows_t* unit_rows =
+        line_unit_rows(lines, &lines->units[lines->ranges[lo - 1].unit]);
+    if (!unit_rows) {
+        return false;
+    }
+
+    lo = 0;
+    hi = unit_rows->len;
+    while (lo < hi) {
+        size_t mid = lo + ((hi - lo) / 2);
+        if (unit_rows->rows[mid].addr <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0 || unit_rows->rows[lo - 1].line == 0) {
+        return false;
+    }
+
+    const line_row_t* row = &unit_rows->rows[lo - 1];
+    const char* name = row->file < unit_rows->files_len ? unit_rows->files[row->file] : NULL;
+    *file = name ? name : "?";
+    *line = row->line == UINT32_MAX ? 0 : row->line;
+
+    return true;
+}
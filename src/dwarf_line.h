@@ -0,0 +1,23 @@
+#ifndef BW_DWARF_LINE_H
+#define BW_DWARF_LINE_H
+
+#include <stdbool.h>    // for bool
+#include <stdint.h>     // for uintptr_t, uint32_t
+
+#include "elf_file.h"   // for elf_file_t
+
+typedef struct dwarf_lines dwarf_lines_t;
+
+// Indexes the address ranges of the line programs in the .debug_line section of `elf`, without
+// keeping their rows. Returns NULL if the file has no usable line information. `elf` must outlive
+// the returned table.
+dwarf_lines_t* dwarf_lines_open(const elf_file_t* elf);
+
+void dwarf_lines_close(dwarf_lines_t* lines);
+
+// Finds the source file and line of the link-time address `addr`. The rows of a line program are
+// decoded the first time one of its addresses is looked up and cached in a sorted array, later
+// lookups are two binary searches. Safe to call concurrently from multiple threads.
+bool dwarf_lines_lookup(dwarf_lines_t* lines, uintptr_t addr, const char** file, uint32_t* line);
+
+#endif // BW_DWARF_LINE_H
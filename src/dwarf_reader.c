@@ -0,0 +1,98 @@
+#include "dwarf_reader.h"
+
+#include <stdbool.h>  // for false, bool
+#include <stddef.h>   // for size_t, NULL
+#include <stdint.h>   // for uint64_t, uint8_t, int64_t, uint16_t, uint32_t
+#include <string.h>   // for memchr, memcpy
+
+#define LEB_PAYLOAD_MASK 0x7fU
+#define LEB_CONTINUE_BIT 0x80U
+#define LEB_SIGN_BIT 0x40U
+#define LEB_SHIFT 7U
+#define BITS_PER_WORD 64U
+
+uint64_t dwarf_read_fixed(dwarf_reader_t* r, size_t size) {
+    if (!r->ok || size > sizeof(uint64_t) || (size_t)(r->end - r->pos) < size) {
+        r->ok = false;
+        return 0;
+    }
+
+    // Both supported architectures are little-endian
+    uint64_t val = 0;
+    memcpy(&val, r->pos, size);
+    r->pos += size;
+
+    return val;
+}
+
+uint8_t dwarf_read_u8(dwarf_reader_t* r) {
+    return (uint8_t)dwarf_read_fixed(r, sizeof(uint8_t));
+}
+
+uint16_t dwarf_read_u16(dwarf_reader_t* r) {
+    return (uint16_t)dwarf_read_fixed(r, sizeof(uint16_t));
+}
+
+uint32_t dwarf_read_u32(dwarf_reader_t* r) {
+    return (uint32_t)dwarf_read_fixed(r, sizeof(uint32_t));
+}
+
+uint64_t dwarf_read_offset(dwarf_reader_t* r, bool is64) {
+    return dwarf_read_fixed(r, is64 ? sizeof(uint64_t) : sizeof(uint32_t));
+}
+
+static uint64_t read_leb(dwarf_reader_t* r, bool is_signed) {
+    uint64_t val = 0;
+    unsigned shift = 0;
+    uint8_t byte = 0;
+    while (r->ok) {
+        byte = dwarf_read_u8(r);
+        if (shift < BITS_PER_WORD) {
+            val |= (uint64_t)(byte & LEB_PAYLOAD_MASK) << shift;
+        }
+        shift += LEB_SHIFT;
+        if (!(byte & LEB_CONTINUE_BIT)) {
+            break;
+        }
+    }
+
+    if (is_signed && shift < BITS_PER_WORD && (byte & LEB_SIGN_BIT)) {
+        val |= ~(uint64_t)0 << shift;
+    }
+
+    return val;
+}
+
+uint64_t dwarf_read_uleb(dwarf_reader_t* r) {
+    return read_leb(r, false);
+}
+
+int64_t dwarf_read_sleb(dwarf_reader_t* r) {
+    return (int64_t)read_leb(r, true);
+}
+
+const char* dwarf_read_cstr(dwarf_reader_t* r) {
+    if (!r->ok) {
+        return NULL;
+    }
+
+    const unsigned char* nul = memchr(r->pos, '\0', (size_t)(r->end - r->pos));
+    if (!nul) {
+        r->ok = false;
+        return NULL;
+    }
+
+    const char* str = (const char*)r->pos;
+    r->pos = nul + 1;
+
+    return str;
+}
+
+void dwarf_skip(dwarf_reader_t* r, uint64_t len) {
+    if (!r->ok || (uint64_t)(r->end - r->pos) < len) {
+        r->ok = false;
+        return;
+    }
+
+    r->pos += len;
+}
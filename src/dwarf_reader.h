@@ -0,0 +1,37 @@
+#ifndef BW_DWARF_READER_H
+#define BW_DWARF_READER_H
+
+#include <stdbool.h>  // for bool
+#include <stddef.h>   // for size_t
+#include <stdint.h>   // for uint8_t, uint16_t, uint32_t, uint64_t, int64_t
+
+// A bounds-checked cursor over DWARF data. A read past `end` clears `ok` and returns 0, and every
+// later read fails, so callers only need to check `ok` once after a sequence of reads.
+typedef struct {
+    const unsigned char* pos;
+    const unsigned char* end;
+    bool ok;
+} dwarf_reader_t;
+
+// Reads a little-endian value of `size` bytes, at most 8
+uint64_t dwarf_read_fixed(dwarf_reader_t* r, size_t size);
+
+uint8_t dwarf_read_u8(dwarf_reader_t* r);
+
+uint16_t dwarf_read_u16(dwarf_reader_t* r);
+
+uint32_t dwarf_read_u32(dwarf_reader_t* r);
+
+// Reads a section offset, which is 8 bytes in the 64-bit DWARF format and 4 bytes otherwise
+uint64_t dwarf_read_offset(dwarf_reader_t* r, bool is64);
+
+uint64_t dwarf_read_uleb(dwarf_reader_t* r);
+
+int64_t dwarf_read_sleb(dwarf_reader_t* r);
+
+// Returns the NUL-terminated string at the cursor, or NULL if it is not terminated before `end`
+const char* dwarf_read_cstr(dwarf_reader_t* r);
+
+void dwarf_skip(dwarf_reader_t* r, uint64_t len);
+
+#endif // BW_DWARF_READER_H
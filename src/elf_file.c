@@ -0,0 +1,332 @@
+#include "elf_file.h"
+
+#include <elf.h>       // for Elf64_Sym, SHT_SYMTAB, SHT_DYNSYM, SHT_NOTE, PT_LOAD, ELFMAG, ...
+#include <fcntl.h>     // for open, O_CLOEXEC, O_RDONLY
+#include <link.h>      // for ElfW
+#include <stdbool.h>   // for bool, false, true
+#include <stddef.h>    // for size_t, NULL
+#include <stdint.h>    // for uintptr_t, uint32_t, uint64_t, UINT32_MAX, UINTPTR_MAX
+#include <stdlib.h>    // for free, malloc, qsort, calloc
+#include <string.h>    // for memcmp, memcpy, strncmp
+#include <sys/mman.h>  // for mmap, munmap, MAP_FAILED, MAP_PRIVATE, PROT_READ
+#include <sys/stat.h>  // for fstat, stat
+#include <unistd.h>    // for close
+
+#include "common.h"    // for BW_UNUSED
+
+// Both supported architectures are 64-bit
+#define ELF_ST_TYPE(info) ELF64_ST_TYPE(info)
+#define ELF_ST_BIND(info) ELF64_ST_BIND(info)
+
+typedef struct {
+    elf_symbol_t sym;
+    int rank;
+} ranked_symbol_t;
+
+static bool elf_range_valid(const elf_file_t* elf, size_t offset, size_t len) {
+    return offset <= elf->size && len <= elf->size - offset;
+}
+
+const unsigned char* elf_section_data(const elf_file_t* elf, const ElfW(Shdr)* shdr) {
+    if (!shdr || shdr->sh_type == SHT_NOBITS ||
+        !elf_range_valid(elf, shdr->sh_offset, shdr->sh_size)) {
+        return NULL;
+    }
+
+    return elf->data + shdr->sh_offset;
+}
+
+const ElfW(Shdr)* elf_section(const elf_file_t* elf, const char* name) {
+    for (size_t i = 0; i < elf->shnum; ++i) {
+        const ElfW(Shdr)* shdr = &elf->shdrs[i];
+        if (shdr->sh_name < elf->shstrtab_size &&
+            strncmp(elf->shstrtab + shdr->sh_name, name, elf->shstrtab_size - shdr->sh_name) ==
+                0) {
+            return shdr;
+        }
+    }
+
+    return NULL;
+}
+
+static const ElfW(Shdr)* elf_section_by_type(const elf_file_t* elf, uint32_t type) {
+    for (size_t i = 0; i < elf->shnum; ++i) {
+        if (elf->shdrs[i].sh_type == type) {
+            return &elf->shdrs[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Prefer global definitions over weak ones and those over local ones, like dladdr does
+static int symbol_rank(const ElfW(Sym)* sym) {
+    int bind = ELF_ST_BIND(sym->st_info);
+    int rank = bind == STB_GLOBAL ? 0 : (bind == STB_WEAK ? 1 : 2);
+
+    return (rank * 2) + (ELF_ST_TYPE(sym->st_info) == STT_NOTYPE ? 1 : 0);
+}
+
+static int compare_symbols(const void* lhs, const void* rhs) {
+    const ranked_symbol_t* lsym = lhs;
+    const ranked_symbol_t* rsym = rhs;
+
+    if (lsym->sym.addr != rsym->sym.addr) {
+        return lsym->sym.addr < rsym->sym.addr ? -1 : 1;
+    }
+
+    return lsym->rank - rsym->rank;
+}
+
+static bool symbol_is_function(const elf_file_t* elf, const ElfW(Sym)* sym, const char* name) {
+    if (sym->st_shndx == SHN_UNDEF || sym->st_shndx >= SHN_LORESERVE ||
+        sym->st_shndx >= elf->shnum) {
+        return false;
+    }
+
+    switch (ELF_ST_TYPE(sym->st_info)) {
+    case STT_FUNC:
+    case STT_GNU_IFUNC:
+        return true;
+    case STT_NOTYPE:
+        // Untyped labels in code, e.g. from assembly, but not local labels or mapping symbols
+        return (elf->shdrs[sym->st_shndx].sh_flags & SHF_EXECINSTR) && name[0] != '\0' &&
+               name[0] != '$' && name[0] != '.';
+    default:
+        return false;
+    }
+}
+
+static bool elf_index_symbols(elf_file_t* elf) {
+    const ElfW(Shdr)* symtab = elf_section_by_type(elf, SHT_SYMTAB);
+    if (!symtab) {
+        symtab = elf_section_by_type(elf, SHT_DYNSYM);
+    }
+    if (!symtab || symtab->sh_link >= elf->shnum || symtab->sh_entsize != sizeof(ElfW(Sym))) {
+        return false;
+    }
+
+    const ElfW(Shdr)* strtab = &elf->shdrs[symtab->sh_link];
+    const ElfW(Sym)* syms = (const ElfW(Sym)*)elf_section_data(elf, symtab);
+    elf->strtab = (const char*)elf_section_data(elf, strtab);
+    elf->strtab_size = strtab->sh_size;
+    if (!syms || !elf->strtab) {
+        return false;
+    }
+
+    size_t count = symtab->sh_size / sizeof(ElfW(Sym));
+    ranked_symbol_t* ranked = calloc(count ? count : 1, sizeof(*ranked));
+    if (!ranked) {
+        return false;
+    }
+
+    size_t len = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const ElfW(Sym)* sym = &syms[i];
+        if (sym->st_name >= elf->strtab_size || sym->st_name > UINT32_MAX ||
+            !symbol_is_function(elf, sym, elf->strtab + sym->st_name)) {
+            continue;
+        }
+
+        ranked[len].sym.addr = sym->st_value;
+        ranked[len].sym.size = sym->st_size > UINT32_MAX ? UINT32_MAX : (uint32_t)sym->st_size;
+        ranked[len].sym.name = (uint32_t)sym->st_name;
+        ranked[len].rank = symbol_rank(sym);
+        len++;
+    }
+
+    qsort(ranked, len, sizeof(*ranked), compare_symbols);
+
+    // Keep a single name per address, the best ranked one sorts first
+    elf->syms = malloc((len ? len : 1) * sizeof(*elf->syms));
+    if (!elf->syms) {
+        free(ranked);
+        return false;
+    }
+
+    elf->syms_len = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (elf->syms_len == 0 || elf->syms[elf->syms_len - 1].addr != ranked[i].sym.addr) {
+            elf->syms[elf->syms_len++] = ranked[i].sym;
+        }
+    }
+    free(ranked);
+
+    return true;
+}
+
+static bool elf_parse_header(elf_file_t* elf) {
+    if (elf->size < sizeof(ElfW(Ehdr))) {
+        return false;
+    }
+
+    const ElfW(Ehdr)* ehdr = (const ElfW(Ehdr)*)elf->data;
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+        ehdr->e_shentsize != sizeof(ElfW(Shdr)) || ehdr->e_shoff == 0) {
+        return false;
+    }
+
+    if (!elf_range_valid(elf, ehdr->e_shoff, sizeof(ElfW(Shdr)))) {
+        return false;
+    }
+    elf->shdrs = (const ElfW(Shdr)*)(elf->data + ehdr->e_shoff);
+
+    // Files with many sections store the real counts in the first section header
+    elf->shnum = ehdr->e_shnum ? ehdr->e_shnum : elf->shdrs[0].sh_size;
+    size_t shstrndx = ehdr->e_shstrndx == SHN_XINDEX ? elf->shdrs[0].sh_link : ehdr->e_shstrndx;
+    if (!elf_range_valid(elf, ehdr->e_shoff, elf->shnum * sizeof(ElfW(Shdr))) ||
+        shstrndx >= elf->shnum) {
+        return false;
+    }
+
+    elf->shstrtab = (const char*)elf_section_data(elf, &elf->shdrs[shstrndx]);
+    elf->shstrtab_size = elf->shdrs[shstrndx].sh_size;
+
+    return elf->shstrtab != NULL;
+}
+
+elf_file_t* elf_open(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    BW_UNUSED(close(fd));
+
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+
+    elf_file_t* elf = calloc(1, sizeof(*elf));
+    if (!elf) {
+        BW_UNUSED(munmap(data, (size_t)st.st_size));
+        return NULL;
+    }
+
+    elf->data = data;
+    elf->size = (size_t)st.st_size;
+
+    if (!elf_parse_header(elf)) {
+        elf_close(elf);
+        return NULL;
+    }
+
+    // A file without symbols is still useful for its other sections
+    BW_UNUSED(elf_index_symbols(elf));
+
+    return elf;
+}
+
+void elf_close(elf_file_t* elf) {
+    if (!elf) {
+        return;
+    }
+
+    free(elf->syms);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-cstyle-cast)
+    BW_UNUSED(munmap((void*)elf->data, elf->size));
+    free(elf);
+}
+
+const char* elf_symbolize(const elf_file_t* elf, uintptr_t addr) {
+    if (!elf || elf->syms_len == 0) {
+        return NULL;
+    }
+
+    // Find the last symbol starting at or before addr
+    size_t lo = 0;
+    size_t hi = elf->syms_len;
+    while (lo < hi) {
+        size_t mid = lo + ((hi - lo) / 2);
+        if (elf->syms[mid].addr <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == 0) {
+        return NULL;
+    }
+
+    const elf_symbol_t* sym = &elf->syms[lo - 1];
+    if (addr - sym->addr >= sym->size && !(sym->size == 0 && addr == sym->addr)) {
+        return NULL;
+    }
+
+    return elf->strtab + sym->name;
+}
+
+uintptr_t elf_link_base(const elf_file_t* elf, uintptr_t page_mask) {
+    const ElfW(Ehdr)* ehdr = (const ElfW(Ehdr)*)elf->data;
+    if (ehdr->e_phoff == 0 || ehdr->e_phentsize != sizeof(ElfW(Phdr)) ||
+        !elf_range_valid(elf, ehdr->e_phoff, ehdr->e_phnum * sizeof(ElfW(Phdr)))) {
+        return 0;
+    }
+
+    const ElfW(Phdr)* phdrs = (const ElfW(Phdr)*)(elf->data + ehdr->e_phoff);
+    uintptr_t start = UINTPTR_MAX;
+    for (size_t i = 0; i < ehdr->e_phnum; ++i) {
+        if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_vaddr < start) {
+            start = phdrs[i].p_vaddr;
+        }
+    }
+
+    return start == UINTPTR_MAX ? 0 : start & page_mask;
+}
+
+static const char k_gnu_note_name[] = "GNU";
+
+static size_t note_align(size_t size, size_t align) {
+    return (size + align - 1) & ~(align - 1);
+}
+
+size_t elf_notes_build_id(const unsigned char* notes,
+                          size_t size,
+                          size_t align,
+                          unsigned char* out,
+                          size_t max) {
+    // Notes are padded to 4 bytes, except in segments aligned to 8 like .note.gnu.property
+    align = align == sizeof(uint64_t) ? sizeof(uint64_t) : sizeof(uint32_t);
+    while (size >= sizeof(ElfW(Nhdr))) {
+        const ElfW(Nhdr)* note = (const ElfW(Nhdr)*)notes;
+        size_t name_size = note_align(note->n_namesz, align);
+        size_t desc_size = note_align(note->n_descsz, align);
+        size_t note_size = sizeof(*note) + name_size + desc_size;
+        if (name_size > size || desc_size > size || note_size > size) {
+            return 0;
+        }
+
+        const unsigned char* name = notes + sizeof(*note);
+        if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == sizeof(k_gnu_note_name) &&
+            memcmp(name, k_gnu_note_name, sizeof(k_gnu_note_name)) == 0) {
+            size_t len = note->n_descsz < max ? note->n_descsz : max;
+            memcpy(out, name + name_size, len);
+            return len;
+        }
+
+        notes += note_size;
+        size -= note_size;
+    }
+
+    return 0;
+}
+
+size_t elf_build_id(const elf_file_t* elf, unsigned char* out, size_t max) {
+    for (size_t i = 0; i < elf->shnum; ++i) {
+        const ElfW(Shdr)* shdr = &elf->shdrs[i];
+        const unsigned char* notes = shdr->sh_type == SHT_NOTE ? elf_section_data(elf, shdr) : NULL;
+        size_t len = notes ? elf_notes_build_id(notes, shdr->sh_size, shdr->sh_addralign, out, max)
+                           : 0;
+        if (len > 0) {
+            return len;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef BW_ELF_FILE_H
+#define BW_ELF_FILE_H
+
+#include <link.h>    // for ElfW
+#include <stddef.h>  // for size_t
+#include <stdint.h>  // for uintptr_t, uint32_t
+
+typedef struct {
+    uintptr_t addr; // Link-time address
+    uint32_t size;
+    uint32_t name;  // Offset in the string table
+} elf_symbol_t;
+
+// A read-only mapping of an ELF file along with a sorted index of its function symbols
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    const ElfW(Shdr)* shdrs;
+    size_t shnum;
+    const char* shstrtab;
+    size_t shstrtab_size;
+    const char* strtab;
+    size_t strtab_size;
+    elf_symbol_t* syms;
+    size_t syms_len;
+} elf_file_t;
+
+// Maps `path` and indexes the functions in .symtab, or in .dynsym if the file was stripped. Returns
+// NULL if the file cannot be mapped or is not a 64-bit ELF file.
+elf_file_t* elf_open(const char* path);
+
+void elf_close(elf_file_t* elf);
+
+// Returns the section named `name`, or NULL if there is none
+const ElfW(Shdr)* elf_section(const elf_file_t* elf, const char* name);
+
+// Returns the contents of `shdr`, or NULL if it lies outside of the file or has no contents
+const unsigned char* elf_section_data(const elf_file_t* elf, const ElfW(Shdr)* shdr);
+
+// Returns the name of the function containing the link-time address `addr`, or NULL
+const char* elf_symbolize(const elf_file_t* elf, uintptr_t addr);
+
+// Returns the page-aligned link-time address of the lowest loadable segment, which module-relative
+// addresses are offsets from, or 0 if the file has no program headers
+uintptr_t elf_link_base(const elf_file_t* elf, uintptr_t page_mask);
+
+// Copies the descriptor of the NT_GNU_BUILD_ID note among the `size` bytes of notes at `notes`,
+// padded to `align`, and returns its length, truncated to `max`. Returns 0 if there is none.
+size_t elf_notes_build_id(const unsigned char* notes,
+                          size_t size,
+                          size_t align,
+                          unsigned char* out,
+                          size_t max);
+
+// Like elf_notes_build_id(), for the notes sections of the file
+size_t elf_build_id(const elf_file_t* elf, unsigned char* out, size_t max);
+
+#endif // BW_ELF_FILE_H
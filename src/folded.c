@@ -0,0 +1,416 @@
+#include "backwalk/folded.h"
+
+#include <errno.h>              // for errno, EINTR
+#include <stdbool.h>            // for bool, false, true
+#include <stddef.h>             // for size_t, NULL
+#include <stdint.h>             // for uintptr_t, uint64_t, uint32_t
+#include <stdlib.h>             // for calloc, free, malloc, realloc
+#include <string.h>             // for memcpy, memset, strlen, strrchr
+#include <sys/types.h>          // for ssize_t
+#include <unistd.h>             // for write
+
+#include "backwalk/backwalk.h"  // for bw_demangle
+#include "common.h"             // for BW_UNUSED
+#include "module.h"             // for module_map_get, module_map_sync, module_map_t
+#include "resolve.h"            // for resolve_frame
+
+enum { FOLDED_DEFAULT_BUFFER_SIZE = 64 << 10 };
+enum { FOLDED_INITIAL_NODES = 1024 };
+enum { FOLDED_INITIAL_SYMBOLS = 1024 };
+enum { FOLDED_INITIAL_PATH = 64 };
+// Longest number or hexadecimal address written, with its prefix
+enum { FOLDED_NUMBER_MAX = 24 };
+
+#define HASH_MULTIPLIER 0x9e3779b97f4a7c15ULL
+#define HASH_SHIFT 32
+#define HEX_BASE 16
+#define DEC_BASE 10
+
+// A trie node per distinct stack prefix, outermost frame first. Node 0 is the root. Children are
+// found through a hash table keyed by parent and address, and linked as siblings so that flushing
+// walks the trie depth-first and writes each line from the path to its node. Flushing empties it.
+typedef struct {
+    uintptr_t ip;
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t next_sibling;
+    uint64_t count;
+} folded_node_t;
+
+typedef struct {
+    const char* sname;
+    const char* fname;
+    uintptr_t mod_addr;
+} folded_frame_t;
+
+typedef struct {
+    uintptr_t ip; // 0 marks an empty slot
+    folded_frame_t frame;
+} folded_symbol_t;
+
+struct bw_folded {
+    int fd;
+    bool failed;
+    bool cache_symbols;
+    bool demangle;
+
+    char* buf;
+    size_t buf_size;
+    size_t len;
+    bool owns_buf;
+
+    folded_node_t* nodes;
+    size_t nodes_len;
+    size_t nodes_cap;
+    uint32_t* children; // Open addressing table of node indices, kept at most half full
+    size_t children_mask;
+
+    folded_symbol_t* symbols; // Open addressing table by address, kept at most half full
+    size_t symbols_mask;
+    size_t symbols_len;
+
+    folded_frame_t* path; // Resolved frames from the root to the node being visited
+    size_t path_cap;
+};
+
+static size_t folded_hash(uintptr_t ip, uint32_t parent) {
+    uint64_t hash = ((uint64_t)ip ^ ((uint64_t)parent << HASH_SHIFT)) * HASH_MULTIPLIER;
+
+    return (size_t)(hash ^ (hash >> HASH_SHIFT));
+}
+
+static void out_flush(bw_folded_t* folded) {
+    size_t flushed = 0;
+    while (!folded->failed && flushed < folded->len) {
+        ssize_t written = write(folded->fd, folded->buf + flushed, folded->len - flushed);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            folded->failed = true;
+            break;
+        }
+        flushed += (size_t)written;
+    }
+    folded->len = 0;
+}
+
+static void out_bytes(bw_folded_t* folded, const char* data, size_t len) {
+    while (len > 0) {
+        if (folded->len == folded->buf_size) {
+            out_flush(folded);
+        }
+
+        size_t chunk = folded->buf_size - folded->len;
+        chunk = chunk < len ? chunk : len;
+        memcpy(folded->buf + folded->len, data, chunk);
+        folded->len += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+static void out_str(bw_folded_t* folded, const char* str) {
+    out_bytes(folded, str, strlen(str));
+}
+
+static void out_num(bw_folded_t* folded, uint64_t value, unsigned base) {
+    static const char k_digits[] = "0123456789abcdef";
+
+    char digits[FOLDED_NUMBER_MAX];
+    size_t len = sizeof(digits);
+    do {
+        digits[--len] = k_digits[value % base];
+        value /= base;
+    } while (value > 0);
+
+    out_bytes(folded, &digits[len], sizeof(digits) - len);
+}
+
+// Frames without a symbol are named after their module and offset, as in "libc.so.6+0x2724a"
+static void out_frame(bw_folded_t* folded, const folded_frame_t* frame) {
+    if (frame->sname[0] != '?' || frame->sname[1] != '\0') {
+        out_str(folded, frame->sname);
+        return;
+    }
+
+    if (frame->fname[0] == '?' && frame->fname[1] == '\0') {
+        out_str(folded, "[unknown]");
+        return;
+    }
+
+    const char* slash = strrchr(frame->fname, '/');
+    out_str(folded, slash ? slash + 1 : frame->fname);
+    out_str(folded, "+0x");
+    out_num(folded, frame->mod_addr, HEX_BASE);
+}
+
+static bool folded_children_reserve(bw_folded_t* folded) {
+    size_t slots = folded->children_mask + 1;
+    if (folded->nodes_len * 2 <= slots) {
+        return true;
+    }
+
+    uint32_t* children = calloc(slots * 2, sizeof(*children));
+    if (!children) {
+        return false;
+    }
+
+    size_t mask = (slots * 2) - 1;
+    for (uint32_t i = 1; i < folded->nodes_len; ++i) {
+        size_t j = folded_hash(folded->nodes[i].ip, folded->nodes[i].parent);
+        while (children[j & mask]) {
+            ++j;
+        }
+        children[j & mask] = i;
+    }
+
+    free(folded->children);
+    folded->children = children;
+    folded->children_mask = mask;
+
+    return true;
+}
+
+// Returns the child of `parent` for `ip`, adding it if it is new, or 0 if out of memory
+static uint32_t folded_child(bw_folded_t* folded, uint32_t parent, uintptr_t ip) {
+    size_t i = folded_hash(ip, parent);
+    for (;; ++i) {
+        uint32_t child = folded->children[i & folded->children_mask];
+        if (!child) {
+            break;
+        }
+        if (folded->nodes[child].ip == ip && folded->nodes[child].parent == parent) {
+            return child;
+        }
+    }
+
+    if (folded->nodes_len == folded->nodes_cap) {
+        folded_node_t* nodes = realloc(folded->nodes, folded->nodes_cap * 2 * sizeof(*nodes));
+        if (!nodes) {
+            return 0;
+        }
+        folded->nodes = nodes;
+        folded->nodes_cap *= 2;
+    }
+
+    uint32_t child = (uint32_t)folded->nodes_len++;
+    folded_node_t* node = &folded->nodes[child];
+    node->ip = ip;
+    node->parent = parent;
+    node->first_child = 0;
+    node->next_sibling = folded->nodes[parent].first_child;
+    node->count = 0;
+    folded->nodes[parent].first_child = child;
+
+    folded->children[i & folded->children_mask] = child;
+    if (!folded_children_reserve(folded)) {
+        // The node was added, later lookups find it once the table could grow
+        folded->failed = true;
+    }
+
+    return child;
+}
+
+static bool folded_symbols_reserve(bw_folded_t* folded) {
+    size_t slots = folded->symbols_mask + 1;
+    if ((folded->symbols_len + 1) * 2 <= slots) {
+        return true;
+    }
+
+    folded_symbol_t* symbols = calloc(slots * 2, sizeof(*symbols));
+    if (!symbols) {
+        return false;
+    }
+
+    size_t mask = (slots * 2) - 1;
+    for (size_t i = 0; i < slots; ++i) {
+        if (folded->symbols[i].ip) {
+            size_t j = folded_hash(folded->symbols[i].ip, 0);
+            while (symbols[j & mask].ip) {
+                ++j;
+            }
+            symbols[j & mask] = folded->symbols[i];
+        }
+    }
+
+    free(folded->symbols);
+    folded->symbols = symbols;
+    folded->symbols_mask = mask;
+
+    return true;
+}
+
+static void folded_resolve(bw_folded_t* folded,
+                           const module_map_t* map,
+                           uintptr_t ip,
+                           folded_frame_t* frame) {
+    folded_symbol_t* slot = NULL;
+    if (folded->cache_symbols && folded_symbols_reserve(folded)) {
+        for (size_t i = folded_hash(ip, 0);; ++i) {
+            slot = &folded->symbols[i & folded->symbols_mask];
+            if (slot->ip == ip) {
+                *frame = slot->frame;
+                return;
+            }
+            if (!slot->ip) {
+                break;
+            }
+        }
+    }
+
+    resolve_frame(map, ip, &frame->mod_addr, &frame->fname, &frame->sname);
+    if (folded->demangle) {
+        frame->sname = bw_demangle(frame->sname);
+    }
+
+    if (slot) {
+        slot->ip = ip;
+        slot->frame = *frame;
+        folded->symbols_len++;
+    }
+}
+
+static void folded_reset(bw_folded_t* folded) {
+    folded->nodes_len = 1;
+    folded->nodes[0].first_child = 0;
+    memset(folded->children, 0, (folded->children_mask + 1) * sizeof(*folded->children));
+}
+
+bw_folded_t* bw_folded_create(const bw_folded_config_t* config) {
+    if (!config || config->fd < 0 || (config->buffer && config->buffer_size == 0)) {
+        return NULL;
+    }
+
+    bw_folded_t* folded = calloc(1, sizeof(*folded));
+    if (!folded) {
+        return NULL;
+    }
+
+    folded->fd = config->fd;
+    folded->cache_symbols = config->cache_symbols;
+    folded->demangle = config->demangle;
+    folded->buf_size = config->buffer_size ? config->buffer_size : FOLDED_DEFAULT_BUFFER_SIZE;
+    folded->owns_buf = !config->buffer;
+    folded->buf = config->buffer ? config->buffer : malloc(folded->buf_size);
+
+    folded->nodes_cap = FOLDED_INITIAL_NODES;
+    folded->nodes = calloc(folded->nodes_cap, sizeof(*folded->nodes));
+    folded->nodes_len = 1;
+    folded->children_mask = (FOLDED_INITIAL_NODES * 2) - 1;
+    folded->children = calloc(folded->children_mask + 1, sizeof(*folded->children));
+    folded->symbols_mask = FOLDED_INITIAL_SYMBOLS - 1;
+    folded->symbols = calloc(FOLDED_INITIAL_SYMBOLS, sizeof(*folded->symbols));
+    folded->path_cap = FOLDED_INITIAL_PATH;
+    folded->path = malloc(folded->path_cap * sizeof(*folded->path));
+
+    if (!folded->buf || !folded->nodes || !folded->children || !folded->symbols || !folded->path) {
+        bw_folded_destroy(folded);
+        return NULL;
+    }
+
+    return folded;
+}
+
+bool bw_folded_add(bw_folded_t* folded, const uintptr_t* ips, size_t len, uint64_t value) {
+    if (!folded || (!ips && len > 0)) {
+        return false;
+    }
+
+    // Flame graphs have nothing to show for empty stacks
+    if (len == 0) {
+        return true;
+    }
+
+    uint32_t node = 0;
+    for (size_t i = len; i-- > 0;) {
+        node = folded_child(folded, node, ips[i]);
+        if (!node) {
+            folded->failed = true;
+            return false;
+        }
+    }
+    folded->nodes[node].count += value;
+
+    return true;
+}
+
+bool bw_folded_flush(bw_folded_t* folded) {
+    if (!folded) {
+        return false;
+    }
+
+    BW_UNUSED(module_map_sync());
+    const module_map_t* map = module_map_get();
+
+    uint32_t node = folded->nodes[0].first_child;
+    size_t depth = 0;
+    while (node) {
+        if (depth == folded->path_cap) {
+            folded_frame_t* path = realloc(folded->path, folded->path_cap * 2 * sizeof(*path));
+            if (!path) {
+                folded->failed = true;
+                break;
+            }
+            folded->path = path;
+            folded->path_cap *= 2;
+        }
+
+        folded_node_t* current = &folded->nodes[node];
+        folded_resolve(folded, map, current->ip, &folded->path[depth]);
+
+        if (current->count > 0) {
+            for (size_t i = 0; i <= depth; ++i) {
+                if (i > 0) {
+                    out_bytes(folded, ";", 1);
+                }
+                out_frame(folded, &folded->path[i]);
+            }
+            out_bytes(folded, " ", 1);
+            out_num(folded, current->count, DEC_BASE);
+            out_bytes(folded, "\n", 1);
+            current->count = 0;
+        }
+
+        if (current->first_child) {
+            node = current->first_child;
+            depth++;
+            continue;
+        }
+
+        // Back up to the closest ancestor with a sibling left to visit
+        while (node && !folded->nodes[node].next_sibling) {
+            node = folded->nodes[node].parent;
+            depth -= node ? 1 : 0;
+        }
+        node = node ? folded->nodes[node].next_sibling : 0;
+    }
+
+    // Every count was written, so the trie starts over: later flushes only visit the stacks added
+    // after this one, instead of every stack ever seen. The tables keep their capacity.
+    if (!node) {
+        folded_reset(folded);
+    }
+
+    out_flush(folded);
+
+    bool success = !folded->failed;
+    folded->failed = false;
+
+    return success;
+}
+
+void bw_folded_destroy(bw_folded_t* folded) {
+    if (!folded) {
+        return;
+    }
+
+    if (folded->owns_buf) {
+        free(folded->buf);
+    }
+    free(folded->nodes);
+    free(folded->children);
+    free(folded->symbols);
+    free(folded->path);
+    free(folded);
+}
@@ -0,0 +1,563 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include "backwalk/heap_profiler.h"
+
+#include <inttypes.h>              // for PRIu64, PRIxPTR
+#include <math.h>                  // for expm1, log
+#include <errno.h>                 // for EINVAL, ENOMEM
+#include <pthread.h>               // for pthread_mutex_lock, pthread_mutex_unlock, PTHREAD_MUTE...
+#include <stdatomic.h>             // for atomic_load_explicit, atomic_store_explicit, memory_or...
+#include <stdbool.h>               // for bool, false, true
+#include <stddef.h>                // for size_t, NULL
+#include <stdint.h>                // for uintptr_t, uint64_t, int64_t, uint32_t, INT64_MAX
+#include <stdio.h>                 // for fclose, fopen, fprintf, fputs, fgets, FILE
+#include <stdlib.h>                // for getenv, strtoull
+
+#include "backwalk/backwalk.h"     // for bw_capture
+#include "backwalk/stack_table.h"  // for bw_stack_table_create, bw_stack_table_intern, bw_stac...
+#include "common.h"                // for BW_UNUSED
+
+// glibc's allocator, which the interposed functions forward to. Calling it directly rather than
+// through dlsym(RTLD_NEXT) also works before the dynamic linker is ready to look up symbols.
+// NOLINTBEGIN(bugprone-reserved-identifier, readability-identifier-naming)
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void* ptr);
+// NOLINTEND(bugprone-reserved-identifier, readability-identifier-naming)
+
+enum { HEAP_DEFAULT_SAMPLE_INTERVAL = 512 << 10 };
+enum { HEAP_DEFAULT_MAX_SAMPLES = 1 << 16 };
+enum { HEAP_DEFAULT_MAX_STACKS = 1 << 14 };
+// The frames of heap_sample() and of the interposed function
+enum { HEAP_SKIP_FRAMES = 2 };
+
+#define HASH_MULTIPLIER 0x9e3779b97f4a7c15ULL
+#define HASH_SHIFT 32
+
+// xorshift64*, see Vigna, "An experimental exploration of Marsaglia's xorshift generators"
+#define RNG_MULTIPLIER 0x2545f4914f6cdd1dULL
+#define RNG_SHIFT_A 12
+#define RNG_SHIFT_B 25
+#define RNG_SHIFT_C 27
+// Turns the top 53 bits into a double in (0, 1]
+#define RNG_MANTISSA_SHIFT 11
+#define RNG_MANTISSA_SCALE 0x1.0p-53
+
+typedef struct {
+    int64_t remaining; // Bytes left until the next sample
+    uint64_t rng;      // 0 until the thread's first allocation
+    bool busy;         // Allocations made by the profiler itself are never sampled
+} heap_thread_t;
+
+// Initial-exec TLS keeps the fast path to a single decrement, without __tls_get_addr
+static _Thread_local heap_thread_t heap_thread __attribute__((tls_model("initial-exec")));
+
+typedef struct {
+    _Atomic(uintptr_t) ptr;
+    uint32_t stack_id;
+    uint64_t weight; // Estimated bytes that the sample stands for
+} heap_sample_t;
+
+typedef struct {
+    uint64_t live_bytes;
+    uint64_t live_allocs;
+} heap_stack_t;
+
+typedef struct {
+    uint32_t id;
+    heap_stack_t stack;
+} heap_dump_entry_t;
+
+// Sampled allocations live in an open addressing table, kept at most half full. Every free()
+// checks it without locks, so removals, which shift entries back into the freed slot, are
+// bracketed by a sequence counter that readers retry on.
+typedef struct {
+    pthread_mutex_t lock;
+    atomic_bool running;
+    atomic_size_t interval;
+    _Atomic(heap_sample_t*) samples;
+    size_t mask;
+    size_t len;
+    atomic_uint seq;
+    bw_stack_table_t* stacks;
+    heap_stack_t* stack_stats;
+    uint64_t sampled;
+    uint64_t dropped;
+    atomic_uint_fast64_t seeds;
+} heap_profiler_t;
+
+static heap_profiler_t heap = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static size_t heap_hash(uintptr_t ptr) {
+    uint64_t hash = ptr * HASH_MULTIPLIER;
+
+    return (size_t)(hash ^ (hash >> HASH_SHIFT));
+}
+
+static uint64_t heap_rng_next(heap_thread_t* ht) {
+    uint64_t x = ht->rng;
+    x ^= x >> RNG_SHIFT_A;
+    x ^= x << RNG_SHIFT_B;
+    x ^= x >> RNG_SHIFT_C;
+    ht->rng = x;
+
+    return x * RNG_MULTIPLIER;
+}
+
+// Gaps between samples are exponentially distributed, which makes sampling a Poisson process over
+// allocated bytes: every byte is equally likely to be sampled, whatever the allocation pattern.
+static int64_t heap_next_interval(heap_thread_t* ht, size_t interval) {
+    double u = (double)((heap_rng_next(ht) >> RNG_MANTISSA_SHIFT) + 1) * RNG_MANTISSA_SCALE;
+    double bytes = -log(u) * (double)interval;
+
+    return bytes < 1 ? 1 : bytes > (double)INT64_MAX / 2 ? INT64_MAX / 2 : (int64_t)bytes;
+}
+
+// An allocation of `size` bytes is sampled with probability 1 - exp(-size / interval), so each
+// sample stands for size / probability bytes on average
+static uint64_t heap_weight(size_t size, size_t interval) {
+    double probability = -expm1(-(double)size / (double)interval);
+
+    return probability > 0 ? (uint64_t)((double)size / probability) : size;
+}
+
+static bool heap_is_sampled(uintptr_t ptr) {
+    const heap_sample_t* samples = atomic_load_explicit(&heap.samples, memory_order_acquire);
+    if (!samples) {
+        return false;
+    }
+
+    for (;;) {
+        unsigned seq = atomic_load_explicit(&heap.seq, memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+
+        bool found = false;
+        for (size_t i = heap_hash(ptr), n = 0; n <= heap.mask; ++i, ++n) {
+            uintptr_t key = atomic_load_explicit(&samples[i & heap.mask].ptr, memory_order_relaxed);
+            if (key == ptr || !key) {
+                found = key == ptr;
+                break;
+            }
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&heap.seq, memory_order_relaxed) == seq) {
+            return found;
+        }
+    }
+}
+
+// Must be called with the lock held
+static heap_sample_t* heap_find(uintptr_t ptr) {
+    heap_sample_t* samples = atomic_load_explicit(&heap.samples, memory_order_relaxed);
+    for (size_t i = heap_hash(ptr);; ++i) {
+        heap_sample_t* sample = &samples[i & heap.mask];
+        uintptr_t key = atomic_load_explicit(&sample->ptr, memory_order_relaxed);
+        if (key == ptr || !key) {
+            return sample;
+        }
+    }
+}
+
+// Must be called with the lock held
+static void heap_insert(uintptr_t ptr, uint32_t stack_id, uint64_t weight) {
+    if (stack_id == BW_STACK_ID_INVALID || (heap.len + 1) * 2 > heap.mask + 1) {
+        heap.dropped++;
+        return;
+    }
+
+    heap_sample_t* sample = heap_find(ptr);
+    if (atomic_load_explicit(&sample->ptr, memory_order_relaxed) == ptr) {
+        // Left over from a release that could not take the lock, the block was released since
+        heap_stack_t* stale = &heap.stack_stats[sample->stack_id];
+        stale->live_bytes -= sample->weight;
+        stale->live_allocs--;
+    } else {
+        heap.len++;
+    }
+
+    sample->stack_id = stack_id;
+    sample->weight = weight;
+    atomic_store_explicit(&sample->ptr, ptr, memory_order_release);
+
+    heap.stack_stats[stack_id].live_bytes += weight;
+    heap.stack_stats[stack_id].live_allocs++;
+    heap.sampled++;
+}
+
+// Must be called with the lock held
+static void heap_remove(heap_sample_t* sample) {
+    heap_sample_t* samples = atomic_load_explicit(&heap.samples, memory_order_relaxed);
+    unsigned seq = atomic_load_explicit(&heap.seq, memory_order_relaxed);
+    atomic_store_explicit(&heap.seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    // Entries further along the probe sequence move back into the hole, unless their home slot is
+    // between the hole and them
+    size_t hole = (size_t)(sample - samples);
+    for (size_t i = (hole + 1) & heap.mask;; i = (i + 1) & heap.mask) {
+        uintptr_t key = atomic_load_explicit(&samples[i].ptr, memory_order_relaxed);
+        if (!key) {
+            break;
+        }
+
+        size_t home = heap_hash(key) & heap.mask;
+        bool stays = hole <= i ? (hole < home && home <= i) : (hole < home || home <= i);
+        if (stays) {
+            continue;
+        }
+
+        samples[hole].stack_id = samples[i].stack_id;
+        samples[hole].weight = samples[i].weight;
+        atomic_store_explicit(&samples[hole].ptr, key, memory_order_relaxed);
+        hole = i;
+    }
+    atomic_store_explicit(&samples[hole].ptr, 0, memory_order_relaxed);
+    heap.len--;
+
+    atomic_store_explicit(&heap.seq, seq + 2, memory_order_release);
+}
+
+// Removes the sample of a block that is about to be released, returning it in `forgotten`
+static bool heap_forget(uintptr_t ptr, heap_sample_t* forgotten) {
+    if (pthread_mutex_lock(&heap.lock) != 0) {
+        return false;
+    }
+
+    heap_sample_t* sample = heap_find(ptr);
+    bool found = atomic_load_explicit(&sample->ptr, memory_order_relaxed) == ptr;
+    if (found) {
+        forgotten->stack_id = sample->stack_id;
+        forgotten->weight = sample->weight;
+        heap_stack_t* stack = &heap.stack_stats[sample->stack_id];
+        stack->live_bytes -= sample->weight;
+        stack->live_allocs--;
+        heap_remove(sample);
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&heap.lock));
+
+    return found;
+}
+
+// Puts back a sample forgotten by heap_forget() when the block was not released after all. Its slot
+// was freed by the removal, so this never drops it.
+static void heap_restore(uintptr_t ptr, const heap_sample_t* forgotten) {
+    if (pthread_mutex_lock(&heap.lock) != 0) {
+        return;
+    }
+
+    heap_sample_t* sample = heap_find(ptr);
+    if (atomic_load_explicit(&sample->ptr, memory_order_relaxed) != ptr) {
+        sample->stack_id = forgotten->stack_id;
+        sample->weight = forgotten->weight;
+        atomic_store_explicit(&sample->ptr, ptr, memory_order_release);
+        heap.len++;
+
+        heap_stack_t* stack = &heap.stack_stats[forgotten->stack_id];
+        stack->live_bytes += forgotten->weight;
+        stack->live_allocs++;
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&heap.lock));
+}
+
+__attribute__((noinline)) static void heap_sample(heap_thread_t* ht, void* ptr, size_t size) {
+    if (ht->busy) {
+        return;
+    }
+
+    size_t interval = atomic_load_explicit(&heap.interval, memory_order_relaxed);
+    if (!atomic_load_explicit(&heap.running, memory_order_relaxed)) {
+        // Checked again after as many bytes as the default interval
+        ht->remaining = HEAP_DEFAULT_SAMPLE_INTERVAL;
+        return;
+    }
+
+    // The first allocation of a thread only seeds its generator, sampling it would be biased
+    bool first = ht->rng == 0;
+    if (first) {
+        uint64_t seed = atomic_fetch_add_explicit(&heap.seeds, 1, memory_order_relaxed);
+        ht->rng = ((seed + 1) * HASH_MULTIPLIER) ^ (uintptr_t)ht;
+    }
+    ht->remaining = heap_next_interval(ht, interval);
+    if (first || !ptr) {
+        return;
+    }
+
+    ht->busy = true;
+
+    // Captured before taking the lock: the walk may call into the dynamic linker
+    uintptr_t ips[BW_HEAP_PROFILER_FRAMES_MAX];
+    size_t len = bw_capture(ips, BW_HEAP_PROFILER_FRAMES_MAX, HEAP_SKIP_FRAMES);
+
+    if (pthread_mutex_lock(&heap.lock) == 0) {
+        uint32_t stack_id = bw_stack_table_intern(heap.stacks, ips, len);
+        heap_insert((uintptr_t)ptr, stack_id, heap_weight(size, interval));
+        BW_UNUSED(pthread_mutex_unlock(&heap.lock));
+    }
+
+    ht->busy = false;
+}
+
+__attribute__((always_inline)) static inline void heap_account(void* ptr, size_t size) {
+    heap_thread_t* ht = &heap_thread;
+    ht->remaining -= (int64_t)size;
+    if (__builtin_expect(ht->remaining <= 0, 0)) {
+        heap_sample(ht, ptr, size);
+    }
+}
+
+// NOLINTBEGIN(bugprone-reserved-identifier, readability-identifier-naming)
+
+void* malloc(size_t size) {
+    void* ptr = __libc_malloc(size);
+    heap_account(ptr, size);
+
+    return ptr;
+}
+
+void* calloc(size_t nmemb, size_t size) {
+    void* ptr = __libc_calloc(nmemb, size);
+    size_t total = 0;
+    if (!__builtin_mul_overflow(nmemb, size, &total)) {
+        heap_account(ptr, total);
+    }
+
+    return ptr;
+}
+
+void* realloc(void* ptr, size_t size) {
+    // Forgotten before the block is released, which may hand it out again right away. A failed
+    // realloc() leaves it allocated, so its sample is put back; realloc(ptr, 0) frees it.
+    heap_sample_t forgotten = {0};
+    bool sampled =
+        ptr && heap_is_sampled((uintptr_t)ptr) && heap_forget((uintptr_t)ptr, &forgotten);
+
+    void* result = __libc_realloc(ptr, size);
+    if (result) {
+        heap_account(result, size);
+    } else if (sampled && size > 0) {
+        heap_restore((uintptr_t)ptr, &forgotten);
+    }
+
+    return result;
+}
+
+void* memalign(size_t alignment, size_t size) {
+    void* ptr = __libc_memalign(alignment, size);
+    heap_account(ptr, size);
+
+    return ptr;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    void* ptr = __libc_memalign(alignment, size);
+    heap_account(ptr, size);
+
+    return ptr;
+}
+
+int posix_memalign(void** memptr, size_t alignment, size_t size) {
+    // The alignment must be a power of two multiple of sizeof(void*), memalign() accepts any
+    if (alignment == 0 || alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+
+    void* ptr = __libc_memalign(alignment, size);
+    if (!ptr) {
+        return ENOMEM;
+    }
+    heap_account(ptr, size);
+    *memptr = ptr;
+
+    return 0;
+}
+
+void free(void* ptr) {
+    // Forgotten before the block is released, which may hand it out again right away
+    heap_sample_t forgotten = {0};
+    if (ptr && heap_is_sampled((uintptr_t)ptr)) {
+        BW_UNUSED(heap_forget((uintptr_t)ptr, &forgotten));
+    }
+
+    __libc_free(ptr);
+}
+
+// NOLINTEND(bugprone-reserved-identifier, readability-identifier-naming)
+
+// Must be called with the lock held
+static bool heap_tables_init(const bw_heap_profiler_config_t* config) {
+    if (atomic_load_explicit(&heap.samples, memory_order_relaxed)) {
+        return true;
+    }
+
+    size_t max_samples = config->max_samples ? config->max_samples : HEAP_DEFAULT_MAX_SAMPLES;
+    size_t max_stacks = config->max_stacks ? config->max_stacks : HEAP_DEFAULT_MAX_STACKS;
+
+    // Keep the load factor at or below one half
+    size_t slots = 1;
+    while (slots < max_samples * 2) {
+        slots <<= 1;
+    }
+
+    heap_sample_t* samples = calloc(slots, sizeof(*samples));
+    heap.stack_stats = calloc(max_stacks + 1, sizeof(*heap.stack_stats));
+    heap.stacks = bw_stack_table_create(max_stacks);
+    if (!samples || !heap.stack_stats || !heap.stacks) {
+        free(samples);
+        free(heap.stack_stats);
+        bw_stack_table_destroy(heap.stacks);
+        heap.stack_stats = NULL;
+        heap.stacks = NULL;
+        return false;
+    }
+
+    heap.mask = slots - 1;
+    atomic_store_explicit(&heap.samples, samples, memory_order_release);
+
+    return true;
+}
+
+bool bw_heap_profiler_start(const bw_heap_profiler_config_t* config) {
+    if (!config) {
+        return false;
+    }
+
+    heap_thread_t* ht = &heap_thread;
+    bool busy = ht->busy;
+    ht->busy = true;
+
+    bool success = pthread_mutex_lock(&heap.lock) == 0;
+    if (success) {
+        success = heap_tables_init(config);
+        if (success) {
+            size_t interval =
+                config->sample_interval ? config->sample_interval : HEAP_DEFAULT_SAMPLE_INTERVAL;
+            atomic_store_explicit(&heap.interval, interval, memory_order_relaxed);
+            atomic_store_explicit(&heap.running, true, memory_order_relaxed);
+        }
+        BW_UNUSED(pthread_mutex_unlock(&heap.lock));
+    }
+
+    ht->busy = busy;
+
+    return success;
+}
+
+void bw_heap_profiler_stop(void) {
+    atomic_store_explicit(&heap.running, false, memory_order_relaxed);
+}
+
+void bw_heap_profiler_dump(bw_heap_profiler_cb cb, void* arg) {
+    if (!cb || pthread_mutex_lock(&heap.lock) != 0) {
+        return;
+    }
+
+    // Copied under the lock, so that the callback can free sampled blocks
+    uint32_t limit = heap.stacks ? bw_stack_table_id_limit(heap.stacks) : 0;
+    heap_dump_entry_t* entries = limit > 0 ? __libc_malloc(limit * sizeof(*entries)) : NULL;
+    size_t len = 0;
+    for (uint32_t id = 1; entries && id < limit; ++id) {
+        if (heap.stack_stats[id].live_allocs > 0) {
+            entries[len].id = id;
+            entries[len].stack = heap.stack_stats[id];
+            len++;
+        }
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&heap.lock));
+
+    for (size_t i = 0; i < len; ++i) {
+        const uintptr_t* ips = NULL;
+        size_t ips_len = bw_stack_table_get(heap.stacks, entries[i].id, &ips);
+        cb(ips, ips_len, entries[i].stack.live_bytes, entries[i].stack.live_allocs, arg);
+    }
+
+    __libc_free(entries);
+}
+
+void bw_heap_profiler_get_stats(bw_heap_profiler_stats_t* stats) {
+    if (!stats || pthread_mutex_lock(&heap.lock) != 0) {
+        return;
+    }
+
+    stats->samples = heap.sampled;
+    stats->dropped = heap.dropped;
+    stats->live_samples = heap.len;
+
+    BW_UNUSED(pthread_mutex_unlock(&heap.lock));
+}
+
+#if defined(BW_HEAP_PRELOAD)
+
+// LD_PRELOAD=libbackwalk_heap_preload.so BACKWALK_HEAP_PROFILE=heap.txt ./program profiles the
+// whole run and writes the live allocations at exit, followed by the memory map for symbolization
+static const char* const k_profile_env = "BACKWALK_HEAP_PROFILE";
+static const char* const k_interval_env = "BACKWALK_HEAP_INTERVAL";
+static const char* const k_maps_path = "/proc/self/maps";
+
+enum { PRELOAD_LINE_MAX = 4096 };
+#define DECIMAL_BASE 10
+
+__attribute__((constructor)) static void heap_preload_start(void) {
+    if (!getenv(k_profile_env)) {
+        return;
+    }
+
+    bw_heap_profiler_config_t config = {0};
+    const char* interval = getenv(k_interval_env);
+    if (interval) {
+        config.sample_interval = (size_t)strtoull(interval, NULL, DECIMAL_BASE);
+    }
+    BW_UNUSED(bw_heap_profiler_start(&config));
+}
+
+static void heap_preload_write(const uintptr_t* ips,
+                               size_t len,
+                               uint64_t live_bytes,
+                               uint64_t live_allocs,
+                               void* arg) {
+    FILE* file = arg;
+    BW_UNUSED(fprintf(file, "%" PRIu64 " %" PRIu64 " @", live_bytes, live_allocs));
+    for (size_t i = 0; i < len; ++i) {
+        BW_UNUSED(fprintf(file, " %#" PRIxPTR, ips[i]));
+    }
+    BW_UNUSED(fputs("\n", file));
+}
+
+__attribute__((destructor)) static void heap_preload_dump(void) {
+    const char* path = getenv(k_profile_env);
+    if (!path) {
+        return;
+    }
+
+    bw_heap_profiler_stop();
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return;
+    }
+
+    BW_UNUSED(fputs("# live bytes, live allocations @ return addresses\n", file));
+    bw_heap_profiler_dump(heap_preload_write, file);
+
+    FILE* maps = fopen(k_maps_path, "r");
+    if (maps) {
+        BW_UNUSED(fputs("\nMAPPED_LIBRARIES:\n", file));
+        char line[PRELOAD_LINE_MAX];
+        while (fgets(line, sizeof(line), maps)) {
+            BW_UNUSED(fputs(line, file));
+        }
+        BW_UNUSED(fclose(maps));
+    }
+
+    BW_UNUSED(fclose(file));
+}
+
+#endif // BW_HEAP_PRELOAD
@@ -0,0 +1,399 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include "module.h"
+
+#include <elf.h>        // for PT_LOAD, PT_NOTE, PT_GNU_EH_FRAME, PF_X
+#include <errno.h>      // for program_invocation_name
+#include <link.h>       // for dl_phdr_info, dl_iterate_phdr, ElfW
+#include <pthread.h>    // for pthread_mutex_lock, pthread_mutex_unlock, PTHREAD_MUTEX_INITIA...
+#include <stdatomic.h>  // for atomic_load_explicit, atomic_store_explicit, memory_order_...
+#include <stdbool.h>    // for bool, false, true
+#include <stddef.h>     // for size_t, NULL
+#include <stdint.h>     // for uintptr_t, UINTPTR_MAX
+#include <stdlib.h>     // for free, malloc, qsort, realloc
+#include <string.h>     // for memcmp, strcmp, strdup
+#include <unistd.h>     // for sysconf, _SC_PAGESIZE
+
+#include "cfi.h"        // for cfi_table_build, cfi_table_t
+#include "common.h"     // for BW_UNUSED
+#include "dwarf_line.h" // for dwarf_lines_open, dwarf_lines_t
+#include "elf_file.h"   // for elf_open, elf_close, elf_build_id, elf_notes_build_id, elf_file_t
+
+typedef struct {
+    unsigned long long adds;
+    unsigned long long subs;
+} module_counters_t;
+
+struct module_file {
+    const char* path;
+    _Atomic(elf_file_t*) elf;
+    atomic_bool failed;
+    _Atomic(dwarf_lines_t*) lines;
+    atomic_bool lines_failed;
+    _Atomic(cfi_table_t*) cfi;
+    atomic_bool cfi_failed;
+};
+
+typedef struct {
+    module_t mod;
+    const char* file_path;
+} module_entry_t;
+
+typedef struct {
+    module_counters_t counters;
+    uintptr_t page_mask;
+    module_entry_t* mods;
+    size_t len;
+    size_t cap;
+    bool failed;
+} module_builder_t;
+
+// Snapshots are published with release semantics and never freed: readers, including signal
+// handlers, may still be holding a pointer to a retired snapshot or to one of its modules.
+static _Atomic(module_map_t*) module_map_current = NULL;
+static pthread_mutex_t module_map_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t module_file_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Path used to open the main executable, argv[0] may be relative or stale
+static const char* const k_self_exe = "/proc/self/exe";
+
+static int read_counters(struct dl_phdr_info* info, size_t size, void* arg) {
+    BW_UNUSED(size);
+
+    module_counters_t* counters = arg;
+    counters->adds = info->dlpi_adds;
+    counters->subs = info->dlpi_subs;
+
+    return 1; // The counters are the same for every object, stop after the first one
+}
+
+static int collect_module(struct dl_phdr_info* info, size_t size, void* arg) {
+    BW_UNUSED(size);
+
+    module_builder_t* builder = arg;
+    builder->counters.adds = info->dlpi_adds;
+    builder->counters.subs = info->dlpi_subs;
+
+    uintptr_t start = UINTPTR_MAX;
+    uintptr_t end = 0;
+    uintptr_t text_start = UINTPTR_MAX;
+    uintptr_t text_end = 0;
+    uintptr_t eh_frame_hdr = 0;
+    for (size_t i = 0; i < info->dlpi_phnum; ++i) {
+        const ElfW(Phdr)* phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type == PT_GNU_EH_FRAME) {
+            eh_frame_hdr = info->dlpi_addr + phdr->p_vaddr;
+        }
+        if (phdr->p_type != PT_LOAD) {
+            continue;
+        }
+        if (phdr->p_vaddr < start) {
+            start = phdr->p_vaddr;
+        }
+        if (phdr->p_vaddr + phdr->p_memsz > end) {
+            end = phdr->p_vaddr + phdr->p_memsz;
+        }
+        if ((phdr->p_flags & PF_X) && phdr->p_vaddr < text_start) {
+            text_start = phdr->p_vaddr;
+        }
+        if ((phdr->p_flags & PF_X) && phdr->p_vaddr + phdr->p_memsz > text_end) {
+            text_end = phdr->p_vaddr + phdr->p_memsz;
+        }
+    }
+
+    if (start >= end) {
+        return 0;
+    }
+
+    if (builder->len == builder->cap) {
+        const size_t initial_cap = 32;
+        size_t cap = builder->cap ? builder->cap * 2 : initial_cap;
+        module_entry_t* mods = realloc(builder->mods, cap * sizeof(*mods));
+        if (!mods) {
+            builder->failed = true;
+            return 1;
+        }
+        builder->mods = mods;
+        builder->cap = cap;
+    }
+
+    module_entry_t* entry = &builder->mods[builder->len++];
+    module_t* mod = &entry->mod;
+    // The main executable has an empty name, dladdr reports it as argv[0]
+    bool main = !info->dlpi_name || !info->dlpi_name[0];
+    mod->path = main ? program_invocation_name : info->dlpi_name;
+    mod->file = NULL;
+    entry->file_path = main ? k_self_exe : mod->path;
+    mod->bias = info->dlpi_addr;
+    mod->base = info->dlpi_addr + (start & builder->page_mask);
+    mod->end = info->dlpi_addr + end;
+    mod->text_start = text_start < text_end ? info->dlpi_addr + text_start : 0;
+    mod->text_end = text_start < text_end ? info->dlpi_addr + text_end : 0;
+    mod->eh_frame_hdr = eh_frame_hdr;
+    mod->build_id_len = 0;
+    for (size_t i = 0; i < info->dlpi_phnum && mod->build_id_len == 0; ++i) {
+        const ElfW(Phdr)* phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type == PT_NOTE) {
+            // NOLINTNEXTLINE(performance-no-int-to-ptr)
+            const unsigned char* notes = (const unsigned char*)(info->dlpi_addr + phdr->p_vaddr);
+            mod->build_id_len = elf_notes_build_id(
+                notes, phdr->p_memsz, phdr->p_align, mod->build_id, MODULE_BUILD_ID_MAX);
+        }
+    }
+
+    return 0;
+}
+
+static int compare_modules(const void* lhs, const void* rhs) {
+    const module_t* lmod = *(const module_t* const*)lhs;
+    const module_t* rmod = *(const module_t* const*)rhs;
+
+    if (lmod->base == rmod->base) {
+        return 0;
+    }
+
+    return lmod->base < rmod->base ? -1 : 1;
+}
+
+static bool module_equal(const module_t* lhs, const module_t* rhs) {
+    // A library rebuilt and loaded again at the same address must not keep its old build ID
+    return lhs->bias == rhs->bias && lhs->base == rhs->base && lhs->end == rhs->end &&
+           lhs->build_id_len == rhs->build_id_len &&
+           memcmp(lhs->build_id, rhs->build_id, lhs->build_id_len) == 0 &&
+           strcmp(lhs->path, rhs->path) == 0;
+}
+
+// Modules that survive a rebuild are shared with the previous snapshot
+static const module_t* module_intern(const module_map_t* prev, const module_entry_t* entry) {
+    const module_t* mod = &entry->mod;
+
+    if (prev) {
+        const module_t* found = module_lookup(prev, mod->base);
+        if (found && module_equal(found, mod)) {
+            return found;
+        }
+    }
+
+    module_t* copy = malloc(sizeof(*copy));
+    module_file_t* file = calloc(1, sizeof(*file));
+    if (!copy || !file) {
+        free(copy);
+        free(file);
+        return NULL;
+    }
+
+    *copy = *mod;
+    copy->path = strdup(mod->path);
+    file->path = strdup(entry->file_path);
+    if (!copy->path || !file->path) {
+        free((void*)copy->path);
+        free((void*)file->path);
+        free(copy);
+        free(file);
+        return NULL;
+    }
+    copy->file = file;
+
+    return copy;
+}
+
+static bool module_map_rebuild(const module_map_t* prev) {
+    module_builder_t builder = {0};
+    builder.page_mask = ~((uintptr_t)sysconf(_SC_PAGESIZE) - 1);
+
+    BW_UNUSED(dl_iterate_phdr(collect_module, &builder));
+    if (builder.failed) {
+        free(builder.mods);
+        return false;
+    }
+
+    module_map_t* map = malloc(sizeof(*map) + (builder.len * sizeof(map->mods[0])));
+    if (!map) {
+        free(builder.mods);
+        return false;
+    }
+
+    map->adds = builder.counters.adds;
+    map->subs = builder.counters.subs;
+    map->len = 0;
+    for (size_t i = 0; i < builder.len; ++i) {
+        const module_t* mod = module_intern(prev, &builder.mods[i]);
+        if (mod) {
+            map->mods[map->len++] = mod;
+        }
+    }
+    free(builder.mods);
+
+    qsort((void*)map->mods, map->len, sizeof(map->mods[0]), compare_modules);
+
+    atomic_store_explicit(&module_map_current, map, memory_order_release);
+
+    return true;
+}
+
+bool module_map_sync(void) {
+    module_counters_t counters = {0};
+    BW_UNUSED(dl_iterate_phdr(read_counters, &counters));
+
+    const module_map_t* map = module_map_get();
+    if (map && map->adds == counters.adds && map->subs == counters.subs) {
+        return true;
+    }
+
+    if (pthread_mutex_lock(&module_map_lock) != 0) {
+        return false;
+    }
+
+    // Another thread may have rebuilt the map while we were waiting for the lock
+    bool success = true;
+    map = module_map_get();
+    if (!map || map->adds != counters.adds || map->subs != counters.subs) {
+        success = module_map_rebuild(map);
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&module_map_lock));
+
+    return success;
+}
+
+const module_map_t* module_map_get(void) {
+    return atomic_load_explicit(&module_map_current, memory_order_acquire);
+}
+
+const module_map_t* module_map_acquire(void) {
+    const module_map_t* map = module_map_get();
+    if (!map) {
+        BW_UNUSED(module_map_sync());
+        map = module_map_get();
+    }
+
+    return map;
+}
+
+const module_map_t* module_map_synced(void) {
+    BW_UNUSED(module_map_sync());
+
+    return module_map_get();
+}
+
+const module_t* module_lookup(const module_map_t* map, uintptr_t addr) {
+    if (!map || map->len == 0) {
+        return NULL;
+    }
+
+    // Find the last module whose base is not above addr
+    size_t lo = 0;
+    size_t hi = map->len;
+    while (lo < hi) {
+        size_t mid = lo + ((hi - lo) / 2);
+        if (map->mods[mid]->base <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == 0) {
+        return NULL;
+    }
+
+    const module_t* mod = map->mods[lo - 1];
+
+    return addr < mod->end ? mod : NULL;
+}
+
+// The file is opened again by path, which may have been replaced on disk since the module was
+// loaded. Modules without a build ID cannot be checked.
+static bool module_file_matches(const module_t* mod, const elf_file_t* elf) {
+    if (mod->build_id_len == 0) {
+        return true;
+    }
+
+    unsigned char build_id[MODULE_BUILD_ID_MAX];
+    size_t len = elf_build_id(elf, build_id, sizeof(build_id));
+
+    return len == mod->build_id_len && memcmp(build_id, mod->build_id, len) == 0;
+}
+
+const elf_file_t* module_elf(const module_t* mod) {
+    module_file_t* file = mod->file;
+
+    elf_file_t* elf = atomic_load_explicit(&file->elf, memory_order_acquire);
+    if (elf || atomic_load_explicit(&file->failed, memory_order_relaxed)) {
+        return elf;
+    }
+
+    if (pthread_mutex_lock(&module_file_lock) != 0) {
+        return NULL;
+    }
+
+    elf = atomic_load_explicit(&file->elf, memory_order_relaxed);
+    if (!elf && !atomic_load_explicit(&file->failed, memory_order_relaxed)) {
+        // Like modules, mapped files are never released: symbol names point into them
+        elf = elf_open(file->path);
+        if (elf && !module_file_matches(mod, elf)) {
+            elf_close(elf);
+            elf = NULL;
+        }
+        atomic_store_explicit(&file->failed, elf == NULL, memory_order_relaxed);
+        atomic_store_explicit(&file->elf, elf, memory_order_release);
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&module_file_lock));
+
+    return elf;
+}
+
+dwarf_lines_t* module_lines(const module_t* mod) {
+    module_file_t* file = mod->file;
+
+    dwarf_lines_t* lines = atomic_load_explicit(&file->lines, memory_order_acquire);
+    if (lines || atomic_load_explicit(&file->lines_failed, memory_order_relaxed)) {
+        return lines;
+    }
+
+    const elf_file_t* elf = module_elf(mod);
+    if (!elf || pthread_mutex_lock(&module_file_lock) != 0) {
+        return NULL;
+    }
+
+    lines = atomic_load_explicit(&file->lines, memory_order_relaxed);
+    if (!lines && !atomic_load_explicit(&file->lines_failed, memory_order_relaxed)) {
+        lines = dwarf_lines_open(elf);
+        atomic_store_explicit(&file->lines_failed, lines == NULL, memory_order_relaxed);
+        atomic_store_explicit(&file->lines, lines, memory_order_release);
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&module_file_lock));
+
+    return lines;
+}
+
+const cfi_table_t* module_cfi(const module_t* mod) {
+    module_file_t* file = mod->file;
+
+    cfi_table_t* cfi = atomic_load_explicit(&file->cfi, memory_order_acquire);
+    if (cfi || atomic_load_explicit(&file->cfi_failed, memory_order_relaxed)) {
+        return cfi;
+    }
+
+    if (pthread_mutex_lock(&module_file_lock) != 0) {
+        return NULL;
+    }
+
+    cfi = atomic_load_explicit(&file->cfi, memory_order_relaxed);
+    if (!cfi && !atomic_load_explicit(&file->cfi_failed, memory_order_relaxed)) {
+        // Built from the loaded image rather than the file, which also covers the vDSO
+        cfi = cfi_table_build(mod->base, mod->eh_frame_hdr);
+        atomic_store_explicit(&file->cfi_failed, cfi == NULL, memory_order_relaxed);
+        atomic_store_explicit(&file->cfi, cfi, memory_order_release);
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&module_file_lock));
+
+    return cfi;
+}
+
+const cfi_table_t* module_cfi_get(const module_t* mod) {
+    return atomic_load_explicit(&mod->file->cfi, memory_order_acquire);
+}
@@ -0,0 +1,78 @@
+#ifndef BW_MODULE_H
+#define BW_MODULE_H
+
+#include <stdbool.h>  // for bool
+#include <stddef.h>   // for size_t
+#include <stdint.h>   // for uintptr_t
+
+#include "cfi.h"         // for cfi_table_t
+#include "dwarf_line.h"  // for dwarf_lines_t
+#include "elf_file.h"    // for elf_file_t
+
+typedef struct module_file module_file_t;
+
+// Longest build ID that is kept, GNU ld emits 20 bytes (SHA-1) by default
+enum { MODULE_BUILD_ID_MAX = 32 };
+
+typedef struct {
+    const char* path;
+    uintptr_t bias;         // Difference between run-time and link-time addresses
+    uintptr_t base;         // Lowest mapped address, as reported by dladdr
+    uintptr_t end;          // End of the highest loadable segment
+    uintptr_t text_start;   // Range covering the executable segments, empty if there are none
+    uintptr_t text_end;
+    uintptr_t eh_frame_hdr; // Run-time address of .eh_frame_hdr, or 0 if there is none
+    module_file_t* file;    // The module's ELF file, mapped on first use
+    size_t build_id_len;    // 0 if the module has no NT_GNU_BUILD_ID note
+    unsigned char build_id[MODULE_BUILD_ID_MAX];
+} module_t;
+
+typedef struct {
+    unsigned long long adds;
+    unsigned long long subs;
+    size_t len;
+    const module_t* mods[];
+} module_map_t;
+
+// Rebuilds the module map if objects were loaded or unloaded since the last call. Takes the
+// dynamic linker's lock and may allocate, so it must not be called from a signal handler.
+bool module_map_sync(void);
+
+// Returns the current snapshot of the module map, or NULL if it was never built. Snapshots are
+// immutable and never freed, so they can be read without locks, including from signal handlers.
+// A rebuild retires the previous snapshot, one pointer per module, while modules that are still
+// loaded are shared with the new one; unloaded modules keep their records and mapped files. What
+// is retained grows with the number of rebuilds, that is with calls to dlopen() and dlclose().
+const module_map_t* module_map_get(void);
+
+// Returns the current snapshot, building it on first use. Once it exists, the dynamic linker's
+// lock is not taken: walks call module_map_sync() only when an address is in none of the modules,
+// so a module unloaded since the last rebuild stays in the map until then. Used to unwind, where a
+// stale module at worst ends the walk early. Not async-signal-safe.
+const module_map_t* module_map_acquire(void);
+
+// Synchronizes the map and returns the current snapshot, or NULL if it could never be built. Used
+// to name frames: after a dlclose(), another module may be loaded at the same addresses, so a
+// lookup that hits must not be trusted unless the adds/subs counters were compared first. Takes
+// the dynamic linker's lock once. Not async-signal-safe.
+const module_map_t* module_map_synced(void);
+
+const module_t* module_lookup(const module_map_t* map, uintptr_t addr);
+
+// Returns the module's mapped ELF file, mapping and indexing it on first use, or NULL if it cannot
+// be read or its build ID differs from the loaded module's, as when the file was replaced on disk.
+// Not async-signal-safe.
+const elf_file_t* module_elf(const module_t* mod);
+
+// Returns the line table index of the module's ELF file, building it on first use, or NULL if the
+// file has no line information. Not async-signal-safe.
+dwarf_lines_t* module_lines(const module_t* mod);
+
+// Returns the module's compiled CFI table, building it from the loaded .eh_frame on first use, or
+// NULL if it has none. Not async-signal-safe.
+const cfi_table_t* module_cfi(const module_t* mod);
+
+// Returns the module's CFI table if it was already built. Async-signal-safe.
+const cfi_table_t* module_cfi_get(const module_t* mod);
+
+#endif // BW_MODULE_H
@@ -0,0 +1,662 @@
+#include "backwalk/pprof.h"
+
+#include <errno.h>              // for errno, EINTR
+#include <stdbool.h>            // for bool, false, true
+#include <stddef.h>             // for size_t, NULL
+#include <stdint.h>             // for uint64_t, uint32_t, uintptr_t, int64_t
+#include <stdlib.h>             // for calloc, free, realloc
+#include <string.h>             // for strcmp, strlen
+#include <sys/types.h>          // for ssize_t
+#include <unistd.h>             // for write
+
+#include "arena.h"              // for arena_alloc, arena_destroy, arena_init, arena_t
+#include "backwalk/backwalk.h"  // for bw_demangle
+#include "common.h"             // for BW_UNUSED
+#include "dwarf_line.h"         // for dwarf_lines_lookup
+#include "elf_file.h"           // for elf_symbolize
+#include "module.h"             // for module_lookup, module_map_synced, module_t
+
+enum { PPROF_BUFFER_SIZE = 64 << 10 };
+enum { PPROF_ARENA_CHUNK_SIZE = 16 << 10 };
+enum { PPROF_INITIAL_SLOTS = 256 };
+enum { PPROF_INITIAL_CAPACITY = 64 };
+
+// Field numbers of profile.proto
+enum {
+    PROFILE_SAMPLE_TYPE = 1,
+    PROFILE_SAMPLE = 2,
+    PROFILE_MAPPING = 3,
+    PROFILE_LOCATION = 4,
+    PROFILE_FUNCTION = 5,
+    PROFILE_STRING_TABLE = 6,
+    PROFILE_TIME_NANOS = 9,
+    PROFILE_DURATION_NANOS = 10,
+    PROFILE_PERIOD_TYPE = 11,
+    PROFILE_PERIOD = 12,
+};
+
+enum {
+    VALUE_TYPE_TYPE = 1,
+    VALUE_TYPE_UNIT = 2,
+};
+
+enum {
+    SAMPLE_LOCATION_ID = 1,
+    SAMPLE_VALUE = 2,
+};
+
+enum {
+    MAPPING_ID = 1,
+    MAPPING_MEMORY_START = 2,
+    MAPPING_MEMORY_LIMIT = 3,
+    MAPPING_FILENAME = 5,
+    MAPPING_BUILD_ID = 6,
+    MAPPING_HAS_FUNCTIONS = 7,
+    MAPPING_HAS_FILENAMES = 8,
+    MAPPING_HAS_LINE_NUMBERS = 9,
+};
+
+enum {
+    LOCATION_ID = 1,
+    LOCATION_MAPPING_ID = 2,
+    LOCATION_ADDRESS = 3,
+    LOCATION_LINE = 4,
+};
+
+enum {
+    LINE_FUNCTION_ID = 1,
+    LINE_LINE = 2,
+};
+
+enum {
+    FUNCTION_ID = 1,
+    FUNCTION_NAME = 2,
+    FUNCTION_SYSTEM_NAME = 3,
+    FUNCTION_FILENAME = 4,
+};
+
+enum {
+    WIRE_VARINT = 0,
+    WIRE_LEN = 2,
+};
+
+#define WIRE_TYPE_BITS 3
+#define VARINT_BITS 7
+#define VARINT_MASK 0x7fU
+#define VARINT_MORE 0x80U
+
+#define HASH_MULTIPLIER 0x9e3779b97f4a7c15ULL
+#define HASH_SHIFT 32
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+#define HEX_BASE 16
+
+// Open addressing table from 64-bit keys to IDs, kept at most half full. String keys are hashes;
+// their slots also have to match the string itself.
+typedef struct {
+    uint64_t key;
+    uint32_t value; // 0 marks an empty slot
+} pprof_slot_t;
+
+typedef struct {
+    pprof_slot_t* slots;
+    size_t mask;
+    size_t len;
+} pprof_map_t;
+
+typedef struct {
+    uint32_t name;
+    uint32_t system_name;
+    uint32_t filename;
+} pprof_function_t;
+
+struct bw_pprof {
+    int fd;
+    bool failed;
+    size_t sample_types_len;
+    bool symbolize;
+
+    pprof_map_t location_ids;
+    uintptr_t* locations; // Return addresses by location ID - 1
+    size_t locations_len;
+    size_t locations_cap;
+
+    pprof_map_t mapping_ids;
+    const module_t** mappings;
+    size_t mappings_len;
+    size_t mappings_cap;
+
+    pprof_map_t function_ids;
+    pprof_function_t* functions;
+    size_t functions_len;
+    size_t functions_cap;
+
+    pprof_map_t string_ids;
+    const char** strings;
+    size_t strings_len;
+    size_t strings_cap;
+    arena_t arena; // Copies of strings that the caller or the encoder owns
+
+    uint64_t* sample_ids; // Location IDs of the sample being written
+    size_t sample_ids_cap;
+
+    size_t len;
+    unsigned char buf[PPROF_BUFFER_SIZE];
+};
+
+static bool grow(void* array, size_t* cap, size_t len, size_t size) {
+    if (len < *cap) {
+        return true;
+    }
+
+    size_t new_cap = *cap ? *cap * 2 : PPROF_INITIAL_CAPACITY;
+    while (new_cap <= len) {
+        new_cap *= 2;
+    }
+
+    void** data = array;
+    void* grown = realloc(*data, new_cap * size);
+    if (!grown) {
+        return false;
+    }
+    *data = grown;
+    *cap = new_cap;
+
+    return true;
+}
+
+static size_t map_hash(uint64_t key) {
+    uint64_t hash = key * HASH_MULTIPLIER;
+
+    return (size_t)(hash ^ (hash >> HASH_SHIFT));
+}
+
+static uint64_t string_hash(const char* str) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (; *str; ++str) {
+        hash = (hash ^ (unsigned char)*str) * FNV_PRIME;
+    }
+
+    return hash;
+}
+
+// Returns the slot holding `key`, or the empty slot where it belongs. With `str`, slots only match
+// if they also hold that string.
+static pprof_slot_t* map_probe(const pprof_map_t* map,
+                               uint64_t key,
+                               const char* str,
+                               const char* const* strings) {
+    for (size_t i = map_hash(key);; ++i) {
+        pprof_slot_t* slot = &map->slots[i & map->mask];
+        if (!slot->value ||
+            (slot->key == key && (!str || strcmp(strings[slot->value], str) == 0))) {
+            return slot;
+        }
+    }
+}
+
+// Makes room for one more entry, before probing for it
+static bool map_reserve(pprof_map_t* map) {
+    if (map->slots && (map->len + 1) * 2 <= map->mask + 1) {
+        return true;
+    }
+
+    size_t slots = map->slots ? (map->mask + 1) * 2 : PPROF_INITIAL_SLOTS;
+    pprof_map_t grown = {calloc(slots, sizeof(pprof_slot_t)), slots - 1, map->len};
+    if (!grown.slots) {
+        return false;
+    }
+
+    for (size_t i = 0; map->slots && i <= map->mask; ++i) {
+        if (map->slots[i].value) {
+            // Keys are unique within the old table, except for colliding strings
+            pprof_slot_t* slot = &grown.slots[map_hash(map->slots[i].key) & grown.mask];
+            while (slot->value) {
+                slot = &grown.slots[(size_t)(slot - grown.slots + 1) & grown.mask];
+            }
+            *slot = map->slots[i];
+        }
+    }
+    free(map->slots);
+    *map = grown;
+
+    return true;
+}
+
+// Returns the index of `str` in the string table, adding it if it is new, or 0 if out of memory.
+// Strings are referenced, not copied.
+static uint32_t intern_string(bw_pprof_t* pprof, const char* str) {
+    if (!str || !*str) {
+        return 0;
+    }
+
+    if (!map_reserve(&pprof->string_ids)) {
+        pprof->failed = true;
+        return 0;
+    }
+
+    uint64_t hash = string_hash(str);
+    pprof_slot_t* slot = map_probe(&pprof->string_ids, hash, str, pprof->strings);
+    if (slot->value) {
+        return slot->value;
+    }
+
+    if (!grow(&pprof->strings, &pprof->strings_cap, pprof->strings_len, sizeof(*pprof->strings))) {
+        pprof->failed = true;
+        return 0;
+    }
+
+    slot->key = hash;
+    slot->value = (uint32_t)pprof->strings_len;
+    pprof->string_ids.len++;
+    pprof->strings[pprof->strings_len++] = str;
+
+    return slot->value;
+}
+
+static uint32_t intern_string_copy(bw_pprof_t* pprof, const char* str) {
+    if (!str || !*str) {
+        return 0;
+    }
+
+    size_t len = strlen(str) + 1;
+    char* copy = arena_alloc(&pprof->arena, len);
+    if (!copy) {
+        pprof->failed = true;
+        return 0;
+    }
+    memcpy(copy, str, len);
+
+    return intern_string(pprof, copy);
+}
+
+// Returns the ID of `key` in `map`, assigning the next one if it is new, or 0 if out of memory.
+// `*is_new` tells the caller to append the entry to its table.
+static uint32_t intern_key(bw_pprof_t* pprof, pprof_map_t* map, uint64_t key, bool* is_new) {
+    *is_new = false;
+    if (!map_reserve(map)) {
+        pprof->failed = true;
+        return 0;
+    }
+
+    pprof_slot_t* slot = map_probe(map, key, NULL, NULL);
+    if (slot->value) {
+        return slot->value;
+    }
+
+    *is_new = true;
+    slot->key = key;
+    slot->value = (uint32_t)++map->len;
+
+    return slot->value;
+}
+
+static void out_flush(bw_pprof_t* pprof) {
+    size_t flushed = 0;
+    while (!pprof->failed && flushed < pprof->len) {
+        ssize_t written = write(pprof->fd, pprof->buf + flushed, pprof->len - flushed);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            pprof->failed = true;
+            break;
+        }
+        flushed += (size_t)written;
+    }
+    pprof->len = 0;
+}
+
+static void out_bytes(bw_pprof_t* pprof, const void* data, size_t len) {
+    const unsigned char* bytes = data;
+    while (len > 0) {
+        if (pprof->len == PPROF_BUFFER_SIZE) {
+            out_flush(pprof);
+        }
+
+        size_t chunk = PPROF_BUFFER_SIZE - pprof->len;
+        chunk = chunk < len ? chunk : len;
+        memcpy(pprof->buf + pprof->len, bytes, chunk);
+        pprof->len += chunk;
+        bytes += chunk;
+        len -= chunk;
+    }
+}
+
+static size_t varint_size(uint64_t value) {
+    size_t size = 1;
+    while (value > VARINT_MASK) {
+        value >>= VARINT_BITS;
+        size++;
+    }
+
+    return size;
+}
+
+static void out_varint(bw_pprof_t* pprof, uint64_t value) {
+    if (PPROF_BUFFER_SIZE - pprof->len < sizeof(uint64_t) * 2) {
+        out_flush(pprof);
+    }
+
+    while (value > VARINT_MASK) {
+        pprof->buf[pprof->len++] = (unsigned char)((value & VARINT_MASK) | VARINT_MORE);
+        value >>= VARINT_BITS;
+    }
+    pprof->buf[pprof->len++] = (unsigned char)value;
+}
+
+static uint64_t tag(uint32_t field, uint32_t wire_type) {
+    return ((uint64_t)field << WIRE_TYPE_BITS) | wire_type;
+}
+
+// Sizes of fields as written below. Like proto3, fields with the default value 0 are omitted.
+static size_t varint_field_size(uint32_t field, uint64_t value) {
+    return value ? varint_size(tag(field, WIRE_VARINT)) + varint_size(value) : 0;
+}
+
+static size_t len_field_size(uint32_t field, size_t len) {
+    return varint_size(tag(field, WIRE_LEN)) + varint_size(len) + len;
+}
+
+static void out_varint_field(bw_pprof_t* pprof, uint32_t field, uint64_t value) {
+    if (value) {
+        out_varint(pprof, tag(field, WIRE_VARINT));
+        out_varint(pprof, value);
+    }
+}
+
+// Writes the header of a length-delimited field, the caller writes its `len` bytes of contents
+static void out_len_field(bw_pprof_t* pprof, uint32_t field, size_t len) {
+    out_varint(pprof, tag(field, WIRE_LEN));
+    out_varint(pprof, len);
+}
+
+static void out_value_type(bw_pprof_t* pprof, uint32_t field, const bw_pprof_value_type_t* vt) {
+    uint32_t type = intern_string_copy(pprof, vt->type);
+    uint32_t unit = intern_string_copy(pprof, vt->unit);
+
+    out_len_field(pprof,
+                  field,
+                  varint_field_size(VALUE_TYPE_TYPE, type) + varint_field_size(VALUE_TYPE_UNIT, unit));
+    out_varint_field(pprof, VALUE_TYPE_TYPE, type);
+    out_varint_field(pprof, VALUE_TYPE_UNIT, unit);
+}
+
+bw_pprof_t* bw_pprof_create(int fd, const bw_pprof_config_t* config) {
+    if (fd < 0 || !config || !config->sample_types || config->sample_types_len == 0 ||
+        config->sample_types_len > BW_PPROF_VALUES_MAX) {
+        return NULL;
+    }
+
+    bw_pprof_t* pprof = calloc(1, sizeof(*pprof));
+    if (!pprof) {
+        return NULL;
+    }
+
+    pprof->fd = fd;
+    pprof->sample_types_len = config->sample_types_len;
+    pprof->symbolize = config->symbolize;
+    arena_init(&pprof->arena, PPROF_ARENA_CHUNK_SIZE);
+
+    // The string table starts with the empty string
+    if (!grow(&pprof->strings, &pprof->strings_cap, 0, sizeof(*pprof->strings))) {
+        free(pprof);
+        return NULL;
+    }
+    pprof->strings[pprof->strings_len++] = "";
+
+    // Protobuf fields can come in any order, the header is written first
+    for (size_t i = 0; i < config->sample_types_len; ++i) {
+        out_value_type(pprof, PROFILE_SAMPLE_TYPE, &config->sample_types[i]);
+    }
+    if (config->period_type.type || config->period_type.unit) {
+        out_value_type(pprof, PROFILE_PERIOD_TYPE, &config->period_type);
+    }
+    out_varint_field(pprof, PROFILE_PERIOD, (uint64_t)config->period);
+    out_varint_field(pprof, PROFILE_TIME_NANOS, (uint64_t)config->time_nanos);
+    out_varint_field(pprof, PROFILE_DURATION_NANOS, (uint64_t)config->duration_nanos);
+
+    return pprof;
+}
+
+bool bw_pprof_add_sample(bw_pprof_t* pprof, const uintptr_t* ips, size_t len, const int64_t* values) {
+    if (!pprof || (!ips && len > 0) || !values) {
+        return false;
+    }
+
+    if (!grow(&pprof->sample_ids, &pprof->sample_ids_cap, len, sizeof(*pprof->sample_ids))) {
+        pprof->failed = true;
+        return false;
+    }
+
+    size_t ids_size = 0;
+    for (size_t i = 0; i < len; ++i) {
+        bool is_new = false;
+        uint32_t id = intern_key(pprof, &pprof->location_ids, ips[i], &is_new);
+        if (is_new) {
+            if (!grow(&pprof->locations,
+                      &pprof->locations_cap,
+                      pprof->locations_len,
+                      sizeof(*pprof->locations))) {
+                pprof->failed = true;
+                return false;
+            }
+            pprof->locations[pprof->locations_len++] = ips[i];
+        }
+        if (!id) {
+            return false;
+        }
+
+        pprof->sample_ids[i] = id;
+        ids_size += varint_size(id);
+    }
+
+    // Values are int64, negative ones take ten bytes as in any protobuf encoder
+    size_t values_size = 0;
+    for (size_t i = 0; i < pprof->sample_types_len; ++i) {
+        values_size += varint_size((uint64_t)values[i]);
+    }
+
+    size_t sample_size = len_field_size(SAMPLE_VALUE, values_size);
+    if (len > 0) {
+        sample_size += len_field_size(SAMPLE_LOCATION_ID, ids_size);
+    }
+
+    out_len_field(pprof, PROFILE_SAMPLE, sample_size);
+    if (len > 0) {
+        out_len_field(pprof, SAMPLE_LOCATION_ID, ids_size);
+        for (size_t i = 0; i < len; ++i) {
+            out_varint(pprof, pprof->sample_ids[i]);
+        }
+    }
+    out_len_field(pprof, SAMPLE_VALUE, values_size);
+    for (size_t i = 0; i < pprof->sample_types_len; ++i) {
+        out_varint(pprof, (uint64_t)values[i]);
+    }
+
+    return !pprof->failed;
+}
+
+static uint32_t intern_mapping(bw_pprof_t* pprof, const module_t* mod) {
+    bool is_new = false;
+    uint32_t id = intern_key(pprof, &pprof->mapping_ids, (uintptr_t)mod, &is_new);
+    if (is_new) {
+        if (!grow(&pprof->mappings,
+                  &pprof->mappings_cap,
+                  pprof->mappings_len,
+                  sizeof(*pprof->mappings))) {
+            pprof->failed = true;
+            return 0;
+        }
+        pprof->mappings[pprof->mappings_len++] = mod;
+    }
+
+    return id;
+}
+
+static uint32_t intern_function(bw_pprof_t* pprof, const char* sname, const char* file) {
+    bool is_new = false;
+    uint32_t id = intern_key(pprof, &pprof->function_ids, (uintptr_t)sname, &is_new);
+    if (is_new) {
+        if (!grow(&pprof->functions,
+                  &pprof->functions_cap,
+                  pprof->functions_len,
+                  sizeof(*pprof->functions))) {
+            pprof->failed = true;
+            return 0;
+        }
+
+        pprof_function_t* function = &pprof->functions[pprof->functions_len++];
+        function->name = intern_string(pprof, bw_demangle(sname));
+        function->system_name = intern_string(pprof, sname);
+        function->filename = intern_string(pprof, file);
+    }
+
+    return id;
+}
+
+static void write_location(bw_pprof_t* pprof, uint32_t id, uintptr_t ip, const module_map_t* map) {
+    // Return addresses point past the call instruction, the location is the call itself
+    uintptr_t addr = ip - 1;
+    const module_t* mod = module_lookup(map, addr);
+    uint32_t mapping_id = mod ? intern_mapping(pprof, mod) : 0;
+
+    uint32_t function_id = 0;
+    uint32_t line = 0;
+    if (mod && pprof->symbolize) {
+        const char* sname = elf_symbolize(module_elf(mod), addr - mod->bias);
+        const char* file = NULL;
+        dwarf_lines_t* lines = module_lines(mod);
+        if (!lines || !dwarf_lines_lookup(lines, addr - mod->bias, &file, &line)) {
+            file = NULL;
+            line = 0;
+        }
+        function_id = sname ? intern_function(pprof, sname, file) : 0;
+    }
+
+    size_t line_size =
+        varint_field_size(LINE_FUNCTION_ID, function_id) + varint_field_size(LINE_LINE, line);
+    size_t location_size = varint_field_size(LOCATION_ID, id) +
+                           varint_field_size(LOCATION_MAPPING_ID, mapping_id) +
+                           varint_field_size(LOCATION_ADDRESS, addr);
+    if (function_id) {
+        location_size += len_field_size(LOCATION_LINE, line_size);
+    }
+
+    out_len_field(pprof, PROFILE_LOCATION, location_size);
+    out_varint_field(pprof, LOCATION_ID, id);
+    out_varint_field(pprof, LOCATION_MAPPING_ID, mapping_id);
+    out_varint_field(pprof, LOCATION_ADDRESS, addr);
+    if (function_id) {
+        out_len_field(pprof, LOCATION_LINE, line_size);
+        out_varint_field(pprof, LINE_FUNCTION_ID, function_id);
+        out_varint_field(pprof, LINE_LINE, line);
+    }
+}
+
+static uint32_t intern_build_id(bw_pprof_t* pprof, const module_t* mod) {
+    static const char k_digits[] = "0123456789abcdef";
+
+    if (mod->build_id_len == 0) {
+        return 0;
+    }
+
+    char* hex = arena_alloc(&pprof->arena, (mod->build_id_len * 2) + 1);
+    if (!hex) {
+        pprof->failed = true;
+        return 0;
+    }
+    for (size_t i = 0; i < mod->build_id_len; ++i) {
+        hex[2 * i] = k_digits[mod->build_id[i] / HEX_BASE];
+        hex[(2 * i) + 1] = k_digits[mod->build_id[i] % HEX_BASE];
+    }
+    hex[mod->build_id_len * 2] = '\0';
+
+    return intern_string(pprof, hex);
+}
+
+static void write_mapping(bw_pprof_t* pprof, uint32_t id, const module_t* mod) {
+    uint32_t filename = intern_string(pprof, mod->path);
+    uint32_t build_id = intern_build_id(pprof, mod);
+    bool has_lines = pprof->symbolize && module_lines(mod);
+
+    // The mapping starts at the module's first segment, at file offset 0, so pprof derives the
+    // same load bias
+    size_t size = varint_field_size(MAPPING_ID, id) +
+                  varint_field_size(MAPPING_MEMORY_START, mod->base) +
+                  varint_field_size(MAPPING_MEMORY_LIMIT, mod->end) +
+                  varint_field_size(MAPPING_FILENAME, filename) +
+                  varint_field_size(MAPPING_BUILD_ID, build_id) +
+                  varint_field_size(MAPPING_HAS_FUNCTIONS, pprof->symbolize) +
+                  varint_field_size(MAPPING_HAS_FILENAMES, has_lines) +
+                  varint_field_size(MAPPING_HAS_LINE_NUMBERS, has_lines);
+
+    out_len_field(pprof, PROFILE_MAPPING, size);
+    out_varint_field(pprof, MAPPING_ID, id);
+    out_varint_field(pprof, MAPPING_MEMORY_START, mod->base);
+    out_varint_field(pprof, MAPPING_MEMORY_LIMIT, mod->end);
+    out_varint_field(pprof, MAPPING_FILENAME, filename);
+    out_varint_field(pprof, MAPPING_BUILD_ID, build_id);
+    out_varint_field(pprof, MAPPING_HAS_FUNCTIONS, pprof->symbolize);
+    out_varint_field(pprof, MAPPING_HAS_FILENAMES, has_lines);
+    out_varint_field(pprof, MAPPING_HAS_LINE_NUMBERS, has_lines);
+}
+
+static void write_function(bw_pprof_t* pprof, uint32_t id, const pprof_function_t* function) {
+    size_t size = varint_field_size(FUNCTION_ID, id) +
+                  varint_field_size(FUNCTION_NAME, function->name) +
+                  varint_field_size(FUNCTION_SYSTEM_NAME, function->system_name) +
+                  varint_field_size(FUNCTION_FILENAME, function->filename);
+
+    out_len_field(pprof, PROFILE_FUNCTION, size);
+    out_varint_field(pprof, FUNCTION_ID, id);
+    out_varint_field(pprof, FUNCTION_NAME, function->name);
+    out_varint_field(pprof, FUNCTION_SYSTEM_NAME, function->system_name);
+    out_varint_field(pprof, FUNCTION_FILENAME, function->filename);
+}
+
+static void write_tables(bw_pprof_t* pprof) {
+    const module_map_t* map = module_map_synced();
+
+    // Mappings and functions get their IDs from the locations, the tables are written after them
+    for (size_t i = 0; i < pprof->locations_len; ++i) {
+        write_location(pprof, (uint32_t)(i + 1), pprof->locations[i], map);
+    }
+    for (size_t i = 0; i < pprof->mappings_len; ++i) {
+        write_mapping(pprof, (uint32_t)(i + 1), pprof->mappings[i]);
+    }
+    for (size_t i = 0; i < pprof->functions_len; ++i) {
+        write_function(pprof, (uint32_t)(i + 1), &pprof->functions[i]);
+    }
+
+    for (size_t i = 0; i < pprof->strings_len; ++i) {
+        size_t len = strlen(pprof->strings[i]);
+        out_len_field(pprof, PROFILE_STRING_TABLE, len);
+        out_bytes(pprof, pprof->strings[i], len);
+    }
+
+    out_flush(pprof);
+}
+
+bool bw_pprof_close(bw_pprof_t* pprof) {
+    if (!pprof) {
+        return false;
+    }
+
+    write_tables(pprof);
+    bool success = !pprof->failed;
+
+    free(pprof->location_ids.slots);
+    free(pprof->locations);
+    free(pprof->mapping_ids.slots);
+    free(pprof->mappings);
+    free(pprof->function_ids.slots);
+    free(pprof->functions);
+    free(pprof->string_ids.slots);
+    free(pprof->strings);
+    free(pprof->sample_ids);
+    arena_destroy(&pprof->arena);
+    free(pprof);
+
+    return success;
+}
@@ -0,0 +1,538 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include "backwalk/profiler.h"
+
+#include <errno.h>      // for errno
+#include <pthread.h>    // for pthread_mutex_lock, pthread_mutex_unlock, pthread_self, ...
+#include <signal.h>     // for sigaction, siginfo_t, sigevent, SIGEV_THREAD_ID, SIGPROF
+#include <stdatomic.h>  // for atomic_load_explicit, atomic_store_explicit, memory_order_...
+#include <stdbool.h>    // for bool, false, true
+#include <stddef.h>     // for size_t, NULL
+#include <stdint.h>     // for uintptr_t, uint64_t
+#include <stdlib.h>     // for free, calloc, realloc
+#include <string.h>     // for memcpy
+#include <time.h>       // for timer_create, timer_delete, timer_settime, clock_gettime
+#include <ucontext.h>   // for ucontext_t
+#include <unistd.h>     // for gettid
+
+#include "common.h"     // for BW_UNUSED
+#include "context.h"    // for context_get_ip, context_init_ucontext, context_set_bou...
+#include "stack.h"      // for stack_bounds_get, stack_bounds_init
+
+// Older glibc headers only provide the union member
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+enum { PROFILER_DEFAULT_FREQUENCY_HZ = 100 };
+enum { PROFILER_DEFAULT_RING_CAPACITY = 256 };
+enum { PROFILER_DEFAULT_DRAIN_INTERVAL_MS = 10 };
+
+#define NSECS_PER_SEC 1000000000L
+#define NSECS_PER_MSEC 1000000L
+
+typedef struct {
+    size_t len;
+    uintptr_t ips[BW_PROFILER_FRAMES_MAX];
+} profiler_sample_t;
+
+// Each ring has a single producer, the thread's own signal handler, and a single consumer, the
+// collector thread, so head and tail only need acquire/release ordering.
+typedef struct profiler_thread {
+    struct profiler_thread* next;
+    pthread_t thread;
+    int tid;
+    timer_t timer;
+    bool armed;
+    profiler_sample_t* ring;
+    size_t ring_mask;
+    atomic_size_t head;
+    atomic_size_t tail;
+    atomic_uint_fast64_t samples;
+    atomic_uint_fast64_t dropped;
+    atomic_uint_fast64_t handler_ns;
+} profiler_thread_t;
+
+// Samples copied out of the rings under the lock, and passed to the callback without it
+typedef struct {
+    int tid;
+    profiler_sample_t sample;
+} profiler_batch_entry_t;
+
+typedef struct {
+    profiler_batch_entry_t* entries;
+    size_t len;
+    size_t cap;
+    bw_profiler_sample_cb cb;
+    void* arg;
+} profiler_batch_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bw_profiler_config_t config;
+    bool running;
+    bool collecting; // The collector thread has not exited yet
+    pthread_t collector;
+    struct sigaction old_action;
+    pthread_key_t key;
+    bool key_created;
+    profiler_thread_t* threads;
+    // Threads that were unregistered with samples left, which the collector drains and frees
+    profiler_thread_t* retired;
+    size_t thread_count;
+    // Counters of threads that were unregistered
+    uint64_t samples;
+    uint64_t dropped;
+    uint64_t handler_ns;
+} profiler_t;
+
+static profiler_t profiler = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wakeup = PTHREAD_COND_INITIALIZER,
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        return 0;
+    }
+
+    return ((uint64_t)ts.tv_sec * NSECS_PER_SEC) + (uint64_t)ts.tv_nsec;
+}
+
+// The walk starts from the interrupted registers, so neither the handler nor the signal trampoline
+// have to be skipped
+static size_t profiler_capture(const ucontext_t* uc, uintptr_t* ips, size_t max) {
+    context_t ctx;
+    context_init_ucontext(&ctx, uc);
+    context_set_bounds(&ctx, stack_bounds_get());
+
+    size_t len = 0;
+    ips[len++] = context_get_ip(&ctx);
+    while (len < max && context_step(&ctx)) {
+        ips[len++] = context_get_ip(&ctx);
+    }
+
+    return len;
+}
+
+static void profiler_handler(int sig, siginfo_t* info, void* ucontext) {
+    BW_UNUSED(sig);
+
+    profiler_thread_t* pt = info->si_code == SI_TIMER ? info->si_value.sival_ptr : NULL;
+    if (!pt || !ucontext) {
+        return;
+    }
+
+    int saved_errno = errno;
+    uint64_t start = now_ns();
+
+    size_t head = atomic_load_explicit(&pt->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&pt->tail, memory_order_acquire);
+    if (head - tail > pt->ring_mask) {
+        atomic_fetch_add_explicit(&pt->dropped, 1, memory_order_relaxed);
+    } else {
+        profiler_sample_t* sample = &pt->ring[head & pt->ring_mask];
+        sample->len = profiler_capture(ucontext, sample->ips, BW_PROFILER_FRAMES_MAX);
+        atomic_store_explicit(&pt->head, head + 1, memory_order_release);
+        atomic_fetch_add_explicit(&pt->samples, 1, memory_order_relaxed);
+    }
+
+    atomic_fetch_add_explicit(&pt->handler_ns, now_ns() - start, memory_order_relaxed);
+    errno = saved_errno;
+}
+
+static size_t ring_capacity(size_t requested) {
+    size_t capacity = 1;
+    while (capacity < requested) {
+        capacity <<= 1;
+    }
+
+    return capacity;
+}
+
+static bool profiler_thread_alloc_ring(profiler_thread_t* pt, size_t capacity) {
+    capacity = ring_capacity(capacity);
+    if (pt->ring && pt->ring_mask + 1 == capacity) {
+        return true;
+    }
+
+    profiler_sample_t* ring = calloc(capacity, sizeof(*ring));
+    if (!ring) {
+        return false;
+    }
+
+    free(pt->ring);
+    pt->ring = ring;
+    pt->ring_mask = capacity - 1;
+    atomic_store(&pt->head, 0);
+    atomic_store(&pt->tail, 0);
+
+    return true;
+}
+
+static bool profiler_thread_arm(profiler_thread_t* pt) {
+    clockid_t clock;
+    if (pthread_getcpuclockid(pt->thread, &clock) != 0) {
+        return false;
+    }
+
+    struct sigevent sev = {0};
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = profiler.config.signo;
+    sev.sigev_value.sival_ptr = pt;
+    sev.sigev_notify_thread_id = pt->tid;
+    if (timer_create(clock, &sev, &pt->timer) != 0) {
+        return false;
+    }
+
+    long period_ns = NSECS_PER_SEC / (long)profiler.config.frequency_hz;
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = period_ns / NSECS_PER_SEC;
+    spec.it_interval.tv_nsec = period_ns % NSECS_PER_SEC;
+    spec.it_value = spec.it_interval;
+    if (timer_settime(pt->timer, 0, &spec, NULL) != 0) {
+        BW_UNUSED(timer_delete(pt->timer));
+        return false;
+    }
+
+    pt->armed = true;
+
+    return true;
+}
+
+// Deleting the timer also discards its pending signal, if any
+static void profiler_thread_disarm(profiler_thread_t* pt) {
+    if (pt->armed) {
+        BW_UNUSED(timer_delete(pt->timer));
+        pt->armed = false;
+    }
+}
+
+static bool profiler_batch_reserve(profiler_batch_t* batch) {
+    if (batch->len < batch->cap) {
+        return true;
+    }
+
+    size_t cap = batch->cap ? batch->cap * 2 : PROFILER_DEFAULT_RING_CAPACITY;
+    profiler_batch_entry_t* entries = realloc(batch->entries, cap * sizeof(*entries));
+    if (!entries) {
+        return false;
+    }
+    batch->entries = entries;
+    batch->cap = cap;
+
+    return true;
+}
+
+// Must be called with the lock held. Returns false if samples were left in the ring because the
+// batch could not grow.
+static bool profiler_thread_collect(profiler_thread_t* pt, profiler_batch_t* batch) {
+    size_t tail = atomic_load_explicit(&pt->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&pt->head, memory_order_acquire);
+
+    for (; tail != head && profiler_batch_reserve(batch); ++tail) {
+        profiler_batch_entry_t* entry = &batch->entries[batch->len++];
+        const profiler_sample_t* sample = &pt->ring[tail & pt->ring_mask];
+        entry->tid = pt->tid;
+        entry->sample.len = sample->len;
+        memcpy(entry->sample.ips, sample->ips, sample->len * sizeof(*sample->ips));
+    }
+
+    atomic_store_explicit(&pt->tail, tail, memory_order_release);
+
+    return tail == head;
+}
+
+// Must be called with the lock held
+static void profiler_collect(profiler_batch_t* batch) {
+    batch->len = 0;
+    batch->cb = profiler.config.cb;
+    batch->arg = profiler.config.arg;
+
+    for (profiler_thread_t* pt = profiler.threads; pt; pt = pt->next) {
+        BW_UNUSED(profiler_thread_collect(pt, batch));
+    }
+
+    profiler_thread_t** link = &profiler.retired;
+    while (*link) {
+        profiler_thread_t* pt = *link;
+        if (profiler_thread_collect(pt, batch)) {
+            *link = pt->next;
+            free(pt->ring);
+            free(pt);
+        } else {
+            link = &pt->next;
+        }
+    }
+}
+
+// Called without the lock, so that callbacks can use the profiler
+static void profiler_deliver(const profiler_batch_t* batch) {
+    for (size_t i = 0; batch->cb && i < batch->len; ++i) {
+        const profiler_batch_entry_t* entry = &batch->entries[i];
+        batch->cb(entry->tid, entry->sample.ips, entry->sample.len, batch->arg);
+    }
+}
+
+static void* profiler_collector_main(void* arg) {
+    BW_UNUSED(arg);
+
+    profiler_batch_t batch = {0};
+    if (pthread_mutex_lock(&profiler.lock) != 0) {
+        return NULL;
+    }
+
+    long interval_ns = (long)profiler.config.drain_interval_ms * NSECS_PER_MSEC;
+    for (;;) {
+        // Once stopped, the timers are disarmed and this drains what is left
+        bool running = profiler.running;
+        profiler_collect(&batch);
+
+        BW_UNUSED(pthread_mutex_unlock(&profiler.lock));
+        profiler_deliver(&batch);
+        if (pthread_mutex_lock(&profiler.lock) != 0) {
+            free(batch.entries);
+            return NULL;
+        }
+
+        if (!running) {
+            break;
+        }
+        if (!profiler.running) {
+            continue;
+        }
+
+        struct timespec deadline;
+        if (clock_gettime(CLOCK_REALTIME, &deadline) != 0) {
+            break;
+        }
+        deadline.tv_sec += (deadline.tv_nsec + interval_ns) / NSECS_PER_SEC;
+        deadline.tv_nsec = (deadline.tv_nsec + interval_ns) % NSECS_PER_SEC;
+        BW_UNUSED(pthread_cond_timedwait(&profiler.wakeup, &profiler.lock, &deadline));
+    }
+
+    // Only samples that did not fit in memory are left
+    while (profiler.retired) {
+        profiler_thread_t* pt = profiler.retired;
+        profiler.retired = pt->next;
+        free(pt->ring);
+        free(pt);
+    }
+    profiler.collecting = false;
+    BW_UNUSED(pthread_mutex_unlock(&profiler.lock));
+    free(batch.entries);
+
+    return NULL;
+}
+
+// Must be called with the lock held, on the thread that owns `pt`
+static void profiler_thread_release(profiler_thread_t* pt) {
+    profiler_thread_disarm(pt);
+
+    for (profiler_thread_t** link = &profiler.threads; *link; link = &(*link)->next) {
+        if (*link == pt) {
+            *link = pt->next;
+            profiler.thread_count--;
+            break;
+        }
+    }
+
+    profiler.samples += atomic_load(&pt->samples);
+    profiler.dropped += atomic_load(&pt->dropped);
+    profiler.handler_ns += atomic_load(&pt->handler_ns);
+
+    // Samples left in the ring are passed to the callback on the collector thread, like all others
+    bool drained =
+        atomic_load(&pt->head) == atomic_load_explicit(&pt->tail, memory_order_relaxed);
+    if (profiler.collecting && !drained) {
+        pt->next = profiler.retired;
+        profiler.retired = pt;
+        return;
+    }
+
+    free(pt->ring);
+    free(pt);
+}
+
+static void profiler_thread_exit(void* arg) {
+    if (pthread_mutex_lock(&profiler.lock) != 0) {
+        return;
+    }
+    profiler_thread_release(arg);
+    BW_UNUSED(pthread_mutex_unlock(&profiler.lock));
+}
+
+// Must be called with the lock held
+static bool profiler_key_init(void) {
+    if (!profiler.key_created) {
+        profiler.key_created = pthread_key_create(&profiler.key, profiler_thread_exit) == 0;
+    }
+
+    return profiler.key_created;
+}
+
+static void profiler_apply_defaults(bw_profiler_config_t* config) {
+    if (config->frequency_hz == 0) {
+        config->frequency_hz = PROFILER_DEFAULT_FREQUENCY_HZ;
+    }
+    if (config->ring_capacity == 0) {
+        config->ring_capacity = PROFILER_DEFAULT_RING_CAPACITY;
+    }
+    if (config->drain_interval_ms == 0) {
+        config->drain_interval_ms = PROFILER_DEFAULT_DRAIN_INTERVAL_MS;
+    }
+    if (config->signo == 0) {
+        config->signo = SIGPROF;
+    }
+}
+
+bool bw_profiler_start(const bw_profiler_config_t* config) {
+    if (!config || config->frequency_hz > NSECS_PER_SEC) {
+        return false;
+    }
+
+    if (pthread_mutex_lock(&profiler.lock) != 0) {
+        return false;
+    }
+
+    bool success = !profiler.running && profiler_key_init();
+    if (success) {
+        profiler.config = *config;
+        profiler_apply_defaults(&profiler.config);
+
+        struct sigaction action = {0};
+        action.sa_sigaction = profiler_handler;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        BW_UNUSED(sigemptyset(&action.sa_mask));
+        success = sigaction(profiler.config.signo, &action, &profiler.old_action) == 0;
+    }
+
+    // Timers are disarmed while stopped, so the rings can be resized without racing the handler
+    for (profiler_thread_t* pt = profiler.threads; success && pt; pt = pt->next) {
+        success = profiler_thread_alloc_ring(pt, profiler.config.ring_capacity) &&
+                  profiler_thread_arm(pt);
+    }
+
+    if (success) {
+        profiler.running = true;
+        profiler.collecting = true;
+        if (pthread_create(&profiler.collector, NULL, profiler_collector_main, NULL) != 0) {
+            profiler.running = false;
+            profiler.collecting = false;
+            success = false;
+        }
+    }
+
+    if (!success) {
+        for (profiler_thread_t* pt = profiler.threads; pt; pt = pt->next) {
+            profiler_thread_disarm(pt);
+        }
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&profiler.lock));
+
+    return success;
+}
+
+void bw_profiler_stop(void) {
+    if (pthread_mutex_lock(&profiler.lock) != 0) {
+        return;
+    }
+
+    if (!profiler.running) {
+        BW_UNUSED(pthread_mutex_unlock(&profiler.lock));
+        return;
+    }
+
+    profiler.running = false;
+    for (profiler_thread_t* pt = profiler.threads; pt; pt = pt->next) {
+        profiler_thread_disarm(pt);
+    }
+    BW_UNUSED(pthread_cond_signal(&profiler.wakeup));
+    BW_UNUSED(pthread_mutex_unlock(&profiler.lock));
+
+    // The collector drains what is left before exiting
+    BW_UNUSED(pthread_join(profiler.collector, NULL));
+
+    if (pthread_mutex_lock(&profiler.lock) == 0) {
+        BW_UNUSED(sigaction(profiler.config.signo, &profiler.old_action, NULL));
+        BW_UNUSED(pthread_mutex_unlock(&profiler.lock));
+    }
+}
+
+bool bw_profiler_register_thread(void) {
+    // The handler can only validate frames against the stack ranges cached here
+    BW_UNUSED(stack_bounds_init(true));
+
+    if (pthread_mutex_lock(&profiler.lock) != 0) {
+        return false;
+    }
+
+    bool success = profiler_key_init();
+    if (success && !pthread_getspecific(profiler.key)) {
+        profiler_thread_t* pt = calloc(1, sizeof(*pt));
+        size_t capacity =
+            profiler.config.ring_capacity ? profiler.config.ring_capacity
+                                          : PROFILER_DEFAULT_RING_CAPACITY;
+        success = pt && profiler_thread_alloc_ring(pt, capacity);
+        if (success) {
+            pt->thread = pthread_self();
+            pt->tid = gettid();
+            pt->next = profiler.threads;
+            profiler.threads = pt;
+            profiler.thread_count++;
+            success = pthread_setspecific(profiler.key, pt) == 0;
+            if (success && profiler.running) {
+                success = profiler_thread_arm(pt);
+            }
+            if (!success) {
+                BW_UNUSED(pthread_setspecific(profiler.key, NULL));
+                profiler_thread_release(pt);
+            }
+        } else {
+            free(pt);
+        }
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&profiler.lock));
+
+    return success;
+}
+
+void bw_profiler_unregister_thread(void) {
+    if (pthread_mutex_lock(&profiler.lock) != 0) {
+        return;
+    }
+
+    profiler_thread_t* pt = profiler.key_created ? pthread_getspecific(profiler.key) : NULL;
+    if (pt) {
+        BW_UNUSED(pthread_setspecific(profiler.key, NULL));
+        profiler_thread_release(pt);
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&profiler.lock));
+}
+
+void bw_profiler_get_stats(bw_profiler_stats_t* stats) {
+    if (!stats || pthread_mutex_lock(&profiler.lock) != 0) {
+        return;
+    }
+
+    stats->frequency_hz = profiler.config.frequency_hz;
+    stats->threads = profiler.thread_count;
+    stats->samples = profiler.samples;
+    stats->dropped = profiler.dropped;
+    stats->handler_ns = profiler.handler_ns;
+    for (const profiler_thread_t* pt = profiler.threads; pt; pt = pt->next) {
+        stats->samples += atomic_load(&pt->samples);
+        stats->dropped += atomic_load(&pt->dropped);
+        stats->handler_ns += atomic_load(&pt->handler_ns);
+    }
+
+    uint64_t handled = stats->samples + stats->dropped;
+    stats->overhead_ns_per_sample = handled ? stats->handler_ns / handled : 0;
+
+    BW_UNUSED(pthread_mutex_unlock(&profiler.lock));
+}
@@ -0,0 +1,188 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include "resolve.h"
+
+#include <dlfcn.h>              // for dladdr, Dl_info
+#include <pthread.h>            // for pthread_key_create, pthread_once, pthread_setspecific, ...
+#include <stdbool.h>            // for bool, false, true
+#include <stdint.h>             // for uintptr_t, uint8_t
+#include <stdlib.h>             // for calloc, free
+#include <string.h>             // for memset
+
+#include "backwalk/backwalk.h"  // for bw_symbol_cache_stats_t
+#include "common.h"             // for BW_UNUSED
+#include "elf_file.h"           // for elf_symbolize
+#include "module.h"             // for module_lookup, module_elf, module_map_get, module_map_sync, ...
+
+// Request handlers see the same few hundred return addresses in almost every trace
+enum { SYMBOL_CACHE_SET_BITS = 8 };
+enum { SYMBOL_CACHE_SETS = 1 << SYMBOL_CACHE_SET_BITS };
+enum { SYMBOL_CACHE_WAYS = 4 };
+
+#define HASH_MULTIPLIER 0x9e3779b97f4a7c15ULL
+#define HASH_BITS 64
+
+typedef struct {
+    uintptr_t ip; // 0 marks an empty entry
+    uintptr_t mod_addr;
+    const char* fname;
+    const char* sname;
+} symbol_cache_entry_t;
+
+typedef struct {
+    // Generation of the module map the entries were resolved against
+    unsigned long long adds;
+    unsigned long long subs;
+    symbol_cache_entry_t sets[SYMBOL_CACHE_SETS][SYMBOL_CACHE_WAYS];
+    uint8_t victim[SYMBOL_CACHE_SETS]; // Next way to replace in each set, in round-robin order
+    bw_symbol_cache_stats_t stats;
+} symbol_cache_t;
+
+// Allocated by each thread's first lookup, which keeps threads that never walk a stack small
+static _Thread_local symbol_cache_t* symbol_cache;
+// Set when the thread's cache was freed at exit: later lookups, from destructors of other keys,
+// resolve uncached instead of allocating a cache that would leak
+static _Thread_local bool symbol_cache_exited;
+static pthread_once_t symbol_cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t symbol_cache_key;
+static bool symbol_cache_key_created;
+
+// Returns false if `ip` is in no loaded module, a result that must not be cached: the map is only
+// rebuilt when a lookup misses, and a module loaded there later would never be found.
+static bool resolve_frame_in_module(const module_map_t* map,
+                                    uintptr_t ip,
+                                    uintptr_t* mod_addr,
+                                    const char** fname,
+                                    const char** sname) {
+    // Return addresses point past the call instruction, look up the call itself
+    const module_t* mod = module_lookup(map, ip - 1);
+    if (!mod && module_map_sync()) {
+        mod = module_lookup(module_map_get(), ip - 1);
+    }
+    if (mod) {
+        *mod_addr = ip - mod->base;
+        *fname = mod->path;
+        *sname = elf_symbolize(module_elf(mod), ip - 1 - mod->bias);
+        if (*sname) {
+            return true;
+        }
+    }
+
+    // Modules without a readable file, like the vDSO, are only known to the dynamic linker
+    Dl_info info = {0};
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    bool found = dladdr((const void*)(ip - 1), &info) != 0;
+
+    if (!mod && found) {
+        *mod_addr = ip - (uintptr_t)info.dli_fbase;
+        *fname = info.dli_fname ? info.dli_fname : "?";
+    } else if (!mod) {
+        *mod_addr = 0;
+        *fname = "?";
+    }
+
+    *sname = found && info.dli_sname ? info.dli_sname : "?";
+
+    return mod || found;
+}
+
+void resolve_frame(const module_map_t* map,
+                   uintptr_t ip,
+                   uintptr_t* mod_addr,
+                   const char** fname,
+                   const char** sname) {
+    BW_UNUSED(resolve_frame_in_module(map, ip, mod_addr, fname, sname));
+}
+
+static void symbol_cache_thread_exit(void* cache) {
+    symbol_cache = NULL;
+    symbol_cache_exited = true;
+    free(cache);
+}
+
+static void symbol_cache_key_init(void) {
+    symbol_cache_key_created = pthread_key_create(&symbol_cache_key, symbol_cache_thread_exit) == 0;
+}
+
+static symbol_cache_t* symbol_cache_get(void) {
+    if (symbol_cache || symbol_cache_exited) {
+        return symbol_cache;
+    }
+
+    // Without a key to free it at thread exit, the cache would leak
+    if (pthread_once(&symbol_cache_once, symbol_cache_key_init) != 0 || !symbol_cache_key_created) {
+        return NULL;
+    }
+
+    symbol_cache_t* cache = calloc(1, sizeof(*cache));
+    if (cache && pthread_setspecific(symbol_cache_key, cache) != 0) {
+        free(cache);
+        cache = NULL;
+    }
+    if (cache) {
+        cache->stats.capacity = SYMBOL_CACHE_SETS * SYMBOL_CACHE_WAYS;
+    }
+    symbol_cache = cache;
+
+    return cache;
+}
+
+void resolve_frame_cached(const module_map_t* map,
+                          uintptr_t ip,
+                          uintptr_t* mod_addr,
+                          const char** fname,
+                          const char** sname) {
+    symbol_cache_t* cache = map && ip != 0 ? symbol_cache_get() : NULL;
+    if (!cache) {
+        resolve_frame(map, ip, mod_addr, fname, sname);
+        return;
+    }
+
+    // Addresses of unloaded modules may belong to other modules now
+    if (cache->adds != map->adds || cache->subs != map->subs) {
+        if (cache->stats.hits + cache->stats.misses > 0) {
+            cache->stats.flushes++;
+        }
+        memset(cache->sets, 0, sizeof(cache->sets));
+        cache->adds = map->adds;
+        cache->subs = map->subs;
+    }
+
+    size_t set = (size_t)(((uint64_t)ip * HASH_MULTIPLIER) >> (HASH_BITS - SYMBOL_CACHE_SET_BITS));
+    symbol_cache_entry_t* ways = cache->sets[set];
+    for (size_t i = 0; i < SYMBOL_CACHE_WAYS; ++i) {
+        if (ways[i].ip == ip) {
+            cache->stats.hits++;
+            *mod_addr = ways[i].mod_addr;
+            *fname = ways[i].fname;
+            *sname = ways[i].sname;
+            return;
+        }
+    }
+
+    cache->stats.misses++;
+    if (!resolve_frame_in_module(map, ip, mod_addr, fname, sname)) {
+        return;
+    }
+
+    symbol_cache_entry_t* entry = &ways[cache->victim[set]];
+    cache->victim[set] = (uint8_t)((cache->victim[set] + 1) % SYMBOL_CACHE_WAYS);
+    if (entry->ip != 0) {
+        cache->stats.evictions++;
+    }
+    entry->ip = ip;
+    entry->mod_addr = *mod_addr;
+    entry->fname = *fname;
+    entry->sname = *sname;
+}
+
+void resolve_cache_stats(bw_symbol_cache_stats_t* stats) {
+    const symbol_cache_t* cache = symbol_cache;
+    if (cache) {
+        *stats = cache->stats;
+        return;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    stats->capacity = SYMBOL_CACHE_SETS * SYMBOL_CACHE_WAYS;
+}
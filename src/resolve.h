@@ -0,0 +1,30 @@
+#ifndef BW_RESOLVE_H
+#define BW_RESOLVE_H
+
+#include <stdint.h>             // for uintptr_t
+
+#include "backwalk/backwalk.h"  // for bw_symbol_cache_stats_t
+#include "module.h"             // for module_map_t
+
+// Resolves the return address `ip` to its module-relative address, module path and symbol name,
+// as passed to bw_backtrace() callbacks. Symbols come from the module's symbol tables, or from
+// the dynamic linker for modules without a readable file. Unknown parts are reported as "?". The
+// strings stay valid for the lifetime of the process. Not async-signal-safe.
+void resolve_frame(const module_map_t* map,
+                   uintptr_t ip,
+                   uintptr_t* mod_addr,
+                   const char** fname,
+                   const char** sname);
+
+// Like resolve_frame(), through the calling thread's cache of resolved return addresses. The cache
+// is emptied whenever `map` is from a later generation of loads and unloads than its entries.
+void resolve_frame_cached(const module_map_t* map,
+                          uintptr_t ip,
+                          uintptr_t* mod_addr,
+                          const char** fname,
+                          const char** sname);
+
+// Returns the counters of the calling thread's cache
+void resolve_cache_stats(bw_symbol_cache_stats_t* stats);
+
+#endif // BW_RESOLVE_H
@@ -0,0 +1,76 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include "stack.h"
+
+#include <pthread.h>  // for pthread_attr_destroy, pthread_attr_getstack, pthread_getattr_np
+#include <signal.h>   // for sigaltstack, stack_t, SS_DISABLE
+#include <stdbool.h>  // for bool, false, true
+#include <stddef.h>   // for size_t, NULL
+#include <stdint.h>   // for uintptr_t
+
+#include "common.h"   // for BW_UNUSED
+
+typedef struct {
+    stack_bounds_t bounds;
+    bool valid;
+} stack_cache_t;
+
+// Initial-exec TLS can be read from signal handlers without going through __tls_get_addr
+static _Thread_local stack_cache_t stack_cache __attribute__((tls_model("initial-exec")));
+
+static bool thread_stack_range(stack_range_t* range) {
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+        return false;
+    }
+
+    void* addr = NULL;
+    size_t size = 0;
+    bool success = pthread_attr_getstack(&attr, &addr, &size) == 0;
+    BW_UNUSED(pthread_attr_destroy(&attr));
+
+    if (!success || !addr || size == 0) {
+        return false;
+    }
+
+    range->lo = (uintptr_t)addr;
+    range->hi = range->lo + size;
+
+    return true;
+}
+
+static void alt_stack_range(stack_range_t* range) {
+    stack_t ss;
+    range->lo = 0;
+    range->hi = 0;
+
+    if (sigaltstack(NULL, &ss) != 0 || (ss.ss_flags & SS_DISABLE) || !ss.ss_sp) {
+        return;
+    }
+
+    range->lo = (uintptr_t)ss.ss_sp;
+    range->hi = range->lo + ss.ss_size;
+}
+
+bool stack_bounds_init(bool refresh) {
+    stack_cache_t* cache = &stack_cache;
+
+    if (cache->valid && !refresh) {
+        return true;
+    }
+
+    // The thread's stack never moves, but its alternate signal stack may have been replaced
+    if (!cache->valid && !thread_stack_range(&cache->bounds.stack)) {
+        return false;
+    }
+    alt_stack_range(&cache->bounds.alt);
+    cache->valid = true;
+
+    return true;
+}
+
+const stack_bounds_t* stack_bounds_get(void) {
+    const stack_cache_t* cache = &stack_cache;
+
+    return cache->valid ? &cache->bounds : NULL;
+}
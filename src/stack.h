@@ -0,0 +1,25 @@
+#ifndef BW_STACK_H
+#define BW_STACK_H
+
+#include <stdbool.h>  // for bool
+#include <stdint.h>   // for uintptr_t
+
+typedef struct {
+    uintptr_t lo;
+    uintptr_t hi;
+} stack_range_t;
+
+typedef struct {
+    stack_range_t stack; // The thread's own stack
+    stack_range_t alt;   // The alternate signal stack, empty if there is none
+} stack_bounds_t;
+
+// Caches the calling thread's stack ranges in thread-local storage, re-reading the alternate signal
+// stack if `refresh` is set. Not async-signal-safe.
+bool stack_bounds_init(bool refresh);
+
+// Returns the calling thread's cached stack ranges, or NULL if stack_bounds_init() was never
+// called on this thread. Async-signal-safe.
+const stack_bounds_t* stack_bounds_get(void);
+
+#endif // BW_STACK_H
@@ -0,0 +1,214 @@
+#include "backwalk/stack_table.h"
+
+#include <stdatomic.h>  // for atomic_load_explicit, atomic_compare_exchange_strong_expl...
+#include <stdbool.h>    // for bool, false, true
+#include <stddef.h>     // for size_t, NULL
+#include <stdint.h>     // for uint64_t, uintptr_t, uint32_t, UINT32_MAX
+#include <stdlib.h>     // for free, calloc
+#include <string.h>     // for memcmp, memcpy
+
+#include "arena.h"      // for arena_alloc, arena_destroy, arena_init, arena_t
+
+enum { STACK_TABLE_ARENA_CHUNK_SIZE = 256 << 10 };
+
+#define HASH_MULTIPLIER 0x9e3779b97f4a7c15ULL
+#define HASH_SHIFT 32
+
+typedef struct {
+    uint64_t hash;
+    // Set once the entry's ID is in a slot. Entries of threads that lost the race to insert the
+    // same stack never are, so they are not reported under a second ID.
+    _Atomic(bool) published;
+    size_t len;
+    uintptr_t ips[];
+} stack_entry_t;
+
+// Slots hold the upper half of the stack's hash next to its ID, so most mismatches are rejected
+// without touching the entry. A slot never changes once set.
+struct bw_stack_table {
+    _Atomic(uint64_t)* slots;
+    size_t slot_mask;
+    _Atomic(stack_entry_t*)* entries;
+    uint32_t capacity;
+    _Atomic(uint32_t) next_id;
+    arena_t arena;
+};
+
+static uint64_t stack_hash(const uintptr_t* ips, size_t len) {
+    uint64_t hash = len * HASH_MULTIPLIER;
+    for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ ips[i]) * HASH_MULTIPLIER;
+        hash ^= hash >> HASH_SHIFT;
+    }
+
+    return hash;
+}
+
+static uint64_t slot_make(uint64_t hash, uint32_t id) {
+    return (hash & ~(uint64_t)UINT32_MAX) | id;
+}
+
+static bool slot_matches(const bw_stack_table_t* table,
+                         uint64_t slot,
+                         uint64_t hash,
+                         const uintptr_t* ips,
+                         size_t len) {
+    if ((slot >> HASH_SHIFT) != (hash >> HASH_SHIFT)) {
+        return false;
+    }
+
+    const stack_entry_t* entry =
+        atomic_load_explicit(&table->entries[(uint32_t)slot], memory_order_relaxed);
+
+    return entry->hash == hash && entry->len == len &&
+           (len == 0 || memcmp(entry->ips, ips, len * sizeof(*ips)) == 0);
+}
+
+bw_stack_table_t* bw_stack_table_create(size_t capacity) {
+    if (capacity == 0 || capacity >= UINT32_MAX / 2) {
+        return NULL;
+    }
+
+    bw_stack_table_t* table = calloc(1, sizeof(*table));
+    if (!table) {
+        return NULL;
+    }
+
+    // Keep the load factor at or below one half
+    size_t slots = 1;
+    while (slots < capacity * 2) {
+        slots <<= 1;
+    }
+
+    table->slots = calloc(slots, sizeof(*table->slots));
+    table->entries = calloc(capacity + 1, sizeof(*table->entries));
+    if (!table->slots || !table->entries) {
+        free((void*)table->slots);
+        free((void*)table->entries);
+        free(table);
+        return NULL;
+    }
+
+    table->slot_mask = slots - 1;
+    table->capacity = (uint32_t)capacity;
+    atomic_init(&table->next_id, 1);
+    arena_init(&table->arena, STACK_TABLE_ARENA_CHUNK_SIZE);
+
+    return table;
+}
+
+void bw_stack_table_destroy(bw_stack_table_t* table) {
+    if (!table) {
+        return;
+    }
+
+    arena_destroy(&table->arena);
+    free((void*)table->slots);
+    free((void*)table->entries);
+    free(table);
+}
+
+static uint32_t stack_table_insert(bw_stack_table_t* table,
+                                   uint64_t hash,
+                                   const uintptr_t* ips,
+                                   size_t len) {
+    // Stops at one past the capacity, so inserts into a full table cannot wrap it around
+    uint32_t id = atomic_load_explicit(&table->next_id, memory_order_relaxed);
+    do {
+        if (id > table->capacity) {
+            return BW_STACK_ID_INVALID;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(
+        &table->next_id, &id, id + 1, memory_order_relaxed, memory_order_relaxed));
+
+    stack_entry_t* entry = arena_alloc(&table->arena, sizeof(*entry) + (len * sizeof(*ips)));
+    if (!entry) {
+        return BW_STACK_ID_INVALID;
+    }
+
+    entry->hash = hash;
+    atomic_init(&entry->published, false);
+    entry->len = len;
+    if (len > 0) {
+        memcpy(entry->ips, ips, len * sizeof(*ips));
+    }
+    atomic_store_explicit(&table->entries[id], entry, memory_order_release);
+
+    return id;
+}
+
+// Makes stack `id` visible to bw_stack_table_get(), after its slot was found or set. Threads that
+// find the slot before its inserter got to this point publish the entry themselves.
+static uint32_t stack_table_publish(bw_stack_table_t* table, uint32_t id) {
+    stack_entry_t* entry = atomic_load_explicit(&table->entries[id], memory_order_relaxed);
+    if (!atomic_load_explicit(&entry->published, memory_order_acquire)) {
+        atomic_store_explicit(&entry->published, true, memory_order_release);
+    }
+
+    return id;
+}
+
+uint32_t bw_stack_table_intern(bw_stack_table_t* table, const uintptr_t* ips, size_t len) {
+    if (!table || (!ips && len > 0)) {
+        return BW_STACK_ID_INVALID;
+    }
+
+    uint64_t hash = stack_hash(ips, len);
+    uint32_t id = BW_STACK_ID_INVALID;
+
+    for (size_t i = 0; i <= table->slot_mask; ++i) {
+        _Atomic(uint64_t)* slot = &table->slots[(hash + i) & table->slot_mask];
+        uint64_t value = atomic_load_explicit(slot, memory_order_acquire);
+
+        while (value == 0) {
+            // The entry is only found through the slot set by the CAS below, and only reported by
+            // bw_stack_table_get() once published, so a thread that loses the race for the same
+            // stack leaves its ID unused
+            if (id == BW_STACK_ID_INVALID) {
+                id = stack_table_insert(table, hash, ips, len);
+                if (id == BW_STACK_ID_INVALID) {
+                    return BW_STACK_ID_INVALID;
+                }
+            }
+
+            if (atomic_compare_exchange_strong_explicit(slot,
+                                                        &value,
+                                                        slot_make(hash, id),
+                                                        memory_order_release,
+                                                        memory_order_acquire)) {
+                return stack_table_publish(table, id);
+            }
+        }
+
+        if (slot_matches(table, value, hash, ips, len)) {
+            return stack_table_publish(table, (uint32_t)value);
+        }
+    }
+
+    return BW_STACK_ID_INVALID;
+}
+
+size_t bw_stack_table_get(const bw_stack_table_t* table, uint32_t id, const uintptr_t** ips) {
+    if (!table || id == BW_STACK_ID_INVALID || id > table->capacity) {
+        return 0;
+    }
+
+    // IDs are published by the slot CAS, which is not ordered with this load: only IDs returned
+    // by bw_stack_table_intern() are guaranteed to be visible
+    const stack_entry_t* entry = atomic_load_explicit(&table->entries[id], memory_order_acquire);
+    if (!entry || !atomic_load_explicit(&entry->published, memory_order_acquire)) {
+        return 0;
+    }
+
+    if (ips) {
+        *ips = entry->ips;
+    }
+
+    return entry->len;
+}
+
+uint32_t bw_stack_table_id_limit(const bw_stack_table_t* table) {
+    uint32_t limit = atomic_load_explicit(&table->next_id, memory_order_relaxed);
+
+    return limit > table->capacity + 1 ? table->capacity + 1 : limit;
+}
@@ -0,0 +1,621 @@
+// backwalk-symbolize: resolves the frames of backwalk traces captured on another machine.
+//
+// Every input line holding a `module+0xoffset` frame, as written by crash reports and thread dumps,
+// is echoed with the frame's symbol and source line appended. Modules are identified by the
+// `base-end build-id path` lines of a crash report's module list, or by a build ID in place of the
+// path.
+//
+// Binary traces written by bw_trace_writer_create() are printed instead as their stacks, heaviest
+// first, each with its sample count and total value and its symbolized frames.
+
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include <errno.h>              // for errno, EINTR
+#include <fcntl.h>              // for open, O_CLOEXEC, O_RDONLY
+#include <stdbool.h>            // for bool, false, true
+#include <stddef.h>             // for size_t, NULL
+#include <stdint.h>             // for uintptr_t, uint64_t
+#include <stdio.h>              // for fprintf, fflush, fwrite_unlocked, setvbuf, stderr, stdout, _IOFBF
+#include <stdlib.h>             // for free, malloc, realloc, calloc, qsort
+#include <string.h>             // for memchr, memcmp, memmem, strcmp, strlen
+#include <sys/mman.h>           // for mmap, munmap, MAP_FAILED, MAP_PRIVATE, PROT_READ
+#include <sys/stat.h>           // for fstat, stat, S_ISREG
+#include <sys/types.h>          // for ssize_t
+#include <unistd.h>             // for close, read, getopt, optarg, optind, STDIN_FILENO
+
+#include "backwalk/backwalk.h"  // for bw_demangle
+#include "backwalk/trace.h"     // for bw_trace_reader_close, bw_trace_reader_module, bw_trace_...
+#include "common.h"             // for BW_UNUSED
+#include "module.h"             // for MODULE_BUILD_ID_MAX
+#include "symbolizer.h"         // for symbolizer_add, symbolizer_create, symbolizer_get, ...
+
+enum { SYMBOLIZE_DEBUG_DIRS_MAX = 16 };
+enum { SYMBOLIZE_READ_SIZE = 1 << 20 };
+enum { SYMBOLIZE_OUT_BUFFER_SIZE = 1 << 20 };
+enum { SYMBOLIZE_INITIAL_KEYS = 64 };
+enum { SYMBOLIZE_INITIAL_FRAMES = 1 << 16 };
+// Longest decimal line number written
+enum { SYMBOLIZE_NUMBER_MAX = 24 };
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+#define HEX_BASE 16
+#define DEC_BASE 10
+
+static const char* const k_default_debug_dir = "/usr/lib/debug";
+static const char k_trace_magic[] = "BWTRACE";
+
+typedef struct {
+    const char* data;
+    size_t size;
+    bool mapped;
+} input_t;
+
+// Module index by the name frames refer to it with, a path or a build ID
+typedef struct {
+    const char* key; // NULL marks an empty slot
+    size_t len;
+    size_t mod;
+} module_key_t;
+
+typedef struct {
+    symbolizer_t* sym;
+    module_key_t* keys; // Open addressing table, kept at most half full
+    size_t keys_mask;
+    size_t keys_len;
+    size_t* frames;     // Address ID of every frame line, in input order
+    size_t frames_len;
+    size_t frames_cap;
+    bool demangle;
+} symbolize_t;
+
+// Samples of a stack of a binary trace
+typedef struct {
+    uint32_t id;
+    uint64_t samples;
+    uint64_t value;
+} trace_stack_t;
+
+typedef struct {
+    const char* key;
+    size_t key_len;
+    uintptr_t addr;
+    const char* end; // End of the frame in the line
+} frame_ref_t;
+
+static bool input_read(int fd, input_t* in) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            in->data = data;
+            in->size = (size_t)st.st_size;
+            in->mapped = true;
+            return true;
+        }
+    }
+
+    // Pipes are read into memory, the whole input is needed before anything can be written
+    char* buf = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    for (;;) {
+        if (cap - len < SYMBOLIZE_READ_SIZE) {
+            cap = cap ? cap * 2 : SYMBOLIZE_READ_SIZE;
+            char* grown = realloc(buf, cap);
+            if (!grown) {
+                free(buf);
+                return false;
+            }
+            buf = grown;
+        }
+
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            free(buf);
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        len += (size_t)n;
+    }
+
+    in->data = buf;
+    in->size = len;
+    in->mapped = false;
+
+    return true;
+}
+
+static void input_release(input_t* in) {
+    if (in->mapped) {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-cstyle-cast)
+        BW_UNUSED(munmap((void*)in->data, in->size));
+    } else {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-cstyle-cast)
+        free((void*)in->data);
+    }
+}
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static bool is_hex(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static unsigned hex_value(char c) {
+    if (c <= '9') {
+        return (unsigned)(c - '0');
+    }
+
+    return (unsigned)((c | ('a' - 'A')) - 'a' + DEC_BASE);
+}
+
+// Parses `0x` and hexadecimal digits at `p`, returning the end or NULL if there are none
+static const char* parse_hex(const char* p, const char* end, uintptr_t* value) {
+    if (end - p < 3 || p[0] != '0' || p[1] != 'x' || !is_hex(p[2])) {
+        return NULL;
+    }
+
+    uintptr_t val = 0;
+    for (p += 2; p < end && is_hex(*p); ++p) {
+        val = (val * HEX_BASE) + hex_value(*p);
+    }
+    *value = val;
+
+    return p;
+}
+
+// Finds the first `module+0xoffset` in the line, delimited by spaces or parentheses
+static bool find_frame(const char* line, const char* end, frame_ref_t* ref) {
+    const char* p = line;
+    while (p < end) {
+        const char* plus = memmem(p, (size_t)(end - p), "+0x", 3);
+        if (!plus) {
+            return false;
+        }
+
+        const char* key = plus;
+        while (key > line && !is_space(key[-1]) && key[-1] != '(') {
+            --key;
+        }
+        const char* hex_end = parse_hex(plus + 1, end, &ref->addr);
+        if (key < plus && hex_end && (hex_end == end || is_space(*hex_end) || *hex_end == ')')) {
+            ref->key = key;
+            ref->key_len = (size_t)(plus - key);
+            ref->end = hex_end;
+            return true;
+        }
+        p = plus + 1;
+    }
+
+    return false;
+}
+
+static size_t key_hash(const char* key, size_t len) {
+    uint64_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ (unsigned char)key[i]) * FNV_PRIME;
+    }
+
+    return (size_t)hash;
+}
+
+static module_key_t* key_slot(const symbolize_t* ctx, const char* key, size_t len) {
+    size_t slot = key_hash(key, len) & ctx->keys_mask;
+    while (ctx->keys[slot].key &&
+           (ctx->keys[slot].len != len || memcmp(ctx->keys[slot].key, key, len) != 0)) {
+        slot = (slot + 1) & ctx->keys_mask;
+    }
+
+    return &ctx->keys[slot];
+}
+
+static bool key_insert(symbolize_t* ctx, const char* key, size_t len, size_t mod) {
+    if (2 * (ctx->keys_len + 1) > ctx->keys_mask + 1) {
+        module_key_t* old = ctx->keys;
+        size_t old_size = ctx->keys_mask + 1;
+        ctx->keys = calloc(old_size * 2, sizeof(*ctx->keys));
+        if (!ctx->keys) {
+            ctx->keys = old;
+            return false;
+        }
+        ctx->keys_mask = (old_size * 2) - 1;
+        for (size_t i = 0; i < old_size; ++i) {
+            if (old[i].key) {
+                *key_slot(ctx, old[i].key, old[i].len) = old[i];
+            }
+        }
+        free(old);
+    }
+
+    module_key_t* slot = key_slot(ctx, key, len);
+    if (!slot->key) {
+        ctx->keys_len++;
+    }
+    slot->key = key;
+    slot->len = len;
+    slot->mod = mod;
+
+    return true;
+}
+
+// Registers a `0xbase-0xend build-id path` line of a module list. The first listing of a path wins.
+static bool add_module_line(symbolize_t* ctx, const char* line, const char* end) {
+    uintptr_t base = 0;
+    uintptr_t mod_end = 0;
+    const char* p = parse_hex(line, end, &base);
+    if (!p || p == end || *p != '-' || !(p = parse_hex(p + 1, end, &mod_end)) || p == end ||
+        *p != ' ') {
+        return true;
+    }
+
+    const char* id = ++p;
+    while (p < end && !is_space(*p)) {
+        ++p;
+    }
+    size_t id_len = (size_t)(p - id);
+    const char* path = p + 1;
+    if (p == end || path >= end || key_slot(ctx, path, (size_t)(end - path))->key) {
+        return true;
+    }
+
+    unsigned char build_id[MODULE_BUILD_ID_MAX];
+    size_t build_id_len = symbolizer_parse_build_id(id, id_len, build_id, sizeof(build_id));
+    size_t mod =
+        symbolizer_module(ctx->sym, path, (size_t)(end - path), build_id, build_id_len);
+
+    return mod != SYMBOLIZER_INVALID && key_insert(ctx, path, (size_t)(end - path), mod);
+}
+
+static bool add_module_frame(symbolize_t* ctx, size_t mod, uintptr_t addr) {
+    if (ctx->frames_len == ctx->frames_cap) {
+        size_t cap = ctx->frames_cap ? ctx->frames_cap * 2 : SYMBOLIZE_INITIAL_FRAMES;
+        size_t* frames = realloc(ctx->frames, cap * sizeof(*frames));
+        if (!frames) {
+            return false;
+        }
+        ctx->frames = frames;
+        ctx->frames_cap = cap;
+    }
+
+    size_t id = symbolizer_add(ctx->sym, mod, addr);
+    ctx->frames[ctx->frames_len++] = id;
+
+    return id != SYMBOLIZER_INVALID;
+}
+
+static bool add_frame(symbolize_t* ctx, const frame_ref_t* ref) {
+    module_key_t* slot = key_slot(ctx, ref->key, ref->key_len);
+    size_t mod = slot->mod;
+    if (!slot->key) {
+        // Frames may name their module by build ID instead of by path
+        unsigned char build_id[MODULE_BUILD_ID_MAX];
+        size_t build_id_len =
+            symbolizer_parse_build_id(ref->key, ref->key_len, build_id, sizeof(build_id));
+        mod = build_id_len > 0
+                  ? symbolizer_module(ctx->sym, NULL, 0, build_id, build_id_len)
+                  : symbolizer_module(ctx->sym, ref->key, ref->key_len, NULL, 0);
+        if (mod == SYMBOLIZER_INVALID || !key_insert(ctx, ref->key, ref->key_len, mod)) {
+            return false;
+        }
+    }
+
+    return add_module_frame(ctx, mod, ref->addr);
+}
+
+static const char* line_end(const char* p, const char* end) {
+    const char* nl = memchr(p, '\n', (size_t)(end - p));
+
+    return nl ? nl : end;
+}
+
+static bool collect(symbolize_t* ctx, const input_t* in) {
+    const char* end = in->data + in->size;
+
+    // Module lists follow the stacks in crash reports, so they are read first
+    for (const char* line = in->data; line < end;) {
+        const char* eol = line_end(line, end);
+        if (line[0] == '0' && !add_module_line(ctx, line, eol)) {
+            return false;
+        }
+        line = eol + 1;
+    }
+
+    for (const char* line = in->data; line < end;) {
+        const char* eol = line_end(line, end);
+        frame_ref_t ref;
+        if (find_frame(line, eol, &ref) && !add_frame(ctx, &ref)) {
+            return false;
+        }
+        line = eol + 1;
+    }
+
+    return true;
+}
+
+static void write_str(const char* str, size_t len) {
+    BW_UNUSED(fwrite_unlocked(str, 1, len, stdout));
+}
+
+static void write_frame(const symbolize_t* ctx, const symbolizer_frame_t* frame) {
+    const char* sname = frame->sname ? frame->sname : "?";
+    if (ctx->demangle && frame->sname) {
+        sname = bw_demangle(sname);
+    }
+    write_str(" ", 1);
+    write_str(sname, strlen(sname));
+
+    if (frame->file) {
+        char num[SYMBOLIZE_NUMBER_MAX];
+        size_t pos = sizeof(num);
+        uint32_t line = frame->line;
+        do {
+            num[--pos] = (char)('0' + (line % DEC_BASE));
+            line /= DEC_BASE;
+        } while (line > 0);
+        num[--pos] = ':';
+
+        write_str(" ", 1);
+        write_str(frame->file, strlen(frame->file));
+        write_str(num + pos, sizeof(num) - pos);
+    }
+}
+
+static void emit(const symbolize_t* ctx, const input_t* in) {
+    const char* end = in->data + in->size;
+    size_t next = 0;
+
+    for (const char* line = in->data; line < end;) {
+        const char* eol = line_end(line, end);
+        write_str(line, (size_t)(eol - line));
+
+        frame_ref_t ref;
+        if (find_frame(line, eol, &ref) && next < ctx->frames_len) {
+            write_frame(ctx, symbolizer_get(ctx->sym, ctx->frames[next++]));
+        }
+        write_str("\n", 1);
+        line = eol + 1;
+    }
+}
+
+static void report_missing(const symbolize_t* ctx) {
+    for (size_t i = 0; i <= ctx->keys_mask; ++i) {
+        const module_key_t* key = &ctx->keys[i];
+        if (key->key && symbolizer_module_missing(ctx->sym, key->mod)) {
+            BW_UNUSED(fprintf(stderr,
+                              "backwalk-symbolize: no matching file for %.*s\n",
+                              (int)key->len,
+                              key->key));
+        }
+    }
+}
+
+static void write_number(uint64_t value, unsigned base) {
+    char num[SYMBOLIZE_NUMBER_MAX];
+    size_t pos = sizeof(num);
+    do {
+        num[--pos] = "0123456789abcdef"[value % base];
+        value /= base;
+    } while (value > 0);
+
+    write_str(num + pos, sizeof(num) - pos);
+}
+
+static int compare_stacks(const void* a, const void* b) {
+    const trace_stack_t* lhs = a;
+    const trace_stack_t* rhs = b;
+    if (lhs->value != rhs->value) {
+        return lhs->value > rhs->value ? -1 : 1;
+    }
+
+    return lhs->id < rhs->id ? -1 : lhs->id > rhs->id;
+}
+
+// Counts the samples of each stack, heaviest first, and returns how many stacks were sampled
+static size_t trace_count(bw_trace_reader_t* reader, trace_stack_t* stacks, uint32_t limit) {
+    for (uint32_t id = 0; id < limit; ++id) {
+        stacks[id].id = id;
+    }
+
+    bw_trace_sample_t sample;
+    while (bw_trace_reader_next(reader, &sample)) {
+        if (sample.stack_id < limit) {
+            stacks[sample.stack_id].samples++;
+            stacks[sample.stack_id].value += sample.value;
+        }
+    }
+
+    size_t len = 0;
+    for (uint32_t id = 0; id < limit; ++id) {
+        if (stacks[id].samples > 0) {
+            stacks[len++] = stacks[id];
+        }
+    }
+    qsort(stacks, len, sizeof(*stacks), compare_stacks);
+
+    return len;
+}
+
+static void trace_emit(const symbolize_t* ctx,
+                       const bw_trace_reader_t* reader,
+                       const trace_stack_t* stacks,
+                       size_t stacks_len) {
+    bw_trace_frame_t frames[BW_TRACE_FRAMES_MAX];
+    size_t next = 0;
+
+    for (size_t i = 0; i < stacks_len; ++i) {
+        write_str("stack ", 6);
+        write_number(stacks[i].id, DEC_BASE);
+        write_str(": ", 2);
+        write_number(stacks[i].samples, DEC_BASE);
+        write_str(" samples, value ", 16);
+        write_number(stacks[i].value, DEC_BASE);
+        write_str("\n", 1);
+
+        size_t len = bw_trace_reader_stack(reader, stacks[i].id, frames, BW_ARRAY_LEN(frames));
+        for (size_t j = 0; j < len; ++j) {
+            write_str("  #", 3);
+            write_number(j, DEC_BASE);
+            write_str(" ", 1);
+            bw_trace_module_t mod;
+            if (bw_trace_reader_module(reader, (size_t)frames[j].module, &mod)) {
+                write_str(mod.path, mod.path_len);
+                write_str("+", 1);
+            }
+            write_str("0x", 2);
+            write_number(frames[j].addr, HEX_BASE);
+            if (frames[j].module != BW_TRACE_MODULE_UNKNOWN && next < ctx->frames_len) {
+                write_frame(ctx, symbolizer_get(ctx->sym, ctx->frames[next++]));
+            }
+            write_str("\n", 1);
+        }
+    }
+}
+
+// Queues the frames of the sampled stacks in the order trace_emit() writes them
+static bool trace_collect(symbolize_t* ctx,
+                          const bw_trace_reader_t* reader,
+                          const trace_stack_t* stacks,
+                          size_t stacks_len) {
+    size_t modules_len = bw_trace_reader_modules_len(reader);
+    size_t* modules = malloc((modules_len + 1) * sizeof(*modules));
+    if (!modules) {
+        return false;
+    }
+
+    bool success = true;
+    for (size_t i = 0; i < modules_len && success; ++i) {
+        bw_trace_module_t mod;
+        BW_UNUSED(bw_trace_reader_module(reader, i, &mod));
+        modules[i] =
+            symbolizer_module(ctx->sym, mod.path, mod.path_len, mod.build_id, mod.build_id_len);
+        success = modules[i] != SYMBOLIZER_INVALID &&
+                  key_insert(ctx, mod.path, mod.path_len, modules[i]);
+    }
+
+    bw_trace_frame_t frames[BW_TRACE_FRAMES_MAX];
+    for (size_t i = 0; i < stacks_len && success; ++i) {
+        size_t len = bw_trace_reader_stack(reader, stacks[i].id, frames, BW_ARRAY_LEN(frames));
+        for (size_t j = 0; j < len && success; ++j) {
+            if (frames[j].module == BW_TRACE_MODULE_UNKNOWN) {
+                continue;
+            }
+            success = add_module_frame(ctx, modules[frames[j].module], frames[j].addr);
+        }
+    }
+
+    free(modules);
+
+    return success;
+}
+
+static bool symbolize_trace(symbolize_t* ctx, const char* path) {
+    bw_trace_reader_t* reader = bw_trace_reader_open(path);
+    if (!reader) {
+        BW_UNUSED(fprintf(stderr, "backwalk-symbolize: cannot read trace %s\n", path));
+        return false;
+    }
+
+    uint32_t limit = bw_trace_reader_stack_id_limit(reader);
+    trace_stack_t* stacks = calloc((size_t)limit + 1, sizeof(*stacks));
+    size_t stacks_len = stacks ? trace_count(reader, stacks, limit) : 0;
+    bool success = stacks && trace_collect(ctx, reader, stacks, stacks_len);
+    if (success) {
+        symbolizer_resolve(ctx->sym);
+        BW_UNUSED(setvbuf(stdout, NULL, _IOFBF, SYMBOLIZE_OUT_BUFFER_SIZE));
+        trace_emit(ctx, reader, stacks, stacks_len);
+        success = fflush(stdout) == 0;
+        report_missing(ctx);
+    } else {
+        BW_UNUSED(fprintf(stderr, "backwalk-symbolize: out of memory\n"));
+    }
+
+    free(stacks);
+    bw_trace_reader_close(reader);
+
+    return success;
+}
+
+static void usage(const char* prog) {
+    BW_UNUSED(fprintf(stderr,
+                      "usage: %s [-C] [-d debug-dir]... [trace]\n"
+                      "  -C  demangle C++ symbol names\n"
+                      "  -d  look up files by build ID in debug-dir/.build-id, before %s\n",
+                      prog,
+                      k_default_debug_dir));
+}
+
+int main(int argc, char** argv) {
+    const char* debug_dirs[SYMBOLIZE_DEBUG_DIRS_MAX + 1];
+    size_t debug_dirs_len = 0;
+    symbolize_t ctx = {0};
+
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "Cd:h")) != -1) {
+        if (opt == 'C') {
+            ctx.demangle = true;
+        } else if (opt == 'd' && debug_dirs_len < SYMBOLIZE_DEBUG_DIRS_MAX) {
+            debug_dirs[debug_dirs_len++] = optarg;
+        } else {
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    debug_dirs[debug_dirs_len++] = k_default_debug_dir;
+
+    if (argc - optind > 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char* path = optind < argc ? argv[optind] : NULL;
+    int fd = path && strcmp(path, "-") != 0 ? open(path, O_RDONLY | O_CLOEXEC) : STDIN_FILENO;
+    input_t in = {0};
+    if (fd < 0 || !input_read(fd, &in)) {
+        BW_UNUSED(fprintf(stderr, "backwalk-symbolize: cannot read %s\n", path ? path : "stdin"));
+        return 1;
+    }
+    if (fd != STDIN_FILENO) {
+        BW_UNUSED(close(fd));
+    }
+
+    // Binary traces are mapped by their reader, so they must be named rather than piped in
+    bool binary = in.size >= sizeof(k_trace_magic) &&
+                  memcmp(in.data, k_trace_magic, sizeof(k_trace_magic)) == 0;
+    if (binary && fd == STDIN_FILENO) {
+        BW_UNUSED(fprintf(stderr, "backwalk-symbolize: binary traces must be read from a file\n"));
+        input_release(&in);
+        return 1;
+    }
+
+    ctx.sym = symbolizer_create(debug_dirs, debug_dirs_len);
+    ctx.keys_mask = SYMBOLIZE_INITIAL_KEYS - 1;
+    ctx.keys = calloc(SYMBOLIZE_INITIAL_KEYS, sizeof(*ctx.keys));
+    bool success = ctx.sym && ctx.keys;
+    if (success && binary) {
+        success = symbolize_trace(&ctx, path);
+    } else if (success && collect(&ctx, &in)) {
+        symbolizer_resolve(ctx.sym);
+        BW_UNUSED(setvbuf(stdout, NULL, _IOFBF, SYMBOLIZE_OUT_BUFFER_SIZE));
+        emit(&ctx, &in);
+        success = fflush(stdout) == 0;
+        report_missing(&ctx);
+    } else {
+        BW_UNUSED(fprintf(stderr, "backwalk-symbolize: out of memory\n"));
+        success = false;
+    }
+
+    free(ctx.frames);
+    free(ctx.keys);
+    symbolizer_destroy(ctx.sym);
+    input_release(&in);
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,373 @@
+#include "symbolizer.h"
+
+#include <limits.h>     // for PATH_MAX
+#include <stdbool.h>    // for bool, false, true
+#include <stddef.h>     // for size_t, NULL
+#include <stdint.h>     // for uintptr_t, uint32_t, uint64_t
+#include <stdio.h>      // for snprintf
+#include <stdlib.h>     // for calloc, free, malloc, qsort, realloc
+#include <string.h>     // for memcmp, memcpy, strncmp, strndup
+#include <unistd.h>     // for sysconf, _SC_PAGESIZE
+
+#include "dwarf_line.h" // for dwarf_lines_close, dwarf_lines_lookup, dwarf_lines_open, dwa...
+#include "elf_file.h"   // for elf_build_id, elf_close, elf_link_base, elf_open, elf_symbolize
+#include "module.h"     // for MODULE_BUILD_ID_MAX
+
+enum { SYMBOLIZER_INITIAL_MODULES = 16 };
+enum { SYMBOLIZER_INITIAL_ADDRS = 1024 };
+
+#define HASH_MULTIPLIER 0x9e3779b97f4a7c15ULL
+#define HASH_SHIFT 32
+#define HEX_BASE 16
+
+typedef struct {
+    char* path; // NULL if unknown
+    unsigned char build_id[MODULE_BUILD_ID_MAX];
+    size_t build_id_len;
+    elf_file_t* elf;
+    dwarf_lines_t* lines;
+    uintptr_t link_base; // Link-time address that module-relative addresses are offsets from
+    bool opened;
+} symbolizer_module_t;
+
+typedef struct {
+    size_t mod;
+    uintptr_t addr;
+} symbolizer_addr_t;
+
+// Pending addresses to sort and slots of the address table, which keep their key to look it up
+// with a single cache miss
+typedef struct {
+    symbolizer_addr_t key;
+    size_t id;
+} symbolizer_pending_t;
+
+struct symbolizer {
+    const char* const* debug_dirs;
+    size_t debug_dirs_len;
+    uintptr_t page_mask;
+
+    symbolizer_module_t* mods;
+    size_t mods_len;
+    size_t mods_cap;
+
+    symbolizer_addr_t* addrs;
+    symbolizer_frame_t* frames;
+    size_t addrs_len;
+    size_t addrs_cap;
+    size_t resolved; // Addresses before this one are resolved
+    symbolizer_pending_t* table; // Open addressing table by address, kept at most half full
+    size_t table_mask;
+};
+
+static size_t symbolizer_hash(size_t mod, uintptr_t addr) {
+    uint64_t hash = ((uint64_t)addr ^ ((uint64_t)mod << HASH_SHIFT)) * HASH_MULTIPLIER;
+
+    return (size_t)(hash ^ (hash >> HASH_SHIFT));
+}
+
+symbolizer_t* symbolizer_create(const char* const* debug_dirs, size_t debug_dirs_len) {
+    symbolizer_t* sym = calloc(1, sizeof(*sym));
+    if (!sym) {
+        return NULL;
+    }
+
+    sym->debug_dirs = debug_dirs;
+    sym->debug_dirs_len = debug_dirs_len;
+    sym->page_mask = ~((uintptr_t)sysconf(_SC_PAGESIZE) - 1);
+    sym->table_mask = (2 * SYMBOLIZER_INITIAL_ADDRS) - 1;
+    sym->table = calloc(sym->table_mask + 1, sizeof(*sym->table));
+    if (!sym->table) {
+        free(sym);
+        return NULL;
+    }
+
+    return sym;
+}
+
+void symbolizer_destroy(symbolizer_t* sym) {
+    if (!sym) {
+        return;
+    }
+
+    for (size_t i = 0; i < sym->mods_len; ++i) {
+        dwarf_lines_close(sym->mods[i].lines);
+        elf_close(sym->mods[i].elf);
+        free(sym->mods[i].path);
+    }
+    free(sym->mods);
+    free(sym->addrs);
+    free(sym->frames);
+    free(sym->table);
+    free(sym);
+}
+
+size_t symbolizer_module(symbolizer_t* sym,
+                         const char* path,
+                         size_t path_len,
+                         const unsigned char* build_id,
+                         size_t build_id_len) {
+    if (build_id_len > MODULE_BUILD_ID_MAX) {
+        build_id_len = MODULE_BUILD_ID_MAX;
+    }
+
+    // Called once per distinct module by callers, which cache the index
+    for (size_t i = 0; i < sym->mods_len; ++i) {
+        const symbolizer_module_t* mod = &sym->mods[i];
+        bool same_path = mod->path ? path_len > 0 && strncmp(mod->path, path, path_len) == 0 &&
+                                         mod->path[path_len] == '\0'
+                                   : path_len == 0;
+        if (same_path && mod->build_id_len == build_id_len &&
+            memcmp(mod->build_id, build_id, build_id_len) == 0) {
+            return i;
+        }
+    }
+
+    if (sym->mods_len == sym->mods_cap) {
+        size_t cap = sym->mods_cap ? sym->mods_cap * 2 : SYMBOLIZER_INITIAL_MODULES;
+        symbolizer_module_t* mods = realloc(sym->mods, cap * sizeof(*mods));
+        if (!mods) {
+            return SYMBOLIZER_INVALID;
+        }
+        sym->mods = mods;
+        sym->mods_cap = cap;
+    }
+
+    symbolizer_module_t* mod = &sym->mods[sym->mods_len];
+    *mod = (symbolizer_module_t){0};
+    if (path_len > 0) {
+        mod->path = strndup(path, path_len);
+        if (!mod->path) {
+            return SYMBOLIZER_INVALID;
+        }
+    }
+    memcpy(mod->build_id, build_id, build_id_len);
+    mod->build_id_len = build_id_len;
+
+    return sym->mods_len++;
+}
+
+static bool symbolizer_grow(symbolizer_t* sym) {
+    size_t cap = sym->addrs_cap ? sym->addrs_cap * 2 : SYMBOLIZER_INITIAL_ADDRS;
+    symbolizer_addr_t* addrs = realloc(sym->addrs, cap * sizeof(*addrs));
+    if (!addrs) {
+        return false;
+    }
+    sym->addrs = addrs;
+
+    symbolizer_frame_t* frames = realloc(sym->frames, cap * sizeof(*frames));
+    if (!frames) {
+        return false;
+    }
+    sym->frames = frames;
+
+    // The capacity only grows once the table can hold it too, the probe loops rely on an empty slot
+    if (cap * 2 <= sym->table_mask + 1) {
+        sym->addrs_cap = cap;
+        return true;
+    }
+
+    size_t mask = (cap * 2) - 1;
+    symbolizer_pending_t* table = calloc(mask + 1, sizeof(*table));
+    if (!table) {
+        return false;
+    }
+    for (size_t i = 0; i <= sym->table_mask; ++i) {
+        const symbolizer_pending_t* entry = &sym->table[i];
+        if (entry->id == 0) {
+            continue;
+        }
+        size_t slot = symbolizer_hash(entry->key.mod, entry->key.addr) & mask;
+        while (table[slot].id != 0) {
+            slot = (slot + 1) & mask;
+        }
+        table[slot] = *entry;
+    }
+    free(sym->table);
+    sym->table = table;
+    sym->table_mask = mask;
+    sym->addrs_cap = cap;
+
+    return true;
+}
+
+size_t symbolizer_add(symbolizer_t* sym, size_t mod, uintptr_t addr) {
+    // Slots hold IDs plus one, 0 marks an empty slot
+    size_t slot = symbolizer_hash(mod, addr) & sym->table_mask;
+    while (sym->table[slot].id != 0) {
+        const symbolizer_pending_t* found = &sym->table[slot];
+        if (found->key.mod == mod && found->key.addr == addr) {
+            return found->id - 1;
+        }
+        slot = (slot + 1) & sym->table_mask;
+    }
+
+    if (sym->addrs_len == sym->addrs_cap) {
+        if (!symbolizer_grow(sym)) {
+            return SYMBOLIZER_INVALID;
+        }
+        // The table was rebuilt, find the free slot again
+        slot = symbolizer_hash(mod, addr) & sym->table_mask;
+        while (sym->table[slot].id != 0) {
+            slot = (slot + 1) & sym->table_mask;
+        }
+    }
+
+    size_t id = sym->addrs_len++;
+    sym->addrs[id].mod = mod;
+    sym->addrs[id].addr = addr;
+    sym->frames[id] = (symbolizer_frame_t){0};
+    sym->table[slot].key = sym->addrs[id];
+    sym->table[slot].id = id + 1;
+
+    return id;
+}
+
+// Opens `path` if it is the module's file, or the module has no build ID to check it against
+static elf_file_t* symbolizer_open_file(const char* path, const symbolizer_module_t* mod) {
+    elf_file_t* elf = elf_open(path);
+    if (!elf || mod->build_id_len == 0) {
+        return elf;
+    }
+
+    unsigned char build_id[MODULE_BUILD_ID_MAX];
+    size_t len = elf_build_id(elf, build_id, sizeof(build_id));
+    if (len != mod->build_id_len || memcmp(build_id, mod->build_id, len) != 0) {
+        elf_close(elf);
+        return NULL;
+    }
+
+    return elf;
+}
+
+static elf_file_t* symbolizer_open(const symbolizer_t* sym, const symbolizer_module_t* mod) {
+    static const char k_digits[] = "0123456789abcdef";
+
+    if (mod->build_id_len > 0) {
+        char hex[(MODULE_BUILD_ID_MAX * 2) + 1];
+        for (size_t i = 0; i < mod->build_id_len; ++i) {
+            hex[2 * i] = k_digits[mod->build_id[i] / HEX_BASE];
+            hex[(2 * i) + 1] = k_digits[mod->build_id[i] % HEX_BASE];
+        }
+        hex[mod->build_id_len * 2] = '\0';
+
+        for (size_t i = 0; i < sym->debug_dirs_len; ++i) {
+            char path[PATH_MAX];
+            int len = snprintf(
+                path, sizeof(path), "%s/.build-id/%.2s/%s.debug", sym->debug_dirs[i], hex, hex + 2);
+            elf_file_t* elf = len > 0 && (size_t)len < sizeof(path)
+                                  ? symbolizer_open_file(path, mod)
+                                  : NULL;
+            if (elf) {
+                return elf;
+            }
+        }
+    }
+
+    return mod->path ? symbolizer_open_file(mod->path, mod) : NULL;
+}
+
+static int compare_pending(const void* lhs, const void* rhs) {
+    const symbolizer_pending_t* lpend = lhs;
+    const symbolizer_pending_t* rpend = rhs;
+
+    if (lpend->key.mod != rpend->key.mod) {
+        return lpend->key.mod < rpend->key.mod ? -1 : 1;
+    }
+    if (lpend->key.addr != rpend->key.addr) {
+        return lpend->key.addr < rpend->key.addr ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static void symbolizer_resolve_one(symbolizer_t* sym, const symbolizer_addr_t* key, size_t id) {
+    symbolizer_module_t* mod = &sym->mods[key->mod];
+    if (!mod->opened) {
+        mod->opened = true;
+        mod->elf = symbolizer_open(sym, mod);
+        if (mod->elf) {
+            mod->lines = dwarf_lines_open(mod->elf);
+            mod->link_base = elf_link_base(mod->elf, sym->page_mask);
+        }
+    }
+    if (!mod->elf) {
+        return;
+    }
+
+    // Return addresses point past the call instruction, look up the call itself
+    uintptr_t addr = mod->link_base + key->addr - (key->addr > 0 ? 1 : 0);
+    symbolizer_frame_t* frame = &sym->frames[id];
+    frame->sname = elf_symbolize(mod->elf, addr);
+    if (mod->lines && !dwarf_lines_lookup(mod->lines, addr, &frame->file, &frame->line)) {
+        frame->file = NULL;
+        frame->line = 0;
+    }
+}
+
+void symbolizer_resolve(symbolizer_t* sym) {
+    size_t len = sym->addrs_len - sym->resolved;
+    if (len == 0) {
+        return;
+    }
+
+    // Each module's file is opened on its first address, and the symbol and line tables are then
+    // searched in address order
+    symbolizer_pending_t* pending = malloc(len * sizeof(*pending));
+    if (pending) {
+        for (size_t i = 0; i < len; ++i) {
+            pending[i].key = sym->addrs[sym->resolved + i];
+            pending[i].id = sym->resolved + i;
+        }
+        qsort(pending, len, sizeof(*pending), compare_pending);
+        for (size_t i = 0; i < len; ++i) {
+            symbolizer_resolve_one(sym, &pending[i].key, pending[i].id);
+        }
+        free(pending);
+    } else {
+        for (size_t id = sym->resolved; id < sym->addrs_len; ++id) {
+            symbolizer_resolve_one(sym, &sym->addrs[id], id);
+        }
+    }
+
+    sym->resolved = sym->addrs_len;
+}
+
+const symbolizer_frame_t* symbolizer_get(const symbolizer_t* sym, size_t id) {
+    return &sym->frames[id];
+}
+
+bool symbolizer_module_missing(const symbolizer_t* sym, size_t mod) {
+    return sym->mods[mod].opened && !sym->mods[mod].elf;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+size_t symbolizer_parse_build_id(const char* hex, size_t len, unsigned char* out, size_t max) {
+    if (len == 0 || len % 2 != 0 || len / 2 > max) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < len / 2; ++i) {
+        int hi = hex_digit(hex[2 * i]);
+        int lo = hex_digit(hex[(2 * i) + 1]);
+        if (hi < 0 || lo < 0) {
+            return 0;
+        }
+        out[i] = (unsigned char)((hi * HEX_BASE) + lo);
+    }
+
+    return len / 2;
+}
@@ -0,0 +1,53 @@
+#ifndef BW_SYMBOLIZER_H
+#define BW_SYMBOLIZER_H
+
+#include <stdbool.h>  // for bool
+#include <stddef.h>   // for size_t
+#include <stdint.h>   // for uintptr_t, uint32_t, SIZE_MAX
+
+// Resolves module-relative addresses captured on another machine against the files of their
+// modules, found by build ID. Addresses are queued first and resolved in one batch, sorted by
+// module and address, so that each file is mapped and indexed once.
+typedef struct symbolizer symbolizer_t;
+
+typedef struct {
+    const char* sname; // NULL if unknown
+    const char* file;  // NULL if unknown
+    uint32_t line;
+} symbolizer_frame_t;
+
+#define SYMBOLIZER_INVALID SIZE_MAX
+
+// Files are looked up as <dir>/.build-id/xx/yyyy.debug in each of `debug_dirs`, in order, and
+// then at the module's path, whose build ID must then match.
+symbolizer_t* symbolizer_create(const char* const* debug_dirs, size_t debug_dirs_len);
+
+void symbolizer_destroy(symbolizer_t* sym);
+
+// Returns the index of the module with `path` and `build_id`, either of which may be empty,
+// registering it on first use. Returns SYMBOLIZER_INVALID if out of memory.
+size_t symbolizer_module(symbolizer_t* sym,
+                         const char* path,
+                         size_t path_len,
+                         const unsigned char* build_id,
+                         size_t build_id_len);
+
+// Queues the return address `addr`, relative to the base of module `mod`, and returns an ID for it
+// that is the same for every occurrence of the address. Returns SYMBOLIZER_INVALID if out of
+// memory.
+size_t symbolizer_add(symbolizer_t* sym, size_t mod, uintptr_t addr);
+
+// Resolves the addresses queued since the last call
+void symbolizer_resolve(symbolizer_t* sym);
+
+// Returns the resolution of the address with ID `id`, valid until the symbolizer is destroyed
+const symbolizer_frame_t* symbolizer_get(const symbolizer_t* sym, size_t id);
+
+// Parses the build ID written as `len` hexadecimal digits at `hex` into `out`. Returns its length
+// in bytes, or 0 if it is malformed or longer than `max`.
+size_t symbolizer_parse_build_id(const char* hex, size_t len, unsigned char* out, size_t max);
+
+// Returns true if addresses of the module were resolved but no file matching it was found
+bool symbolizer_module_missing(const symbolizer_t* sym, size_t mod);
+
+#endif // BW_SYMBOLIZER_H
@@ -0,0 +1,340 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include "backwalk/thread_dump.h"
+
+#include <dirent.h>             // for closedir, opendir, readdir, DIR, dirent
+#include <errno.h>              // for errno, EINTR
+#include <fcntl.h>              // for open, O_CLOEXEC, O_RDONLY
+#include <pthread.h>            // for pthread_mutex_lock, pthread_mutex_unlock, PTHREAD_MUTE...
+#include <signal.h>             // for sigaction, siginfo_t, sigemptyset, SA_ONSTACK, SA_REST...
+#include <stdatomic.h>          // for atomic_compare_exchange_strong, atomic_load_explicit, ...
+#include <stdbool.h>            // for bool, false, true
+#include <stddef.h>             // for size_t, NULL
+#include <stdint.h>             // for uintptr_t, uint64_t, uint32_t, uintmax_t
+#include <stdio.h>              // for dprintf, snprintf
+#include <stdlib.h>             // for calloc, strtol
+#include <string.h>             // for memcpy, memset, strchr
+#include <sys/syscall.h>        // for SYS_rt_tgsigqueueinfo
+#include <sys/types.h>          // for ssize_t, pid_t
+#include <time.h>               // for clock_gettime, nanosleep, timespec, CLOCK_MONOTONIC
+#include <unistd.h>             // for getpid, gettid, getuid, close, read, syscall
+
+#include "backwalk/backwalk.h"  // for bw_backtrace_from_ucontext, bw_frame_t, bw_signal_safe...
+#include "common.h"             // for BW_UNUSED
+#include "module.h"             // for module_map_get, module_map_t
+#include "resolve.h"            // for resolve_frame
+
+enum { DUMP_DEFAULT_MAX_THREADS = 1024 };
+enum { DUMP_DEFAULT_SIGNAL_OFFSET = 3 };
+enum { DUMP_POLL_INTERVAL_NS = 50000 };
+enum { DUMP_PATH_MAX = 64 };
+
+#define NSECS_PER_SEC 1000000000L
+#define NSECS_PER_MSEC 1000000L
+#define DEC_BASE 10
+
+// The signal's value carries the dump's generation and the slot index, so that a thread that
+// answers a dump which already timed out cannot write into a slot reused by the next one
+#define DUMP_INDEX_BITS 32
+#define DUMP_INDEX_MASK 0xffffffffU
+#define DUMP_PHASE_BITS 2
+
+typedef enum {
+    DUMP_PENDING = 0,
+    DUMP_RUNNING = 1,
+    DUMP_DONE = 2,
+    DUMP_EXPIRED = 3,
+} dump_phase_t;
+
+typedef struct {
+    atomic_uint_fast64_t state; // Generation of the dump, then its phase in the low bits
+    int tid;
+    char name[BW_DUMP_NAME_MAX];
+    size_t len;
+    bw_frame_t frames[BW_DUMP_FRAMES_MAX];
+} dump_slot_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    bool installed;
+    int signo;
+    size_t max_threads;
+    dump_slot_t* slots; // Never freed, late answers may still write to them
+    uint32_t generation;
+} dump_t;
+
+static dump_t dump = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static uint64_t dump_state(uint32_t generation, dump_phase_t phase) {
+    return ((uint64_t)generation << DUMP_PHASE_BITS) | phase;
+}
+
+static dump_phase_t dump_phase(const dump_slot_t* slot) {
+    uint64_t state = atomic_load_explicit(&slot->state, memory_order_acquire);
+
+    return (dump_phase_t)(state & ((1U << DUMP_PHASE_BITS) - 1));
+}
+
+static void dump_handler(int sig, siginfo_t* info, void* ucontext) {
+    BW_UNUSED(sig);
+
+    // Only answer the dumps of this process
+    if (info->si_code != SI_QUEUE || info->si_pid != getpid() || !ucontext) {
+        return;
+    }
+
+    int saved_errno = errno;
+
+    uintptr_t value = (uintptr_t)info->si_value.sival_ptr;
+    size_t index = value & DUMP_INDEX_MASK;
+    uint32_t generation = (uint32_t)(value >> DUMP_INDEX_BITS);
+
+    dump_slot_t* slot = index < dump.max_threads ? &dump.slots[index] : NULL;
+    uint_fast64_t expected = dump_state(generation, DUMP_PENDING);
+    if (slot && slot->tid == gettid() &&
+        atomic_compare_exchange_strong(&slot->state,
+                                       &expected,
+                                       dump_state(generation, DUMP_RUNNING))) {
+        slot->len = bw_backtrace_from_ucontext(ucontext, slot->frames, BW_DUMP_FRAMES_MAX);
+        atomic_store_explicit(&slot->state,
+                              dump_state(generation, DUMP_DONE),
+                              memory_order_release);
+    }
+
+    errno = saved_errno;
+}
+
+// Must be called with the lock held
+static bool dump_install_locked(const bw_dump_config_t* config) {
+    if (dump.installed) {
+        return true;
+    }
+
+    dump.signo = config && config->signo ? config->signo : SIGRTMIN + DUMP_DEFAULT_SIGNAL_OFFSET;
+    dump.max_threads =
+        config && config->max_threads ? config->max_threads : DUMP_DEFAULT_MAX_THREADS;
+    if (dump.signo < SIGRTMIN || dump.signo > SIGRTMAX || dump.max_threads > DUMP_INDEX_MASK) {
+        return false;
+    }
+
+    dump.slots = calloc(dump.max_threads, sizeof(*dump.slots));
+    if (!dump.slots) {
+        return false;
+    }
+
+    struct sigaction action = {0};
+    action.sa_sigaction = dump_handler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;
+    BW_UNUSED(sigemptyset(&action.sa_mask));
+    dump.installed = sigaction(dump.signo, &action, NULL) == 0;
+
+    return dump.installed;
+}
+
+bool bw_dump_install(const bw_dump_config_t* config) {
+    if (pthread_mutex_lock(&dump.lock) != 0) {
+        return false;
+    }
+
+    bool success = dump_install_locked(config);
+    BW_UNUSED(pthread_mutex_unlock(&dump.lock));
+
+    return success;
+}
+
+static long now_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        return 0;
+    }
+
+    return (ts.tv_sec * NSECS_PER_SEC) + ts.tv_nsec;
+}
+
+static void dump_sleep(void) {
+    struct timespec interval = {0, DUMP_POLL_INTERVAL_NS};
+    BW_UNUSED(nanosleep(&interval, NULL));
+}
+
+static void dump_read_name(dump_slot_t* slot) {
+    slot->name[0] = '\0';
+
+    char path[DUMP_PATH_MAX];
+    BW_UNUSED(snprintf(path, sizeof(path), "/proc/self/task/%d/comm", slot->tid));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    ssize_t len = read(fd, slot->name, sizeof(slot->name) - 1);
+    BW_UNUSED(close(fd));
+
+    slot->name[len > 0 ? len : 0] = '\0';
+    char* newline = strchr(slot->name, '\n');
+    if (newline) {
+        *newline = '\0';
+    }
+}
+
+// Must be called with the lock held. Returns the number of slots filled.
+static size_t dump_list_threads(uint32_t generation) {
+    DIR* dir = opendir("/proc/self/task");
+    if (!dir) {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (struct dirent* entry = readdir(dir); entry && count < dump.max_threads;
+         entry = readdir(dir)) {
+        char* end = NULL;
+        long tid = strtol(entry->d_name, &end, DEC_BASE);
+        if (tid <= 0 || *end != '\0') {
+            continue;
+        }
+
+        dump_slot_t* slot = &dump.slots[count++];
+        slot->tid = (int)tid;
+        slot->len = 0;
+        dump_read_name(slot);
+        atomic_store_explicit(&slot->state,
+                              dump_state(generation, DUMP_PENDING),
+                              memory_order_release);
+    }
+    BW_UNUSED(closedir(dir));
+
+    return count;
+}
+
+// Queues the signal to a thread of this process with `value`, which tgkill() cannot carry
+static bool dump_signal(pid_t pid, int tid, uintptr_t value) {
+    siginfo_t info;
+    memset(&info, 0, sizeof(info));
+    info.si_signo = dump.signo;
+    info.si_code = SI_QUEUE;
+    info.si_pid = pid;
+    info.si_uid = getuid();
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    info.si_value.sival_ptr = (void*)value;
+
+    return syscall(SYS_rt_tgsigqueueinfo, pid, tid, dump.signo, &info) == 0;
+}
+
+// Must be called with the lock held. Returns once every slot is done or expired.
+static void dump_collect(uint32_t generation, size_t count, unsigned timeout_ms) {
+    pid_t pid = getpid();
+    for (size_t i = 0; i < count; ++i) {
+        // The calling thread answers its own signal before the call returns
+        uintptr_t value = ((uintptr_t)generation << DUMP_INDEX_BITS) | i;
+        if (!dump_signal(pid, dump.slots[i].tid, value)) {
+            // The thread has exited since it was listed
+            atomic_store_explicit(&dump.slots[i].state,
+                                  dump_state(generation, DUMP_EXPIRED),
+                                  memory_order_relaxed);
+        }
+    }
+
+    long deadline = now_ns() + ((long)timeout_ms * NSECS_PER_MSEC);
+    for (size_t i = 0; i < count; ++i) {
+        while (dump_phase(&dump.slots[i]) == DUMP_PENDING && now_ns() < deadline) {
+            dump_sleep();
+        }
+
+        // Too late, the thread no longer writes to the slot once it sees the new state
+        uint_fast64_t expected = dump_state(generation, DUMP_PENDING);
+        BW_UNUSED(atomic_compare_exchange_strong(&dump.slots[i].state,
+                                                 &expected,
+                                                 dump_state(generation, DUMP_EXPIRED)));
+
+        // A thread that started its walk is inside the handler, which finishes in bounded time
+        while (dump_phase(&dump.slots[i]) == DUMP_RUNNING) {
+            dump_sleep();
+        }
+    }
+}
+
+size_t bw_dump_all_threads(unsigned timeout_ms, bw_dump_cb cb, void* arg) {
+    if (pthread_mutex_lock(&dump.lock) != 0) {
+        return 0;
+    }
+
+    size_t captured = 0;
+    if (dump_install_locked(NULL)) {
+        // Takes a snapshot of the loaded modules for the handlers
+        BW_UNUSED(bw_signal_safe_init());
+
+        uint32_t generation = ++dump.generation;
+        size_t count = dump_list_threads(generation);
+        dump_collect(generation, count, timeout_ms);
+
+        bool more = true;
+        for (size_t i = 0; i < count; ++i) {
+            const dump_slot_t* slot = &dump.slots[i];
+            bw_thread_stack_t stack = {0};
+            stack.tid = slot->tid;
+            memcpy(stack.name, slot->name, sizeof(stack.name));
+            stack.captured = dump_phase(slot) == DUMP_DONE;
+            stack.len = stack.captured ? slot->len : 0;
+            stack.frames = slot->frames;
+
+            captured += stack.captured ? 1 : 0;
+            more = more && (!cb || cb(&stack, arg));
+        }
+    }
+
+    BW_UNUSED(pthread_mutex_unlock(&dump.lock));
+
+    return captured;
+}
+
+typedef struct {
+    int fd;
+    bool failed;
+} dump_writer_t;
+
+static bool dump_write_thread(const bw_thread_stack_t* stack, void* arg) {
+    dump_writer_t* writer = arg;
+    // Synchronized by the dump before signalling
+    const module_map_t* map = module_map_get();
+
+    bool success = dprintf(writer->fd,
+                           "Thread %d \"%s\"%s\n",
+                           stack->tid,
+                           stack->name,
+                           stack->captured ? ":" : ": not captured") >= 0;
+
+    for (size_t i = 0; i < stack->len; ++i) {
+        // The first frame is the interrupted instruction, not a return address
+        uintptr_t ip = stack->frames[i].ip + (i == 0 ? 1 : 0);
+        uintptr_t mod_addr = 0;
+        const char* fname = NULL;
+        const char* sname = NULL;
+        resolve_frame(map, ip, &mod_addr, &fname, &sname);
+
+        success = dprintf(writer->fd,
+                          "  #%zu 0x%016jx %s (%s+0x%jx)\n",
+                          i,
+                          (uintmax_t)stack->frames[i].ip,
+                          sname,
+                          fname,
+                          (uintmax_t)stack->frames[i].addr) >= 0 &&
+                  success;
+    }
+
+    success = dprintf(writer->fd, "\n") >= 0 && success;
+    writer->failed = writer->failed || !success;
+
+    return true;
+}
+
+bool bw_dump_all_threads_fd(int fd, unsigned timeout_ms) {
+    if (fd < 0) {
+        return false;
+    }
+
+    dump_writer_t writer = {fd, false};
+    size_t captured = bw_dump_all_threads(timeout_ms, dump_write_thread, &writer);
+
+    return captured > 0 && !writer.failed;
+}
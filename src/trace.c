@@ -0,0 +1,670 @@
+#include "backwalk/trace.h"
+
+#include <errno.h>                 // for errno, EINTR
+#include <fcntl.h>                 // for open, O_CLOEXEC, O_RDONLY
+#include <stdbool.h>               // for bool, false, true
+#include <stddef.h>                // for size_t, NULL
+#include <stdint.h>                // for uintptr_t, uint32_t, uint64_t, int64_t, SIZE_MAX, ...
+#include <stdlib.h>                // for calloc, free, malloc, realloc
+#include <string.h>                // for memcpy, memcmp, strlen
+#include <sys/mman.h>              // for mmap, munmap, MAP_FAILED, MAP_PRIVATE, PROT_READ
+#include <sys/stat.h>              // for fstat, stat
+#include <sys/types.h>             // for ssize_t
+#include <unistd.h>                // for close, write
+
+#include "backwalk/stack_table.h"  // for bw_stack_table_create, bw_stack_table_destroy, bw_st...
+#include "common.h"                // for BW_UNUSED
+#include "module.h"                // for module_lookup, module_map_get, module_map_sync, mod...
+
+// File layout, all integers little-endian:
+//   header:  "BWTRACE\0", u32 version, u32 reserved
+//   records: u8 type, u32 payload length, payload
+// Module payload: varint index, varint build ID length, build ID, varint path length, path
+// Stack payload:  varint ID, varint frame count, then per frame varint module index plus one (0
+//                 when unknown) and zigzag varint difference from the previous frame's address
+// Samples payload: per sample zigzag varint time and thread ID differences from the previous
+//                 sample of the record, varint stack ID and varint value
+enum { TRACE_HEADER_SIZE = 16 };
+enum { TRACE_RECORD_HEADER_SIZE = 5 };
+enum { TRACE_VERSION_OFFSET = 8 };
+enum { TRACE_DEFAULT_BUFFER_SIZE = 1 << 20 };
+enum { TRACE_MIN_BUFFER_SIZE = 64 << 10 };
+enum { TRACE_DEFAULT_STACK_CAPACITY = 1 << 20 };
+enum { TRACE_INITIAL_MODULES = 64 };
+enum { TRACE_VARINT_MAX = 10 };
+enum { TRACE_SAMPLE_MAX = 4 * TRACE_VARINT_MAX };
+enum { TRACE_FRAME_MAX = 2 * TRACE_VARINT_MAX };
+// Longest module path written, which keeps every record smaller than the minimum buffer
+enum { TRACE_PATH_MAX = 4096 };
+
+enum {
+    TRACE_RECORD_MODULE = 1,
+    TRACE_RECORD_STACK = 2,
+    TRACE_RECORD_SAMPLES = 3,
+};
+
+#define HASH_MULTIPLIER 0x9e3779b97f4a7c15ULL
+#define HASH_SHIFT 32
+#define VARINT_SHIFT 7
+#define VARINT_MASK 0x7f
+#define VARINT_MORE 0x80
+#define BYTE_BITS 8
+#define BYTE_MASK 0xff
+
+static const char k_trace_magic[] = "BWTRACE";
+
+// File index of each module written so far, by module, which is never freed
+typedef struct {
+    const module_t* mod; // NULL marks an empty slot
+    uint32_t index;
+} trace_module_slot_t;
+
+struct bw_trace_writer {
+    int fd;
+    bool failed;
+
+    unsigned char* buf;
+    size_t buf_size;
+    size_t len;
+    size_t run_start; // Offset of the open samples record in `buf`, or SIZE_MAX
+
+    bw_stack_table_t* stacks;
+    uint64_t dropped;
+
+    trace_module_slot_t* modules; // Open addressing table, kept at most half full
+    size_t modules_mask;
+    uint32_t modules_len;
+
+    uint64_t prev_time;
+    int32_t prev_tid;
+};
+
+struct bw_trace_reader {
+    const unsigned char* data;
+    size_t size;
+    size_t end; // End of the last complete record
+
+    bw_trace_module_t* modules;
+    size_t modules_len;
+    size_t modules_cap;
+
+    size_t* stacks; // Offset of each stack's frame count by ID, 0 if there is no such stack
+    uint32_t stacks_len;
+
+    size_t pos;     // Next sample, or the end of the current samples record
+    size_t run_end;
+    uint64_t prev_time;
+    int32_t prev_tid;
+};
+
+static uint64_t zigzag_encode(int64_t value) {
+    return value < 0 ? ~((uint64_t)value << 1) : (uint64_t)value << 1;
+}
+
+static int64_t zigzag_decode(uint64_t value) {
+    return (value & 1) ? (int64_t)~(value >> 1) : (int64_t)(value >> 1);
+}
+
+static size_t put_varint(unsigned char* out, uint64_t value) {
+    size_t len = 0;
+    while (value > VARINT_MASK) {
+        out[len++] = (unsigned char)((value & VARINT_MASK) | VARINT_MORE);
+        value >>= VARINT_SHIFT;
+    }
+    out[len++] = (unsigned char)value;
+
+    return len;
+}
+
+static bool get_varint(const unsigned char** pos, const unsigned char* end, uint64_t* value) {
+    uint64_t result = 0;
+    for (unsigned shift = 0; *pos < end && shift < TRACE_VARINT_MAX * VARINT_SHIFT;
+         shift += VARINT_SHIFT) {
+        unsigned char byte = *(*pos)++;
+        result |= (uint64_t)(byte & VARINT_MASK) << shift;
+        if (!(byte & VARINT_MORE)) {
+            *value = result;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void put_u32(unsigned char* out, uint32_t value) {
+    for (size_t i = 0; i < sizeof(value); ++i) {
+        out[i] = (unsigned char)(value >> (i * BYTE_BITS));
+    }
+}
+
+static uint32_t get_u32(const unsigned char* in) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < sizeof(value); ++i) {
+        value |= (uint32_t)in[i] << (i * BYTE_BITS);
+    }
+
+    return value;
+}
+
+static size_t module_hash(const module_t* mod) {
+    uint64_t hash = (uint64_t)(uintptr_t)mod * HASH_MULTIPLIER;
+
+    return (size_t)(hash ^ (hash >> HASH_SHIFT));
+}
+
+static void writer_close_run(bw_trace_writer_t* writer) {
+    if (writer->run_start == SIZE_MAX) {
+        return;
+    }
+
+    size_t payload = writer->len - writer->run_start - TRACE_RECORD_HEADER_SIZE;
+    put_u32(writer->buf + writer->run_start + 1, (uint32_t)payload);
+    writer->run_start = SIZE_MAX;
+}
+
+static void writer_flush(bw_trace_writer_t* writer) {
+    writer_close_run(writer);
+
+    size_t flushed = 0;
+    while (!writer->failed && flushed < writer->len) {
+        ssize_t written = write(writer->fd, writer->buf + flushed, writer->len - flushed);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            writer->failed = true;
+            break;
+        }
+        flushed += (size_t)written;
+    }
+    writer->len = 0;
+}
+
+// Returns room for `size` bytes, flushing the buffer if needed. Records are always smaller than it.
+static unsigned char* writer_reserve(bw_trace_writer_t* writer, size_t size) {
+    if (writer->buf_size - writer->len < size) {
+        writer_flush(writer);
+    }
+
+    return writer->buf + writer->len;
+}
+
+// Starts a record of at most `size` bytes of payload and returns where the payload goes
+static unsigned char* writer_record_begin(bw_trace_writer_t* writer, int type, size_t size) {
+    writer_close_run(writer);
+    unsigned char* out = writer_reserve(writer, TRACE_RECORD_HEADER_SIZE + size);
+    out[0] = (unsigned char)type;
+
+    return out + TRACE_RECORD_HEADER_SIZE;
+}
+
+static void writer_record_end(bw_trace_writer_t* writer, size_t payload) {
+    put_u32(writer->buf + writer->len + 1, (uint32_t)payload);
+    writer->len += TRACE_RECORD_HEADER_SIZE + payload;
+}
+
+bw_trace_writer_t* bw_trace_writer_create(const bw_trace_config_t* config) {
+    if (!config || config->fd < 0 ||
+        (config->buffer_size != 0 && config->buffer_size < TRACE_MIN_BUFFER_SIZE)) {
+        return NULL;
+    }
+
+    bw_trace_writer_t* writer = calloc(1, sizeof(*writer));
+    if (!writer) {
+        return NULL;
+    }
+
+    writer->fd = config->fd;
+    writer->run_start = SIZE_MAX;
+    writer->buf_size = config->buffer_size ? config->buffer_size : TRACE_DEFAULT_BUFFER_SIZE;
+    writer->buf = malloc(writer->buf_size);
+    writer->stacks = bw_stack_table_create(
+        config->stack_capacity ? config->stack_capacity : TRACE_DEFAULT_STACK_CAPACITY);
+    writer->modules_mask = TRACE_INITIAL_MODULES - 1;
+    writer->modules = calloc(TRACE_INITIAL_MODULES, sizeof(*writer->modules));
+    if (!writer->buf || !writer->stacks || !writer->modules) {
+        bw_stack_table_destroy(writer->stacks);
+        free(writer->modules);
+        free(writer->buf);
+        free(writer);
+        return NULL;
+    }
+
+    memcpy(writer->buf, k_trace_magic, sizeof(k_trace_magic));
+    put_u32(writer->buf + TRACE_VERSION_OFFSET, BW_TRACE_VERSION);
+    put_u32(writer->buf + TRACE_VERSION_OFFSET + sizeof(uint32_t), 0);
+    writer->len = TRACE_HEADER_SIZE;
+
+    return writer;
+}
+
+static bool writer_modules_reserve(bw_trace_writer_t* writer) {
+    size_t slots = writer->modules_mask + 1;
+    if ((writer->modules_len + 1) * 2 <= slots) {
+        return true;
+    }
+
+    trace_module_slot_t* modules = calloc(slots * 2, sizeof(*modules));
+    if (!modules) {
+        return false;
+    }
+
+    size_t mask = (slots * 2) - 1;
+    for (size_t i = 0; i < slots; ++i) {
+        if (!writer->modules[i].mod) {
+            continue;
+        }
+        size_t j = module_hash(writer->modules[i].mod);
+        while (modules[j & mask].mod) {
+            ++j;
+        }
+        modules[j & mask] = writer->modules[i];
+    }
+
+    free(writer->modules);
+    writer->modules = modules;
+    writer->modules_mask = mask;
+
+    return true;
+}
+
+// Returns the file index of `mod`, writing its record the first time, or -1 if out of memory
+static int writer_module(bw_trace_writer_t* writer, const module_t* mod) {
+    size_t i = module_hash(mod);
+    for (;; ++i) {
+        const trace_module_slot_t* slot = &writer->modules[i & writer->modules_mask];
+        if (!slot->mod) {
+            break;
+        }
+        if (slot->mod == mod) {
+            return (int)slot->index;
+        }
+    }
+
+    if (!writer_modules_reserve(writer)) {
+        return -1;
+    }
+
+    uint32_t index = writer->modules_len++;
+    i = module_hash(mod);
+    while (writer->modules[i & writer->modules_mask].mod) {
+        ++i;
+    }
+    writer->modules[i & writer->modules_mask].mod = mod;
+    writer->modules[i & writer->modules_mask].index = index;
+
+    size_t path_len = strlen(mod->path);
+    path_len = path_len < TRACE_PATH_MAX ? path_len : TRACE_PATH_MAX;
+    unsigned char* out = writer_record_begin(
+        writer, TRACE_RECORD_MODULE, (3 * TRACE_VARINT_MAX) + mod->build_id_len + path_len);
+    size_t len = put_varint(out, index);
+    len += put_varint(out + len, mod->build_id_len);
+    memcpy(out + len, mod->build_id, mod->build_id_len);
+    len += mod->build_id_len;
+    len += put_varint(out + len, path_len);
+    memcpy(out + len, mod->path, path_len);
+    len += path_len;
+    writer_record_end(writer, len);
+
+    return (int)index;
+}
+
+static void writer_stack(bw_trace_writer_t* writer, uint32_t id, const uintptr_t* ips, size_t len) {
+    // Modules are written before the stacks that refer to them
+    int modules[BW_TRACE_FRAMES_MAX];
+    uintptr_t addrs[BW_TRACE_FRAMES_MAX];
+    const module_map_t* map = module_map_get();
+    bool synced = false;
+    for (size_t i = 0; i < len; ++i) {
+        // Return addresses point past the call instruction, look up the call itself
+        const module_t* mod = module_lookup(map, ips[i] - 1);
+        if (!mod && !synced) {
+            synced = true;
+            BW_UNUSED(module_map_sync());
+            map = module_map_get();
+            mod = module_lookup(map, ips[i] - 1);
+        }
+
+        // Frames of modules that could not be added keep their absolute address
+        modules[i] = mod ? writer_module(writer, mod) : BW_TRACE_MODULE_UNKNOWN;
+        addrs[i] = modules[i] != BW_TRACE_MODULE_UNKNOWN ? ips[i] - mod->base : ips[i];
+    }
+
+    unsigned char* out = writer_record_begin(
+        writer, TRACE_RECORD_STACK, (2 * TRACE_VARINT_MAX) + (len * TRACE_FRAME_MAX));
+    size_t size = put_varint(out, id);
+    size += put_varint(out + size, len);
+    uintptr_t prev = 0;
+    for (size_t i = 0; i < len; ++i) {
+        size += put_varint(out + size, (uint64_t)(modules[i] + 1));
+        size += put_varint(out + size, zigzag_encode((int64_t)(addrs[i] - prev)));
+        prev = addrs[i];
+    }
+    writer_record_end(writer, size);
+}
+
+bool bw_trace_write(bw_trace_writer_t* writer,
+                    const bw_trace_sample_t* sample,
+                    const uintptr_t* ips,
+                    size_t len) {
+    if (!writer || !sample || (!ips && len > 0)) {
+        return false;
+    }
+
+    len = len < BW_TRACE_FRAMES_MAX ? len : BW_TRACE_FRAMES_MAX;
+    uint32_t limit = bw_stack_table_id_limit(writer->stacks);
+    uint32_t id = bw_stack_table_intern(writer->stacks, ips, len);
+    if (id == BW_STACK_ID_INVALID) {
+        writer->dropped++;
+        return false;
+    }
+    if (id >= limit) {
+        writer_stack(writer, id, ips, len);
+    }
+
+    if (writer->run_start == SIZE_MAX || writer->buf_size - writer->len < TRACE_SAMPLE_MAX) {
+        writer_close_run(writer);
+        unsigned char* out = writer_reserve(writer, TRACE_RECORD_HEADER_SIZE + TRACE_SAMPLE_MAX);
+        out[0] = TRACE_RECORD_SAMPLES;
+        writer->run_start = writer->len;
+        writer->len += TRACE_RECORD_HEADER_SIZE;
+        // Every samples record can be decoded on its own
+        writer->prev_time = 0;
+        writer->prev_tid = 0;
+    }
+
+    unsigned char* out = writer->buf + writer->len;
+    size_t size = put_varint(out, zigzag_encode((int64_t)(sample->time_ns - writer->prev_time)));
+    size += put_varint(out + size, zigzag_encode((int64_t)sample->tid - writer->prev_tid));
+    size += put_varint(out + size, id);
+    size += put_varint(out + size, sample->value);
+    writer->len += size;
+    writer->prev_time = sample->time_ns;
+    writer->prev_tid = sample->tid;
+
+    return true;
+}
+
+bool bw_trace_writer_flush(bw_trace_writer_t* writer) {
+    if (!writer) {
+        return false;
+    }
+
+    writer_flush(writer);
+
+    return !writer->failed;
+}
+
+uint64_t bw_trace_writer_dropped(const bw_trace_writer_t* writer) {
+    return writer ? writer->dropped : 0;
+}
+
+bool bw_trace_writer_close(bw_trace_writer_t* writer) {
+    if (!writer) {
+        return false;
+    }
+
+    bool success = bw_trace_writer_flush(writer);
+    bw_stack_table_destroy(writer->stacks);
+    free(writer->modules);
+    free(writer->buf);
+    free(writer);
+
+    return success;
+}
+
+static bool reader_add_module(bw_trace_reader_t* reader, const unsigned char* pos,
+                              const unsigned char* end) {
+    uint64_t index = 0;
+    uint64_t build_id_len = 0;
+    uint64_t path_len = 0;
+    if (!get_varint(&pos, end, &index) || index != reader->modules_len ||
+        !get_varint(&pos, end, &build_id_len) || build_id_len > (uint64_t)(end - pos)) {
+        return false;
+    }
+    const unsigned char* build_id = pos;
+    pos += build_id_len;
+    if (!get_varint(&pos, end, &path_len) || path_len > (uint64_t)(end - pos)) {
+        return false;
+    }
+
+    if (reader->modules_len == reader->modules_cap) {
+        size_t cap = reader->modules_cap ? reader->modules_cap * 2 : TRACE_INITIAL_MODULES;
+        bw_trace_module_t* modules = realloc(reader->modules, cap * sizeof(*modules));
+        if (!modules) {
+            return false;
+        }
+        reader->modules = modules;
+        reader->modules_cap = cap;
+    }
+
+    bw_trace_module_t* mod = &reader->modules[reader->modules_len++];
+    mod->path = (const char*)pos;
+    mod->path_len = path_len;
+    mod->build_id = build_id;
+    mod->build_id_len = build_id_len;
+
+    return true;
+}
+
+static bool reader_add_stack(bw_trace_reader_t* reader, const unsigned char* pos,
+                             const unsigned char* end) {
+    uint64_t id = 0;
+    if (!get_varint(&pos, end, &id) || id == BW_STACK_ID_INVALID || id >= UINT32_MAX) {
+        return false;
+    }
+
+    if (id >= reader->stacks_len) {
+        size_t len = reader->stacks_len ? reader->stacks_len : TRACE_INITIAL_MODULES;
+        while (len <= id) {
+            len *= 2;
+        }
+        size_t* stacks = realloc(reader->stacks, len * sizeof(*stacks));
+        if (!stacks) {
+            return false;
+        }
+        for (size_t i = reader->stacks_len; i < len; ++i) {
+            stacks[i] = 0;
+        }
+        reader->stacks = stacks;
+        reader->stacks_len = (uint32_t)len;
+    }
+    reader->stacks[id] = (size_t)(pos - reader->data);
+
+    return true;
+}
+
+// Indexes modules and stacks, and finds the end of the last complete record
+static bool reader_index(bw_trace_reader_t* reader) {
+    size_t pos = TRACE_HEADER_SIZE;
+    while (reader->size - pos >= TRACE_RECORD_HEADER_SIZE) {
+        size_t payload = get_u32(reader->data + pos + 1);
+        if (payload > reader->size - pos - TRACE_RECORD_HEADER_SIZE) {
+            break;
+        }
+
+        const unsigned char* start = reader->data + pos + TRACE_RECORD_HEADER_SIZE;
+        bool valid = true;
+        switch (reader->data[pos]) {
+        case TRACE_RECORD_MODULE:
+            valid = reader_add_module(reader, start, start + payload);
+            break;
+        case TRACE_RECORD_STACK:
+            valid = reader_add_stack(reader, start, start + payload);
+            break;
+        default:
+            // Sample records are decoded while iterating, later versions may add other records
+            break;
+        }
+        if (!valid) {
+            break;
+        }
+
+        pos += TRACE_RECORD_HEADER_SIZE + payload;
+    }
+    reader->end = pos;
+
+    return true;
+}
+
+bw_trace_reader_t* bw_trace_reader_open(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= TRACE_HEADER_SIZE) {
+        data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    BW_UNUSED(close(fd));
+
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+
+    bw_trace_reader_t* reader = calloc(1, sizeof(*reader));
+    if (!reader) {
+        BW_UNUSED(munmap(data, (size_t)st.st_size));
+        return NULL;
+    }
+    reader->data = data;
+    reader->size = (size_t)st.st_size;
+
+    if (memcmp(reader->data, k_trace_magic, sizeof(k_trace_magic)) != 0 ||
+        get_u32(reader->data + TRACE_VERSION_OFFSET) != BW_TRACE_VERSION ||
+        !reader_index(reader)) {
+        bw_trace_reader_close(reader);
+        return NULL;
+    }
+    bw_trace_reader_rewind(reader);
+
+    return reader;
+}
+
+void bw_trace_reader_close(bw_trace_reader_t* reader) {
+    if (!reader) {
+        return;
+    }
+
+    free(reader->modules);
+    free(reader->stacks);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-cstyle-cast)
+    BW_UNUSED(munmap((void*)reader->data, reader->size));
+    free(reader);
+}
+
+size_t bw_trace_reader_modules_len(const bw_trace_reader_t* reader) {
+    return reader ? reader->modules_len : 0;
+}
+
+bool bw_trace_reader_module(const bw_trace_reader_t* reader, size_t index, bw_trace_module_t* mod) {
+    if (!reader || !mod || index >= reader->modules_len) {
+        return false;
+    }
+    *mod = reader->modules[index];
+
+    return true;
+}
+
+uint32_t bw_trace_reader_stack_id_limit(const bw_trace_reader_t* reader) {
+    if (!reader) {
+        return 0;
+    }
+
+    uint32_t limit = reader->stacks_len;
+    while (limit > 0 && reader->stacks[limit - 1] == 0) {
+        --limit;
+    }
+
+    return limit;
+}
+
+size_t bw_trace_reader_stack(const bw_trace_reader_t* reader,
+                             uint32_t id,
+                             bw_trace_frame_t* frames,
+                             size_t max) {
+    if (!reader || !frames || id >= reader->stacks_len || reader->stacks[id] == 0) {
+        return 0;
+    }
+
+    const unsigned char* pos = reader->data + reader->stacks[id];
+    const unsigned char* end = reader->data + reader->end;
+    uint64_t len = 0;
+    if (!get_varint(&pos, end, &len)) {
+        return 0;
+    }
+
+    uintptr_t prev = 0;
+    size_t count = 0;
+    for (; count < len && count < max; ++count) {
+        uint64_t mod = 0;
+        uint64_t delta = 0;
+        if (!get_varint(&pos, end, &mod) || !get_varint(&pos, end, &delta) ||
+            mod > reader->modules_len) {
+            break;
+        }
+        prev += (uintptr_t)zigzag_decode(delta);
+        frames[count].module = (int)mod - 1;
+        frames[count].addr = prev;
+    }
+
+    return count;
+}
+
+bool bw_trace_reader_next(bw_trace_reader_t* reader, bw_trace_sample_t* sample) {
+    if (!reader || !sample) {
+        return false;
+    }
+
+    // Skips to the next samples record
+    while (reader->pos >= reader->run_end) {
+        size_t pos = reader->run_end;
+        if (reader->end - pos < TRACE_RECORD_HEADER_SIZE) {
+            return false;
+        }
+        size_t payload = get_u32(reader->data + pos + 1);
+        reader->pos = pos + TRACE_RECORD_HEADER_SIZE;
+        reader->run_end = reader->pos + payload;
+        if (reader->data[pos] != TRACE_RECORD_SAMPLES) {
+            reader->pos = reader->run_end;
+        }
+        reader->prev_time = 0;
+        reader->prev_tid = 0;
+    }
+
+    const unsigned char* pos = reader->data + reader->pos;
+    const unsigned char* end = reader->data + reader->run_end;
+    uint64_t time = 0;
+    uint64_t tid = 0;
+    uint64_t stack_id = 0;
+    uint64_t value = 0;
+    if (!get_varint(&pos, end, &time) || !get_varint(&pos, end, &tid) ||
+        !get_varint(&pos, end, &stack_id) || !get_varint(&pos, end, &value)) {
+        // A malformed record ends the trace
+        reader->pos = reader->run_end = reader->end;
+        return false;
+    }
+    reader->pos = (size_t)(pos - reader->data);
+
+    reader->prev_time += (uint64_t)zigzag_decode(time);
+    reader->prev_tid = (int32_t)(reader->prev_tid + zigzag_decode(tid));
+    sample->time_ns = reader->prev_time;
+    sample->tid = reader->prev_tid;
+    sample->stack_id = (uint32_t)stack_id;
+    sample->value = value;
+
+    return true;
+}
+
+void bw_trace_reader_rewind(bw_trace_reader_t* reader) {
+    if (!reader) {
+        return;
+    }
+
+    reader->pos = TRACE_HEADER_SIZE;
+    reader->run_end = TRACE_HEADER_SIZE;
+    reader->prev_time = 0;
+    reader->prev_tid = 0;
+}
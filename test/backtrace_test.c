@@ -1,14 +1,20 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include <dlfcn.h>              // for dladdr, dlclose, dlopen, dlsym, Dl_info, RTLD_LOCAL, ...
+#include <pthread.h>            // for pthread_create, pthread_join, pthread_key_create, ...
 #include <stdbool.h>            // for bool, true, false
 #include <stddef.h>             // for size_t, NULL
 #include <stdint.h>             // for uintptr_t
-#include <string.h>             // for strlen, strcmp
+#include <stdlib.h>             // for free, malloc
+#include <string.h>             // for strcmp, strlen, strstr
 
-#include "common.h"             // for BW_UNUSED
-#include "backwalk/backwalk.h"  // for bw_backtrace
+#include "common.h"             // for BW_ARRAY_LEN, BW_UNUSED
+#include "backwalk/backwalk.h"  // for bw_backtrace, bw_capture, bw_symbolize, bw_trace_capture, ...
 
 #include "test.h"               // for TEST, TEST_ASSERT_TRUE, TEST_RUN, TES...
 
 enum { SNAME_ENTRIES_MAX = 16 };
+enum { CAPTURE_FRAMES_MAX = 64 };
 
 #define MK_SNAME_EXP(ctx, i, fname)                                                                \
     do {                                                                                           \
@@ -141,6 +147,337 @@ TEST(symbol_resolution, {
     TEST_ASSERT_GE_INT32(valid_symbols, 1); // Should have at least some valid symbols
 })
 
+TEST(capture_basic, {
+    uintptr_t ips[CAPTURE_FRAMES_MAX] = {0};
+
+    size_t len = bw_capture(ips, CAPTURE_FRAMES_MAX, 0);
+
+    TEST_ASSERT_GE_SIZE(len, 2L);
+
+    Dl_info info;
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    TEST_ASSERT_TRUE(dladdr((const void*)(ips[0] - 1), &info) != 0);
+    TEST_ASSERT_NONNULL(info.dli_sname);
+    TEST_ASSERT_TRUE(strcmp(info.dli_sname, "capture_basic") == 0);
+})
+
+TEST(capture_matches_backtrace, {
+    stop_context_t ctx = {0};
+    ctx.fnum_max = CAPTURE_FRAMES_MAX;
+    uintptr_t ips[CAPTURE_FRAMES_MAX] = {0};
+
+    bool success = bw_backtrace(stop_after_n_frames_cb, &ctx);
+    size_t len = bw_capture(ips, CAPTURE_FRAMES_MAX, 0);
+
+    TEST_ASSERT_TRUE(success);
+    TEST_ASSERT_EQ_SIZE(len, ctx.fnum);
+})
+
+TEST(capture_skip, {
+    uintptr_t all[CAPTURE_FRAMES_MAX] = {0};
+    uintptr_t skipped[CAPTURE_FRAMES_MAX] = {0};
+
+    size_t all_len = bw_capture(all, CAPTURE_FRAMES_MAX, 0);
+    size_t skipped_len = bw_capture(skipped, CAPTURE_FRAMES_MAX, 1);
+
+    TEST_ASSERT_GE_SIZE(all_len, 2L);
+    TEST_ASSERT_EQ_SIZE(skipped_len, all_len - 1);
+    for (size_t i = 0; i < skipped_len; ++i) {
+        TEST_ASSERT_TRUE(skipped[i] == all[i + 1]);
+    }
+})
+
+TEST(capture_max_frames, {
+    uintptr_t ips[CAPTURE_FRAMES_MAX] = {0};
+
+    size_t len = bw_capture(ips, 1, 0);
+
+    TEST_ASSERT_EQ_SIZE(len, 1L);
+    TEST_ASSERT_TRUE(ips[0] != 0);
+    TEST_ASSERT_TRUE(ips[1] == 0);
+})
+
+TEST(capture_invalid_args, {
+    uintptr_t ips[CAPTURE_FRAMES_MAX] = {0};
+
+    TEST_ASSERT_EQ_SIZE(bw_capture(NULL, CAPTURE_FRAMES_MAX, 0), 0L);
+    TEST_ASSERT_EQ_SIZE(bw_capture(ips, 0, 0), 0L);
+    TEST_ASSERT_EQ_SIZE(bw_capture(ips, CAPTURE_FRAMES_MAX, CAPTURE_FRAMES_MAX), 0L);
+})
+
+TEST(symbolize_matches_backtrace, {
+    context_t ctx = {0};
+    MK_SNAME_EXP(&ctx, 0, "deep_function_3");
+    MK_SNAME_EXP(&ctx, 1, "deep_function_2");
+    MK_SNAME_EXP(&ctx, 2, "deep_function_1");
+    ctx.sname_entries_len = 3;
+    TEST_ASSERT_TRUE(deep_function_1(&ctx));
+
+    uintptr_t ips[CAPTURE_FRAMES_MAX] = {0};
+    bw_symbol_t syms[CAPTURE_FRAMES_MAX];
+    size_t len = bw_capture(ips, CAPTURE_FRAMES_MAX, 0);
+    bw_symbolize(ips, len, syms);
+
+    TEST_ASSERT_EQ_SIZE(len + 3, ctx.fnum);
+    TEST_ASSERT_TRUE(strcmp(syms[0].sname, "symbolize_matches_backtrace") == 0);
+    TEST_ASSERT_TRUE(syms[0].addr != 0);
+    TEST_ASSERT_TRUE(strcmp(syms[0].fname, "?") != 0);
+    bw_symbolize(NULL, len, syms);
+})
+
+// Both passes must walk the same stack, down to the return address into the test, so they are
+// made from a single call site. Reading the number of passes through a volatile keeps the compiler
+// from unrolling the loop into two.
+static volatile size_t symbol_cache_passes = 2;
+static context_t symbol_cache_ctxs[2];
+static bw_symbol_cache_stats_t symbol_cache_stats[2];
+static size_t symbol_cache_pass_num;
+
+__attribute__((noinline)) bool symbol_cache_pass(void) {
+    if (symbol_cache_pass_num == BW_ARRAY_LEN(symbol_cache_ctxs)) {
+        return false;
+    }
+
+    context_t* ctx = &symbol_cache_ctxs[symbol_cache_pass_num];
+    MK_SNAME_EXP(ctx, 0, "deep_function_3");
+    MK_SNAME_EXP(ctx, 1, "deep_function_2");
+    MK_SNAME_EXP(ctx, 2, "deep_function_1");
+    ctx->sname_entries_len = 3;
+    bool success = deep_function_1(ctx);
+    bw_symbol_cache_stats(&symbol_cache_stats[symbol_cache_pass_num++]);
+
+    return success;
+}
+
+TEST(symbol_cache_hits, {
+    for (size_t pass = 0; pass < symbol_cache_passes; ++pass) {
+        TEST_ASSERT_TRUE(symbol_cache_pass());
+    }
+    const context_t* ctxs = symbol_cache_ctxs;
+    const bw_symbol_cache_stats_t* stats = symbol_cache_stats;
+    TEST_ASSERT_GE_SIZE(stats[0].capacity, ctxs[0].fnum);
+
+    // The same stack again is served from the cache and resolves to the same symbols
+    TEST_ASSERT_EQ_SIZE(ctxs[1].fnum, ctxs[0].fnum);
+    TEST_ASSERT_EQ_SIZE((size_t)(stats[1].hits - stats[0].hits), ctxs[1].fnum);
+    TEST_ASSERT_EQ_SIZE((size_t)(stats[1].misses - stats[0].misses), 0L);
+    for (size_t i = 0; i < ctxs[1].sname_entries_len; ++i) {
+        TEST_ASSERT_TRUE(ctxs[1].sname_found[i]);
+    }
+    bw_symbol_cache_stats(NULL);
+})
+
+static const char* const k_lib_name = "libm.so.6";
+
+TEST(symbol_cache_flushed_by_dlopen, {
+    context_t ctx = {0};
+    TEST_ASSERT_TRUE(deep_function_1(&ctx));
+
+    bw_symbol_cache_stats_t before = {0};
+    bw_symbol_cache_stats(&before);
+
+    void* handle = dlopen(k_lib_name, RTLD_NOW | RTLD_LOCAL);
+    TEST_ASSERT_NONNULL(handle);
+
+    // Loading a module rebuilds the map, which empties the cache on the next lookup
+    uintptr_t ip = (uintptr_t)dlsym(handle, "cos") + 1;
+    bw_symbol_t sym;
+    bw_symbolize(&ip, 1, &sym);
+
+    context_t loaded = {0};
+    MK_SNAME_EXP(&loaded, 0, "deep_function_3");
+    loaded.sname_entries_len = 1;
+    TEST_ASSERT_TRUE(deep_function_1(&loaded));
+    TEST_ERROR_NONZERO(dlclose(handle));
+
+    bw_symbol_cache_stats_t after = {0};
+    bw_symbol_cache_stats(&after);
+
+    TEST_ASSERT_NONNULL(strstr(sym.fname, "libm"));
+    TEST_ASSERT_EQ_SIZE((size_t)(after.flushes - before.flushes), 1L);
+    TEST_ASSERT_EQ_SIZE((size_t)(after.misses - before.misses), loaded.fnum + 1);
+    TEST_ASSERT_TRUE(loaded.sname_found[0]);
+})
+
+TEST(symbol_cache_flushed_by_dlclose, {
+    void* handle = dlopen(k_lib_name, RTLD_NOW | RTLD_LOCAL);
+    TEST_ASSERT_NONNULL(handle);
+
+    uintptr_t ip = (uintptr_t)dlsym(handle, "cos") + 1;
+    bw_symbol_t loaded;
+    bw_symbolize(&ip, 1, &loaded);
+    TEST_ASSERT_NONNULL(strstr(loaded.fname, "libm"));
+
+    // The cached address must not be trusted once its module is unloaded, another one may be
+    // loaded at the same addresses
+    TEST_ERROR_NONZERO(dlclose(handle));
+    bw_symbol_cache_stats_t before = {0};
+    bw_symbol_cache_stats(&before);
+    bw_symbol_t unloaded;
+    bw_symbolize(&ip, 1, &unloaded);
+    bw_symbol_cache_stats_t after = {0};
+    bw_symbol_cache_stats(&after);
+
+    TEST_ASSERT_TRUE(strstr(unloaded.fname, "libm") == NULL);
+    TEST_ASSERT_EQ_SIZE((size_t)(after.flushes - before.flushes), 1L);
+    TEST_ASSERT_EQ_SIZE((size_t)(after.hits - before.hits), 0L);
+})
+
+typedef struct {
+    context_t ctx;
+    bool walked;
+    bw_symbol_cache_stats_t stats;
+} exit_walk_t;
+
+static pthread_key_t exit_walk_key;
+
+// Runs after the destructor of the symbol cache's key, which was created first
+static void exit_walk(void* arg) {
+    exit_walk_t* walk = arg;
+    walk->walked = deep_function_1(&walk->ctx);
+    bw_symbol_cache_stats(&walk->stats);
+}
+
+static void* exit_walk_thread(void* arg) {
+    context_t ctx = {0};
+    BW_UNUSED(deep_function_1(&ctx));
+    BW_UNUSED(pthread_setspecific(exit_walk_key, arg));
+
+    return NULL;
+}
+
+TEST(symbol_cache_after_thread_exit, {
+    static exit_walk_t walk;
+    MK_SNAME_EXP(&walk.ctx, 0, "deep_function_3");
+    walk.ctx.sname_entries_len = 1;
+
+    pthread_t thread;
+    TEST_ERROR_NONZERO(pthread_key_create(&exit_walk_key, exit_walk));
+    TEST_ERROR_NONZERO(pthread_create(&thread, NULL, exit_walk_thread, &walk));
+    TEST_ERROR_NONZERO(pthread_join(thread, NULL));
+    TEST_ERROR_NONZERO(pthread_key_delete(exit_walk_key));
+
+    // Once its cache is freed, the exiting thread resolves frames without one
+    TEST_ASSERT_TRUE(walk.walked);
+    TEST_ASSERT_TRUE(walk.ctx.sname_found[0]);
+    TEST_ASSERT_EQ_SIZE((size_t)(walk.stats.hits + walk.stats.misses), 0L);
+})
+
+typedef struct {
+    size_t allocs;
+    size_t frees;
+    size_t bytes; // Allocated and not freed yet
+    bool fail;
+} counting_allocator_t;
+
+static void* counting_alloc(size_t size, void* ctx) {
+    counting_allocator_t* counts = ctx;
+    if (counts->fail) {
+        return NULL;
+    }
+    counts->allocs++;
+    counts->bytes += size;
+    return malloc(size);
+}
+
+static void counting_free(void* ptr, size_t size, void* ctx) {
+    counting_allocator_t* counts = ctx;
+    counts->frees++;
+    counts->bytes -= size;
+    free(ptr);
+}
+
+static bw_allocator_t counting_allocator(counting_allocator_t* counts) {
+    bw_allocator_t allocator = {.alloc = counting_alloc, .free = counting_free, .ctx = counts};
+    return allocator;
+}
+
+TEST(trace_foreach_matches_backtrace, {
+    bw_trace_t* trace = bw_trace_capture(CAPTURE_FRAMES_MAX, 0, NULL);
+    TEST_ASSERT_NONNULL(trace);
+
+    uintptr_t ips[CAPTURE_FRAMES_MAX] = {0};
+    bw_symbol_t syms[CAPTURE_FRAMES_MAX];
+    size_t len = bw_capture(ips, CAPTURE_FRAMES_MAX, 0);
+    bw_symbolize(ips, len, syms);
+
+    context_t ctx = {0};
+    MK_SNAME_EXP(&ctx, 0, "trace_foreach_matches_backtrace");
+    ctx.sname_entries_len = 1;
+    TEST_ASSERT_TRUE(bw_trace_foreach(trace, validate_backtrace, &ctx));
+    TEST_ASSERT_TRUE(ctx.sname_found[0]);
+    TEST_ASSERT_EQ_SIZE(ctx.fnum, len);
+    TEST_ASSERT_EQ_SIZE(bw_trace_len(trace), len);
+
+    // Only the innermost return address differs, since the two captures are called from different
+    // places
+    for (size_t i = 1; i < len; ++i) {
+        TEST_ASSERT_TRUE(bw_trace_ips(trace)[i] == ips[i]);
+    }
+    bw_trace_free(trace);
+})
+
+TEST(trace_foreach_memoized, {
+    bw_trace_t* trace = bw_trace_capture(CAPTURE_FRAMES_MAX, 0, NULL);
+    TEST_ASSERT_NONNULL(trace);
+
+    context_t first = {0};
+    TEST_ASSERT_TRUE(bw_trace_foreach(trace, validate_backtrace, &first));
+    bw_symbol_cache_stats_t before = {0};
+    bw_symbol_cache_stats(&before);
+
+    // The second iteration reads the stored results without looking anything up
+    context_t second = {0};
+    MK_SNAME_EXP(&second, 0, "trace_foreach_memoized");
+    second.sname_entries_len = 1;
+    TEST_ASSERT_TRUE(bw_trace_foreach(trace, validate_backtrace, &second));
+    bw_symbol_cache_stats_t after = {0};
+    bw_symbol_cache_stats(&after);
+
+    TEST_ASSERT_EQ_SIZE(second.fnum, first.fnum);
+    TEST_ASSERT_TRUE(second.sname_found[0]);
+    TEST_ASSERT_EQ_SIZE((size_t)(after.hits - before.hits), 0L);
+    TEST_ASSERT_EQ_SIZE((size_t)(after.misses - before.misses), 0L);
+    bw_trace_free(trace);
+})
+
+TEST(trace_allocator, {
+    counting_allocator_t counts = {0};
+    bw_allocator_t allocator = counting_allocator(&counts);
+
+    bw_trace_t* trace = bw_trace_capture(CAPTURE_FRAMES_MAX, 1, &allocator);
+    TEST_ASSERT_NONNULL(trace);
+    TEST_ASSERT_EQ_SIZE(counts.allocs, 1L);
+
+    stop_context_t stop = {0};
+    stop.fnum_max = 1;
+    TEST_ASSERT_FALSE(bw_trace_foreach(trace, stop_after_n_frames_cb, &stop));
+    TEST_ASSERT_EQ_SIZE(stop.fnum, 1L);
+    TEST_ASSERT_EQ_SIZE(counts.allocs, 2L);
+
+    bw_trace_free(trace);
+    TEST_ASSERT_EQ_SIZE(counts.frees, 2L);
+    TEST_ASSERT_EQ_SIZE(counts.bytes, 0L);
+
+    counts.fail = true;
+    TEST_ASSERT_TRUE(bw_trace_capture(CAPTURE_FRAMES_MAX, 0, &allocator) == NULL);
+})
+
+TEST(trace_invalid_args, {
+    TEST_ASSERT_TRUE(bw_trace_capture(0, 0, NULL) == NULL);
+    TEST_ASSERT_FALSE(bw_trace_foreach(NULL, validate_backtrace, NULL));
+    TEST_ASSERT_EQ_SIZE(bw_trace_len(NULL), 0L);
+    TEST_ASSERT_TRUE(bw_trace_ips(NULL) == NULL);
+    bw_trace_free(NULL);
+
+    bw_trace_t* trace = bw_trace_capture(CAPTURE_FRAMES_MAX, CAPTURE_FRAMES_MAX, NULL);
+    TEST_ASSERT_NONNULL(trace);
+    TEST_ASSERT_EQ_SIZE(bw_trace_len(trace), 0L);
+    TEST_ASSERT_TRUE(bw_trace_foreach(trace, validate_backtrace, NULL));
+    TEST_ASSERT_TRUE(bw_trace_foreach(trace, NULL, NULL));
+    bw_trace_free(trace);
+})
+
 int main(int argc, char** argv) {
     TEST_INIT("backtrace", argc, argv);
 
@@ -149,6 +486,20 @@ int main(int argc, char** argv) {
     TEST_RUN(early_termination);
     TEST_RUN(null_callback);
     TEST_RUN(symbol_resolution);
+    TEST_RUN(capture_basic);
+    TEST_RUN(capture_matches_backtrace);
+    TEST_RUN(capture_skip);
+    TEST_RUN(capture_max_frames);
+    TEST_RUN(capture_invalid_args);
+    TEST_RUN(symbolize_matches_backtrace);
+    TEST_RUN(symbol_cache_hits);
+    TEST_RUN(symbol_cache_flushed_by_dlopen);
+    TEST_RUN(symbol_cache_flushed_by_dlclose);
+    TEST_RUN(symbol_cache_after_thread_exit);
+    TEST_RUN(trace_foreach_matches_backtrace);
+    TEST_RUN(trace_foreach_memoized);
+    TEST_RUN(trace_allocator);
+    TEST_RUN(trace_invalid_args);
 
     TEST_EXIT();
 }
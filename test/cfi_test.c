@@ -0,0 +1,240 @@
+#include <pthread.h>                // for pthread_create, pthread_join, pthread_t
+#include <stdbool.h>                // for bool, false, true
+#include <stddef.h>                 // for size_t, NULL
+#include <stdint.h>                 // for uintptr_t
+#include <stdio.h>                  // for fprintf, stderr
+#include <string.h>                 // for strcmp
+#include <time.h>                   // for clock_gettime, timespec, CLOCK_MONOTONIC
+#include <unwind.h>                 // for _Unwind_Backtrace, _Unwind_GetIP, _Unwind_Context
+
+#include "backwalk/backwalk.h"      // for bw_capture, bw_set_unwind_mode, BW_UNWIND_CFI, BW_UNW...
+#include "cfi.h"                    // for cfi_table_lookup, cfi_table_t
+#include "common.h"                 // for BW_UNUSED
+#include "elf_file.h"               // for elf_symbolize
+#include "module.h"                 // for module_cfi, module_elf, module_lookup, module_map_get
+
+#include "cfi_test_omit_fp.h"       // for omit_fp_recurse
+#include "test.h"                   // for TEST, TEST_ASSERT_TRUE, TEST_RUN, TEST_ASSERT_GE_SIZE
+
+enum { OMIT_FP_DEPTH = 8 };
+enum { BENCH_DEPTH = 32 };
+enum { BENCH_ITERATIONS = 20000 };
+enum { FRAMES_MAX = 128 };
+enum { CFI_THREADS = 4 };
+
+static const char* const k_omit_fp_function = "omit_fp_recurse";
+
+static size_t capture_fp(uintptr_t* ips, size_t max) {
+    bw_set_unwind_mode(BW_UNWIND_FP);
+    return bw_capture(ips, max, 0);
+}
+
+static size_t capture_cfi(uintptr_t* ips, size_t max) {
+    bw_set_unwind_mode(BW_UNWIND_CFI);
+    return bw_capture(ips, max, 0);
+}
+
+static size_t capture_signal_safe(uintptr_t* ips, size_t max) {
+    bw_frame_t frames[FRAMES_MAX];
+    size_t len = bw_backtrace_signal_safe(frames, max < FRAMES_MAX ? max : FRAMES_MAX);
+    for (size_t i = 0; i < len; ++i) {
+        ips[i] = frames[i].ip;
+    }
+
+    return len;
+}
+
+typedef struct {
+    uintptr_t* ips;
+    size_t len;
+    size_t max;
+} unwind_data_t;
+
+static _Unwind_Reason_Code unwind_frame(struct _Unwind_Context* uctx, void* arg) {
+    unwind_data_t* data = arg;
+    if (data->len == data->max) {
+        return _URC_END_OF_STACK;
+    }
+    data->ips[data->len++] = _Unwind_GetIP(uctx);
+
+    return _URC_NO_REASON;
+}
+
+__attribute__((noinline)) static size_t capture_unwind(uintptr_t* ips, size_t max) {
+    unwind_data_t data = {ips, 0, max};
+    BW_UNUSED(_Unwind_Backtrace(unwind_frame, &data));
+
+    return data.len;
+}
+
+static size_t count_omit_fp_frames(const uintptr_t* ips, size_t len) {
+    BW_UNUSED(module_map_sync());
+    const module_map_t* map = module_map_get();
+
+    size_t count = 0;
+    for (size_t i = 0; i < len; ++i) {
+        const module_t* mod = module_lookup(map, ips[i] - 1);
+        const char* name = mod ? elf_symbolize(module_elf(mod), ips[i] - 1 - mod->bias) : NULL;
+        if (name && strcmp(name, k_omit_fp_function) == 0) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+TEST(cfi_finds_frames_without_frame_pointers, {
+    uintptr_t fp_ips[FRAMES_MAX];
+    uintptr_t cfi_ips[FRAMES_MAX];
+    size_t fp_len = omit_fp_recurse(OMIT_FP_DEPTH, capture_fp, fp_ips, FRAMES_MAX);
+    size_t cfi_len = omit_fp_recurse(OMIT_FP_DEPTH, capture_cfi, cfi_ips, FRAMES_MAX);
+    bw_set_unwind_mode(BW_UNWIND_FP);
+
+    TEST_ASSERT_EQ_SIZE(count_omit_fp_frames(cfi_ips, cfi_len), (size_t)OMIT_FP_DEPTH + 1);
+    TEST_ASSERT_TRUE(count_omit_fp_frames(fp_ips, fp_len) < (size_t)OMIT_FP_DEPTH + 1);
+})
+
+static uintptr_t unwind_ips[FRAMES_MAX];
+static size_t unwind_len;
+
+// Captures with both unwinders from the same frame
+__attribute__((noinline)) static size_t capture_cfi_and_unwind(uintptr_t* ips, size_t max) {
+    size_t len = capture_cfi(ips, max);
+    unwind_len = capture_unwind(unwind_ips, FRAMES_MAX);
+
+    // The outermost frame reported by libgcc has no return address
+    while (unwind_len > 0 && unwind_ips[unwind_len - 1] == 0) {
+        unwind_len--;
+    }
+
+    return len;
+}
+
+// Everything above the capturing function must match the unwinder of the C++ runtime
+TEST(cfi_matches_unwind_backtrace, {
+    uintptr_t cfi_ips[FRAMES_MAX];
+    size_t cfi_len = omit_fp_recurse(OMIT_FP_DEPTH, capture_cfi_and_unwind, cfi_ips, FRAMES_MAX);
+    bw_set_unwind_mode(BW_UNWIND_FP);
+    TEST_ASSERT_GE_SIZE(cfi_len, (size_t)OMIT_FP_DEPTH + 3);
+
+    // Frames differ up to the common caller: each unwinder is called from its own call site
+    size_t start = 0;
+    while (start < unwind_len && unwind_ips[start] != cfi_ips[2]) {
+        start++;
+    }
+    TEST_ASSERT_TRUE(start < unwind_len);
+    TEST_ASSERT_EQ_SIZE(cfi_len - 2, unwind_len - start);
+
+    for (size_t i = 2; i < cfi_len; ++i) {
+        TEST_ASSERT_TRUE(cfi_ips[i] == unwind_ips[start + i - 2]);
+    }
+})
+
+TEST(signal_safe_uses_prebuilt_tables, {
+    bw_set_unwind_mode(BW_UNWIND_CFI);
+    TEST_ASSERT_TRUE(bw_signal_safe_init());
+
+    uintptr_t ips[FRAMES_MAX];
+    size_t len = omit_fp_recurse(OMIT_FP_DEPTH, capture_signal_safe, ips, FRAMES_MAX);
+    bw_set_unwind_mode(BW_UNWIND_FP);
+
+    TEST_ASSERT_EQ_SIZE(count_omit_fp_frames(ips, len), (size_t)OMIT_FP_DEPTH + 1);
+})
+
+TEST(table_lookup, {
+    TEST_ASSERT_TRUE(module_map_sync());
+    uintptr_t pc = (uintptr_t)omit_fp_recurse;
+    const module_t* mod = module_lookup(module_map_get(), pc);
+    TEST_ASSERT_NONNULL(mod);
+
+    const cfi_table_t* cfi = module_cfi(mod);
+    TEST_ASSERT_NONNULL(cfi);
+    TEST_ASSERT_TRUE(module_cfi(mod) == cfi);
+    TEST_ASSERT_TRUE(module_cfi_get(mod) == cfi);
+
+    TEST_ASSERT_NONNULL(cfi_table_lookup(cfi, pc));
+    TEST_ASSERT_TRUE(cfi_table_lookup(cfi, 0) == NULL);
+    TEST_ASSERT_TRUE(cfi_table_lookup(NULL, pc) == NULL);
+})
+
+static void* capture_thread(void* arg) {
+    bool* success = arg;
+    uintptr_t ips[FRAMES_MAX];
+    size_t len = omit_fp_recurse(OMIT_FP_DEPTH, capture_cfi, ips, FRAMES_MAX);
+    *success = count_omit_fp_frames(ips, len) == (size_t)OMIT_FP_DEPTH + 1;
+
+    return NULL;
+}
+
+TEST(concurrent_capture, {
+    pthread_t threads[CFI_THREADS];
+    bool success[CFI_THREADS];
+    for (int i = 0; i < CFI_THREADS; i++) {
+        success[i] = false;
+        TEST_ERROR_NONZERO(pthread_create(&threads[i], NULL, capture_thread, &success[i]));
+    }
+
+    for (int i = 0; i < CFI_THREADS; i++) {
+        TEST_ERROR_NONZERO(pthread_join(threads[i], NULL));
+        TEST_ASSERT_TRUE(success[i]);
+    }
+    bw_set_unwind_mode(BW_UNWIND_FP);
+})
+
+typedef size_t (*capture_fn)(uintptr_t* ips, size_t max);
+
+// NOLINTNEXTLINE(misc-no-recursion)
+__attribute__((noinline)) static size_t bench_recurse(int depth, capture_fn capture, uintptr_t* ips) {
+    if (depth > 0) {
+        return bench_recurse(depth - 1, capture, ips) + 0;
+    }
+
+    size_t len = 0;
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        len = capture(ips, FRAMES_MAX);
+    }
+
+    return len;
+}
+
+static test_result_t bench(const char* name, capture_fn capture) {
+    uintptr_t ips[FRAMES_MAX];
+    BW_UNUSED(capture(ips, FRAMES_MAX));
+
+    struct timespec start_time;
+    struct timespec end_time;
+    TEST_ERROR_NONZERO(clock_gettime(CLOCK_MONOTONIC, &start_time));
+    size_t len = bench_recurse(BENCH_DEPTH, capture, ips);
+    TEST_ERROR_NONZERO(clock_gettime(CLOCK_MONOTONIC, &end_time));
+
+    TEST_ASSERT_GE_SIZE(len, (size_t)BENCH_DEPTH);
+
+    long elapsed_ns = ((end_time.tv_sec - start_time.tv_sec) * 1000000000L) +
+                      (end_time.tv_nsec - start_time.tv_nsec);
+    long per_walk_ns = elapsed_ns / BENCH_ITERATIONS;
+    fprintf(stderr, "%-20s %3zu frames: %6ld ns per walk, %4ld ns per frame\n", name, len,
+            per_walk_ns, per_walk_ns / (long)len);
+
+    TEST_OK();
+}
+
+// Frame pointers are kept in this file, so all three walk the same frames
+TEST(walk_performance, {
+    TEST_ASSERT_TRUE(bench("context_step", capture_fp) == TEST_RESULT_OK);
+    TEST_ASSERT_TRUE(bench("context_step_cfi", capture_cfi) == TEST_RESULT_OK);
+    TEST_ASSERT_TRUE(bench("_Unwind_Backtrace", capture_unwind) == TEST_RESULT_OK);
+    bw_set_unwind_mode(BW_UNWIND_FP);
+})
+
+int main(int argc, char** argv) {
+    TEST_INIT("cfi", argc, argv);
+
+    TEST_RUN(cfi_finds_frames_without_frame_pointers);
+    TEST_RUN(cfi_matches_unwind_backtrace);
+    TEST_RUN(signal_safe_uses_prebuilt_tables);
+    TEST_RUN(table_lookup);
+    TEST_RUN(concurrent_capture);
+    TEST_RUN(walk_performance);
+
+    TEST_EXIT();
+}
@@ -0,0 +1,19 @@
+#include <stddef.h>   // for size_t
+#include <stdint.h>   // for uintptr_t
+
+#include "cfi_test_omit_fp.h"
+
+// This file is built with -fomit-frame-pointer: none of these frames are on the frame pointer chain
+
+static volatile int omit_fp_sink;
+
+// NOLINTNEXTLINE(misc-no-recursion)
+__attribute__((noinline)) size_t omit_fp_recurse(int depth,
+                                                 omit_fp_capture_fn capture,
+                                                 uintptr_t* ips,
+                                                 size_t max) {
+    size_t len = depth > 0 ? omit_fp_recurse(depth - 1, capture, ips, max) : capture(ips, max);
+    omit_fp_sink = depth;
+
+    return len;
+}
@@ -0,0 +1,12 @@
+#ifndef BW_CFI_TEST_OMIT_FP_H
+#define BW_CFI_TEST_OMIT_FP_H
+
+#include <stddef.h>   // for size_t
+#include <stdint.h>   // for uintptr_t
+
+typedef size_t (*omit_fp_capture_fn)(uintptr_t* ips, size_t max);
+
+// Calls `capture` from `depth` + 1 nested frames built without frame pointers
+size_t omit_fp_recurse(int depth, omit_fp_capture_fn capture, uintptr_t* ips, size_t max);
+
+#endif // BW_CFI_TEST_OMIT_FP_H
@@ -0,0 +1,307 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include <dlfcn.h>                         // for dladdr, Dl_info
+#include <pthread.h>                       // for pthread_mutex_lock, pthread_create, pthread_join
+#include <stdbool.h>                       // for bool, false, true
+#include <stddef.h>                        // for size_t, NULL
+#include <stdint.h>                        // for uintptr_t, uint64_t
+#include <stdio.h>                         // for fprintf, stderr
+#include <string.h>                        // for strcmp
+#include <time.h>                          // for nanosleep, clock_gettime, timespec
+
+#include "backwalk/backwalk.h"             // for bw_backtrace
+#include "backwalk/contention_profiler.h"  // for bw_contention_profiler_start, bw_contention_pro...
+#include "common.h"                        // for BW_UNUSED
+
+#include "test.h"                          // for TEST, TEST_ASSERT_TRUE, TEST_RUN, TEST_ERROR_NO...
+
+enum { MAX_THREADS = 8 };
+enum { ITERATIONS = 50 };
+enum { HOLD_NS = 100000 };
+enum { SAMPLE_PERIOD = 4 };
+enum { BENCH_ITERATIONS = 1000000 };
+
+static pthread_mutex_t shared_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t shared_rwlock = PTHREAD_RWLOCK_INITIALIZER;
+
+typedef struct {
+    const char* fname;
+    uint64_t wait_ns;
+    uint64_t waits;
+    uint64_t all_waits;
+} found_t;
+
+static found_t found;
+
+static void find_stack(const uintptr_t* ips,
+                       size_t len,
+                       uint64_t wait_ns,
+                       uint64_t waits,
+                       void* arg) {
+    BW_UNUSED(arg);
+
+    found.all_waits += waits;
+
+    // Only the first frame is the caller of the locking function
+    Dl_info info;
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    if (len > 0 && dladdr((const void*)ips[0], &info) && info.dli_sname &&
+        strcmp(info.dli_sname, found.fname) == 0) {
+        found.wait_ns += wait_ns;
+        found.waits += waits;
+    }
+}
+
+static void find(const char* fname) {
+    found.fname = fname;
+    found.wait_ns = 0;
+    found.waits = 0;
+    found.all_waits = 0;
+    bw_contention_profiler_dump(find_stack, NULL);
+}
+
+static bool collect_frame(uintptr_t addr, const char* fname, const char* sname, void* arg) {
+    BW_UNUSED(addr);
+    BW_UNUSED(fname);
+    BW_UNUSED(sname);
+
+    (*(int*)arg)++;
+    return true;
+}
+
+static void hold(void) {
+    struct timespec interval = {0, HOLD_NS};
+    BW_UNUSED(nanosleep(&interval, NULL));
+}
+
+// The high_contention_backtrace workload of threading_test, with every backtrace taken under a
+// shared mutex that is held long enough for the other threads to queue up
+__attribute__((noinline)) bool contend_mutex(void) {
+    for (int i = 0; i < ITERATIONS; i++) {
+        if (pthread_mutex_lock(&shared_mutex) != 0) {
+            return false;
+        }
+
+        int frames = 0;
+        bool result = bw_backtrace(collect_frame, &frames);
+        hold();
+
+        BW_UNUSED(pthread_mutex_unlock(&shared_mutex));
+        if (!result || frames == 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+typedef struct {
+    bool writer;
+    bool success;
+} worker_data_t;
+
+void* mutex_worker(void* arg) {
+    worker_data_t* data = arg;
+    data->success = contend_mutex();
+
+    return NULL;
+}
+
+__attribute__((noinline)) bool read_shared(void) {
+    for (int i = 0; i < ITERATIONS; i++) {
+        if (pthread_rwlock_rdlock(&shared_rwlock) != 0) {
+            return false;
+        }
+        BW_UNUSED(pthread_rwlock_unlock(&shared_rwlock));
+    }
+
+    return true;
+}
+
+__attribute__((noinline)) bool write_shared(void) {
+    for (int i = 0; i < ITERATIONS; i++) {
+        if (pthread_rwlock_wrlock(&shared_rwlock) != 0) {
+            return false;
+        }
+        hold();
+        BW_UNUSED(pthread_rwlock_unlock(&shared_rwlock));
+    }
+
+    return true;
+}
+
+void* rwlock_worker(void* arg) {
+    worker_data_t* data = arg;
+    data->success = data->writer ? write_shared() : read_shared();
+
+    return NULL;
+}
+
+static test_result_t run_workers(void* (*worker)(void*), int num_threads) {
+    pthread_t threads[MAX_THREADS];
+    worker_data_t worker_data[MAX_THREADS];
+
+    for (int i = 0; i < num_threads; i++) {
+        // Half of the threads write to the read-write lock
+        worker_data[i].writer = i % 2 == 0;
+        worker_data[i].success = false;
+        TEST_ERROR_NONZERO(pthread_create(&threads[i], NULL, worker, &worker_data[i]));
+    }
+
+    for (int i = 0; i < num_threads; i++) {
+        TEST_ERROR_NONZERO(pthread_join(threads[i], NULL));
+        TEST_ASSERT_TRUE(worker_data[i].success);
+    }
+
+    TEST_OK();
+}
+
+TEST(mutex_contention, {
+    bw_contention_profiler_config_t config = {0};
+    config.threshold_ns = 1; // Every blocking wait
+    TEST_ASSERT_TRUE(bw_contention_profiler_start(&config));
+    test_result_t result = run_workers(mutex_worker, MAX_THREADS);
+    bw_contention_profiler_stop();
+    TEST_ASSERT_TRUE(result == TEST_RESULT_OK);
+
+    bw_contention_profiler_stats_t stats = {0};
+    bw_contention_profiler_get_stats(&stats);
+    BW_UNUSED(fprintf(stderr,
+                      "\tcontended: %ju, waited %ju us\n",
+                      (uintmax_t)stats.contended,
+                      (uintmax_t)stats.wait_ns / 1000));
+    TEST_ASSERT_TRUE(stats.contended > 0);
+    TEST_ASSERT_EQ_SIZE((size_t)stats.recorded, (size_t)stats.contended);
+    TEST_ASSERT_EQ_SIZE((size_t)stats.dropped, 0L);
+
+    find("contend_mutex");
+    TEST_ASSERT_TRUE(found.waits > 0);
+    // Each wait lasts at least until the holder has slept
+    TEST_ASSERT_TRUE(found.wait_ns >= found.waits * (HOLD_NS / 2));
+    TEST_ASSERT_EQ_SIZE((size_t)found.all_waits, (size_t)stats.recorded);
+})
+
+TEST(rwlock_contention, {
+    bw_contention_profiler_stats_t before = {0};
+    bw_contention_profiler_get_stats(&before);
+
+    bw_contention_profiler_config_t config = {0};
+    config.threshold_ns = 1;
+    TEST_ASSERT_TRUE(bw_contention_profiler_start(&config));
+    test_result_t result = run_workers(rwlock_worker, MAX_THREADS);
+    bw_contention_profiler_stop();
+    TEST_ASSERT_TRUE(result == TEST_RESULT_OK);
+
+    bw_contention_profiler_stats_t stats = {0};
+    bw_contention_profiler_get_stats(&stats);
+    TEST_ASSERT_TRUE(stats.contended > before.contended);
+
+    find("read_shared");
+    uint64_t read_waits = found.waits;
+    find("write_shared");
+    TEST_ASSERT_TRUE(read_waits + found.waits > 0);
+})
+
+TEST(samples_short_waits, {
+    bw_contention_profiler_stats_t before = {0};
+    bw_contention_profiler_get_stats(&before);
+    find("contend_mutex");
+    uint64_t waits_before = found.all_waits;
+
+    // Every wait is short of a threshold this long
+    bw_contention_profiler_config_t config = {0};
+    config.threshold_ns = UINT64_MAX;
+    config.sample_period = SAMPLE_PERIOD;
+    TEST_ASSERT_TRUE(bw_contention_profiler_start(&config));
+    test_result_t result = run_workers(mutex_worker, MAX_THREADS);
+    bw_contention_profiler_stop();
+    TEST_ASSERT_TRUE(result == TEST_RESULT_OK);
+
+    bw_contention_profiler_stats_t stats = {0};
+    bw_contention_profiler_get_stats(&stats);
+    uint64_t contended = stats.contended - before.contended;
+    uint64_t recorded = stats.recorded - before.recorded;
+    TEST_ASSERT_TRUE(recorded * SAMPLE_PERIOD <= contended);
+
+    // Each recorded wait stands for SAMPLE_PERIOD of them
+    find("contend_mutex");
+    TEST_ASSERT_EQ_SIZE((size_t)(found.all_waits - waits_before), (size_t)recorded * SAMPLE_PERIOD);
+})
+
+TEST(uncontended_not_counted, {
+    bw_contention_profiler_stats_t before = {0};
+    bw_contention_profiler_get_stats(&before);
+
+    bw_contention_profiler_config_t config = {0};
+    TEST_ASSERT_TRUE(bw_contention_profiler_start(&config));
+    for (int i = 0; i < ITERATIONS; i++) {
+        TEST_ERROR_NONZERO(pthread_mutex_lock(&shared_mutex));
+        TEST_ERROR_NONZERO(pthread_mutex_unlock(&shared_mutex));
+        TEST_ERROR_NONZERO(pthread_rwlock_rdlock(&shared_rwlock));
+        TEST_ERROR_NONZERO(pthread_rwlock_rdlock(&shared_rwlock)); // Readers share the lock
+        TEST_ERROR_NONZERO(pthread_rwlock_unlock(&shared_rwlock));
+        TEST_ERROR_NONZERO(pthread_rwlock_unlock(&shared_rwlock));
+    }
+    bw_contention_profiler_stop();
+
+    bw_contention_profiler_stats_t stats = {0};
+    bw_contention_profiler_get_stats(&stats);
+    TEST_ASSERT_EQ_SIZE((size_t)stats.contended, (size_t)before.contended);
+})
+
+static long now_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        return -1;
+    }
+
+    return (ts.tv_sec * 1000000000L) + ts.tv_nsec;
+}
+
+TEST(benchmark, {
+    bw_contention_profiler_config_t config = {0};
+    TEST_ASSERT_TRUE(bw_contention_profiler_start(&config));
+
+    long start = now_ns();
+    for (size_t i = 0; i < BENCH_ITERATIONS; ++i) {
+        BW_UNUSED(pthread_mutex_lock(&shared_mutex));
+        BW_UNUSED(pthread_mutex_unlock(&shared_mutex));
+    }
+    long profiled = now_ns() - start;
+
+    start = now_ns();
+    for (size_t i = 0; i < BENCH_ITERATIONS; ++i) {
+        BW_UNUSED(pthread_mutex_trylock(&shared_mutex)); // The fast path of glibc's lock
+        BW_UNUSED(pthread_mutex_unlock(&shared_mutex));
+    }
+    long plain = now_ns() - start;
+
+    bw_contention_profiler_stop();
+
+    BW_UNUSED(fprintf(stderr,
+                      "\tuncontended lock+unlock: %.1f ns profiled, %.1f ns plain\n",
+                      (double)profiled / BENCH_ITERATIONS,
+                      (double)plain / BENCH_ITERATIONS));
+    TEST_ASSERT_TRUE(profiled > 0 && plain > 0);
+})
+
+TEST(invalid_config, {
+    TEST_ASSERT_FALSE(bw_contention_profiler_start(NULL));
+
+    bw_contention_profiler_stop(); // Stopping a stopped profiler is a no-op
+    bw_contention_profiler_dump(NULL, NULL);
+    bw_contention_profiler_get_stats(NULL);
+})
+
+int main(int argc, char** argv) {
+    TEST_INIT("contention_profiler", argc, argv);
+
+    TEST_RUN(mutex_contention);
+    TEST_RUN(rwlock_contention);
+    TEST_RUN(samples_short_waits);
+    TEST_RUN(uncontended_not_counted);
+    TEST_RUN(benchmark);
+    TEST_RUN(invalid_config);
+
+    TEST_EXIT();
+}
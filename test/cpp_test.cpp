@@ -1,16 +1,22 @@
 // NOLINTBEGIN(misc-use-internal-linkage, cppcoreguidelines-pro-type-vararg)
-#include <cxxabi.h>             // for __cxa_demangle, abi
-#include <stdlib.h>             // for free
+#include <cxxabi.h>               // for __cxa_demangle, abi
 
-#include <cstdint>              // for uintptr_t
+#include <cstddef>                // for size_t
+#include <cstdint>                // for uintptr_t
+#include <cstdio>                 // for fprintf, stderr
+#include <cstdlib>                // for free
+#include <cstring>                // for memcpy, strcmp, strlen, strncmp, strstr
 
-#include <functional>           // for function
-#include <vector>               // for vector
+#include <algorithm>              // for equal
+#include <chrono>                 // for duration, steady_clock
+#include <functional>             // for function
+#include <vector>                 // for vector
 
-#include "common.h"             // for BW_UNUSED
-#include "backwalk/backwalk.h"  // for bw_backtrace
+#include "common.h"               // for BW_UNUSED
+#include "backwalk/backwalk.h"    // for bw_backtrace, bw_demangle, bw_set_demangle
+#include "backwalk/backwalk.hpp"  // for backtrace, capture, trace
 
-#include "test.h"               // for TEST, TEST_RUN, TEST_ASSERT_EQ_INT32
+#include "test.h"                 // for TEST, TEST_RUN, TEST_ASSERT_EQ_INT32
 
 namespace test_ns {
 
@@ -104,6 +110,205 @@ TEST(demangle, {
     TEST_ASSERT_EQ_INT32(fail, 0);
 })
 
+const char* mangled_sname = nullptr;
+
+bool find_mangled(uintptr_t, const char*, const char* sname, void*) {
+    if (std::strncmp(sname, "_Z", 2) == 0) {
+        mangled_sname = sname;
+        return false;
+    }
+
+    return true;
+}
+
+TEST(builtin_demangle, {
+    auto lambda = [](uintptr_t, const char*, const char* sname, void* arg) {
+        auto* found = static_cast<bool*>(arg);
+        *found = *found || std::strstr(sname, "test_ns::") != nullptr;
+        return true;
+    };
+
+    bool found = false;
+    bw_set_demangle(true);
+    auto retval = bw_backtrace(lambda, &found);
+    bw_set_demangle(false);
+    TEST_ASSERT_TRUE(retval);
+    TEST_ASSERT_TRUE(found);
+})
+
+TEST(demangle_cache, {
+    BW_UNUSED(bw_backtrace(find_mangled, nullptr));
+    TEST_ASSERT_NONNULL(mangled_sname);
+
+    const char* demangled = bw_demangle(mangled_sname);
+    TEST_ASSERT_TRUE(demangled != mangled_sname);
+    TEST_ASSERT_NONNULL(std::strstr(demangled, "test_ns::"));
+    TEST_ASSERT_TRUE(bw_demangle(mangled_sname) == demangled);
+
+    const char* plain = "main";
+    TEST_ASSERT_TRUE(bw_demangle(plain) == plain);
+    TEST_ASSERT_TRUE(bw_demangle(nullptr) == nullptr);
+})
+
+// Every copy of a name has its own address, so each one takes an entry in the cache
+constexpr size_t k_name_copies = 4096;
+constexpr size_t k_name_size = 32;
+char name_copies[k_name_copies][k_name_size];
+
+// Calls into the bw_dbg_demangle hook defined below
+size_t demangle_hook_calls = 0;
+
+TEST(demangle_cache_grows, {
+    const char* demangled = bw_demangle(mangled_sname);
+    size_t len = std::strlen(mangled_sname);
+    TEST_ASSERT_TRUE(len < k_name_size);
+    for (auto& copy : name_copies) {
+        std::memcpy(copy, mangled_sname, len + 1);
+    }
+
+    // Each copy is demangled once through the hook, then found in the cache
+    size_t calls = demangle_hook_calls;
+    for (auto& copy : name_copies) {
+        TEST_ASSERT_TRUE(std::strcmp(bw_demangle(copy), demangled) == 0);
+    }
+    TEST_ASSERT_EQ_SIZE(demangle_hook_calls, calls + k_name_copies);
+    for (auto& copy : name_copies) {
+        TEST_ASSERT_TRUE(bw_demangle(copy) != copy);
+    }
+    TEST_ASSERT_EQ_SIZE(demangle_hook_calls, calls + k_name_copies);
+})
+
+constexpr size_t k_capture_max = 64;
+
+TEST(template_backtrace, {
+    ns_backtrace_ctx_t ctx = {};
+    auto retval = bw::backtrace([&](uintptr_t addr, const char* fname, const char* sname) {
+        return ns_backtrace_cb(addr, fname, sname, &ctx);
+    });
+    TEST_ASSERT_TRUE(retval);
+
+    int c_frames = 0;
+    TEST_ASSERT_TRUE(bw_backtrace(increment_backtrace_cb, &c_frames));
+    TEST_ASSERT_EQ_INT32(ctx.fnum, c_frames);
+    TEST_ASSERT_EQ_INT32(ctx.fname_ok, ctx.fnum);
+    TEST_ASSERT_EQ_INT32(ctx.sname_ok, ctx.fnum);
+
+    // The first frame is the caller's own, as with bw_backtrace()
+    const char* first = nullptr;
+    BW_UNUSED(bw::backtrace([&](uintptr_t, const char*, const char* sname) {
+        first = sname;
+        return false;
+    }));
+    TEST_ASSERT_NONNULL(first);
+    TEST_ASSERT_NONNULL(std::strstr(first, "template_backtrace"));
+})
+
+TEST(template_early_termination, {
+    int fnum = 0;
+    auto retval = bw::backtrace<4>([&](uintptr_t, const char*, const char*) { return ++fnum < 2; });
+    TEST_ASSERT_FALSE(retval);
+    TEST_ASSERT_EQ_INT32(fnum, 2);
+})
+
+TEST(template_deeper_than_buffer, {
+    // Stacks deeper than the buffer on the stack are captured again into a larger one, without
+    // losing or repeating frames
+    std::vector<uintptr_t> walked;
+    TEST_ASSERT_TRUE(bw::backtrace<1>([&](uintptr_t addr, const char*, const char*) {
+        walked.push_back(addr);
+        return true;
+    }));
+    std::vector<uintptr_t> chunked;
+    TEST_ASSERT_TRUE(bw::backtrace<3>([&](uintptr_t addr, const char*, const char*) {
+        chunked.push_back(addr);
+        return true;
+    }));
+
+    int c_frames = 0;
+    TEST_ASSERT_TRUE(bw_backtrace(increment_backtrace_cb, &c_frames));
+    TEST_ASSERT_EQ_SIZE(walked.size(), static_cast<size_t>(c_frames));
+    TEST_ASSERT_EQ_SIZE(chunked.size(), walked.size());
+    TEST_ASSERT_TRUE(std::equal(walked.begin() + 1, walked.end(), chunked.begin() + 1));
+})
+
+TEST(template_capture, {
+    auto trace = bw::capture<k_capture_max>();
+    uintptr_t ips[k_capture_max];
+    size_t len = bw_capture(ips, k_capture_max, 0);
+
+    TEST_ASSERT_EQ_SIZE(trace.size(), len);
+    TEST_ASSERT_TRUE(trace.capacity() == k_capture_max);
+    // Only the return addresses into this function differ
+    for (size_t i = 1; i < len; ++i) {
+        TEST_ASSERT_TRUE(trace[i] == ips[i]);
+    }
+    TEST_ASSERT_NONNULL(std::strstr(trace.symbol(0).sname, "template_capture"));
+
+    auto skipped = bw::capture<k_capture_max>(1);
+    TEST_ASSERT_EQ_SIZE(skipped.size() + 1, len);
+    TEST_ASSERT_TRUE(*skipped.begin() == ips[1]);
+    TEST_ASSERT_TRUE(bw::capture<1>().size() == 1);
+})
+
+constexpr int k_bench_depth = 32;
+constexpr int k_bench_walks = 2000;
+
+struct bench_counts_t {
+    uintptr_t addr_sum;
+    size_t frames;
+};
+
+__attribute__((noinline)) bool bench_c_cb(uintptr_t addr, const char*, const char*, void* arg) {
+    auto* counts = static_cast<bench_counts_t*>(arg);
+    counts->addr_sum += addr;
+    counts->frames++;
+    return true;
+}
+
+// Returns the nanoseconds per frame of walks from `depth` frames down, through the C callback or
+// the inlined lambda
+__attribute__((noinline)) double bench_walk(int depth, bool use_template, bench_counts_t* counts) {
+    if (depth > 0) {
+        return bench_walk(depth - 1, use_template, counts);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < k_bench_walks; ++i) {
+        if (use_template) {
+            BW_UNUSED(bw::backtrace([counts](uintptr_t addr, const char*, const char*) {
+                counts->addr_sum += addr;
+                counts->frames++;
+                return true;
+            }));
+        } else {
+            BW_UNUSED(bw_backtrace(bench_c_cb, counts));
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    return elapsed.count() / static_cast<double>(counts->frames);
+}
+
+TEST(template_vs_c_performance, {
+    bench_counts_t c_counts = {};
+    bench_counts_t cpp_counts = {};
+    // Warm up the symbol tables
+    BW_UNUSED(bench_walk(k_bench_depth, false, &c_counts));
+    c_counts = {};
+
+    double c_ns = bench_walk(k_bench_depth, false, &c_counts);
+    double cpp_ns = bench_walk(k_bench_depth, true, &cpp_counts);
+    TEST_ASSERT_EQ_SIZE(cpp_counts.frames, c_counts.frames);
+    TEST_ASSERT_TRUE(cpp_counts.addr_sum != 0);
+
+    BW_UNUSED(std::fprintf(stderr,
+                           "\t%zu frames: bw_backtrace() %.1f ns/frame, bw::backtrace() %.1f "
+                           "ns/frame\n",
+                           c_counts.frames,
+                           c_ns,
+                           cpp_ns));
+})
+
 std::vector<uintptr_t> addrs;
 bool vector_collect(uintptr_t addr, const char* fname, const char* sname, void* arg) {
     BW_UNUSED(fname);
@@ -127,6 +332,7 @@ TEST(cross_namespace, {
 
 extern "C" {
 char* bw_dbg_demangle(const char* sname) {
+    test_ns::demangle_hook_calls++;
     int fail = 1;
     auto* demangled = abi::__cxa_demangle(sname, nullptr, nullptr, &fail);
     return fail == 0 ? demangled : nullptr;
@@ -144,6 +350,14 @@ int main(int argc, char** argv) {
     TEST_RUN(test_ns::lambda_in_callstack);
     TEST_RUN(test_ns::lambda_cb);
     TEST_RUN(test_ns::demangle);
+    TEST_RUN(test_ns::builtin_demangle);
+    TEST_RUN(test_ns::demangle_cache);
+    TEST_RUN(test_ns::demangle_cache_grows);
+    TEST_RUN(test_ns::template_backtrace);
+    TEST_RUN(test_ns::template_early_termination);
+    TEST_RUN(test_ns::template_deeper_than_buffer);
+    TEST_RUN(test_ns::template_capture);
+    TEST_RUN(test_ns::template_vs_c_performance);
     TEST_RUN(other_ns::cross_namespace);
 
     TEST_EXIT();
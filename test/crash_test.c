@@ -0,0 +1,227 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include <dlfcn.h>              // for dladdr, Dl_info
+#include <fcntl.h>              // for open, O_RDONLY
+#include <signal.h>             // for SIGABRT, SIGSEGV
+#include <stdbool.h>            // for bool, false, true
+#include <stddef.h>             // for size_t, NULL
+#include <stdint.h>             // for uintptr_t
+#include <stdio.h>              // for snprintf
+#include <stdlib.h>             // for abort, exit, mkstemp, strtoull
+#include <string.h>             // for strstr, strlen
+#include <sys/stat.h>           // for stat
+#include <sys/types.h>          // for pid_t, ssize_t
+#include <sys/wait.h>           // for waitpid, WEXITSTATUS, WIFEXITED, WIFSIGNALED, WTERMSIG
+#include <unistd.h>             // for close, fork, pipe, read, unlink, _exit
+
+#include "backwalk/crash.h"     // for bw_crash_config_t, bw_crash_install, bw_crash_uninstall
+#include "common.h"             // for BW_UNUSED
+
+#include "test.h"               // for TEST, TEST_ASSERT_TRUE, TEST_ERROR_NONZERO, TEST_RUN
+
+enum { REPORT_MAX = 256 << 10 };
+enum { OVERFLOW_FRAME_SIZE = 1024 };
+#define HEX_BASE 16
+
+typedef void (*crash_fn)(void);
+
+static char report[REPORT_MAX];
+static char report_path[] = "/tmp/crash_test_XXXXXX";
+
+// Not known to be NULL at compile time, so the store is not turned into a trap
+static volatile uintptr_t null_address = 0;
+
+__attribute__((noinline)) void crash_segv(void) {
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    *(volatile int*)null_address = 1;
+}
+
+__attribute__((noinline)) void crash_abort(void) {
+    abort();
+}
+
+// Never reached, but keeps the recursion from being provably infinite
+static volatile int overflow_limit = -1;
+
+// NOLINTNEXTLINE(misc-no-recursion)
+__attribute__((noinline)) int overflow(int depth) {
+    volatile char frame[OVERFLOW_FRAME_SIZE];
+    frame[0] = (char)depth;
+    if (depth == overflow_limit) {
+        return 0;
+    }
+
+    return overflow(depth + 1) + frame[0];
+}
+
+__attribute__((noinline)) void crash_overflow(void) {
+    BW_UNUSED(overflow(1));
+}
+
+// Runs `fn` in a child process with the crash reporter installed and returns the signal that
+// killed it, or 0 if it exited
+static int run_child(const bw_crash_config_t* config, crash_fn fn) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (!bw_crash_install(config)) {
+            _exit(1);
+        }
+        fn();
+        _exit(0);
+    }
+
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+        return 0;
+    }
+
+    return WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+}
+
+static int crash_to_pipe(crash_fn fn) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return 0;
+    }
+
+    bw_crash_config_t config = {.fd = fds[1]};
+    int sig = run_child(&config, fn);
+    BW_UNUSED(close(fds[1]));
+
+    size_t len = 0;
+    ssize_t n = 0;
+    while (len < REPORT_MAX - 1 && (n = read(fds[0], report + len, REPORT_MAX - 1 - len)) > 0) {
+        len += (size_t)n;
+    }
+    report[len] = '\0';
+    BW_UNUSED(close(fds[0]));
+
+    return sig;
+}
+
+static size_t read_file(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    size_t len = 0;
+    ssize_t n = 0;
+    while (len < REPORT_MAX - 1 && (n = read(fd, report + len, REPORT_MAX - 1 - len)) > 0) {
+        len += (size_t)n;
+    }
+    report[len] = '\0';
+    BW_UNUSED(close(fd));
+
+    return len;
+}
+
+// The child is forked from this process, so its addresses can be symbolized here
+static bool frame_in(size_t index, crash_fn fn) {
+    char prefix[32];
+    BW_UNUSED(snprintf(prefix, sizeof(prefix), "\n#%zu 0x", index));
+    const char* line = strstr(report, prefix);
+    if (!line) {
+        return false;
+    }
+
+    uintptr_t ip = (uintptr_t)strtoull(line + strlen(prefix), NULL, HEX_BASE);
+    Dl_info info = {0};
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    return dladdr((const void*)ip, &info) != 0 && (uintptr_t)info.dli_saddr == (uintptr_t)fn;
+}
+
+TEST(segv_report, {
+    TEST_ASSERT_TRUE(crash_to_pipe(crash_segv) == SIGSEGV);
+
+    TEST_ASSERT_NONNULL(strstr(report, "signal 11 (SIGSEGV)"));
+    TEST_ASSERT_NONNULL(strstr(report, "address 0x0\n"));
+    TEST_ASSERT_TRUE(frame_in(0, crash_segv));
+    TEST_ASSERT_NONNULL(strstr(report, "\nmodules:\n"));
+    TEST_ASSERT_NONNULL(strstr(report, "crash_test\n"));
+})
+
+TEST(abort_report_to_file, {
+    int fd = mkstemp(report_path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    BW_UNUSED(close(fd));
+
+    bw_crash_config_t config = {.path = report_path};
+    TEST_ASSERT_TRUE(run_child(&config, crash_abort) == SIGABRT);
+
+    // The file is truncated to the report
+    size_t len = read_file(report_path);
+    BW_UNUSED(unlink(report_path));
+    TEST_ASSERT_EQ_SIZE(len, strlen(report));
+    TEST_ASSERT_NONNULL(strstr(report, "(SIGABRT)"));
+    TEST_ASSERT_NONNULL(strstr(report, "\nmodules:\n"));
+})
+
+// Exits through exit() with the reporter installed, after checking that the file was mapped
+static int exit_with_file(const char* path) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        bw_crash_config_t config = {.path = path};
+        struct stat st;
+        if (!bw_crash_install(&config) || stat(path, &st) != 0 || st.st_size == 0) {
+            _exit(1);
+        }
+        exit(0);
+    }
+
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+        return -1;
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+TEST(file_emptied_at_exit, {
+    char path[] = "/tmp/crash_test_XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    BW_UNUSED(close(fd));
+
+    int status = exit_with_file(path);
+    size_t len = read_file(path);
+    BW_UNUSED(unlink(path));
+    TEST_ASSERT_TRUE(status == 0);
+    TEST_ASSERT_EQ_SIZE(len, 0L);
+})
+
+// The overflowing thread's own stack is exhausted, the report is written from the signal stack
+TEST(stack_overflow_report, {
+    TEST_ASSERT_TRUE(crash_to_pipe(crash_overflow) == SIGSEGV);
+
+    char last_frame[32];
+    BW_UNUSED(snprintf(last_frame, sizeof(last_frame), "\n#%d 0x", BW_CRASH_FRAMES_MAX - 1));
+    TEST_ASSERT_NONNULL(strstr(report, last_frame));
+    TEST_ASSERT_TRUE(frame_in(1, (crash_fn)overflow));
+})
+
+TEST(install_uninstall, {
+    bw_crash_config_t config = {.fd = -1};
+    TEST_ASSERT_FALSE(bw_crash_install(NULL));
+    TEST_ASSERT_FALSE(bw_crash_install(&config));
+
+    config.fd = 2;
+    TEST_ASSERT_TRUE(bw_crash_install(&config));
+    TEST_ASSERT_FALSE(bw_crash_install(&config));
+    bw_crash_uninstall();
+    TEST_ASSERT_TRUE(bw_crash_install(&config));
+    bw_crash_uninstall();
+    TEST_ASSERT_TRUE(bw_crash_register_thread());
+})
+
+int main(int argc, char** argv) {
+    TEST_INIT("crash", argc, argv);
+
+    TEST_RUN(segv_report);
+    TEST_RUN(abort_report_to_file);
+    TEST_RUN(file_emptied_at_exit);
+    TEST_RUN(stack_overflow_report);
+    TEST_RUN(install_uninstall);
+
+    TEST_EXIT();
+}
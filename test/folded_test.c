@@ -0,0 +1,270 @@
+#include <stdbool.h>            // for bool, false, true
+#include <stddef.h>             // for size_t, NULL
+#include <stdint.h>             // for uintptr_t, uint64_t
+#include <stdio.h>              // for fprintf, stderr
+#include <stdlib.h>             // for free, malloc, mkstemp
+#include <string.h>             // for strstr, strchr, strlen, strncmp
+#include <sys/stat.h>           // for fstat, stat
+#include <sys/types.h>          // for ssize_t
+#include <time.h>               // for clock_gettime, timespec, CLOCK_MONOTONIC
+#include <unistd.h>             // for close, pread, unlink
+
+#include "backwalk/backwalk.h"  // for bw_capture
+#include "backwalk/folded.h"    // for bw_folded_add, bw_folded_create, bw_folded_destroy, bw_...
+#include "common.h"             // for BW_UNUSED
+
+#include "test.h"               // for TEST, TEST_ASSERT_TRUE, TEST_RUN, TEST_ASSERT_NONNULL
+
+enum { MAX_FRAMES = 64 };
+enum { SMALL_BUFFER_SIZE = 64 };
+enum { BENCH_SAMPLES = 1000000 };
+enum { BENCH_STACKS = 4096 };
+enum { BENCH_LEAVES = 64 };
+enum { BENCH_FLUSHES = 10 };
+
+static char small_buffer[SMALL_BUFFER_SIZE];
+
+static int open_temp(void) {
+    char path[] = "/tmp/backwalk_folded_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0) {
+        BW_UNUSED(unlink(path));
+    }
+
+    return fd;
+}
+
+// Reads the whole file as a string, which the caller frees
+static char* read_all(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return NULL;
+    }
+
+    size_t len = (size_t)st.st_size;
+    char* data = malloc(len + 1);
+    if (data && pread(fd, data, len, 0) != (ssize_t)len) {
+        free(data);
+        return NULL;
+    }
+    if (data) {
+        data[len] = '\0';
+    }
+
+    return data;
+}
+
+static size_t count_lines(const char* text) {
+    size_t lines = 0;
+    for (const char* nl = strchr(text, '\n'); nl; nl = strchr(nl + 1, '\n')) {
+        lines++;
+    }
+
+    return lines;
+}
+
+__attribute__((noinline)) size_t folded_leaf_a(uintptr_t* ips) {
+    return bw_capture(ips, MAX_FRAMES, 0);
+}
+
+__attribute__((noinline)) size_t folded_leaf_b(uintptr_t* ips) {
+    return bw_capture(ips, MAX_FRAMES, 0);
+}
+
+// Read through a volatile so that the compiler does not clone folded_caller() for each leaf
+static volatile bool use_leaf_a;
+
+__attribute__((noinline)) size_t folded_caller(uintptr_t* ips) {
+    return use_leaf_a ? folded_leaf_a(ips) : folded_leaf_b(ips);
+}
+
+static size_t capture_through(uintptr_t* ips, bool leaf_a) {
+    use_leaf_a = leaf_a;
+    return folded_caller(ips);
+}
+
+static uintptr_t ips_a[MAX_FRAMES];
+static uintptr_t ips_b[MAX_FRAMES];
+
+static test_result_t check_folded(char* buffer, size_t buffer_size, bool cache_symbols) {
+    int fd = open_temp();
+    TEST_ASSERT_TRUE(fd >= 0);
+
+    bw_folded_config_t config = {0};
+    config.fd = fd;
+    config.buffer = buffer;
+    config.buffer_size = buffer_size;
+    config.cache_symbols = cache_symbols;
+    bw_folded_t* folded = bw_folded_create(&config);
+
+    size_t len_a = capture_through(ips_a, true);
+    size_t len_b = capture_through(ips_b, false);
+    bool added = folded && bw_folded_add(folded, ips_a, len_a, 3) &&
+                 bw_folded_add(folded, ips_a, len_a, 4) && bw_folded_add(folded, ips_b, len_b, 5) &&
+                 bw_folded_add(folded, ips_b + 1, len_b - 1, 6); // folded_caller itself
+    bool flushed = folded && bw_folded_flush(folded);
+    // Counts were reset, a second flush writes nothing
+    bool flushed_again = folded && bw_folded_flush(folded);
+    bw_folded_destroy(folded);
+
+    char* text = read_all(fd);
+    BW_UNUSED(close(fd));
+    TEST_ASSERT_NONNULL(folded);
+    TEST_ASSERT_TRUE(added && flushed && flushed_again);
+    TEST_ASSERT_NONNULL(text);
+
+    // Outermost frame first, innermost last, then the count
+    bool found_a = strstr(text, ";folded_caller;folded_leaf_a 7\n") != NULL;
+    bool found_b = strstr(text, ";folded_caller;folded_leaf_b 5\n") != NULL;
+    bool found_caller = strstr(text, ";folded_caller 6\n") != NULL;
+    bool starts_at_root = strncmp(text, "folded_leaf", strlen("folded_leaf")) != 0;
+    size_t lines = count_lines(text);
+    free(text);
+
+    TEST_ASSERT_TRUE(found_a);
+    TEST_ASSERT_TRUE(found_b);
+    TEST_ASSERT_TRUE(found_caller);
+    TEST_ASSERT_TRUE(starts_at_root);
+    TEST_ASSERT_EQ_SIZE(lines, 3L);
+
+    TEST_OK();
+}
+
+TEST(aggregates_stacks, { TEST_ASSERT_TRUE(check_folded(NULL, 0, true) == TEST_RESULT_OK); })
+
+TEST(without_symbol_cache, { TEST_ASSERT_TRUE(check_folded(NULL, 0, false) == TEST_RESULT_OK); })
+
+TEST(flush_starts_over, {
+    int fd = open_temp();
+    TEST_ASSERT_TRUE(fd >= 0);
+
+    bw_folded_config_t config = {0};
+    config.fd = fd;
+    bw_folded_t* folded = bw_folded_create(&config);
+
+    // Stacks added after a flush are aggregated again from an empty trie
+    size_t len_a = capture_through(ips_a, true);
+    size_t len_b = capture_through(ips_b, false);
+    bool success = folded && bw_folded_add(folded, ips_a, len_a, 1) && bw_folded_flush(folded) &&
+                   bw_folded_add(folded, ips_b, len_b, 2) &&
+                   bw_folded_add(folded, ips_a, len_a, 3) &&
+                   bw_folded_add(folded, ips_b, len_b, 4) && bw_folded_flush(folded);
+    bw_folded_destroy(folded);
+
+    char* text = read_all(fd);
+    BW_UNUSED(close(fd));
+    TEST_ASSERT_TRUE(success);
+    TEST_ASSERT_NONNULL(text);
+
+    const char* first = strstr(text, ";folded_caller;folded_leaf_a 1\n");
+    const char* second_a = first ? strstr(first + 1, ";folded_caller;folded_leaf_a 3\n") : NULL;
+    bool found_b = strstr(text, ";folded_caller;folded_leaf_b 6\n") != NULL;
+    size_t lines = count_lines(text);
+    free(text);
+
+    TEST_ASSERT_NONNULL(first);
+    TEST_ASSERT_NONNULL(second_a);
+    TEST_ASSERT_TRUE(found_b);
+    TEST_ASSERT_EQ_SIZE(lines, 3L);
+})
+
+// Lines are longer than the buffer, which is written out every time it fills
+TEST(small_user_buffer, {
+    TEST_ASSERT_TRUE(check_folded(small_buffer, SMALL_BUFFER_SIZE, true) == TEST_RESULT_OK);
+})
+
+TEST(invalid_arguments, {
+    bw_folded_config_t config = {0};
+    config.fd = -1;
+    TEST_ASSERT_TRUE(bw_folded_create(&config) == NULL);
+    config.fd = 1;
+    config.buffer = small_buffer;
+    TEST_ASSERT_TRUE(bw_folded_create(&config) == NULL); // Buffer without a size
+    TEST_ASSERT_TRUE(bw_folded_create(NULL) == NULL);
+    TEST_ASSERT_FALSE(bw_folded_add(NULL, NULL, 0, 1));
+    TEST_ASSERT_FALSE(bw_folded_flush(NULL));
+    bw_folded_destroy(NULL);
+})
+
+static long now_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        return -1;
+    }
+
+    return (ts.tv_sec * 1000000000L) + ts.tv_nsec;
+}
+
+static uintptr_t bench_ips[BENCH_STACKS][MAX_FRAMES];
+static size_t bench_lens[BENCH_STACKS];
+
+static test_result_t bench_folded(bool cache_symbols) {
+    int fd = open_temp();
+    TEST_ASSERT_TRUE(fd >= 0);
+
+    bw_folded_config_t config = {0};
+    config.fd = fd;
+    config.cache_symbols = cache_symbols;
+    bw_folded_t* folded = bw_folded_create(&config);
+    TEST_ASSERT_NONNULL(folded);
+
+    // Flushed periodically, like a profiler writing out a profile every few seconds
+    bool success = true;
+    long add_ns = 0;
+    long flush_ns = 0;
+    for (size_t flush = 0; flush < BENCH_FLUSHES; ++flush) {
+        long start = now_ns();
+        for (size_t i = 0; i < BENCH_SAMPLES / BENCH_FLUSHES; ++i) {
+            size_t stack = i % BENCH_STACKS;
+            success = bw_folded_add(folded, bench_ips[stack], bench_lens[stack], 1) && success;
+        }
+        long added = now_ns();
+        success = bw_folded_flush(folded) && success;
+        add_ns += added - start;
+        flush_ns += now_ns() - added;
+    }
+
+    bw_folded_destroy(folded);
+    BW_UNUSED(close(fd));
+    TEST_ASSERT_TRUE(success);
+
+    BW_UNUSED(fprintf(stderr,
+                      "\t%d samples, symbol cache %s: %.1f ns/sample to add, %.2f ms/flush\n",
+                      BENCH_SAMPLES,
+                      cache_symbols ? "on" : "off",
+                      (double)add_ns / BENCH_SAMPLES,
+                      (double)flush_ns / BENCH_FLUSHES / 1e6));
+
+    TEST_OK();
+}
+
+TEST(benchmark, {
+    // Real stacks, with leaves at different addresses of the leaf functions
+    size_t len = capture_through(ips_a, true);
+    TEST_ASSERT_TRUE(len > 1 && len < MAX_FRAMES);
+    for (size_t i = 0; i < BENCH_STACKS; ++i) {
+        uintptr_t leaf = i % 2 ? (uintptr_t)folded_leaf_a : (uintptr_t)folded_leaf_b;
+        bench_ips[i][0] = leaf + 1 + (i / 2 % BENCH_LEAVES);
+        bench_ips[i][1] = ips_a[(i % (len - 1)) + 1];
+        for (size_t j = 2; j <= len; ++j) {
+            bench_ips[i][j] = ips_a[j - 1];
+        }
+        bench_lens[i] = len + 1;
+    }
+
+    TEST_ASSERT_TRUE(bench_folded(true) == TEST_RESULT_OK);
+    TEST_ASSERT_TRUE(bench_folded(false) == TEST_RESULT_OK);
+})
+
+int main(int argc, char** argv) {
+    TEST_INIT("folded", argc, argv);
+
+    TEST_RUN(aggregates_stacks);
+    TEST_RUN(without_symbol_cache);
+    TEST_RUN(flush_starts_over);
+    TEST_RUN(small_user_buffer);
+    TEST_RUN(invalid_arguments);
+    TEST_RUN(benchmark);
+
+    TEST_EXIT();
+}
@@ -0,0 +1,329 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include <dlfcn.h>                   // for dladdr, Dl_info
+#include <errno.h>                   // for EINVAL
+#include <malloc.h>                  // for memalign
+#include <pthread.h>                 // for pthread_create, pthread_join, pthread_t
+#include <stdbool.h>                 // for bool, false, true
+#include <stddef.h>                  // for size_t, NULL
+#include <stdint.h>                  // for uintptr_t, uint64_t, SIZE_MAX
+#include <stdio.h>                   // for fprintf, stderr
+#include <stdlib.h>                  // for free, malloc, calloc, realloc, aligned_alloc, posix_m...
+#include <string.h>                  // for strcmp
+#include <time.h>                    // for clock_gettime, timespec, CLOCK_MONOTONIC
+
+#include "backwalk/heap_profiler.h"  // for bw_heap_profiler_start, bw_heap_profiler_dump, bw_...
+#include "common.h"                  // for BW_UNUSED
+
+#include "test.h"                    // for TEST, TEST_ASSERT_TRUE, TEST_RUN, TEST_ASSERT_EQ_SIZE
+
+// NOLINTBEGIN(bugprone-reserved-identifier, readability-identifier-naming)
+extern void* __libc_malloc(size_t size);
+extern void __libc_free(void* ptr);
+// NOLINTEND(bugprone-reserved-identifier, readability-identifier-naming)
+
+enum { BLOCKS = 4096 };
+enum { BLOCK_SIZE = 1024 };
+enum { SAMPLE_INTERVAL = 4 << 10 };
+enum { MAX_THREADS = 4 };
+enum { THREAD_KEPT = 64 };
+enum { THREAD_ITERATIONS = 100000 };
+enum { BENCH_ITERATIONS = 1000000 };
+enum { BENCH_SIZE = 64 };
+enum { BLOCK_ALIGNMENT = 64 };
+
+// Estimates of BLOCKS * BLOCK_SIZE bytes from ~900 samples are well within this
+#define ESTIMATE_TOLERANCE 0.3
+
+static void* blocks[BLOCKS];
+
+typedef struct {
+    const char* fname;
+    uint64_t live_bytes;
+    uint64_t live_allocs;
+} found_t;
+
+static found_t found;
+
+static void find_stack(const uintptr_t* ips,
+                       size_t len,
+                       uint64_t live_bytes,
+                       uint64_t live_allocs,
+                       void* arg) {
+    BW_UNUSED(arg);
+
+    // Only the first frame is the caller of the allocator
+    Dl_info info;
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    if (len > 0 && dladdr((const void*)ips[0], &info) && info.dli_sname &&
+        strcmp(info.dli_sname, found.fname) == 0) {
+        found.live_bytes += live_bytes;
+        found.live_allocs += live_allocs;
+    }
+}
+
+static void find(const char* fname) {
+    found.fname = fname;
+    found.live_bytes = 0;
+    found.live_allocs = 0;
+    bw_heap_profiler_dump(find_stack, NULL);
+}
+
+static bool near_total(uint64_t estimate, uint64_t total) {
+    double ratio = (double)estimate / (double)total;
+
+    return ratio > 1 - ESTIMATE_TOLERANCE && ratio < 1 + ESTIMATE_TOLERANCE;
+}
+
+__attribute__((noinline)) bool malloc_blocks(void) {
+    for (size_t i = 0; i < BLOCKS; ++i) {
+        blocks[i] = malloc(BLOCK_SIZE);
+        if (!blocks[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+__attribute__((noinline)) bool calloc_blocks(void) {
+    for (size_t i = 0; i < BLOCKS; ++i) {
+        blocks[i] = calloc(1, BLOCK_SIZE / 2);
+        if (!blocks[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+__attribute__((noinline)) bool realloc_blocks(void) {
+    for (size_t i = 0; i < BLOCKS; ++i) {
+        void* block = realloc(blocks[i], BLOCK_SIZE);
+        if (!block) {
+            return false;
+        }
+        blocks[i] = block;
+    }
+
+    return true;
+}
+
+__attribute__((noinline)) bool aligned_blocks(void) {
+    for (size_t i = 0; i < BLOCKS; ++i) {
+        switch (i % 3) {
+        case 0:
+            blocks[i] = memalign(BLOCK_ALIGNMENT, BLOCK_SIZE);
+            break;
+        case 1:
+            blocks[i] = aligned_alloc(BLOCK_ALIGNMENT, BLOCK_SIZE);
+            break;
+        default:
+            if (posix_memalign(&blocks[i], BLOCK_ALIGNMENT, BLOCK_SIZE) != 0) {
+                blocks[i] = NULL;
+            }
+            break;
+        }
+        if (!blocks[i] || (uintptr_t)blocks[i] % BLOCK_ALIGNMENT != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void free_blocks(void) {
+    for (size_t i = 0; i < BLOCKS; ++i) {
+        free(blocks[i]);
+        blocks[i] = NULL;
+    }
+}
+
+static const bw_heap_profiler_config_t k_config = {.sample_interval = SAMPLE_INTERVAL};
+
+TEST(attributes_live_bytes, {
+    TEST_ASSERT_TRUE(bw_heap_profiler_start(&k_config));
+    bool allocated = malloc_blocks();
+    bw_heap_profiler_stop();
+    TEST_ASSERT_TRUE(allocated);
+
+    find("malloc_blocks");
+    BW_UNUSED(fprintf(stderr,
+                      "\testimated %ju of %ju bytes\n",
+                      (uintmax_t)found.live_bytes,
+                      (uintmax_t)BLOCKS * BLOCK_SIZE));
+    TEST_ASSERT_TRUE(near_total(found.live_bytes, (uint64_t)BLOCKS * BLOCK_SIZE));
+    TEST_ASSERT_TRUE(found.live_allocs > 0);
+
+    // Frees are accounted for after stopping too
+    free_blocks();
+    find("malloc_blocks");
+    TEST_ASSERT_EQ_SIZE((size_t)found.live_allocs, 0L);
+    TEST_ASSERT_EQ_SIZE((size_t)found.live_bytes, 0L);
+})
+
+TEST(calloc_and_realloc, {
+    TEST_ASSERT_TRUE(bw_heap_profiler_start(&k_config));
+    bool allocated = calloc_blocks();
+    find("calloc_blocks");
+    TEST_ASSERT_TRUE(near_total(found.live_bytes, (uint64_t)BLOCKS * BLOCK_SIZE / 2));
+
+    // Reallocated blocks move to the stack of realloc()
+    allocated = allocated && realloc_blocks();
+    bw_heap_profiler_stop();
+    TEST_ASSERT_TRUE(allocated);
+
+    find("calloc_blocks");
+    TEST_ASSERT_EQ_SIZE((size_t)found.live_allocs, 0L);
+    find("realloc_blocks");
+    TEST_ASSERT_TRUE(near_total(found.live_bytes, (uint64_t)BLOCKS * BLOCK_SIZE));
+
+    free_blocks();
+    find("realloc_blocks");
+    TEST_ASSERT_EQ_SIZE((size_t)found.live_allocs, 0L);
+})
+
+TEST(failed_realloc_keeps_sample, {
+    TEST_ASSERT_TRUE(bw_heap_profiler_start(&k_config));
+    bool allocated = malloc_blocks();
+    bw_heap_profiler_stop();
+    TEST_ASSERT_TRUE(allocated);
+
+    find("malloc_blocks");
+    uint64_t live_allocs = found.live_allocs;
+    uint64_t live_bytes = found.live_bytes;
+    TEST_ASSERT_TRUE(live_allocs > 0);
+
+    // The blocks stay allocated when realloc() fails, and so do their samples
+    volatile size_t too_large = SIZE_MAX / 2;
+    size_t failed = 0;
+    for (size_t i = 0; i < BLOCKS; ++i) {
+        failed += realloc(blocks[i], too_large) == NULL;
+    }
+    TEST_ASSERT_EQ_SIZE(failed, (size_t)BLOCKS);
+
+    find("malloc_blocks");
+    TEST_ASSERT_EQ_SIZE((size_t)found.live_allocs, (size_t)live_allocs);
+    TEST_ASSERT_EQ_SIZE((size_t)found.live_bytes, (size_t)live_bytes);
+
+    free_blocks();
+    find("malloc_blocks");
+    TEST_ASSERT_EQ_SIZE((size_t)found.live_allocs, 0L);
+})
+
+TEST(aligned_allocations, {
+    TEST_ASSERT_TRUE(bw_heap_profiler_start(&k_config));
+    bool allocated = aligned_blocks();
+    bw_heap_profiler_stop();
+    TEST_ASSERT_TRUE(allocated);
+
+    find("aligned_blocks");
+    TEST_ASSERT_TRUE(near_total(found.live_bytes, (uint64_t)BLOCKS * BLOCK_SIZE));
+
+    free_blocks();
+    find("aligned_blocks");
+    TEST_ASSERT_EQ_SIZE((size_t)found.live_allocs, 0L);
+
+    void* ptr = NULL;
+    int error = posix_memalign(&ptr, sizeof(void*) + 1, BLOCK_SIZE);
+    TEST_ASSERT_EQ_SIZE((size_t)error, (size_t)EINVAL);
+    TEST_ASSERT_TRUE(ptr == NULL);
+})
+
+void* churn_worker(void* arg) {
+    BW_UNUSED(arg);
+
+    void* kept[THREAD_KEPT] = {0};
+    for (size_t i = 0; i < THREAD_ITERATIONS; ++i) {
+        size_t slot = i % THREAD_KEPT;
+        free(kept[slot]);
+        kept[slot] = malloc((i % BLOCK_SIZE) + 1);
+    }
+    for (size_t i = 0; i < THREAD_KEPT; ++i) {
+        free(kept[i]);
+    }
+
+    return NULL;
+}
+
+TEST(concurrent_threads, {
+    bw_heap_profiler_stats_t before = {0};
+    bw_heap_profiler_get_stats(&before);
+
+    pthread_t threads[MAX_THREADS];
+    TEST_ASSERT_TRUE(bw_heap_profiler_start(&k_config));
+    for (int i = 0; i < MAX_THREADS; i++) {
+        TEST_ERROR_NONZERO(pthread_create(&threads[i], NULL, churn_worker, NULL));
+    }
+    for (int i = 0; i < MAX_THREADS; i++) {
+        TEST_ERROR_NONZERO(pthread_join(threads[i], NULL));
+    }
+    bw_heap_profiler_stop();
+
+    bw_heap_profiler_stats_t stats = {0};
+    bw_heap_profiler_get_stats(&stats);
+    TEST_ASSERT_TRUE(stats.samples > before.samples);
+    TEST_ASSERT_EQ_SIZE((size_t)stats.dropped, (size_t)before.dropped);
+
+    find("churn_worker");
+    TEST_ASSERT_EQ_SIZE((size_t)found.live_allocs, 0L);
+})
+
+static long now_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        return -1;
+    }
+
+    return (ts.tv_sec * 1000000000L) + ts.tv_nsec;
+}
+
+TEST(benchmark, {
+    // The default interval, as a profiled program would run
+    bw_heap_profiler_config_t config = {0};
+    TEST_ASSERT_TRUE(bw_heap_profiler_start(&config));
+
+    long start = now_ns();
+    for (size_t i = 0; i < BENCH_ITERATIONS; ++i) {
+        void* volatile ptr = malloc(BENCH_SIZE);
+        free(ptr);
+    }
+    long profiled = now_ns() - start;
+
+    start = now_ns();
+    for (size_t i = 0; i < BENCH_ITERATIONS; ++i) {
+        void* volatile ptr = __libc_malloc(BENCH_SIZE);
+        __libc_free(ptr);
+    }
+    long plain = now_ns() - start;
+
+    bw_heap_profiler_stop();
+
+    BW_UNUSED(fprintf(stderr,
+                      "\tmalloc+free: %.1f ns profiled, %.1f ns plain\n",
+                      (double)profiled / BENCH_ITERATIONS,
+                      (double)plain / BENCH_ITERATIONS));
+    TEST_ASSERT_TRUE(profiled > 0 && plain > 0);
+})
+
+TEST(invalid_config, {
+    TEST_ASSERT_FALSE(bw_heap_profiler_start(NULL));
+
+    bw_heap_profiler_stop(); // Stopping a stopped profiler is a no-op
+    bw_heap_profiler_dump(NULL, NULL);
+    bw_heap_profiler_get_stats(NULL);
+})
+
+int main(int argc, char** argv) {
+    TEST_INIT("heap_profiler", argc, argv);
+
+    TEST_RUN(attributes_live_bytes);
+    TEST_RUN(calloc_and_realloc);
+    TEST_RUN(failed_realloc_keeps_sample);
+    TEST_RUN(aligned_allocations);
+    TEST_RUN(concurrent_threads);
+    TEST_RUN(benchmark);
+    TEST_RUN(invalid_config);
+
+    TEST_EXIT();
+}
@@ -0,0 +1,141 @@
+#include <pthread.h>                // for pthread_create, pthread_join, pthread_t
+#include <stdbool.h>                // for bool, false, true
+#include <stddef.h>                 // for NULL, size_t
+#include <stdint.h>                 // for uintptr_t
+#include <stdio.h>                  // for fprintf, stderr
+#include <string.h>                 // for strcmp, strlen
+#include <time.h>                   // for clock_gettime, timespec, CLOCK_MONOTONIC
+
+#include "backwalk/backwalk.h"      // for bw_resolve_line, bw_capture
+
+#include "test.h"                   // for TEST, TEST_ASSERT_TRUE, TEST_RUN, TEST_ASSERT_...
+
+enum { LINE_THREADS = 4 };
+enum { LOOKUP_ITERATIONS = 100000 };
+enum { CAPTURE_FRAMES_MAX = 32 };
+
+static const char* const k_test_file = "line_test.c";
+
+static unsigned int call_line;
+
+__attribute__((noinline)) static uintptr_t return_address(void) {
+    return (uintptr_t)__builtin_return_address(0);
+}
+
+__attribute__((noinline)) static uintptr_t line_caller(void) {
+    call_line = __LINE__ + 1;
+    uintptr_t ip = return_address();
+
+    return ip;
+}
+
+static bool is_test_file(const char* file) {
+    size_t len = strlen(file);
+    size_t suffix_len = strlen(k_test_file);
+
+    return len >= suffix_len && strcmp(file + len - suffix_len, k_test_file) == 0;
+}
+
+TEST(resolve_call_site, {
+    uintptr_t ip = line_caller();
+
+    const char* file = NULL;
+    unsigned int line = 0;
+    TEST_ASSERT_TRUE(bw_resolve_line(ip, &file, &line));
+    TEST_ASSERT_NONNULL(file);
+    TEST_ASSERT_TRUE(is_test_file(file));
+    TEST_ASSERT_EQ_INT64((int64_t)line, (int64_t)call_line);
+})
+
+TEST(resolve_captured_frames, {
+    uintptr_t ips[CAPTURE_FRAMES_MAX];
+    size_t len = bw_capture(ips, CAPTURE_FRAMES_MAX, 0);
+    TEST_ASSERT_GE_SIZE(len, 1L);
+
+    const char* file = NULL;
+    unsigned int line = 0;
+    TEST_ASSERT_TRUE(bw_resolve_line(ips[0], &file, &line));
+    TEST_ASSERT_TRUE(is_test_file(file));
+    TEST_ASSERT_TRUE(line > 0);
+})
+
+TEST(repeated_lookup_is_cached, {
+    uintptr_t ip = line_caller();
+
+    const char* first = NULL;
+    const char* second = NULL;
+    unsigned int line = 0;
+    TEST_ASSERT_TRUE(bw_resolve_line(ip, &first, &line));
+    TEST_ASSERT_TRUE(bw_resolve_line(ip, &second, &line));
+    TEST_ASSERT_TRUE(first == second);
+
+    struct timespec start_time;
+    struct timespec end_time;
+    TEST_ERROR_NONZERO(clock_gettime(CLOCK_MONOTONIC, &start_time));
+
+    bool success = true;
+    for (int i = 0; i < LOOKUP_ITERATIONS; i++) {
+        success = bw_resolve_line(ip, &second, &line) && success;
+    }
+
+    TEST_ERROR_NONZERO(clock_gettime(CLOCK_MONOTONIC, &end_time));
+    TEST_ASSERT_TRUE(success);
+
+    long elapsed_ns = ((end_time.tv_sec - start_time.tv_sec) * 1000000000L) +
+                      (end_time.tv_nsec - start_time.tv_nsec);
+    fprintf(stderr, "bw_resolve_line: %ld ns per cached lookup\n", elapsed_ns / LOOKUP_ITERATIONS);
+})
+
+TEST(unknown_address, {
+    const char* file = NULL;
+    unsigned int line = 0;
+    TEST_ASSERT_FALSE(bw_resolve_line(0, &file, &line));
+    TEST_ASSERT_FALSE(bw_resolve_line(line_caller(), NULL, &line));
+})
+
+typedef struct {
+    uintptr_t ip;
+    const char* file;
+    unsigned int line;
+    bool success;
+} thread_data_t;
+
+static void* resolve_thread(void* arg) {
+    thread_data_t* data = (thread_data_t*)arg;
+    data->success = bw_resolve_line(data->ip, &data->file, &data->line);
+
+    return NULL;
+}
+
+// Every thread races to decode the same line program
+TEST(concurrent_first_lookup, {
+    uintptr_t ip = line_caller();
+
+    pthread_t threads[LINE_THREADS];
+    thread_data_t thread_data[LINE_THREADS];
+    for (int i = 0; i < LINE_THREADS; i++) {
+        thread_data[i].ip = ip;
+        thread_data[i].success = false;
+        TEST_ERROR_NONZERO(pthread_create(&threads[i], NULL, resolve_thread, &thread_data[i]));
+    }
+
+    for (int i = 0; i < LINE_THREADS; i++) {
+        TEST_ERROR_NONZERO(pthread_join(threads[i], NULL));
+        TEST_ASSERT_TRUE(thread_data[i].success);
+        TEST_ASSERT_TRUE(thread_data[i].file == thread_data[0].file);
+        TEST_ASSERT_TRUE(thread_data[i].line == call_line);
+    }
+})
+
+int main(int argc, char** argv) {
+    TEST_INIT("line", argc, argv);
+
+    // Runs first, so that the line table is still cold
+    TEST_RUN(concurrent_first_lookup);
+    TEST_RUN(resolve_call_site);
+    TEST_RUN(resolve_captured_frames);
+    TEST_RUN(repeated_lookup_is_cached);
+    TEST_RUN(unknown_address);
+
+    TEST_EXIT();
+}
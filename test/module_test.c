@@ -0,0 +1,222 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include <dlfcn.h>              // for dladdr, dlclose, dlopen, dlsym, Dl_info, RTLD_...
+#include <pthread.h>            // for pthread_create, pthread_join, pthread_t
+#include <stdatomic.h>          // for atomic_bool, atomic_load, atomic_store
+#include <stdbool.h>            // for bool, false, true
+#include <stddef.h>             // for NULL, size_t
+#include <stdint.h>             // for uintptr_t
+#include <string.h>             // for strcmp, strlen, strstr
+
+#include "backwalk/backwalk.h"  // for bw_module_t, bw_build_id_hex, bw_module_find, bw_mod...
+#include "common.h"             // for BW_UNUSED
+#include "module.h"             // for module_lookup, module_map_get, module_map_sync
+
+#include "test.h"               // for TEST, TEST_ASSERT_TRUE, TEST_ASSERT_NONNULL
+
+enum { LOOKUP_THREADS = 4 };
+enum { DLOPEN_ITERATIONS = 50 };
+enum { BUILD_ID_HEX_MAX = (BW_BUILD_ID_MAX * 2) + 1 };
+
+static const char* const k_lib_name = "libm.so.6";
+
+__attribute__((noinline)) uintptr_t local_function_addr(void) {
+    return (uintptr_t)local_function_addr;
+}
+
+static test_result_t check_against_dladdr(const module_map_t* map, uintptr_t addr) {
+    Dl_info info;
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    TEST_ASSERT_TRUE(dladdr((const void*)addr, &info) != 0);
+
+    const module_t* mod = module_lookup(map, addr);
+    TEST_ASSERT_NONNULL(mod);
+    TEST_ASSERT_TRUE(mod->base == (uintptr_t)info.dli_fbase);
+    TEST_ASSERT_TRUE(strcmp(mod->path, info.dli_fname) == 0);
+    TEST_ASSERT_TRUE(addr >= mod->base && addr < mod->end);
+
+    TEST_OK();
+}
+
+TEST(lookup_matches_dladdr, {
+    TEST_ASSERT_TRUE(module_map_sync());
+    const module_map_t* map = module_map_get();
+    TEST_ASSERT_NONNULL(map);
+    TEST_ASSERT_GE_SIZE(map->len, 2L);
+
+    TEST_ASSERT_TRUE(check_against_dladdr(map, local_function_addr()) == TEST_RESULT_OK);
+    TEST_ASSERT_TRUE(check_against_dladdr(map, (uintptr_t)dlsym(RTLD_DEFAULT, "strcmp")) ==
+                     TEST_RESULT_OK);
+})
+
+TEST(modules_sorted, {
+    TEST_ASSERT_TRUE(module_map_sync());
+    const module_map_t* map = module_map_get();
+    TEST_ASSERT_NONNULL(map);
+
+    for (size_t i = 1; i < map->len; ++i) {
+        TEST_ASSERT_TRUE(map->mods[i - 1]->end <= map->mods[i]->base);
+    }
+})
+
+TEST(unmapped_address, {
+    TEST_ASSERT_TRUE(module_map_sync());
+    const module_map_t* map = module_map_get();
+
+    TEST_ASSERT_TRUE(module_lookup(map, 0) == NULL);
+    TEST_ASSERT_TRUE(module_lookup(NULL, local_function_addr()) == NULL);
+})
+
+TEST(sync_reuses_snapshot, {
+    TEST_ASSERT_TRUE(module_map_sync());
+    const module_map_t* first = module_map_get();
+    TEST_ASSERT_TRUE(module_map_sync());
+    const module_map_t* second = module_map_get();
+
+    TEST_ASSERT_TRUE(first == second);
+})
+
+TEST(dlopen_refreshes_map, {
+    TEST_ASSERT_TRUE(module_map_sync());
+    const module_map_t* before = module_map_get();
+
+    void* handle = dlopen(k_lib_name, RTLD_NOW | RTLD_LOCAL);
+    TEST_ASSERT_NONNULL(handle);
+    void* sym = dlsym(handle, "cos");
+    TEST_ASSERT_NONNULL(sym);
+
+    TEST_ASSERT_TRUE(module_map_sync());
+    const module_map_t* after = module_map_get();
+    TEST_ASSERT_TRUE(before != after);
+
+    const module_t* mod = module_lookup(after, (uintptr_t)sym);
+    TEST_ASSERT_NONNULL(mod);
+    TEST_ASSERT_NONNULL(strstr(mod->path, "libm"));
+
+    TEST_ERROR_NONZERO(dlclose(handle));
+    TEST_ASSERT_TRUE(module_map_sync());
+    TEST_ASSERT_TRUE(module_map_get() != after);
+})
+
+typedef struct {
+    atomic_bool* stop;
+    size_t lookups;
+    bool success;
+} lookup_thread_data_t;
+
+void* lookup_thread_func(void* arg) {
+    lookup_thread_data_t* data = arg;
+    uintptr_t addr = local_function_addr();
+
+    data->success = true;
+    while (!atomic_load(data->stop)) {
+        const module_t* mod = module_lookup(module_map_get(), addr);
+        if (!mod || addr >= mod->end) {
+            data->success = false;
+            break;
+        }
+        data->lookups++;
+    }
+
+    return NULL;
+}
+
+TEST(concurrent_lookup_during_reload, {
+    pthread_t threads[LOOKUP_THREADS];
+    lookup_thread_data_t thread_data[LOOKUP_THREADS];
+    atomic_bool stop = false;
+
+    TEST_ASSERT_TRUE(module_map_sync());
+
+    for (int i = 0; i < LOOKUP_THREADS; i++) {
+        thread_data[i].stop = &stop;
+        thread_data[i].lookups = 0;
+        thread_data[i].success = false;
+        TEST_ERROR_NONZERO(pthread_create(&threads[i], NULL, lookup_thread_func, &thread_data[i]));
+    }
+
+    bool reloaded = true;
+    for (int i = 0; i < DLOPEN_ITERATIONS; i++) {
+        void* handle = dlopen(k_lib_name, RTLD_NOW | RTLD_LOCAL);
+        reloaded = reloaded && handle != NULL && module_map_sync();
+        if (handle) {
+            BW_UNUSED(dlclose(handle));
+        }
+        reloaded = reloaded && module_map_sync();
+    }
+
+    atomic_store(&stop, true);
+    for (int i = 0; i < LOOKUP_THREADS; i++) {
+        TEST_ERROR_NONZERO(pthread_join(threads[i], NULL));
+        TEST_ASSERT_TRUE(thread_data[i].success);
+    }
+
+    TEST_ASSERT_TRUE(reloaded);
+})
+
+TEST(module_find_reports_metadata, {
+    uintptr_t addr = local_function_addr();
+    bw_module_t mod;
+    TEST_ASSERT_TRUE(bw_module_find(addr, &mod));
+
+    Dl_info info;
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    TEST_ASSERT_TRUE(dladdr((const void*)addr, &info) != 0);
+    TEST_ASSERT_TRUE(mod.base == (uintptr_t)info.dli_fbase);
+    TEST_ASSERT_TRUE(strcmp(mod.path, info.dli_fname) == 0);
+    TEST_ASSERT_TRUE(addr >= mod.text_start && addr < mod.text_end);
+    TEST_ASSERT_TRUE(mod.text_start >= mod.base && mod.text_end <= mod.end);
+
+    // GNU ld emits a 20 byte build ID by default
+    char hex[BUILD_ID_HEX_MAX];
+    TEST_ASSERT_EQ_SIZE(mod.build_id_len, 20L);
+    TEST_ASSERT_EQ_SIZE(bw_build_id_hex(&mod, hex, sizeof(hex)), 40L);
+    TEST_ASSERT_EQ_SIZE(strlen(hex), 40L);
+    TEST_ASSERT_EQ_SIZE(bw_build_id_hex(&mod, hex, 40), 0L);
+
+    TEST_ASSERT_FALSE(bw_module_find(0, &mod));
+    TEST_ASSERT_FALSE(bw_module_find(addr, NULL));
+})
+
+typedef struct {
+    size_t count;
+    uintptr_t last_base;
+    bool sorted;
+    bool found_self;
+} modules_seen_t;
+
+static bool count_module(const bw_module_t* mod, void* arg) {
+    modules_seen_t* seen = arg;
+    seen->sorted = seen->sorted && mod->base >= seen->last_base;
+    seen->last_base = mod->base;
+    seen->found_self = seen->found_self || (local_function_addr() >= mod->text_start &&
+                                            local_function_addr() < mod->text_end);
+    seen->count++;
+
+    return true;
+}
+
+TEST(modules_lists_loaded_modules, {
+    modules_seen_t seen = {0};
+    seen.sorted = true;
+    TEST_ASSERT_TRUE(bw_modules(count_module, &seen));
+    TEST_ASSERT_TRUE(seen.sorted);
+    TEST_ASSERT_TRUE(seen.found_self);
+    TEST_ASSERT_EQ_SIZE(seen.count, module_map_get()->len);
+    TEST_ASSERT_FALSE(bw_modules(NULL, NULL));
+})
+
+int main(int argc, char** argv) {
+    TEST_INIT("module", argc, argv);
+
+    TEST_RUN(lookup_matches_dladdr);
+    TEST_RUN(modules_sorted);
+    TEST_RUN(unmapped_address);
+    TEST_RUN(sync_reuses_snapshot);
+    TEST_RUN(dlopen_refreshes_map);
+    TEST_RUN(concurrent_lookup_during_reload);
+    TEST_RUN(module_find_reports_metadata);
+    TEST_RUN(modules_lists_loaded_modules);
+
+    TEST_EXIT();
+}
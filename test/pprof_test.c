@@ -0,0 +1,344 @@
+#include <stdbool.h>            // for bool, false, true
+#include <stddef.h>             // for size_t, NULL
+#include <stdint.h>             // for uint64_t, uintptr_t, int64_t
+#include <stdio.h>              // for fprintf, stderr
+#include <stdlib.h>             // for free, malloc, mkstemp
+#include <string.h>             // for memcmp, strlen, strncmp
+#include <sys/stat.h>           // for fstat, stat
+#include <sys/types.h>          // for ssize_t
+#include <time.h>               // for clock_gettime, timespec, CLOCK_MONOTONIC
+#include <unistd.h>             // for close, pread, unlink
+
+#include "backwalk/backwalk.h"  // for bw_capture
+#include "backwalk/pprof.h"     // for bw_pprof_add_sample, bw_pprof_close, bw_pprof_create
+#include "common.h"             // for BW_UNUSED, BW_ARRAY_LEN
+
+#include "test.h"               // for TEST, TEST_ASSERT_TRUE, TEST_RUN, TEST_ASSERT_EQ_SIZE
+
+enum { MAX_FRAMES = 32 };
+enum { MAX_STRINGS = 4096 };
+enum { BENCH_SAMPLES = 1000000 };
+enum { BENCH_STACKS = 1024 };
+enum { BENCH_DEPTH = 16 };
+
+#define VARINT_BITS 7
+#define VARINT_MASK 0x7fU
+#define VARINT_MORE 0x80U
+#define WIRE_TYPE_BITS 3
+#define WIRE_TYPE_MASK 7U
+
+static const int64_t k_values[] = {1, 1000000};
+
+static const bw_pprof_value_type_t k_sample_types[] = {
+    {"samples", "count"},
+    {"cpu", "nanoseconds"},
+};
+
+// Just enough of a protobuf decoder to check the profile
+typedef struct {
+    const unsigned char* data;
+    size_t len;
+    size_t pos;
+} reader_t;
+
+typedef struct {
+    size_t samples;
+    size_t sample_types;
+    size_t mappings;
+    size_t locations;
+    size_t functions;
+    size_t strings;
+    const char* string_ptrs[MAX_STRINGS];
+    size_t string_lens[MAX_STRINGS];
+    int64_t value_sum;
+} decoded_t;
+
+static decoded_t decoded;
+
+static bool read_varint(reader_t* r, uint64_t* value) {
+    *value = 0;
+    for (unsigned shift = 0; r->pos < r->len && shift < 64; shift += VARINT_BITS) {
+        unsigned char byte = r->data[r->pos++];
+        *value |= (uint64_t)(byte & VARINT_MASK) << shift;
+        if (!(byte & VARINT_MORE)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Reads a tag and, for length-delimited fields, the contents into `sub`
+static bool read_field(reader_t* r, uint64_t* field, uint64_t* value, reader_t* sub) {
+    uint64_t key = 0;
+    if (!read_varint(r, &key) || !read_varint(r, value)) {
+        return false;
+    }
+
+    *field = key >> WIRE_TYPE_BITS;
+    if ((key & WIRE_TYPE_MASK) == 2) {
+        if (*value > r->len - r->pos) {
+            return false;
+        }
+        sub->data = r->data + r->pos;
+        sub->len = *value;
+        sub->pos = 0;
+        r->pos += *value;
+    }
+
+    return true;
+}
+
+static bool decode_sample(reader_t* r) {
+    uint64_t field = 0;
+    uint64_t value = 0;
+    reader_t sub = {0};
+    while (r->pos < r->len) {
+        if (!read_field(r, &field, &value, &sub)) {
+            return false;
+        }
+        // Packed values
+        while (field == 2 && sub.pos < sub.len) {
+            if (!read_varint(&sub, &value)) {
+                return false;
+            }
+            decoded.value_sum += (int64_t)value;
+        }
+    }
+
+    return true;
+}
+
+static bool decode(const unsigned char* data, size_t len) {
+    reader_t r = {data, len, 0};
+    decoded_t empty = {0};
+    decoded = empty;
+
+    uint64_t field = 0;
+    uint64_t value = 0;
+    reader_t sub = {0};
+    while (r.pos < r.len) {
+        if (!read_field(&r, &field, &value, &sub)) {
+            return false;
+        }
+
+        switch (field) {
+        case 1:
+            decoded.sample_types++;
+            break;
+        case 2:
+            decoded.samples++;
+            if (!decode_sample(&sub)) {
+                return false;
+            }
+            break;
+        case 3:
+            decoded.mappings++;
+            break;
+        case 4:
+            decoded.locations++;
+            break;
+        case 5:
+            decoded.functions++;
+            break;
+        case 6:
+            if (decoded.strings < MAX_STRINGS) {
+                decoded.string_ptrs[decoded.strings] = (const char*)sub.data;
+                decoded.string_lens[decoded.strings] = sub.len;
+            }
+            decoded.strings++;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return true;
+}
+
+static bool has_string(const char* str) {
+    size_t len = strlen(str);
+    for (size_t i = 0; i < decoded.strings && i < MAX_STRINGS; ++i) {
+        if (decoded.string_lens[i] == len && strncmp(decoded.string_ptrs[i], str, len) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Reads the whole file, which the caller frees
+static unsigned char* read_all(int fd, size_t* len) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return NULL;
+    }
+
+    *len = (size_t)st.st_size;
+    unsigned char* data = malloc(*len + 1);
+    if (data && pread(fd, data, *len, 0) != (ssize_t)*len) {
+        free(data);
+        return NULL;
+    }
+
+    return data;
+}
+
+static int open_temp(void) {
+    char path[] = "/tmp/backwalk_pprof_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0) {
+        BW_UNUSED(unlink(path));
+    }
+
+    return fd;
+}
+
+static bw_pprof_config_t make_config(bool symbolize) {
+    bw_pprof_config_t config = {0};
+    config.sample_types = k_sample_types;
+    config.sample_types_len = BW_ARRAY_LEN(k_sample_types);
+    config.period_type.type = "cpu";
+    config.period_type.unit = "nanoseconds";
+    config.period = 1000000;
+    config.symbolize = symbolize;
+
+    return config;
+}
+
+__attribute__((noinline)) size_t profiled_function(uintptr_t* ips) {
+    return bw_capture(ips, MAX_FRAMES, 0);
+}
+
+static bool write_profile(int fd, bool symbolize) {
+    bw_pprof_config_t config = make_config(symbolize);
+    bw_pprof_t* pprof = bw_pprof_create(fd, &config);
+    if (!pprof) {
+        return false;
+    }
+
+    uintptr_t ips[MAX_FRAMES];
+    size_t len = profiled_function(ips);
+
+    // The same stack twice shares its locations
+    bool success = len > 0 && bw_pprof_add_sample(pprof, ips, len, k_values) &&
+                   bw_pprof_add_sample(pprof, ips, len, k_values) &&
+                   bw_pprof_add_sample(pprof, ips, 1, k_values);
+
+    return bw_pprof_close(pprof) && success;
+}
+
+static test_result_t check_profile(bool symbolize) {
+    int fd = open_temp();
+    TEST_ASSERT_TRUE(fd >= 0);
+    bool written = write_profile(fd, symbolize);
+
+    size_t len = 0;
+    unsigned char* data = read_all(fd, &len);
+    BW_UNUSED(close(fd));
+    TEST_ASSERT_TRUE(written);
+    TEST_ASSERT_NONNULL(data);
+
+    bool valid = decode(data, len);
+    bool has_types = has_string("samples") && has_string("count") && has_string("cpu") &&
+                     has_string("nanoseconds");
+    bool has_function = has_string("profiled_function");
+    free(data);
+
+    TEST_ASSERT_TRUE(valid);
+    TEST_ASSERT_EQ_SIZE(decoded.sample_types, 2L);
+    TEST_ASSERT_EQ_SIZE(decoded.samples, 3L);
+    TEST_ASSERT_TRUE(decoded.value_sum == 3 * (k_values[0] + k_values[1]));
+    TEST_ASSERT_TRUE(decoded.locations > 1 && decoded.locations <= MAX_FRAMES);
+    TEST_ASSERT_GE_SIZE(decoded.mappings, 1L);
+    TEST_ASSERT_TRUE(has_types);
+    TEST_ASSERT_TRUE(has_function == symbolize);
+    if (symbolize) {
+        TEST_ASSERT_GE_SIZE(decoded.functions, 1L);
+    } else {
+        TEST_ASSERT_EQ_SIZE(decoded.functions, 0L);
+    }
+
+    TEST_OK();
+}
+
+TEST(symbolized_profile, { TEST_ASSERT_TRUE(check_profile(true) == TEST_RESULT_OK); })
+
+TEST(unsymbolized_profile, {
+    TEST_ASSERT_TRUE(check_profile(false) == TEST_RESULT_OK);
+    // Build IDs are hex strings of 20 bytes with GNU ld's default --build-id
+    bool found_build_id = false;
+    for (size_t i = 0; i < decoded.strings && i < MAX_STRINGS; ++i) {
+        found_build_id = found_build_id || decoded.string_lens[i] == 40;
+    }
+    TEST_ASSERT_TRUE(found_build_id);
+})
+
+TEST(invalid_arguments, {
+    bw_pprof_config_t config = make_config(false);
+    config.sample_types_len = 0;
+    TEST_ASSERT_TRUE(bw_pprof_create(1, &config) == NULL);
+    config.sample_types_len = BW_PPROF_VALUES_MAX + 1;
+    TEST_ASSERT_TRUE(bw_pprof_create(1, &config) == NULL);
+    TEST_ASSERT_TRUE(bw_pprof_create(-1, NULL) == NULL);
+    TEST_ASSERT_FALSE(bw_pprof_add_sample(NULL, NULL, 0, NULL));
+    TEST_ASSERT_FALSE(bw_pprof_close(NULL));
+})
+
+static long now_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        return -1;
+    }
+
+    return (ts.tv_sec * 1000000000L) + ts.tv_nsec;
+}
+
+static uintptr_t bench_ips[BENCH_STACKS][BENCH_DEPTH];
+
+TEST(benchmark, {
+    // Stacks share their outer frames, like those of a real program
+    for (size_t i = 0; i < BENCH_STACKS; ++i) {
+        for (size_t j = 0; j < BENCH_DEPTH; ++j) {
+            bench_ips[i][j] = 0x400000 + (j < BENCH_DEPTH / 2 ? i * 64 + j : j);
+        }
+    }
+
+    int fd = open_temp();
+    TEST_ASSERT_TRUE(fd >= 0);
+    bw_pprof_config_t config = make_config(false);
+    bw_pprof_t* pprof = bw_pprof_create(fd, &config);
+    TEST_ASSERT_NONNULL(pprof);
+
+    bool success = true;
+    long start = now_ns();
+    for (size_t i = 0; i < BENCH_SAMPLES; ++i) {
+        success = bw_pprof_add_sample(pprof, bench_ips[i % BENCH_STACKS], BENCH_DEPTH, k_values) &&
+                  success;
+    }
+    success = bw_pprof_close(pprof) && success;
+    long elapsed = now_ns() - start;
+
+    struct stat st;
+    bool stat_ok = fstat(fd, &st) == 0;
+    BW_UNUSED(close(fd));
+
+    TEST_ASSERT_TRUE(success && stat_ok);
+    BW_UNUSED(fprintf(stderr,
+                      "\t%d samples of %d frames: %.1f ns/sample, %jd bytes\n",
+                      BENCH_SAMPLES,
+                      BENCH_DEPTH,
+                      (double)elapsed / BENCH_SAMPLES,
+                      (intmax_t)st.st_size));
+})
+
+int main(int argc, char** argv) {
+    TEST_INIT("pprof", argc, argv);
+
+    TEST_RUN(symbolized_profile);
+    TEST_RUN(unsymbolized_profile);
+    TEST_RUN(invalid_arguments);
+    TEST_RUN(benchmark);
+
+    TEST_EXIT();
+}
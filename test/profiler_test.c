@@ -0,0 +1,283 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include <dlfcn.h>              // for dladdr, Dl_info
+#include <pthread.h>            // for pthread_create, pthread_join, pthread_t
+#include <stdatomic.h>          // for atomic_fetch_add, atomic_load, atomic_size_t, atomic...
+#include <stdbool.h>            // for bool, false, true
+#include <stddef.h>             // for size_t, NULL
+#include <stdint.h>             // for uintptr_t, uint64_t
+#include <stdio.h>              // for fprintf, stderr
+#include <string.h>             // for strcmp
+#include <time.h>               // for clock_gettime, timespec, CLOCK_THREAD_CPUTIME_ID
+#include <unistd.h>             // for gettid
+
+#include "common.h"             // for BW_UNUSED
+#include "backwalk/profiler.h"  // for bw_profiler_start, bw_profiler_stop, bw_profiler_...
+
+#include "test.h"               // for TEST, TEST_ASSERT_TRUE, TEST_ERROR_NONZERO, TEST_RUN
+
+enum { MAX_THREADS = 4 };
+enum { PROFILER_TEST_FREQUENCY_HZ = 1000 };
+// CPU time spun between checks for a dropped sample, and before giving up
+#define DROP_SPIN_NS (10L * 1000 * 1000)
+#define DROP_DEADLINE_NS (10L * 1000 * 1000 * 1000)
+
+typedef struct {
+    atomic_size_t samples;
+    atomic_size_t frames;
+    atomic_bool found_busy_spin;
+} collected_t;
+
+static void collect_sample(int tid, const uintptr_t* ips, size_t len, void* arg) {
+    BW_UNUSED(tid);
+
+    collected_t* collected = arg;
+    atomic_fetch_add(&collected->samples, 1);
+    atomic_fetch_add(&collected->frames, len);
+
+    for (size_t i = 0; i < len; ++i) {
+        Dl_info info;
+        // NOLINTNEXTLINE(performance-no-int-to-ptr)
+        if (dladdr((const void*)ips[i], &info) && info.dli_sname &&
+            strcmp(info.dli_sname, "busy_spin") == 0) {
+            atomic_store(&collected->found_busy_spin, true);
+        }
+    }
+}
+
+static long thread_cpu_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return -1;
+    }
+
+    return (ts.tv_sec * 1000000000L) + ts.tv_nsec;
+}
+
+__attribute__((noinline)) bool busy_spin(long cpu_ns) {
+    long start = thread_cpu_ns();
+    volatile uint64_t sink = 0;
+
+    while (start >= 0 && thread_cpu_ns() - start < cpu_ns) {
+        for (int i = 0; i < 1000; i++) {
+            sink = sink + (uint64_t)i;
+        }
+    }
+
+    return start >= 0;
+}
+
+typedef struct {
+    long cpu_ns;
+    bool unregister;
+    bool success;
+} worker_data_t;
+
+void* profiled_worker(void* arg) {
+    worker_data_t* data = arg;
+
+    data->success = bw_profiler_register_thread() && busy_spin(data->cpu_ns);
+    if (data->unregister) {
+        bw_profiler_unregister_thread();
+    }
+
+    return NULL;
+}
+
+static test_result_t run_workers(int num_threads, long cpu_ns) {
+    pthread_t threads[MAX_THREADS];
+    worker_data_t worker_data[MAX_THREADS];
+
+    for (int i = 0; i < num_threads; i++) {
+        worker_data[i].cpu_ns = cpu_ns;
+        // Half of the threads rely on the thread-exit hook to unregister
+        worker_data[i].unregister = i % 2 == 0;
+        worker_data[i].success = false;
+        TEST_ERROR_NONZERO(pthread_create(&threads[i], NULL, profiled_worker, &worker_data[i]));
+    }
+
+    for (int i = 0; i < num_threads; i++) {
+        TEST_ERROR_NONZERO(pthread_join(threads[i], NULL));
+        TEST_ASSERT_TRUE(worker_data[i].success);
+    }
+
+    TEST_OK();
+}
+
+TEST(samples_busy_threads, {
+    const long cpu_ns = 200L * 1000 * 1000;
+    collected_t collected = {0};
+    bw_profiler_config_t config = {0};
+    config.frequency_hz = PROFILER_TEST_FREQUENCY_HZ;
+    config.cb = collect_sample;
+    config.arg = &collected;
+
+    TEST_ASSERT_TRUE(bw_profiler_start(&config));
+    TEST_ASSERT_FALSE(bw_profiler_start(&config)); // Already running
+    test_result_t result = run_workers(MAX_THREADS, cpu_ns);
+    bw_profiler_stop();
+
+    TEST_ASSERT_TRUE(result == TEST_RESULT_OK);
+
+    bw_profiler_stats_t stats = {0};
+    bw_profiler_get_stats(&stats);
+    BW_UNUSED(fprintf(stderr,
+                      "\tsamples: %ju, dropped: %ju, overhead: %ju ns/sample\n",
+                      (uintmax_t)stats.samples,
+                      (uintmax_t)stats.dropped,
+                      (uintmax_t)stats.overhead_ns_per_sample));
+
+    TEST_ASSERT_TRUE(stats.frequency_hz == PROFILER_TEST_FREQUENCY_HZ);
+    TEST_ASSERT_EQ_SIZE(stats.threads, 0L);
+    // CPU-time timers expire on scheduler ticks, so 800ms of CPU yields at least 80 samples at
+    // HZ=100 no matter the requested rate
+    TEST_ASSERT_GE_SIZE((size_t)stats.samples, 40L);
+    TEST_ASSERT_EQ_SIZE(atomic_load(&collected.samples), (size_t)stats.samples);
+    TEST_ASSERT_GE_SIZE(atomic_load(&collected.frames), atomic_load(&collected.samples));
+    TEST_ASSERT_TRUE(stats.overhead_ns_per_sample > 0);
+    TEST_ASSERT_TRUE(atomic_load(&collected.found_busy_spin));
+})
+
+typedef struct {
+    uint64_t dropped_before;
+    bool dropped;
+    bool success;
+} drop_worker_data_t;
+
+// Spins until a sample is dropped rather than for a fixed time, since samples are only taken as
+// the thread is scheduled
+void* drop_worker(void* arg) {
+    drop_worker_data_t* data = arg;
+
+    data->success = bw_profiler_register_thread();
+    for (long spun = 0; data->success && !data->dropped && spun < DROP_DEADLINE_NS;
+         spun += DROP_SPIN_NS) {
+        data->success = busy_spin(DROP_SPIN_NS);
+
+        bw_profiler_stats_t stats = {0};
+        bw_profiler_get_stats(&stats);
+        data->dropped = stats.dropped > data->dropped_before;
+    }
+    bw_profiler_unregister_thread();
+
+    return NULL;
+}
+
+TEST(counts_dropped_samples, {
+    collected_t collected = {0};
+    bw_profiler_stats_t before = {0};
+    bw_profiler_get_stats(&before);
+
+    // A single slot drained once per second overflows at 1kHz
+    bw_profiler_config_t config = {0};
+    config.frequency_hz = PROFILER_TEST_FREQUENCY_HZ;
+    config.ring_capacity = 1;
+    config.drain_interval_ms = 1000;
+    config.cb = collect_sample;
+    config.arg = &collected;
+
+    drop_worker_data_t data = {0};
+    data.dropped_before = before.dropped;
+    pthread_t thread;
+    TEST_ASSERT_TRUE(bw_profiler_start(&config));
+    int error = pthread_create(&thread, NULL, drop_worker, &data);
+    if (error == 0) {
+        error = pthread_join(thread, NULL);
+    }
+    bw_profiler_stop();
+
+    TEST_ERROR_NONZERO(error);
+    TEST_ASSERT_TRUE(data.success);
+    TEST_ASSERT_TRUE(data.dropped);
+
+    bw_profiler_stats_t stats = {0};
+    bw_profiler_get_stats(&stats);
+    TEST_ASSERT_TRUE(stats.dropped > before.dropped);
+    TEST_ASSERT_EQ_SIZE(atomic_load(&collected.samples), (size_t)(stats.samples - before.samples));
+})
+
+TEST(register_before_start, {
+    collected_t collected = {0};
+    bw_profiler_config_t config = {0};
+    config.frequency_hz = PROFILER_TEST_FREQUENCY_HZ;
+    config.cb = collect_sample;
+    config.arg = &collected;
+
+    TEST_ASSERT_TRUE(bw_profiler_register_thread());
+    TEST_ASSERT_TRUE(bw_profiler_register_thread()); // Registering twice is a no-op
+
+    TEST_ASSERT_TRUE(bw_profiler_start(&config));
+    bool spun = busy_spin(50L * 1000 * 1000);
+    bw_profiler_stop();
+
+    bw_profiler_unregister_thread();
+    bw_profiler_unregister_thread();
+
+    TEST_ASSERT_TRUE(spun);
+    TEST_ASSERT_GE_SIZE(atomic_load(&collected.samples), 1L);
+    TEST_ASSERT_TRUE(atomic_load(&collected.found_busy_spin));
+})
+
+typedef struct {
+    atomic_size_t samples;
+    atomic_size_t on_sampled_thread;
+} collector_checks_t;
+
+// Takes the profiler's lock, which would deadlock if callbacks ran with it held
+static void check_collector_sample(int tid, const uintptr_t* ips, size_t len, void* arg) {
+    BW_UNUSED(ips);
+    BW_UNUSED(len);
+
+    collector_checks_t* checks = arg;
+    atomic_fetch_add(&checks->samples, 1);
+    if (gettid() == tid) {
+        atomic_fetch_add(&checks->on_sampled_thread, 1);
+    }
+
+    bw_profiler_stats_t stats = {0};
+    bw_profiler_get_stats(&stats);
+}
+
+TEST(callbacks_on_collector, {
+    const long cpu_ns = 100L * 1000 * 1000;
+    collector_checks_t checks = {0};
+    bw_profiler_stats_t before = {0};
+    bw_profiler_get_stats(&before);
+
+    // Samples are still buffered when the workers unregister or exit
+    bw_profiler_config_t config = {0};
+    config.frequency_hz = PROFILER_TEST_FREQUENCY_HZ;
+    config.drain_interval_ms = 1000;
+    config.cb = check_collector_sample;
+    config.arg = &checks;
+
+    TEST_ASSERT_TRUE(bw_profiler_start(&config));
+    test_result_t result = run_workers(2, cpu_ns);
+    bw_profiler_stop();
+
+    TEST_ASSERT_TRUE(result == TEST_RESULT_OK);
+
+    bw_profiler_stats_t stats = {0};
+    bw_profiler_get_stats(&stats);
+    TEST_ASSERT_GE_SIZE(atomic_load(&checks.samples), 1L);
+    TEST_ASSERT_EQ_SIZE(atomic_load(&checks.samples), (size_t)(stats.samples - before.samples));
+    TEST_ASSERT_EQ_SIZE(atomic_load(&checks.on_sampled_thread), 0L);
+})
+
+TEST(invalid_config, {
+    TEST_ASSERT_FALSE(bw_profiler_start(NULL));
+
+    bw_profiler_stop(); // Stopping a stopped profiler is a no-op
+})
+
+int main(int argc, char** argv) {
+    TEST_INIT("profiler", argc, argv);
+
+    TEST_RUN(samples_busy_threads);
+    TEST_RUN(counts_dropped_samples);
+    TEST_RUN(register_before_start);
+    TEST_RUN(callbacks_on_collector);
+    TEST_RUN(invalid_config);
+
+    TEST_EXIT();
+}
@@ -0,0 +1,271 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include <dlfcn.h>              // for dladdr, Dl_info
+#include <pthread.h>            // for pthread_create, pthread_join, pthread_kill, pthread_t
+#include <sched.h>              // for sched_yield
+#include <signal.h>             // for sigaction, sigemptyset, SA_RESTART, SA_SIGINFO, SIGPROF
+#include <stdatomic.h>          // for atomic_fetch_add, atomic_load, atomic_store, atomic_...
+#include <stdbool.h>            // for bool, false, true
+#include <stddef.h>             // for size_t, NULL
+#include <stdint.h>             // for uintptr_t
+#include <string.h>             // for strcmp
+#include <unistd.h>             // for alarm, usleep
+
+#include "common.h"             // for BW_UNUSED, BW_ARRAY_LEN
+#include "backwalk/backwalk.h"  // for bw_backtrace_signal_safe, bw_frame_t, bw_backtrace_fro...
+
+#include "test.h"               // for TEST, TEST_ASSERT_TRUE, TEST_ERROR_NONZERO, TEST_RUN
+
+enum { MAX_THREADS = 8 };
+enum { SIGNAL_FRAMES_MAX = 64 };
+enum { SIGNALS_PER_THREAD = 500 };
+enum { DEADLOCK_TIMEOUT_SECS = 60 };
+
+typedef struct {
+    atomic_size_t samples;
+    atomic_size_t frames;
+    atomic_size_t empty_samples;
+    atomic_size_t resolved_frames;
+} signal_stats_t;
+
+static signal_stats_t signal_stats;
+
+static void sample_handler(int sig, siginfo_t* info, void* ucontext) {
+    BW_UNUSED(sig);
+    BW_UNUSED(info);
+    BW_UNUSED(ucontext);
+
+    bw_frame_t frames[SIGNAL_FRAMES_MAX];
+    size_t len = bw_backtrace_signal_safe(frames, BW_ARRAY_LEN(frames));
+
+    size_t resolved = 0;
+    for (size_t i = 0; i < len; ++i) {
+        resolved += frames[i].addr != 0 ? 1 : 0;
+    }
+
+    atomic_fetch_add(&signal_stats.samples, 1);
+    atomic_fetch_add(&signal_stats.frames, len);
+    atomic_fetch_add(&signal_stats.resolved_frames, resolved);
+    if (len == 0) {
+        atomic_fetch_add(&signal_stats.empty_samples, 1);
+    }
+}
+
+static int install_handler(void) {
+    struct sigaction action = {0};
+    action.sa_sigaction = sample_handler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    BW_UNUSED(sigemptyset(&action.sa_mask));
+
+    return sigaction(SIGPROF, &action, NULL);
+}
+
+bool count_frames_cb(uintptr_t addr, const char* fname, const char* sname, void* arg) {
+    BW_UNUSED(addr);
+    BW_UNUSED(fname);
+    BW_UNUSED(sname);
+
+    int* count = (int*)arg;
+    (*count)++;
+
+    return true;
+}
+
+typedef struct {
+    atomic_bool* stop;
+    size_t iterations;
+    bool success;
+} worker_data_t;
+
+// NOLINTNEXTLINE(misc-no-recursion)
+__attribute__((noinline)) bool busy_recursive(int depth) {
+    if (depth > 0) {
+        return busy_recursive(depth - 1);
+    }
+
+    int count = 0;
+    return bw_backtrace(count_frames_cb, &count) && count > 0;
+}
+
+// Keeps threads inside bw_backtrace (and so inside dladdr) to catch handlers that take locks
+__attribute__((noinline)) void* busy_worker(void* arg) {
+    worker_data_t* data = arg;
+    const int depth = 8;
+
+    data->success = true;
+    while (!atomic_load(data->stop)) {
+        if (!busy_recursive(depth)) {
+            data->success = false;
+        }
+        data->iterations++;
+    }
+
+    return NULL;
+}
+
+TEST(signal_safe_matches_capture, {
+    TEST_ASSERT_TRUE(bw_signal_safe_init());
+
+    bw_frame_t frames[SIGNAL_FRAMES_MAX];
+    uintptr_t ips[SIGNAL_FRAMES_MAX];
+
+    size_t frames_len = bw_backtrace_signal_safe(frames, BW_ARRAY_LEN(frames));
+    size_t ips_len = bw_capture(ips, BW_ARRAY_LEN(ips), 0);
+
+    TEST_ASSERT_GE_SIZE(frames_len, 2L);
+    TEST_ASSERT_EQ_SIZE(frames_len, ips_len);
+
+    // The first frame differs since the two calls come from different call sites
+    for (size_t i = 1; i < frames_len; ++i) {
+        TEST_ASSERT_TRUE(frames[i].ip == ips[i]);
+    }
+
+    TEST_ASSERT_TRUE(frames[0].addr != 0);
+    TEST_ASSERT_TRUE(strcmp(frames[0].fname, "?") != 0);
+})
+
+TEST(signal_safe_invalid_args, {
+    bw_frame_t frames[1];
+
+    TEST_ASSERT_EQ_SIZE(bw_backtrace_signal_safe(NULL, 1), 0L);
+    TEST_ASSERT_EQ_SIZE(bw_backtrace_signal_safe(frames, 0), 0L);
+})
+
+static atomic_bool spin_ready;
+static atomic_bool spin_stop;
+static atomic_size_t spin_len;
+static bw_frame_t spin_frames[SIGNAL_FRAMES_MAX];
+
+static void ucontext_handler(int sig, siginfo_t* info, void* ucontext) {
+    BW_UNUSED(sig);
+    BW_UNUSED(info);
+
+    size_t len = bw_backtrace_from_ucontext(ucontext, spin_frames, BW_ARRAY_LEN(spin_frames));
+    atomic_store(&spin_len, len);
+}
+
+// Only ever interrupted in its loop
+__attribute__((noinline)) void spin(void) {
+    atomic_store(&spin_ready, true);
+    while (!atomic_load(&spin_stop)) {
+    }
+}
+
+__attribute__((noinline)) void* spin_thread(void* arg) {
+    BW_UNUSED(arg);
+    BW_UNUSED(bw_signal_safe_init());
+    spin();
+
+    return NULL;
+}
+
+static bool frame_in(const bw_frame_t* frame, uintptr_t fn, uintptr_t pc) {
+    Dl_info info = {0};
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    return dladdr((const void*)pc, &info) != 0 && (uintptr_t)info.dli_saddr == fn &&
+           frame->addr != 0;
+}
+
+// The first frame is the spinning function itself, with no handler or trampoline frames before it
+static test_result_t check_ucontext_walk(bw_unwind_mode_t mode) {
+    bw_set_unwind_mode(mode);
+    TEST_ASSERT_TRUE(bw_signal_safe_init());
+    atomic_store(&spin_ready, false);
+    atomic_store(&spin_stop, false);
+    atomic_store(&spin_len, 0);
+
+    struct sigaction action = {0};
+    action.sa_sigaction = ucontext_handler;
+    action.sa_flags = SA_SIGINFO;
+    BW_UNUSED(sigemptyset(&action.sa_mask));
+    TEST_ERROR_NONZERO(sigaction(SIGUSR1, &action, NULL));
+
+    pthread_t thread;
+    TEST_ERROR_NONZERO(pthread_create(&thread, NULL, spin_thread, NULL));
+    while (!atomic_load(&spin_ready)) {
+        BW_UNUSED(sched_yield());
+    }
+    TEST_ERROR_NONZERO(pthread_kill(thread, SIGUSR1));
+    while (atomic_load(&spin_len) == 0) {
+        BW_UNUSED(sched_yield());
+    }
+    atomic_store(&spin_stop, true);
+    TEST_ERROR_NONZERO(pthread_join(thread, NULL));
+    bw_set_unwind_mode(BW_UNWIND_FP);
+
+    size_t len = atomic_load(&spin_len);
+    TEST_ASSERT_GE_SIZE(len, 2L);
+    TEST_ASSERT_TRUE(frame_in(&spin_frames[0], (uintptr_t)spin, spin_frames[0].ip));
+    // Optimized builds may leave the leaf without a frame record, only CFI finds its caller then
+    if (mode == BW_UNWIND_CFI) {
+        TEST_ASSERT_TRUE(frame_in(&spin_frames[1], (uintptr_t)spin_thread, spin_frames[1].ip - 1));
+    }
+
+    TEST_OK();
+}
+
+TEST(backtrace_from_ucontext, {
+    TEST_ASSERT_TRUE(check_ucontext_walk(BW_UNWIND_FP) == TEST_RESULT_OK);
+    TEST_ASSERT_TRUE(check_ucontext_walk(BW_UNWIND_CFI) == TEST_RESULT_OK);
+
+    bw_frame_t frames[1];
+    TEST_ASSERT_EQ_SIZE(bw_backtrace_from_ucontext(NULL, frames, 1), 0L);
+})
+
+TEST(signals_during_multithreaded_backtrace, {
+    const int num_threads = MAX_THREADS;
+    const int signal_delay_usecs = 100;
+    pthread_t threads[MAX_THREADS];
+    worker_data_t worker_data[MAX_THREADS];
+    atomic_bool stop = false;
+
+    TEST_ASSERT_TRUE(bw_signal_safe_init());
+    TEST_ERROR_NONZERO(install_handler());
+
+    // A deadlocked handler never returns: let SIGALRM kill the test instead of hanging
+    BW_UNUSED(alarm(DEADLOCK_TIMEOUT_SECS));
+
+    for (int i = 0; i < num_threads; i++) {
+        worker_data[i].stop = &stop;
+        worker_data[i].iterations = 0;
+        worker_data[i].success = false;
+        TEST_ERROR_NONZERO(pthread_create(&threads[i], NULL, busy_worker, &worker_data[i]));
+    }
+
+    int signals_sent = 0;
+    for (int n = 0; n < SIGNALS_PER_THREAD; n++) {
+        for (int i = 0; i < num_threads; i++) {
+            if (pthread_kill(threads[i], SIGPROF) == 0) {
+                signals_sent++;
+            }
+        }
+        BW_UNUSED(usleep(signal_delay_usecs));
+    }
+
+    atomic_store(&stop, true);
+    for (int i = 0; i < num_threads; i++) {
+        TEST_ERROR_NONZERO(pthread_join(threads[i], NULL));
+        TEST_ASSERT_TRUE(worker_data[i].success);
+        TEST_ASSERT_GE_SIZE(worker_data[i].iterations, 1L);
+    }
+
+    BW_UNUSED(alarm(0));
+
+    size_t samples = atomic_load(&signal_stats.samples);
+    TEST_ASSERT_GE_INT32(signals_sent, 1);
+    TEST_ASSERT_GE_SIZE(samples, 1L);
+    TEST_ASSERT_EQ_SIZE(atomic_load(&signal_stats.empty_samples), 0L);
+    TEST_ASSERT_GE_SIZE(atomic_load(&signal_stats.frames), samples);
+    TEST_ASSERT_GE_SIZE(atomic_load(&signal_stats.resolved_frames), samples);
+})
+
+int main(int argc, char** argv) {
+    TEST_INIT("signal", argc, argv);
+
+    TEST_RUN(signal_safe_matches_capture);
+    TEST_RUN(signal_safe_invalid_args);
+    TEST_RUN(backtrace_from_ucontext);
+    TEST_RUN(signals_during_multithreaded_backtrace);
+
+    TEST_EXIT();
+}
@@ -0,0 +1,289 @@
+#include <pthread.h>                   // for pthread_barrier_wait, pthread_create, pthread_...
+#include <stdbool.h>                   // for bool, false, true
+#include <stddef.h>                    // for size_t, NULL
+#include <stdint.h>                    // for uintptr_t, uint32_t
+#include <stdio.h>                     // for fprintf, stderr
+#include <time.h>                      // for clock_gettime, timespec, CLOCK_MONOTONIC
+
+#include "common.h"                    // for BW_UNUSED, BW_ARRAY_LEN
+#include "backwalk/backwalk.h"         // for bw_capture
+#include "backwalk/stack_table.h"      // for bw_stack_table_intern, bw_stack_table_create, ...
+
+#include "test.h"                      // for TEST, TEST_ASSERT_TRUE, TEST_RUN, TEST_ASSERT_...
+
+enum { BENCH_THREADS = 8 };
+enum { BENCH_STACKS = 4096 };
+enum { BENCH_DEPTH = 16 };
+enum { BENCH_LOOKUPS_PER_THREAD = 200000 };
+enum { RACE_ROUNDS = 2000 };
+
+static void make_stack(uintptr_t* ips, size_t len, size_t seed) {
+    for (size_t i = 0; i < len; ++i) {
+        ips[i] = 0x400000 + (seed * 131) + (i * 7);
+    }
+}
+
+TEST(same_stack_same_id, {
+    bw_stack_table_t* table = bw_stack_table_create(16);
+    TEST_ASSERT_NONNULL(table);
+
+    uintptr_t ips[32];
+    size_t len = bw_capture(ips, BW_ARRAY_LEN(ips), 0);
+
+    uint32_t first = bw_stack_table_intern(table, ips, len);
+    uint32_t second = bw_stack_table_intern(table, ips, len);
+
+    const uintptr_t* stored = NULL;
+    size_t stored_len = bw_stack_table_get(table, first, &stored);
+
+    bool equal = stored_len == len;
+    for (size_t i = 0; equal && i < len; ++i) {
+        equal = stored[i] == ips[i];
+    }
+
+    bw_stack_table_destroy(table);
+
+    TEST_ASSERT_TRUE(first != BW_STACK_ID_INVALID);
+    TEST_ASSERT_TRUE(first == second);
+    TEST_ASSERT_TRUE(equal);
+})
+
+static const uintptr_t k_stack_a[] = {1, 2, 3, 4};
+static const uintptr_t k_stack_b[] = {1, 2, 3, 5};
+
+TEST(distinct_stacks_distinct_ids, {
+    bw_stack_table_t* table = bw_stack_table_create(16);
+    TEST_ASSERT_NONNULL(table);
+
+    const uintptr_t* a = k_stack_a;
+    const uintptr_t* b = k_stack_b;
+
+    uint32_t id_a = bw_stack_table_intern(table, a, 4);
+    uint32_t id_b = bw_stack_table_intern(table, b, 4);
+    uint32_t id_prefix = bw_stack_table_intern(table, a, 3);
+    uint32_t id_empty = bw_stack_table_intern(table, NULL, 0);
+    uint32_t limit = bw_stack_table_id_limit(table);
+
+    bw_stack_table_destroy(table);
+
+    TEST_ASSERT_TRUE(id_a != id_b);
+    TEST_ASSERT_TRUE(id_a != id_prefix);
+    TEST_ASSERT_TRUE(id_empty != BW_STACK_ID_INVALID);
+    TEST_ASSERT_TRUE(limit == 5);
+})
+
+TEST(full_table, {
+    const size_t capacity = 4;
+    bw_stack_table_t* table = bw_stack_table_create(capacity);
+    TEST_ASSERT_NONNULL(table);
+
+    uintptr_t ips[BENCH_DEPTH];
+    bool all_valid = true;
+    for (size_t i = 0; i < capacity; ++i) {
+        make_stack(ips, BENCH_DEPTH, i);
+        all_valid = all_valid && bw_stack_table_intern(table, ips, BENCH_DEPTH) != 0;
+    }
+
+    // Dropped stacks must not use up IDs, which would eventually wrap around
+    uint32_t overflow = BW_STACK_ID_INVALID;
+    for (size_t i = 0; i < capacity; ++i) {
+        make_stack(ips, BENCH_DEPTH, capacity + i);
+        overflow |= bw_stack_table_intern(table, ips, BENCH_DEPTH);
+    }
+    uint32_t limit = bw_stack_table_id_limit(table);
+    make_stack(ips, BENCH_DEPTH, 0);
+    uint32_t existing = bw_stack_table_intern(table, ips, BENCH_DEPTH);
+
+    bw_stack_table_destroy(table);
+
+    TEST_ASSERT_TRUE(all_valid);
+    TEST_ASSERT_TRUE(overflow == BW_STACK_ID_INVALID);
+    TEST_ASSERT_TRUE(limit == capacity + 1);
+    TEST_ASSERT_TRUE(existing == 1);
+})
+
+TEST(invalid_args, {
+    const uintptr_t* ips = k_stack_a;
+
+    TEST_ASSERT_TRUE(bw_stack_table_create(0) == NULL);
+    TEST_ASSERT_TRUE(bw_stack_table_intern(NULL, ips, 1) == BW_STACK_ID_INVALID);
+    TEST_ASSERT_EQ_SIZE(bw_stack_table_get(NULL, 1, NULL), 0L);
+
+    bw_stack_table_t* table = bw_stack_table_create(1);
+    TEST_ASSERT_NONNULL(table);
+    size_t unknown = bw_stack_table_get(table, 1, NULL);
+    size_t invalid = bw_stack_table_get(table, BW_STACK_ID_INVALID, NULL);
+    bw_stack_table_destroy(table);
+
+    TEST_ASSERT_EQ_SIZE(unknown, 0L);
+    TEST_ASSERT_EQ_SIZE(invalid, 0L);
+})
+
+typedef struct {
+    bw_stack_table_t* table;
+    pthread_barrier_t* barrier;
+    uint32_t ids[RACE_ROUNDS];
+} race_data_t;
+
+// Every thread interns the same new stack at the same time, once per round
+void* race_thread_func(void* arg) {
+    race_data_t* data = arg;
+    uintptr_t ips[BENCH_DEPTH];
+
+    for (size_t round = 0; round < RACE_ROUNDS; ++round) {
+        make_stack(ips, BENCH_DEPTH, round);
+        BW_UNUSED(pthread_barrier_wait(data->barrier));
+        data->ids[round] = bw_stack_table_intern(data->table, ips, BENCH_DEPTH);
+    }
+
+    return NULL;
+}
+
+TEST(concurrent_intern_same_stack, {
+    static race_data_t thread_data[BENCH_THREADS];
+    pthread_t threads[BENCH_THREADS];
+    pthread_barrier_t barrier;
+
+    bw_stack_table_t* table = bw_stack_table_create((size_t)RACE_ROUNDS * BENCH_THREADS);
+    TEST_ASSERT_NONNULL(table);
+    TEST_ERROR_NONZERO(pthread_barrier_init(&barrier, NULL, BENCH_THREADS));
+
+    for (int i = 0; i < BENCH_THREADS; i++) {
+        thread_data[i].table = table;
+        thread_data[i].barrier = &barrier;
+        TEST_ERROR_NONZERO(pthread_create(&threads[i], NULL, race_thread_func, &thread_data[i]));
+    }
+    for (int i = 0; i < BENCH_THREADS; i++) {
+        TEST_ERROR_NONZERO(pthread_join(threads[i], NULL));
+    }
+    TEST_ERROR_NONZERO(pthread_barrier_destroy(&barrier));
+
+    // Every thread gets the same ID, and the IDs lost in each race are not reported
+    bool consistent = true;
+    for (size_t round = 0; round < RACE_ROUNDS; ++round) {
+        uint32_t id = thread_data[0].ids[round];
+        consistent = consistent && id != BW_STACK_ID_INVALID &&
+                     bw_stack_table_get(table, id, NULL) == BENCH_DEPTH;
+        for (int i = 1; i < BENCH_THREADS; i++) {
+            consistent = consistent && thread_data[i].ids[round] == id;
+        }
+    }
+    size_t reported = 0;
+    uint32_t limit = bw_stack_table_id_limit(table);
+    for (uint32_t id = 1; id < limit; ++id) {
+        reported += bw_stack_table_get(table, id, NULL) > 0 ? 1 : 0;
+    }
+    bw_stack_table_destroy(table);
+
+    TEST_ASSERT_TRUE(consistent);
+    TEST_ASSERT_EQ_SIZE(reported, (size_t)RACE_ROUNDS);
+    BW_UNUSED(fprintf(stderr, "\t%u IDs taken for %d stacks\n", limit - 1, RACE_ROUNDS));
+})
+
+typedef struct {
+    bw_stack_table_t* table;
+    pthread_barrier_t* barrier;
+    size_t first_stack;
+    uint32_t ids[BENCH_STACKS];
+    bool success;
+} bench_data_t;
+
+static long elapsed_ns(const struct timespec* start, const struct timespec* end) {
+    return ((end->tv_sec - start->tv_sec) * 1000000000L) + (end->tv_nsec - start->tv_nsec);
+}
+
+// Every thread interns the same stacks, starting at a different offset, then looks them up again.
+// The barriers let the main thread time each phase across all threads.
+void* intern_thread_func(void* arg) {
+    bench_data_t* data = arg;
+    uintptr_t ips[BENCH_DEPTH];
+
+    data->success = true;
+    BW_UNUSED(pthread_barrier_wait(data->barrier));
+    for (size_t i = 0; i < BENCH_STACKS; ++i) {
+        size_t stack = (data->first_stack + i) % BENCH_STACKS;
+        make_stack(ips, BENCH_DEPTH, stack);
+        data->ids[stack] = bw_stack_table_intern(data->table, ips, BENCH_DEPTH);
+    }
+
+    BW_UNUSED(pthread_barrier_wait(data->barrier));
+    for (size_t i = 0; i < BENCH_LOOKUPS_PER_THREAD; ++i) {
+        size_t stack = (data->first_stack + i) % BENCH_STACKS;
+        make_stack(ips, BENCH_DEPTH, stack);
+        if (bw_stack_table_intern(data->table, ips, BENCH_DEPTH) != data->ids[stack]) {
+            data->success = false;
+        }
+    }
+    BW_UNUSED(pthread_barrier_wait(data->barrier));
+
+    return NULL;
+}
+
+TEST(concurrent_intern_throughput, {
+    static bench_data_t thread_data[BENCH_THREADS];
+    pthread_t threads[BENCH_THREADS];
+    pthread_barrier_t barrier;
+    struct timespec phases[3];
+
+    bw_stack_table_t* table = bw_stack_table_create(BENCH_STACKS * 2);
+    TEST_ASSERT_NONNULL(table);
+    TEST_ERROR_NONZERO(pthread_barrier_init(&barrier, NULL, BENCH_THREADS + 1));
+
+    for (int i = 0; i < BENCH_THREADS; i++) {
+        thread_data[i].table = table;
+        thread_data[i].barrier = &barrier;
+        thread_data[i].first_stack = (size_t)i * (BENCH_STACKS / BENCH_THREADS);
+        thread_data[i].success = false;
+        TEST_ERROR_NONZERO(pthread_create(&threads[i], NULL, intern_thread_func, &thread_data[i]));
+    }
+
+    for (size_t i = 0; i < BW_ARRAY_LEN(phases); ++i) {
+        BW_UNUSED(pthread_barrier_wait(&barrier));
+        TEST_ERROR_NONZERO(clock_gettime(CLOCK_MONOTONIC, &phases[i]));
+    }
+
+    for (int i = 0; i < BENCH_THREADS; i++) {
+        TEST_ERROR_NONZERO(pthread_join(threads[i], NULL));
+        TEST_ASSERT_TRUE(thread_data[i].success);
+    }
+    TEST_ERROR_NONZERO(pthread_barrier_destroy(&barrier));
+
+    // All threads must agree on every stack's ID
+    bool consistent = true;
+    for (int i = 1; i < BENCH_THREADS; i++) {
+        for (size_t s = 0; s < BENCH_STACKS; ++s) {
+            consistent = consistent && thread_data[i].ids[s] == thread_data[0].ids[s] &&
+                         thread_data[0].ids[s] != BW_STACK_ID_INVALID;
+        }
+    }
+    uint32_t limit = bw_stack_table_id_limit(table);
+    bw_stack_table_destroy(table);
+
+    const double insert_ops = (double)BENCH_THREADS * BENCH_STACKS;
+    const double lookup_ops = (double)BENCH_THREADS * BENCH_LOOKUPS_PER_THREAD;
+    const double ns_per_sec = 1e9;
+    BW_UNUSED(fprintf(stderr,
+                      "\t%d threads, depth %d: intern %.2f Mops/s, lookup %.2f Mops/s, "
+                      "%u IDs used\n",
+                      BENCH_THREADS,
+                      BENCH_DEPTH,
+                      insert_ops * ns_per_sec / (double)elapsed_ns(&phases[0], &phases[1]) / 1e6,
+                      lookup_ops * ns_per_sec / (double)elapsed_ns(&phases[1], &phases[2]) / 1e6,
+                      limit - 1));
+
+    TEST_ASSERT_TRUE(consistent);
+    TEST_ASSERT_GE_SIZE((size_t)limit - 1, (size_t)BENCH_STACKS);
+})
+
+int main(int argc, char** argv) {
+    TEST_INIT("stack_table", argc, argv);
+
+    TEST_RUN(same_stack_same_id);
+    TEST_RUN(distinct_stacks_distinct_ids);
+    TEST_RUN(full_table);
+    TEST_RUN(invalid_args);
+    TEST_RUN(concurrent_intern_same_stack);
+    TEST_RUN(concurrent_intern_throughput);
+
+    TEST_EXIT();
+}
@@ -0,0 +1,257 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include <dlfcn.h>              // for dladdr, Dl_info
+#include <pthread.h>            // for pthread_create, pthread_join, pthread_t
+#include <signal.h>             // for sigaction, sigaltstack, raise, sigemptyset, stack_t
+#include <stdbool.h>            // for bool, false, true
+#include <stddef.h>             // for size_t, NULL
+#include <stdint.h>             // for uintptr_t
+#include <stdlib.h>             // for free, malloc
+#include <string.h>             // for strcmp
+#include <ucontext.h>           // for getcontext, makecontext, swapcontext, ucontext_t
+
+#include "common.h"             // for BW_UNUSED, BW_ARRAY_LEN
+#include "context.h"            // for context_t, context_set_bounds, context_step, CONTE...
+#include "stack.h"              // for stack_bounds_get, stack_bounds_init, stack_bounds_t
+#include "backwalk/backwalk.h"  // for bw_backtrace_signal_safe, bw_capture, bw_frame_t
+
+#include "test.h"               // for TEST, TEST_ASSERT_TRUE, TEST_ASSERT_NONNULL, TEST_RUN
+
+enum { FRAMES_MAX = 64 };
+enum { ALT_STACK_SIZE = 64 << 10 };
+enum { FAKE_CHAIN_LEN = 8 };
+enum { FIBER_STACK_SIZE = 64 << 10 };
+// Far enough past the base of the stack to be outside of any guard page
+enum { CORRUPT_FP_DISTANCE = 1 << 20 };
+
+static bool in_stack(const stack_range_t* range, const void* addr) {
+    return (uintptr_t)addr >= range->lo && (uintptr_t)addr < range->hi;
+}
+
+TEST(bounds_cover_current_frame, {
+    TEST_ASSERT_TRUE(stack_bounds_init(false));
+    const stack_bounds_t* bounds = stack_bounds_get();
+
+    TEST_ASSERT_NONNULL(bounds);
+    TEST_ASSERT_TRUE(bounds->stack.lo < bounds->stack.hi);
+    TEST_ASSERT_TRUE(in_stack(&bounds->stack, __builtin_frame_address(0)));
+})
+
+void* thread_bounds_func(void* arg) {
+    stack_bounds_t* out = arg;
+
+    if (stack_bounds_get() == NULL && stack_bounds_init(false)) {
+        *out = *stack_bounds_get();
+        if (!in_stack(&out->stack, __builtin_frame_address(0))) {
+            out->stack.lo = 0;
+            out->stack.hi = 0;
+        }
+    }
+
+    return NULL;
+}
+
+TEST(bounds_are_per_thread, {
+    stack_bounds_t thread_bounds = {0};
+    pthread_t thread;
+
+    TEST_ASSERT_TRUE(stack_bounds_init(false));
+    TEST_ERROR_NONZERO(pthread_create(&thread, NULL, thread_bounds_func, &thread_bounds));
+    TEST_ERROR_NONZERO(pthread_join(thread, NULL));
+
+    const stack_bounds_t* bounds = stack_bounds_get();
+    TEST_ASSERT_TRUE(thread_bounds.stack.hi != 0);
+    TEST_ASSERT_TRUE(thread_bounds.stack.hi <= bounds->stack.lo ||
+                     thread_bounds.stack.lo >= bounds->stack.hi);
+})
+
+// A frame record on the stack pointing past its base, like a corrupted frame pointer would. The
+// bounds reject it before it is read.
+TEST(rejects_frames_outside_stack, {
+    TEST_ASSERT_TRUE(stack_bounds_init(false));
+    const stack_bounds_t* bounds = stack_bounds_get();
+
+    uintptr_t record[2];
+    record[0] = bounds->stack.hi + CORRUPT_FP_DISTANCE;
+    record[1] = 1;
+
+    context_t ctx = {0};
+    ctx.data[CONTEXT_FP] = (uintptr_t)record;
+    context_set_bounds(&ctx, bounds);
+
+    TEST_ASSERT_TRUE(context_step(&ctx));
+    TEST_ASSERT_TRUE(context_get_ip(&ctx) == 1);
+    TEST_ASSERT_FALSE(context_step(&ctx));
+})
+
+// Builds a well-formed frame chain outside of the known stacks: walks that start there are not
+// bounded by them
+TEST(walks_chain_outside_stack, {
+    uintptr_t* chain = malloc(FAKE_CHAIN_LEN * 2 * sizeof(uintptr_t));
+    TEST_ASSERT_NONNULL(chain);
+    for (size_t i = 0; i + 1 < FAKE_CHAIN_LEN; ++i) {
+        chain[2 * i] = (uintptr_t)&chain[2 * (i + 1)];
+        chain[(2 * i) + 1] = i + 1;
+    }
+    chain[2 * (FAKE_CHAIN_LEN - 1)] = 0;
+
+    TEST_ASSERT_TRUE(stack_bounds_init(false));
+
+    context_t ctx = {0};
+    ctx.data[CONTEXT_FP] = (uintptr_t)chain;
+    context_set_bounds(&ctx, stack_bounds_get());
+    size_t steps = 0;
+    while (context_step(&ctx)) {
+        steps++;
+    }
+
+    free(chain);
+
+    TEST_ASSERT_EQ_SIZE(steps, (size_t)FAKE_CHAIN_LEN);
+})
+
+static ucontext_t main_context;
+static ucontext_t fiber_context;
+static size_t fiber_capture_len;
+static size_t fiber_backtrace_len;
+static uintptr_t fiber_caller_ip;
+
+static bool count_frame(uintptr_t addr, const char* fname, const char* sname, void* arg) {
+    BW_UNUSED(addr);
+    BW_UNUSED(fname);
+    BW_UNUSED(sname);
+    ++*(size_t*)arg;
+    return true;
+}
+
+__attribute__((noinline)) void fiber_walk(void) {
+    uintptr_t ips[FRAMES_MAX];
+    fiber_capture_len = bw_capture(ips, BW_ARRAY_LEN(ips), 0);
+    fiber_caller_ip = fiber_capture_len >= 2 ? ips[1] : 0;
+    BW_UNUSED(bw_backtrace(count_frame, &fiber_backtrace_len));
+}
+
+void fiber_main(void) {
+    fiber_walk();
+    BW_UNUSED(swapcontext(&fiber_context, &main_context));
+}
+
+TEST(walks_makecontext_stack, {
+    void* fiber_stack = malloc(FIBER_STACK_SIZE);
+    TEST_ASSERT_NONNULL(fiber_stack);
+
+    TEST_ERROR_NONZERO(getcontext(&fiber_context));
+    fiber_context.uc_stack.ss_sp = fiber_stack;
+    fiber_context.uc_stack.ss_size = FIBER_STACK_SIZE;
+    fiber_context.uc_link = NULL;
+    makecontext(&fiber_context, fiber_main, 0);
+
+    TEST_ASSERT_TRUE(stack_bounds_init(false));
+    fiber_capture_len = 0;
+    fiber_backtrace_len = 0;
+    int swapped = swapcontext(&main_context, &fiber_context);
+    free(fiber_stack);
+    TEST_ERROR_NONZERO(swapped);
+
+    // At least fiber_walk() and fiber_main(), which run on neither the thread's nor the alternate
+    // signal stack
+    TEST_ASSERT_GE_SIZE(fiber_capture_len, 2L);
+    TEST_ASSERT_GE_SIZE(fiber_backtrace_len, 2L);
+
+    Dl_info info;
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    TEST_ASSERT_TRUE(dladdr((const void*)fiber_caller_ip, &info) && info.dli_sname);
+    TEST_ASSERT_TRUE(strcmp(info.dli_sname, "fiber_main") == 0);
+})
+
+TEST(rejects_frames_moving_away_from_base, {
+    uintptr_t frames[4];
+    // Point each record at the previous one, i.e. toward lower addresses
+    frames[2] = (uintptr_t)&frames[0];
+    frames[3] = 1;
+    frames[0] = 0;
+    frames[1] = 2;
+
+    context_t ctx = {0};
+    ctx.data[CONTEXT_FP] = (uintptr_t)&frames[2];
+    TEST_ASSERT_TRUE(stack_bounds_init(false));
+    context_set_bounds(&ctx, stack_bounds_get());
+
+    // The first record is reported, but the walk must not follow it downward
+    TEST_ASSERT_TRUE(context_step(&ctx));
+    TEST_ASSERT_TRUE(context_get_ip(&ctx) == 1);
+    TEST_ASSERT_FALSE(context_step(&ctx));
+})
+
+static bw_frame_t alt_frames[FRAMES_MAX];
+static size_t alt_frames_len;
+static bool alt_handler_on_alt_stack;
+
+static void alt_stack_handler(int sig) {
+    BW_UNUSED(sig);
+
+    const stack_bounds_t* bounds = stack_bounds_get();
+    alt_handler_on_alt_stack = bounds && in_stack(&bounds->alt, __builtin_frame_address(0));
+    alt_frames_len = bw_backtrace_signal_safe(alt_frames, BW_ARRAY_LEN(alt_frames));
+}
+
+__attribute__((noinline)) test_result_t raise_on_alt_stack(uintptr_t* caller_ip) {
+    uintptr_t ips[FRAMES_MAX];
+    size_t len = bw_capture(ips, BW_ARRAY_LEN(ips), 0);
+    TEST_ASSERT_GE_SIZE(len, 2L);
+    *caller_ip = ips[1];
+
+    TEST_ERROR_NONZERO(raise(SIGUSR1));
+
+    TEST_OK();
+}
+
+TEST(walks_from_alt_stack, {
+    void* alt_stack = malloc(ALT_STACK_SIZE);
+    TEST_ASSERT_NONNULL(alt_stack);
+
+    stack_t ss = {0};
+    ss.ss_sp = alt_stack;
+    ss.ss_size = ALT_STACK_SIZE;
+    TEST_ERROR_NONZERO(sigaltstack(&ss, NULL));
+
+    struct sigaction action = {0};
+    action.sa_handler = alt_stack_handler;
+    action.sa_flags = SA_ONSTACK;
+    BW_UNUSED(sigemptyset(&action.sa_mask));
+    TEST_ERROR_NONZERO(sigaction(SIGUSR1, &action, NULL));
+
+    TEST_ASSERT_TRUE(bw_signal_safe_init());
+
+    uintptr_t caller_ip = 0;
+    test_result_t result = raise_on_alt_stack(&caller_ip);
+
+    ss.ss_flags = SS_DISABLE;
+    TEST_ERROR_NONZERO(sigaltstack(&ss, NULL));
+    TEST_ASSERT_TRUE(stack_bounds_init(true));
+    free(alt_stack);
+
+    TEST_ASSERT_TRUE(result == TEST_RESULT_OK);
+    TEST_ASSERT_TRUE(alt_handler_on_alt_stack);
+
+    // The walk must cross from the alternate stack back into the frames of the thread's stack
+    bool found_caller = false;
+    for (size_t i = 0; i < alt_frames_len; ++i) {
+        found_caller = found_caller || alt_frames[i].ip == caller_ip;
+    }
+    TEST_ASSERT_TRUE(found_caller);
+})
+
+int main(int argc, char** argv) {
+    TEST_INIT("stack", argc, argv);
+
+    TEST_RUN(bounds_cover_current_frame);
+    TEST_RUN(bounds_are_per_thread);
+    TEST_RUN(rejects_frames_outside_stack);
+    TEST_RUN(walks_chain_outside_stack);
+    TEST_RUN(walks_makecontext_stack);
+    TEST_RUN(rejects_frames_moving_away_from_base);
+    TEST_RUN(walks_from_alt_stack);
+
+    TEST_EXIT();
+}
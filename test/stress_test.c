@@ -1,12 +1,18 @@
 #include <stdbool.h>            // for bool, true
+#include <stddef.h>             // for size_t
 #include <stdint.h>             // for uintptr_t
+#include <stdio.h>              // for fprintf, stderr
 #include <time.h>               // for clock_gettime, timespec, CLOCK_MONOTONIC
 
-#include "common.h"             // for BW_UNUSED
-#include "backwalk/backwalk.h"  // for bw_backtrace
+#include "common.h"             // for BW_UNUSED, BW_ARRAY_LEN
+#include "backwalk/backwalk.h"  // for bw_backtrace, bw_capture, bw_trace_capture, ...
 
 #include "test.h"               // for TEST, TEST_ASSERT_GE_INT32, TEST_ASSE...
 
+enum { CAPTURE_DEPTH_MAX = 64 };
+enum { TIMED_FRAMES_MAX = 256 };
+enum { TIMED_ITERATIONS = 2000 };
+
 // Simple counter callback for performance testing
 bool count_callback(uintptr_t addr, const char* fname, const char* sname, void* arg) {
     BW_UNUSED(addr);
@@ -102,6 +108,155 @@ __attribute__((noinline)) bool stress_recursive_helper(int depth, int max_depth)
     return stress_recursive_helper(depth + 1, max_depth);
 }
 
+// One operation timed by time_recursive, returning how many frames it handled
+typedef size_t (*timed_op_t)(void* arg);
+
+// Runs `op` `iterations` times at the bottom of a recursion `depth` calls deep, sets `frames` to
+// what its last run returned, and returns its mean time in ns, or -1 when the clock fails
+// NOLINTNEXTLINE(misc-no-recursion)
+__attribute__((noinline)) double time_recursive(
+    int depth, int iterations, timed_op_t op, void* arg, size_t* frames) {
+    if (depth > 0) {
+        return time_recursive(depth - 1, iterations, op, arg, frames);
+    }
+
+    struct timespec start_time;
+    struct timespec end_time;
+    if (clock_gettime(CLOCK_MONOTONIC, &start_time) != 0) {
+        return -1.0;
+    }
+
+    for (int i = 0; i < iterations; i++) {
+        *frames = op(arg);
+    }
+
+    if (clock_gettime(CLOCK_MONOTONIC, &end_time) != 0) {
+        return -1.0;
+    }
+
+    long elapsed_ns = ((end_time.tv_sec - start_time.tv_sec) * 1000000000L) +
+                      (end_time.tv_nsec - start_time.tv_nsec);
+
+    return (double)elapsed_ns / iterations;
+}
+
+// Captures at most `*(size_t*)arg` frames
+size_t capture_op(void* arg) {
+    uintptr_t ips[TIMED_FRAMES_MAX];
+    return bw_capture(ips, *(size_t*)arg, 0);
+}
+
+size_t backtrace_op(void* arg) {
+    BW_UNUSED(arg);
+    int count = 0;
+    BW_UNUSED(bw_backtrace(count_callback, &count));
+    return (size_t)count;
+}
+
+// Captures and frees a trace, iterating its frames when `*(bool*)arg` is set
+size_t trace_op(void* arg) {
+    bw_trace_t* trace = bw_trace_capture(TIMED_FRAMES_MAX, 0, NULL);
+    size_t len = bw_trace_len(trace);
+    if (*(bool*)arg) {
+        int count = 0;
+        BW_UNUSED(bw_trace_foreach(trace, count_callback, &count));
+    }
+    bw_trace_free(trace);
+    return len;
+}
+
+TEST(capture_vs_backtrace_performance, {
+    const int depth = 32;
+    size_t max_frames = TIMED_FRAMES_MAX;
+    size_t raw_frames = 0;
+    size_t resolved_frames = 0;
+
+    // Warm up the dynamic linker's lookup paths before timing
+    BW_UNUSED(time_recursive(depth, TIMED_ITERATIONS, backtrace_op, NULL, &resolved_frames));
+
+    bw_symbol_cache_stats_t before = {0};
+    bw_symbol_cache_stats(&before);
+    double raw_ns = time_recursive(depth, TIMED_ITERATIONS, capture_op, &max_frames, &raw_frames);
+    bw_symbol_cache_stats_t after = {0};
+    bw_symbol_cache_stats(&after);
+    double resolved_ns =
+        time_recursive(depth, TIMED_ITERATIONS, backtrace_op, NULL, &resolved_frames);
+
+    TEST_ASSERT_TRUE(raw_ns >= 0.0);
+    TEST_ASSERT_TRUE(resolved_ns >= 0.0);
+    TEST_ASSERT_EQ_SIZE(raw_frames, resolved_frames);
+    TEST_ASSERT_GE_SIZE(raw_frames, (size_t)depth);
+
+    BW_UNUSED(fprintf(stderr,
+                      "\tbw_capture:   %.0f ns/call, %.2f ns/frame\n"
+                      "\tbw_backtrace: %.0f ns/call, %.2f ns/frame\n",
+                      raw_ns,
+                      raw_ns / (double)raw_frames,
+                      resolved_ns,
+                      resolved_ns / (double)resolved_frames));
+
+    // Raw capture must skip symbol lookup entirely
+    TEST_ASSERT_EQ_SIZE((size_t)(after.hits - before.hits), 0L);
+    TEST_ASSERT_EQ_SIZE((size_t)(after.misses - before.misses), 0L);
+})
+
+// Shallow "who called me" captures, where the fixed cost of a capture matters most
+TEST(capture_depth_performance, {
+    enum { CAPTURE_DEPTH_ITERATIONS = 100000 };
+
+    size_t depths[4];
+    depths[0] = 1;
+    depths[1] = 4;
+    depths[2] = 16;
+    depths[3] = CAPTURE_DEPTH_MAX;
+
+    for (size_t i = 0; i < BW_ARRAY_LEN(depths); ++i) {
+        size_t frames = 0;
+        double ns = time_recursive(
+            CAPTURE_DEPTH_MAX, CAPTURE_DEPTH_ITERATIONS, capture_op, &depths[i], &frames);
+        TEST_ASSERT_TRUE(ns >= 0.0);
+        TEST_ASSERT_EQ_SIZE(frames, depths[i]);
+
+        BW_UNUSED(fprintf(stderr, "\tbw_capture depth %2zu: %.1f ns/capture\n", depths[i], ns));
+    }
+})
+
+// Traces kept "just in case" should cost a capture and an allocation, not a symbolization
+TEST(trace_capture_performance, {
+    const int depth = 32;
+    bool lazy = false;
+    bool iterate = true;
+    size_t lazy_frames = 0;
+    size_t iterated_frames = 0;
+
+    BW_UNUSED(time_recursive(depth, TIMED_ITERATIONS, trace_op, &iterate, &iterated_frames));
+
+    bw_symbol_cache_stats_t before = {0};
+    bw_symbol_cache_stats(&before);
+    double lazy_ns = time_recursive(depth, TIMED_ITERATIONS, trace_op, &lazy, &lazy_frames);
+    bw_symbol_cache_stats_t after = {0};
+    bw_symbol_cache_stats(&after);
+    double iterated_ns =
+        time_recursive(depth, TIMED_ITERATIONS, trace_op, &iterate, &iterated_frames);
+
+    TEST_ASSERT_TRUE(lazy_ns >= 0.0);
+    TEST_ASSERT_TRUE(iterated_ns >= 0.0);
+    TEST_ASSERT_EQ_SIZE(lazy_frames, iterated_frames);
+    TEST_ASSERT_GE_SIZE(lazy_frames, (size_t)depth);
+
+    BW_UNUSED(fprintf(stderr,
+                      "\tbw_trace_capture:          %.0f ns/call, %.2f ns/frame\n"
+                      "\tbw_trace_capture+foreach:  %.0f ns/call, %.2f ns/frame\n",
+                      lazy_ns,
+                      lazy_ns / (double)lazy_frames,
+                      iterated_ns,
+                      iterated_ns / (double)iterated_frames));
+
+    // Capturing and freeing a trace that is never iterated looks nothing up
+    TEST_ASSERT_EQ_SIZE((size_t)(after.hits - before.hits), 0L);
+    TEST_ASSERT_EQ_SIZE((size_t)(after.misses - before.misses), 0L);
+})
+
 TEST(deep_stack_stress, {
     const int max_depth = 20;
 
@@ -141,6 +296,9 @@ int main(int argc, char** argv) {
 
     TEST_RUN(repeated_backtrace_calls);
     TEST_RUN(backtrace_performance_basic);
+    TEST_RUN(capture_vs_backtrace_performance);
+    TEST_RUN(capture_depth_performance);
+    TEST_RUN(trace_capture_performance);
     TEST_RUN(deep_stack_stress);
     TEST_RUN(callback_with_significant_work);
     TEST_RUN(memory_stability);
@@ -0,0 +1,215 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include <limits.h>             // for PATH_MAX
+#include <stdbool.h>            // for bool, false, true
+#include <stddef.h>             // for NULL, size_t
+#include <stdint.h>             // for uintptr_t, int64_t
+#include <stdio.h>              // for snprintf, fprintf, stderr
+#include <stdlib.h>             // for mkdtemp, realpath
+#include <string.h>             // for strcmp, strlen
+#include <sys/stat.h>           // for mkdir
+#include <time.h>               // for clock_gettime, timespec, CLOCK_MONOTONIC
+#include <unistd.h>             // for rmdir, symlink, unlink
+
+#include "backwalk/backwalk.h"  // for bw_module_find, bw_module_t, bw_build_id_hex, BW_BUILD...
+#include "symbolizer.h"         // for symbolizer_add, symbolizer_create, symbolizer_get, ...
+
+#include "test.h"               // for TEST, TEST_ASSERT_TRUE, TEST_RUN, TEST_ASSERT_...
+
+enum { BATCH_ADDRS = 1000000 };
+enum { BUILD_ID_HEX_MAX = (BW_BUILD_ID_MAX * 2) + 1 };
+
+#define NSEC_PER_SEC 1000000000.0
+
+static const char* const k_test_file = "symbolizer_test.c";
+
+static unsigned int call_line;
+
+__attribute__((noinline)) static uintptr_t return_address(void) {
+    return (uintptr_t)__builtin_return_address(0);
+}
+
+__attribute__((noinline)) static uintptr_t symbolizer_caller(void) {
+    call_line = __LINE__ + 1;
+    uintptr_t ip = return_address();
+
+    return ip;
+}
+
+static bool is_test_file(const char* file) {
+    size_t len = strlen(file);
+    size_t suffix_len = strlen(k_test_file);
+
+    return len >= suffix_len && strcmp(file + len - suffix_len, k_test_file) == 0;
+}
+
+// Registers the module of `ip` as a trace from another machine would, by path and build ID
+static size_t add_module_of(symbolizer_t* sym, uintptr_t ip, bw_module_t* mod) {
+    if (!bw_module_find(ip, mod)) {
+        return SYMBOLIZER_INVALID;
+    }
+
+    return symbolizer_module(sym, mod->path, strlen(mod->path), mod->build_id, mod->build_id_len);
+}
+
+TEST(resolve_by_path, {
+    symbolizer_t* sym = symbolizer_create(NULL, 0);
+    TEST_ASSERT_NONNULL(sym);
+
+    uintptr_t ip = symbolizer_caller();
+    bw_module_t mod;
+    size_t mod_index = add_module_of(sym, ip, &mod);
+    TEST_ASSERT_TRUE(mod_index != SYMBOLIZER_INVALID);
+
+    size_t id = symbolizer_add(sym, mod_index, ip - mod.base);
+    TEST_ASSERT_TRUE(symbolizer_add(sym, mod_index, ip - mod.base) == id);
+    symbolizer_resolve(sym);
+
+    const symbolizer_frame_t* frame = symbolizer_get(sym, id);
+    TEST_ASSERT_NONNULL(frame->sname);
+    TEST_ASSERT_TRUE(strcmp(frame->sname, "symbolizer_caller") == 0);
+    TEST_ASSERT_NONNULL(frame->file);
+    TEST_ASSERT_TRUE(is_test_file(frame->file));
+    TEST_ASSERT_EQ_INT64((int64_t)frame->line, (int64_t)call_line);
+    TEST_ASSERT_FALSE(symbolizer_module_missing(sym, mod_index));
+
+    symbolizer_destroy(sym);
+})
+
+TEST(resolve_by_build_id, {
+    char dir[] = "/tmp/backwalk_symbolizer_XXXXXX";
+    TEST_ASSERT_NONNULL(mkdtemp(dir));
+
+    uintptr_t ip = symbolizer_caller();
+    bw_module_t mod;
+    TEST_ASSERT_TRUE(bw_module_find(ip, &mod));
+    char hex[BUILD_ID_HEX_MAX];
+    TEST_ASSERT_TRUE(bw_build_id_hex(&mod, hex, sizeof(hex)) > 2);
+
+    // Lay out the executable as a separate debug file would be
+    char exe[PATH_MAX];
+    char debug_dir[PATH_MAX / 4];
+    char build_id_dir[PATH_MAX / 2];
+    char debug_file[PATH_MAX];
+    TEST_ASSERT_NONNULL(realpath("/proc/self/exe", exe));
+    BW_UNUSED(snprintf(debug_dir, sizeof(debug_dir), "%s/.build-id", dir));
+    BW_UNUSED(snprintf(build_id_dir, sizeof(build_id_dir), "%s/%.2s", debug_dir, hex));
+    BW_UNUSED(snprintf(debug_file, sizeof(debug_file), "%s/%s.debug", build_id_dir, hex + 2));
+    TEST_ERROR_NONZERO(mkdir(debug_dir, S_IRWXU));
+    TEST_ERROR_NONZERO(mkdir(build_id_dir, S_IRWXU));
+    TEST_ERROR_NONZERO(symlink(exe, debug_file));
+
+    const char* debug_dirs[2];
+    debug_dirs[0] = "/nonexistent";
+    debug_dirs[1] = dir;
+    symbolizer_t* sym = symbolizer_create(debug_dirs, BW_ARRAY_LEN(debug_dirs));
+    TEST_ASSERT_NONNULL(sym);
+
+    unsigned char build_id[BW_BUILD_ID_MAX];
+    size_t build_id_len = symbolizer_parse_build_id(hex, strlen(hex), build_id, sizeof(build_id));
+    TEST_ASSERT_EQ_SIZE(build_id_len, mod.build_id_len);
+    size_t found = symbolizer_module(sym, NULL, 0, build_id, build_id_len);
+
+    // A build ID that no file has
+    build_id[0] ^= 1;
+    size_t missing = symbolizer_module(sym, NULL, 0, build_id, build_id_len);
+    TEST_ASSERT_TRUE(found != missing);
+
+    size_t found_id = symbolizer_add(sym, found, ip - mod.base);
+    size_t missing_id = symbolizer_add(sym, missing, ip - mod.base);
+    TEST_ASSERT_TRUE(found_id != missing_id);
+    symbolizer_resolve(sym);
+
+    const symbolizer_frame_t* frame = symbolizer_get(sym, found_id);
+    TEST_ASSERT_NONNULL(frame->sname);
+    TEST_ASSERT_TRUE(strcmp(frame->sname, "symbolizer_caller") == 0);
+    TEST_ASSERT_TRUE(symbolizer_get(sym, missing_id)->sname == NULL);
+    TEST_ASSERT_FALSE(symbolizer_module_missing(sym, found));
+    TEST_ASSERT_TRUE(symbolizer_module_missing(sym, missing));
+
+    symbolizer_destroy(sym);
+    TEST_ERROR_NONZERO(unlink(debug_file));
+    TEST_ERROR_NONZERO(rmdir(build_id_dir));
+    TEST_ERROR_NONZERO(rmdir(debug_dir));
+    TEST_ERROR_NONZERO(rmdir(dir));
+})
+
+TEST(path_must_match_build_id, {
+    symbolizer_t* sym = symbolizer_create(NULL, 0);
+    TEST_ASSERT_NONNULL(sym);
+
+    uintptr_t ip = symbolizer_caller();
+    bw_module_t mod;
+    TEST_ASSERT_TRUE(bw_module_find(ip, &mod));
+    mod.build_id[0] ^= 1;
+    size_t mod_index =
+        symbolizer_module(sym, mod.path, strlen(mod.path), mod.build_id, mod.build_id_len);
+
+    size_t id = symbolizer_add(sym, mod_index, ip - mod.base);
+    symbolizer_resolve(sym);
+    TEST_ASSERT_TRUE(symbolizer_get(sym, id)->sname == NULL);
+    TEST_ASSERT_TRUE(symbolizer_module_missing(sym, mod_index));
+
+    symbolizer_destroy(sym);
+})
+
+TEST(parse_build_id, {
+    unsigned char build_id[4];
+    TEST_ASSERT_EQ_SIZE(symbolizer_parse_build_id("0aFf", 4, build_id, sizeof(build_id)), 2L);
+    TEST_ASSERT_TRUE(build_id[0] == 0x0a);
+    TEST_ASSERT_TRUE(build_id[1] == 0xff);
+    TEST_ASSERT_EQ_SIZE(symbolizer_parse_build_id("0af", 3, build_id, sizeof(build_id)), 0L);
+    TEST_ASSERT_EQ_SIZE(symbolizer_parse_build_id("0x12", 4, build_id, sizeof(build_id)), 0L);
+    TEST_ASSERT_EQ_SIZE(symbolizer_parse_build_id("0011223344", 10, build_id, sizeof(build_id)),
+                        0L);
+})
+
+TEST(batch_throughput, {
+    symbolizer_t* sym = symbolizer_create(NULL, 0);
+    TEST_ASSERT_NONNULL(sym);
+
+    uintptr_t ip = symbolizer_caller();
+    bw_module_t mod;
+    size_t mod_index = add_module_of(sym, ip, &mod);
+    TEST_ASSERT_TRUE(mod_index != SYMBOLIZER_INVALID);
+
+    // Frames of a trace repeat a limited set of return addresses across the module's text
+    size_t text_len = mod.text_end - mod.text_start;
+    uintptr_t text_offset = mod.text_start - mod.base;
+    struct timespec start_time;
+    struct timespec end_time;
+    TEST_ERROR_NONZERO(clock_gettime(CLOCK_MONOTONIC, &start_time));
+
+    bool success = true;
+    for (size_t i = 0; i < BATCH_ADDRS; ++i) {
+        uintptr_t addr = text_offset + ((i * 7919) % text_len);
+        success = symbolizer_add(sym, mod_index, addr) != SYMBOLIZER_INVALID && success;
+    }
+    symbolizer_resolve(sym);
+
+    TEST_ERROR_NONZERO(clock_gettime(CLOCK_MONOTONIC, &end_time));
+    TEST_ASSERT_TRUE(success);
+
+    double elapsed = (double)(end_time.tv_sec - start_time.tv_sec) +
+                     ((double)(end_time.tv_nsec - start_time.tv_nsec) / NSEC_PER_SEC);
+    BW_UNUSED(fprintf(stderr,
+                      "symbolized %d frames (%zu distinct) in %.3f s, %.2f M frames/s\n",
+                      BATCH_ADDRS,
+                      text_len < BATCH_ADDRS ? text_len : (size_t)BATCH_ADDRS,
+                      elapsed,
+                      BATCH_ADDRS / elapsed / 1e6));
+
+    symbolizer_destroy(sym);
+})
+
+int main(int argc, char** argv) {
+    TEST_INIT("symbolizer", argc, argv);
+
+    TEST_RUN(resolve_by_path);
+    TEST_RUN(resolve_by_build_id);
+    TEST_RUN(path_must_match_build_id);
+    TEST_RUN(parse_build_id);
+    TEST_RUN(batch_throughput);
+
+    TEST_EXIT();
+}
@@ -0,0 +1,185 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include <dlfcn.h>              // for dladdr, dlclose, dlopen, dlsym, Dl_info, RTLD_LOCAL, ...
+#include <fcntl.h>              // for open, O_RDONLY, O_WRONLY, O_CREAT, O_TRUNC
+#include <stdbool.h>            // for bool, false, true
+#include <stddef.h>             // for NULL, size_t
+#include <stdint.h>             // for uintptr_t
+#include <stdio.h>              // for rename, snprintf
+#include <stdlib.h>             // for mkdtemp
+#include <string.h>             // for strcmp, strlen, strncmp
+#include <unistd.h>             // for close, read, rmdir, unlink, write
+
+#include "backwalk/backwalk.h"  // for bw_backtrace
+#include "common.h"             // for BW_UNUSED
+#include "elf_file.h"           // for elf_open, elf_symbolize, elf_file_t
+#include "module.h"             // for module_elf, module_lookup, module_map_get, module_map_sync
+
+#include "test.h"               // for TEST, TEST_ASSERT_TRUE, TEST_ASSERT_NONNULL
+
+enum { COPY_BUFFER_SIZE = 64 << 10 };
+enum { PATH_MAX_LEN = 256 };
+
+// This test is linked without -rdynamic, so none of the functions below are in .dynsym
+
+typedef struct {
+    const char* want;
+    bool found;
+} find_data_t;
+
+static bool find_frame(uintptr_t addr, const char* fname, const char* sname, void* arg) {
+    BW_UNUSED(addr);
+    BW_UNUSED(fname);
+    find_data_t* data = (find_data_t*)arg;
+    if (strcmp(sname, data->want) == 0) {
+        data->found = true;
+    }
+
+    return !data->found;
+}
+
+__attribute__((noinline)) static bool symtab_static_leaf(find_data_t* data) {
+    return bw_backtrace(find_frame, data);
+}
+
+__attribute__((noinline)) static bool symtab_static_caller(find_data_t* data) {
+    return symtab_static_leaf(data);
+}
+
+static uintptr_t static_function_addr(void) {
+    return (uintptr_t)symtab_static_caller;
+}
+
+TEST(dladdr_has_no_name, {
+    Dl_info info = {0};
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    TEST_ASSERT_TRUE(dladdr((const void*)static_function_addr(), &info) != 0);
+    TEST_ASSERT_TRUE(info.dli_sname == NULL);
+})
+
+TEST(backtrace_resolves_static_functions, {
+    find_data_t leaf = {0};
+    leaf.want = "symtab_static_leaf";
+    BW_UNUSED(symtab_static_caller(&leaf));
+    TEST_ASSERT_TRUE(leaf.found);
+
+    find_data_t caller = {0};
+    caller.want = "symtab_static_caller";
+    BW_UNUSED(symtab_static_caller(&caller));
+    TEST_ASSERT_TRUE(caller.found);
+})
+
+TEST(symbolize_function_body, {
+    TEST_ASSERT_TRUE(module_map_sync());
+    const module_map_t* map = module_map_get();
+    uintptr_t addr = static_function_addr();
+
+    const module_t* mod = module_lookup(map, addr);
+    TEST_ASSERT_NONNULL(mod);
+    const elf_file_t* elf = module_elf(mod);
+    TEST_ASSERT_NONNULL(elf);
+
+    const char* start = elf_symbolize(elf, addr - mod->bias);
+    TEST_ASSERT_NONNULL(start);
+    TEST_ASSERT_TRUE(strcmp(start, "symtab_static_caller") == 0);
+
+    const char* inside = elf_symbolize(elf, addr - mod->bias + 1);
+    TEST_ASSERT_NONNULL(inside);
+    TEST_ASSERT_TRUE(strcmp(inside, "symtab_static_caller") == 0);
+
+    TEST_ASSERT_TRUE(module_elf(mod) == elf);
+})
+
+TEST(open_missing_file, {
+    TEST_ASSERT_TRUE(elf_open("/nonexistent/backwalk.so") == NULL);
+    TEST_ASSERT_TRUE(elf_symbolize(NULL, static_function_addr()) == NULL);
+})
+
+static bool copy_file(const char* from, const char* to) {
+    int in = open(from, O_RDONLY);
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    bool success = in >= 0 && out >= 0;
+
+    static char buffer[COPY_BUFFER_SIZE];
+    while (success) {
+        ssize_t len = read(in, buffer, sizeof(buffer));
+        if (len <= 0) {
+            success = len == 0;
+            break;
+        }
+        success = write(out, buffer, (size_t)len) == len;
+    }
+
+    if (in >= 0) {
+        BW_UNUSED(close(in));
+    }
+    if (out >= 0) {
+        success = close(out) == 0 && success;
+    }
+
+    return success;
+}
+
+// A copy of libm is loaded, then replaced on disk by another file before its symbols are first
+// read, as when a package upgrade replaces a library under a running process
+TEST(replaced_file_rejected, {
+    // hypot() is defined in libm itself, unlike functions that libm takes from libc, and is not an
+    // IFUNC, whose resolved implementation dladdr() cannot name
+    Dl_info libm = {0};
+    void* handle = dlopen("libm.so.6", RTLD_NOW | RTLD_LOCAL);
+    TEST_ASSERT_NONNULL(handle);
+    TEST_ASSERT_TRUE(dladdr(dlsym(handle, "hypot"), &libm) != 0);
+
+    char dir[] = "/tmp/backwalk_symtab_XXXXXX";
+    TEST_ASSERT_NONNULL(mkdtemp(dir));
+    char path[PATH_MAX_LEN];
+    char replacement[PATH_MAX_LEN];
+    BW_UNUSED(snprintf(path, sizeof(path), "%s/libm.so.6", dir));
+    BW_UNUSED(snprintf(replacement, sizeof(replacement), "%s/replacement", dir));
+
+    bool copied = copy_file(libm.dli_fname, path);
+    void* copy = copied ? dlopen(path, RTLD_NOW | RTLD_LOCAL) : NULL;
+    uintptr_t addr = copy ? (uintptr_t)dlsym(copy, "hypot") : 0;
+    bool replaced = copy && copy_file("/proc/self/exe", replacement) &&
+                    rename(replacement, path) == 0;
+
+    const module_t* mod = NULL;
+    if (replaced && module_map_sync()) {
+        mod = module_lookup(module_map_get(), addr);
+    }
+    bool rejected = mod && mod->build_id_len > 0 && module_elf(mod) == NULL;
+
+    // Frames are still named, by the dynamic linker. The name points into the module, which is
+    // unloaded below. dladdr() may report an alias, like hypotf64.
+    bw_symbol_t sym = {0};
+    uintptr_t ip = addr + 1;
+    bw_symbolize(&ip, 1, &sym);
+    bool named = sym.sname && strncmp(sym.sname, "hypot", strlen("hypot")) == 0;
+
+    if (copy) {
+        BW_UNUSED(dlclose(copy));
+    }
+    BW_UNUSED(dlclose(handle));
+    BW_UNUSED(unlink(path));
+    BW_UNUSED(unlink(replacement));
+    BW_UNUSED(rmdir(dir));
+
+    TEST_ASSERT_TRUE(copied);
+    TEST_ASSERT_NONNULL(copy);
+    TEST_ASSERT_TRUE(replaced);
+    TEST_ASSERT_NONNULL(mod);
+    TEST_ASSERT_TRUE(rejected);
+    TEST_ASSERT_TRUE(named);
+})
+
+int main(int argc, char** argv) {
+    TEST_INIT("symtab", argc, argv);
+
+    TEST_RUN(dladdr_has_no_name);
+    TEST_RUN(backtrace_resolves_static_functions);
+    TEST_RUN(symbolize_function_body);
+    TEST_RUN(open_missing_file);
+    TEST_RUN(replaced_file_rejected);
+
+    TEST_EXIT();
+}
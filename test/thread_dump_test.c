@@ -0,0 +1,250 @@
+// NOLINTNEXTLINE(bugprone-reserved-identifier, readability-identifier-naming)
+#define _GNU_SOURCE
+#include <dlfcn.h>                  // for dladdr, Dl_info
+#include <pthread.h>                // for pthread_create, pthread_join, pthread_setname_np, ...
+#include <sched.h>                  // for sched_yield
+#include <signal.h>                 // for sigaddset, sigemptyset, sigset_t, SIGRTMIN, SIG_BLOCK
+#include <stdatomic.h>              // for atomic_load, atomic_store, atomic_fetch_add, atomic_...
+#include <stdbool.h>                // for bool, false, true
+#include <stddef.h>                 // for size_t, NULL
+#include <stdint.h>                 // for uintptr_t
+#include <stdio.h>                  // for fprintf, stderr
+#include <stdlib.h>                 // for free, malloc, mkstemp
+#include <string.h>                 // for strcmp, strstr
+#include <sys/stat.h>               // for fstat, stat
+#include <sys/types.h>              // for ssize_t
+#include <time.h>                   // for clock_gettime, timespec, CLOCK_MONOTONIC
+#include <unistd.h>                 // for close, pread, unlink, gettid
+
+#include "backwalk/thread_dump.h"   // for bw_dump_all_threads, bw_thread_stack_t, bw_dump_in...
+#include "common.h"                 // for BW_UNUSED
+
+#include "test.h"                   // for TEST, TEST_ASSERT_TRUE, TEST_RUN, TEST_ASSERT_EQ_SIZE
+
+enum { WORKERS = 4 };
+enum { TIMEOUT_MS = 2000 };
+enum { SHORT_TIMEOUT_MS = 50 };
+enum { DUMP_SIGNAL_OFFSET = 5 };
+enum { BENCH_DUMPS = 20 };
+
+#define NSECS_PER_SEC 1000000000L
+#define NSECS_PER_MSEC 1000000L
+
+static atomic_bool stop;
+static atomic_int started;
+static atomic_int blocked_tid;
+
+__attribute__((noinline)) void dump_worker_spin(void) {
+    while (!atomic_load(&stop)) {
+        BW_UNUSED(sched_yield());
+    }
+}
+
+__attribute__((noinline)) void* dump_worker_main(void* arg) {
+    BW_UNUSED(pthread_setname_np(pthread_self(), "dump_worker"));
+
+    // One worker cannot answer, its dumps must time out
+    if (arg) {
+        sigset_t set;
+        BW_UNUSED(sigemptyset(&set));
+        BW_UNUSED(sigaddset(&set, SIGRTMIN + DUMP_SIGNAL_OFFSET));
+        BW_UNUSED(pthread_sigmask(SIG_BLOCK, &set, NULL));
+        atomic_store(&blocked_tid, gettid());
+    }
+
+    atomic_fetch_add(&started, 1);
+    dump_worker_spin();
+
+    return NULL;
+}
+
+static pthread_t workers[WORKERS];
+
+static bool start_workers(bool block_one) {
+    atomic_store(&stop, false);
+    atomic_store(&started, 0);
+    atomic_store(&blocked_tid, 0);
+
+    for (size_t i = 0; i < WORKERS; ++i) {
+        // NOLINTNEXTLINE(performance-no-int-to-ptr)
+        void* arg = block_one && i == 0 ? (void*)1 : NULL;
+        if (pthread_create(&workers[i], NULL, dump_worker_main, arg) != 0) {
+            return false;
+        }
+    }
+    while (atomic_load(&started) < WORKERS) {
+        BW_UNUSED(sched_yield());
+    }
+
+    return true;
+}
+
+static void stop_workers(void) {
+    atomic_store(&stop, true);
+    for (size_t i = 0; i < WORKERS; ++i) {
+        BW_UNUSED(pthread_join(workers[i], NULL));
+    }
+}
+
+typedef struct {
+    size_t threads;
+    size_t captured;
+    size_t workers_found;
+    bool blocked_captured;
+    bool self_found;
+} found_t;
+
+static bool has_function(const bw_thread_stack_t* stack, const char* sname) {
+    for (size_t i = 0; i < stack->len; ++i) {
+        Dl_info info;
+        // NOLINTNEXTLINE(performance-no-int-to-ptr)
+        if (dladdr((const void*)(stack->frames[i].ip - 1), &info) && info.dli_sname &&
+            strcmp(info.dli_sname, sname) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool find_stacks(const bw_thread_stack_t* stack, void* arg) {
+    found_t* found = arg;
+
+    found->threads++;
+    found->captured += stack->captured ? 1 : 0;
+    if (stack->captured && strcmp(stack->name, "dump_worker") == 0 &&
+        has_function(stack, "dump_worker_main")) {
+        found->workers_found++;
+    }
+    if (stack->tid == atomic_load(&blocked_tid)) {
+        found->blocked_captured = stack->captured;
+    }
+    if (stack->tid == gettid()) {
+        found->self_found = stack->captured && has_function(stack, "main");
+    }
+
+    return true;
+}
+
+static long now_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        return -1;
+    }
+
+    return (ts.tv_sec * NSECS_PER_SEC) + ts.tv_nsec;
+}
+
+TEST(install, {
+    bw_dump_config_t config = {0};
+    config.signo = SIGRTMIN + DUMP_SIGNAL_OFFSET;
+    TEST_ASSERT_TRUE(bw_dump_install(&config));
+    // Already installed, the first configuration stays
+    TEST_ASSERT_TRUE(bw_dump_install(NULL));
+})
+
+TEST(dumps_all_threads, {
+    TEST_ASSERT_TRUE(start_workers(false));
+
+    found_t found = {0};
+    size_t captured = bw_dump_all_threads(TIMEOUT_MS, find_stacks, &found);
+    stop_workers();
+
+    TEST_ASSERT_EQ_SIZE(found.threads, (long)WORKERS + 1);
+    TEST_ASSERT_EQ_SIZE(captured, (long)WORKERS + 1);
+    TEST_ASSERT_EQ_SIZE(found.captured, (long)WORKERS + 1);
+    TEST_ASSERT_EQ_SIZE(found.workers_found, (long)WORKERS);
+    TEST_ASSERT_TRUE(found.self_found);
+})
+
+TEST(times_out_blocked_thread, {
+    TEST_ASSERT_TRUE(start_workers(true));
+
+    found_t found = {0};
+    long start = now_ns();
+    size_t captured = bw_dump_all_threads(SHORT_TIMEOUT_MS, find_stacks, &found);
+    long elapsed = now_ns() - start;
+    stop_workers();
+
+    TEST_ASSERT_EQ_SIZE(found.threads, (long)WORKERS + 1);
+    TEST_ASSERT_EQ_SIZE(captured, (long)WORKERS);
+    TEST_ASSERT_FALSE(found.blocked_captured);
+    TEST_ASSERT_TRUE(elapsed >= SHORT_TIMEOUT_MS * NSECS_PER_MSEC);
+    TEST_ASSERT_TRUE(elapsed < NSECS_PER_SEC);
+})
+
+// Reads the whole file as a string, which the caller frees
+static char* read_all(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return NULL;
+    }
+
+    size_t len = (size_t)st.st_size;
+    char* data = malloc(len + 1);
+    if (data && pread(fd, data, len, 0) != (ssize_t)len) {
+        free(data);
+        return NULL;
+    }
+    if (data) {
+        data[len] = '\0';
+    }
+
+    return data;
+}
+
+TEST(writes_to_fd, {
+    char path[] = "/tmp/backwalk_dump_XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    BW_UNUSED(unlink(path));
+
+    TEST_ASSERT_TRUE(start_workers(false));
+    bool written = bw_dump_all_threads_fd(fd, TIMEOUT_MS);
+    stop_workers();
+
+    char* text = read_all(fd);
+    BW_UNUSED(close(fd));
+    TEST_ASSERT_TRUE(written);
+    TEST_ASSERT_NONNULL(text);
+
+    bool has_thread = strstr(text, "\"dump_worker\":\n") != NULL;
+    bool has_frame = strstr(text, " dump_worker_main (") != NULL;
+    free(text);
+
+    TEST_ASSERT_TRUE(has_thread);
+    TEST_ASSERT_TRUE(has_frame);
+})
+
+TEST(invalid_arguments, { TEST_ASSERT_FALSE(bw_dump_all_threads_fd(-1, TIMEOUT_MS)); })
+
+TEST(benchmark, {
+    TEST_ASSERT_TRUE(start_workers(false));
+
+    size_t captured = 0;
+    long start = now_ns();
+    for (size_t i = 0; i < BENCH_DUMPS; ++i) {
+        captured += bw_dump_all_threads(TIMEOUT_MS, NULL, NULL);
+    }
+    long elapsed = now_ns() - start;
+    stop_workers();
+
+    TEST_ASSERT_EQ_SIZE(captured, (long)BENCH_DUMPS * (WORKERS + 1));
+    BW_UNUSED(fprintf(stderr,
+                      "\t%d threads: %.3f ms/dump\n",
+                      WORKERS + 1,
+                      (double)elapsed / BENCH_DUMPS / NSECS_PER_MSEC));
+})
+
+int main(int argc, char** argv) {
+    TEST_INIT("thread_dump", argc, argv);
+
+    TEST_RUN(install);
+    TEST_RUN(dumps_all_threads);
+    TEST_RUN(times_out_blocked_thread);
+    TEST_RUN(writes_to_fd);
+    TEST_RUN(invalid_arguments);
+    TEST_RUN(benchmark);
+
+    TEST_EXIT();
+}
@@ -0,0 +1,284 @@
+#include <stdbool.h>            // for bool, false, true
+#include <stddef.h>             // for size_t, NULL
+#include <stdint.h>             // for uintptr_t, uint64_t, int64_t
+#include <stdio.h>              // for fprintf, stderr
+#include <stdlib.h>             // for mkstemp
+#include <string.h>             // for strlen, strncmp
+#include <sys/stat.h>           // for fstat, stat
+#include <time.h>               // for clock_gettime, timespec, CLOCK_MONOTONIC
+#include <unistd.h>             // for close, ftruncate, unlink
+
+#include "backwalk/backwalk.h"  // for bw_capture, bw_module_find, bw_module_t
+#include "backwalk/trace.h"     // for bw_trace_write, bw_trace_writer_create, bw_trace_reader_...
+#include "common.h"             // for BW_UNUSED, BW_ARRAY_LEN
+
+#include "test.h"               // for TEST, TEST_ASSERT_TRUE, TEST_RUN, TEST_ASSERT_NONNULL
+
+enum { MAX_FRAMES = 64 };
+enum { PATH_SIZE = 64 };
+enum { ROUND_TRIP_SAMPLES = 1000 };
+enum { BENCH_SAMPLES = 1000000 };
+enum { BENCH_STACKS = 4096 };
+enum { BENCH_LEAVES = 64 };
+enum { BENCH_THREADS = 8 };
+// Sampling period of the benchmark, as a 1 kHz profiler would record
+enum { BENCH_PERIOD_NS = 1000000 };
+
+static char trace_path[PATH_SIZE];
+
+static int open_temp(void) {
+    BW_UNUSED(snprintf(trace_path, sizeof(trace_path), "/tmp/backwalk_trace_XXXXXX"));
+
+    return mkstemp(trace_path);
+}
+
+__attribute__((noinline)) size_t trace_leaf_a(uintptr_t* ips) {
+    return bw_capture(ips, MAX_FRAMES, 0);
+}
+
+__attribute__((noinline)) size_t trace_leaf_b(uintptr_t* ips) {
+    return bw_capture(ips, MAX_FRAMES, 0);
+}
+
+static uintptr_t ips_a[MAX_FRAMES];
+static uintptr_t ips_b[MAX_FRAMES];
+static bw_trace_frame_t frames[BW_TRACE_FRAMES_MAX];
+
+// Checks that stack `id` of the trace decodes to the module-relative addresses of `ips`
+static bool same_stack(const bw_trace_reader_t* reader, uint32_t id, const uintptr_t* ips,
+                       size_t len) {
+    if (bw_trace_reader_stack(reader, id, frames, BW_ARRAY_LEN(frames)) != len) {
+        return false;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        bw_module_t mod;
+        bw_trace_module_t trace_mod;
+        if (!bw_module_find(ips[i], &mod) ||
+            !bw_trace_reader_module(reader, (size_t)frames[i].module, &trace_mod) ||
+            frames[i].addr != ips[i] - mod.base || trace_mod.path_len != strlen(mod.path) ||
+            strncmp(trace_mod.path, mod.path, trace_mod.path_len) != 0 ||
+            trace_mod.build_id_len != mod.build_id_len) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+TEST(round_trip, {
+    int fd = open_temp();
+    TEST_ASSERT_TRUE(fd >= 0);
+
+    bw_trace_config_t config = {0};
+    config.fd = fd;
+    bw_trace_writer_t* writer = bw_trace_writer_create(&config);
+    TEST_ASSERT_NONNULL(writer);
+
+    size_t len_a = trace_leaf_a(ips_a);
+    size_t len_b = trace_leaf_b(ips_b);
+    TEST_ASSERT_TRUE(len_a > 1 && len_b > 1);
+
+    // Times go backwards and thread IDs vary, as with samples from several threads
+    bool written = true;
+    bw_trace_sample_t sample = {0};
+    for (size_t i = 0; i < ROUND_TRIP_SAMPLES; ++i) {
+        sample.time_ns = 1000000000000ULL + (i * 1000) - (i % 3 * 1500);
+        sample.tid = (int32_t)(1000 + (i % 7));
+        sample.value = i;
+        written = bw_trace_write(writer, &sample, i % 2 ? ips_b : ips_a, i % 2 ? len_b : len_a) &&
+                  written;
+    }
+    TEST_ASSERT_TRUE(written);
+    TEST_ASSERT_TRUE(bw_trace_writer_close(writer));
+    BW_UNUSED(close(fd));
+
+    bw_trace_reader_t* reader = bw_trace_reader_open(trace_path);
+    TEST_ERROR_NONZERO(unlink(trace_path));
+    TEST_ASSERT_NONNULL(reader);
+    TEST_ASSERT_TRUE(bw_trace_reader_modules_len(reader) > 0);
+    TEST_ASSERT_TRUE(bw_trace_reader_stack_id_limit(reader) == 3);
+    TEST_ASSERT_TRUE(same_stack(reader, 1, ips_a, len_a));
+    TEST_ASSERT_TRUE(same_stack(reader, 2, ips_b, len_b));
+    TEST_ASSERT_EQ_SIZE(bw_trace_reader_stack(reader, 3, frames, BW_ARRAY_LEN(frames)), 0L);
+
+    for (int pass = 0; pass < 2; ++pass) {
+        size_t count = 0;
+        bool matches = true;
+        while (bw_trace_reader_next(reader, &sample)) {
+            matches = matches && sample.time_ns == 1000000000000ULL + (count * 1000) -
+                                                       (count % 3 * 1500);
+            matches = matches && sample.tid == (int32_t)(1000 + (count % 7));
+            matches = matches && sample.value == count;
+            matches = matches && sample.stack_id == (count % 2 ? 2U : 1U);
+            count++;
+        }
+        TEST_ASSERT_TRUE(matches);
+        TEST_ASSERT_EQ_SIZE(count, (size_t)ROUND_TRIP_SAMPLES);
+        bw_trace_reader_rewind(reader);
+    }
+
+    bw_trace_reader_close(reader);
+})
+
+// A writer killed before it flushed leaves a partial record at the end of the file
+TEST(truncated_file, {
+    int fd = open_temp();
+    TEST_ASSERT_TRUE(fd >= 0);
+
+    bw_trace_config_t config = {0};
+    config.fd = fd;
+    bw_trace_writer_t* writer = bw_trace_writer_create(&config);
+    TEST_ASSERT_NONNULL(writer);
+
+    size_t len_a = trace_leaf_a(ips_a);
+    size_t len_b = trace_leaf_b(ips_b);
+    bw_trace_sample_t sample = {0};
+    sample.value = 1;
+    TEST_ASSERT_TRUE(bw_trace_write(writer, &sample, ips_a, len_a));
+    TEST_ASSERT_TRUE(bw_trace_writer_flush(writer));
+    struct stat st;
+    TEST_ERROR_NONZERO(fstat(fd, &st));
+    TEST_ASSERT_TRUE(bw_trace_write(writer, &sample, ips_b, len_b));
+    TEST_ASSERT_TRUE(bw_trace_writer_close(writer));
+
+    // Cut into the second stack's record
+    TEST_ERROR_NONZERO(ftruncate(fd, st.st_size + 8));
+    BW_UNUSED(close(fd));
+
+    bw_trace_reader_t* reader = bw_trace_reader_open(trace_path);
+    TEST_ERROR_NONZERO(unlink(trace_path));
+    TEST_ASSERT_NONNULL(reader);
+    TEST_ASSERT_TRUE(bw_trace_reader_stack_id_limit(reader) == 2);
+    TEST_ASSERT_TRUE(same_stack(reader, 1, ips_a, len_a));
+    TEST_ASSERT_TRUE(bw_trace_reader_next(reader, &sample));
+    TEST_ASSERT_TRUE(sample.stack_id == 1);
+    TEST_ASSERT_FALSE(bw_trace_reader_next(reader, &sample));
+    bw_trace_reader_close(reader);
+})
+
+TEST(full_stack_table, {
+    int fd = open_temp();
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ERROR_NONZERO(unlink(trace_path));
+
+    bw_trace_config_t config = {0};
+    config.fd = fd;
+    config.stack_capacity = 1;
+    bw_trace_writer_t* writer = bw_trace_writer_create(&config);
+    TEST_ASSERT_NONNULL(writer);
+
+    size_t len_a = trace_leaf_a(ips_a);
+    size_t len_b = trace_leaf_b(ips_b);
+    bw_trace_sample_t sample = {0};
+    TEST_ASSERT_TRUE(bw_trace_write(writer, &sample, ips_a, len_a));
+    TEST_ASSERT_FALSE(bw_trace_write(writer, &sample, ips_b, len_b));
+    TEST_ASSERT_TRUE(bw_trace_write(writer, &sample, ips_a, len_a));
+    TEST_ASSERT_TRUE(bw_trace_writer_dropped(writer) == 1);
+    TEST_ASSERT_TRUE(bw_trace_writer_close(writer));
+    BW_UNUSED(close(fd));
+})
+
+TEST(invalid_arguments, {
+    bw_trace_config_t config = {0};
+    config.fd = -1;
+    TEST_ASSERT_TRUE(bw_trace_writer_create(&config) == NULL);
+    config.fd = 1;
+    config.buffer_size = 1024; // Smaller than the minimum
+    TEST_ASSERT_TRUE(bw_trace_writer_create(&config) == NULL);
+    TEST_ASSERT_TRUE(bw_trace_writer_create(NULL) == NULL);
+    TEST_ASSERT_FALSE(bw_trace_write(NULL, NULL, NULL, 0));
+    TEST_ASSERT_FALSE(bw_trace_writer_close(NULL));
+    TEST_ASSERT_TRUE(bw_trace_reader_open("/nonexistent") == NULL);
+    // Not a trace
+    TEST_ASSERT_TRUE(bw_trace_reader_open("/proc/self/exe") == NULL);
+    bw_trace_reader_close(NULL);
+})
+
+static long now_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        return -1;
+    }
+
+    return (ts.tv_sec * 1000000000L) + ts.tv_nsec;
+}
+
+static uintptr_t bench_ips[BENCH_STACKS][MAX_FRAMES];
+static size_t bench_lens[BENCH_STACKS];
+
+TEST(benchmark, {
+    // Real stacks, with leaves at different addresses of the leaf functions
+    size_t len = trace_leaf_a(ips_a);
+    TEST_ASSERT_TRUE(len > 1 && len < MAX_FRAMES);
+    for (size_t i = 0; i < BENCH_STACKS; ++i) {
+        uintptr_t leaf = i % 2 ? (uintptr_t)trace_leaf_a : (uintptr_t)trace_leaf_b;
+        bench_ips[i][0] = leaf + 1 + (i / 2 % BENCH_LEAVES);
+        bench_ips[i][1] = ips_a[(i % (len - 1)) + 1];
+        for (size_t j = 2; j <= len; ++j) {
+            bench_ips[i][j] = ips_a[j - 1];
+        }
+        bench_lens[i] = len + 1;
+    }
+
+    int fd = open_temp();
+    TEST_ASSERT_TRUE(fd >= 0);
+    bw_trace_config_t config = {0};
+    config.fd = fd;
+    bw_trace_writer_t* writer = bw_trace_writer_create(&config);
+    TEST_ASSERT_NONNULL(writer);
+
+    bool written = true;
+    bw_trace_sample_t sample = {0};
+    sample.value = 1;
+    long start = now_ns();
+    for (size_t i = 0; i < BENCH_SAMPLES; ++i) {
+        size_t stack = (i * 7919) % BENCH_STACKS;
+        sample.time_ns += BENCH_PERIOD_NS / BENCH_THREADS;
+        sample.tid = (int32_t)(1000 + (i % BENCH_THREADS));
+        written = bw_trace_write(writer, &sample, bench_ips[stack], bench_lens[stack]) && written;
+    }
+    written = bw_trace_writer_close(writer) && written;
+    long write_ns = now_ns() - start;
+
+    struct stat st;
+    TEST_ERROR_NONZERO(fstat(fd, &st));
+    BW_UNUSED(close(fd));
+    TEST_ASSERT_TRUE(written);
+
+    start = now_ns();
+    bw_trace_reader_t* reader = bw_trace_reader_open(trace_path);
+    TEST_ERROR_NONZERO(unlink(trace_path));
+    TEST_ASSERT_NONNULL(reader);
+    size_t count = 0;
+    uint64_t total = 0;
+    while (bw_trace_reader_next(reader, &sample)) {
+        total += sample.value;
+        count++;
+    }
+    long read_ns = now_ns() - start;
+    bw_trace_reader_close(reader);
+    TEST_ASSERT_EQ_SIZE(count, (size_t)BENCH_SAMPLES);
+    TEST_ASSERT_TRUE(total == BENCH_SAMPLES);
+
+    BW_UNUSED(fprintf(stderr,
+                      "\t%d samples of %d stacks: %.2f bytes/sample, %.1f ns/sample to write, "
+                      "%.1f ns/sample to decode\n",
+                      BENCH_SAMPLES,
+                      BENCH_STACKS,
+                      (double)st.st_size / BENCH_SAMPLES,
+                      (double)write_ns / BENCH_SAMPLES,
+                      (double)read_ns / BENCH_SAMPLES));
+})
+
+int main(int argc, char** argv) {
+    TEST_INIT("trace", argc, argv);
+
+    TEST_RUN(round_trip);
+    TEST_RUN(truncated_file);
+    TEST_RUN(full_stack_table);
+    TEST_RUN(invalid_arguments);
+    TEST_RUN(benchmark);
+
+    TEST_EXIT();
+}